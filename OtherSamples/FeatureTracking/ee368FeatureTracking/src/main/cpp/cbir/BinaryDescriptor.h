@@ -0,0 +1,125 @@
+#ifndef BINARY_DESCRIPTOR_H
+#define BINARY_DESCRIPTOR_H
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+
+// bit-packed descriptor, bit i is bit (i % 32) of word i / 32
+typedef vector<Uint32> BinaryDescriptor;
+
+// Binary RIFF descriptors. Every bit compares two bins of the gradient
+// histogram of one cell, which needs no normalization and survives the
+// quantization to bytes. The bin pairs are drawn from a fixed seed and spread
+// evenly over the cells, so the same layout always gives the same bits.
+class BinaryTests {
+public:
+	BinaryTests() {
+		iNumBits = 0;
+	}
+
+	// aOrder[i] is the index (cell * aNumBins + bin) stored at descriptor
+	// index i, NULL for that order itself. 0 bits turns binarization off.
+	void Construct(Int aNumCells, Int aNumBins, Int aNumBits, const Int *aOrder = NULL) {
+		Int dim = aNumCells * aNumBins;
+		vector<Int> position(dim);
+		for (Int i = 0; i < dim; ++i) {
+			position[aOrder ? aOrder[i] : i] = i;
+		}
+
+		// at most every pair of bins once
+		Int maxBits = aNumCells * (aNumBins * (aNumBins - 1) / 2);
+		iNumBits = aNumBits < maxBits ? aNumBits : maxBits;
+		if (iNumBits < 0) iNumBits = 0;
+		iTests.resize(iNumBits);
+
+		vector<Byte> used(dim * aNumBins, 0);
+		Uint32 seed = KSeed;
+		for (Int t = 0; t < iNumBits; ++t) {
+			Int cell = t % aNumCells;
+			Int a, b;
+			do {
+				a = Random(seed) % aNumBins;
+				b = Random(seed) % aNumBins;
+			} while (a == b || used[(cell * aNumBins + a) * aNumBins + b]);
+
+			used[(cell * aNumBins + a) * aNumBins + b] = 1;
+			used[(cell * aNumBins + b) * aNumBins + a] = 1;
+
+			iTests[t].first = position[cell * aNumBins + a];
+			iTests[t].second = position[cell * aNumBins + b];
+		}
+	}
+
+	Int NumBits() {
+		return iNumBits;
+	}
+
+	Int NumWords() {
+		return (iNumBits + 31) / 32;
+	}
+
+	// works on float and on quantized descriptors
+	template <class T>
+	void Binarize(T &aDesc, BinaryDescriptor &aBits) {
+		aBits.assign(NumWords(), 0);
+		for (Int t = 0; t < iNumBits; ++t) {
+			if (aDesc[iTests[t].first] > aDesc[iTests[t].second]) {
+				aBits[t >> 5] |= Uint32(1) << (t & 31);
+			}
+		}
+	}
+
+	template <class T>
+	void Binarize(vector< vector<T> > &aDescs, vector<BinaryDescriptor> &aBits) {
+		Int size = aDescs.size();
+		aBits.resize(size);
+		for (Int i = 0; i < size; ++i) {
+			Binarize(aDescs[i], aBits[i]);
+		}
+	}
+
+private:
+	// linear congruential generator, same sequence on every platform
+	static inline Uint32 Random(Uint32 &aSeed) {
+		aSeed = aSeed * 1664525 + 1013904223;
+		return aSeed >> 8;
+	}
+
+private:
+	const static Uint32 KSeed = 0x52494646;	// "RIFF"
+
+	Int iNumBits;
+	vector< pair<Int,Int> > iTests;		// descriptor indices, bit set if first > second
+};
+
+// number of differing bits
+class HammingDistance {
+public:
+	inline Int operator() (BinaryDescriptor &aDesc1, BinaryDescriptor &aDesc2) {
+		Int size1 = aDesc1.size();
+
+		Int dist = 0;
+		for (Int i = 0; i < size1; ++i) {
+			dist += PopCount(aDesc1[i] ^ aDesc2[i]);
+		}
+		return dist;
+	}
+
+	inline Int operator() (BinaryDescriptor &aDesc1, BinaryDescriptor &aDesc2, Int aBestDist) {
+		Int size1 = aDesc1.size();
+
+		Int dist = 0;
+		for (Int i = 0; i < size1; ++i) {
+			dist += PopCount(aDesc1[i] ^ aDesc2[i]);
+			if (dist >= aBestDist) break;
+		}
+		return dist;
+	}
+
+	// a single instruction where the target has one, e.g. vcnt on NEON
+	static inline Int PopCount(Uint32 aBits) {
+		return __builtin_popcount(aBits);
+	}
+};
+
+#endif
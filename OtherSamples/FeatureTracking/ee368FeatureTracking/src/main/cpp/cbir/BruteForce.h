@@ -19,8 +19,9 @@ public:
 			vector< vector<DescType> > &aDataBase, 
 			vector< vector<Int> > &aNeighbors) {
 
-		aNeighbors.resize(aQuery.size());
-		for (Int i = 0; i < aQuery.size(); ++i) {
+		Int numQuery = aQuery.size();
+		aNeighbors.resize(numQuery);
+		for (Int i = 0; i < numQuery; ++i) {
 			FindNN(aK, aQuery[i], aDataBase, aNeighbors[i]);
 		}
 	}
@@ -31,9 +32,10 @@ public:
 			vector< vector<Int> > &aNeighbors,
 			vector< vector<DistType> > &aDist) {
 
-		aDist.resize(aQuery.size());
-		aNeighbors.resize(aQuery.size());
-		for (Int i = 0; i < aQuery.size(); ++i) {
+		Int numQuery = aQuery.size();
+		aDist.resize(numQuery);
+		aNeighbors.resize(numQuery);
+		for (Int i = 0; i < numQuery; ++i) {
 			FindNN(aK, aQuery[i], aDataBase, aNeighbors[i], aDist[i]);
 		}
 	}
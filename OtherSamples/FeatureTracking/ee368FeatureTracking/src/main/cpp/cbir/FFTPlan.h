@@ -0,0 +1,440 @@
+#ifndef FFT_PLAN_H
+#define FFT_PLAN_H
+
+#include <math.h>
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+
+#if defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define FFT_SIMD
+	typedef float32x4_t FFTVec;
+	#define FFT_LOAD(p)		vld1q_f32(p)
+	#define FFT_STORE(p, v)		vst1q_f32(p, v)
+	#define FFT_ADD(a, b)		vaddq_f32(a, b)
+	#define FFT_SUB(a, b)		vsubq_f32(a, b)
+	#define FFT_MUL(a, b)		vmulq_f32(a, b)
+#elif defined(__SSE__)
+	#include <xmmintrin.h>
+	#define FFT_SIMD
+	typedef __m128 FFTVec;
+	#define FFT_LOAD(p)		_mm_loadu_ps(p)
+	#define FFT_STORE(p, v)		_mm_storeu_ps(p, v)
+	#define FFT_ADD(a, b)		_mm_add_ps(a, b)
+	#define FFT_SUB(a, b)		_mm_sub_ps(a, b)
+	#define FFT_MUL(a, b)		_mm_mul_ps(a, b)
+#endif
+
+// Scalar type the transforms below are computed in for data of type S:
+// Float data stays in Float, anything else is computed in Double.
+template <class S>
+struct FFTScalar {
+	typedef Double Type;
+};
+template <>
+struct FFTScalar<Float> {
+	typedef Float Type;
+};
+
+// Precomputed radix-2 complex FFT of a fixed power of 2 length.
+// Data is split into separate real and imaginary arrays, transforms are
+// done in place and are unscaled in both directions (inverse(forward(x))
+// returns N*x). A plan holds no per-call state, but the real and 2D
+// plans below own scratch buffers, so use one plan per thread.
+class FFTPlan {
+public:
+	FFTPlan() {
+		iSize = 0;
+		iBits = 0;
+	}
+	FFTPlan(Int aSize) {
+		Construct(aSize);
+	}
+
+	void Construct(Int aSize) {
+		static const Double pi = 3.14159265358979;
+
+		iSize = aSize;
+		for (iBits = 0; (1 << iBits) < iSize; ++iBits);
+
+		// bit reversal table, only the pairs that need swapping
+		iSwapA.resize(0);
+		iSwapB.resize(0);
+		for (Int i = 0; i < iSize; ++i) {
+			Int j = 0;
+			for (Int b = 0; b < iBits; ++b) {
+				j = (j << 1) | ((i >> b) & 1);
+			}
+			if (i < j) {
+				iSwapA.push_back(i);
+				iSwapB.push_back(j);
+			}
+		}
+
+		// twiddles for the stage with half size h live at [h-1, 2h-1)
+		Int numTwiddles = iSize > 1 ? iSize - 1 : 1;
+		iTwiddleReal.resize(numTwiddles);
+		iTwiddleImag.resize(numTwiddles);
+		iTwiddleRealD.resize(numTwiddles);
+		iTwiddleImagD.resize(numTwiddles);
+		for (Int h = 1; h < iSize; h <<= 1) {
+			for (Int j = 0; j < h; ++j) {
+				Double arg = -pi * j / h;
+				iTwiddleRealD[h - 1 + j] = cos(arg);
+				iTwiddleImagD[h - 1 + j] = sin(arg);
+				iTwiddleReal[h - 1 + j] = iTwiddleRealD[h - 1 + j];
+				iTwiddleImag[h - 1 + j] = iTwiddleImagD[h - 1 + j];
+			}
+		}
+	}
+
+	Int Size() { return iSize; }
+
+	// in place complex transform
+	void Transform(Float *aReal, Float *aImag, Bool aInverse = false) {
+		Butterflies(aReal, aImag, aInverse, &iTwiddleReal[0], &iTwiddleImag[0]);
+	}
+
+	// in place complex transform in double precision
+	void Transform(Double *aReal, Double *aImag, Bool aInverse = false) {
+		Butterflies(aReal, aImag, aInverse, &iTwiddleRealD[0], &iTwiddleImagD[0]);
+	}
+
+private:
+	template <class S>
+	void Butterflies(S *aReal, S *aImag, Bool aInverse, const S *aTwiddleReal, const S *aTwiddleImag) {
+		// the inverse is the forward transform with real and imaginary swapped
+		if (aInverse) {
+			S *tmp = aReal;
+			aReal = aImag;
+			aImag = tmp;
+		}
+
+		// arrange input in bit reversed order
+		Int numSwaps = iSwapA.size();
+		for (Int i = 0; i < numSwaps; ++i) {
+			Int a = iSwapA[i];
+			Int b = iSwapB[i];
+
+			S t = aReal[a]; aReal[a] = aReal[b]; aReal[b] = t;
+			t = aImag[a]; aImag[a] = aImag[b]; aImag[b] = t;
+		}
+
+		// first stage has unit twiddles
+		for (Int k = 0; k + 1 < iSize; k += 2) {
+			S tr = aReal[k+1];
+			S ti = aImag[k+1];
+
+			aReal[k+1] = aReal[k] - tr;
+			aImag[k+1] = aImag[k] - ti;
+			aReal[k] += tr;
+			aImag[k] += ti;
+		}
+
+		// remaining butterfly stages
+		for (Int h = 2; h < iSize; h <<= 1) {
+			const S *wr = aTwiddleReal + h - 1;
+			const S *wi = aTwiddleImag + h - 1;
+
+			for (Int k = 0; k < iSize; k += 2*h) {
+				S *r0 = aReal + k;
+				S *i0 = aImag + k;
+				S *r1 = r0 + h;
+				S *i1 = i0 + h;
+
+				Int j = VectorButterflies(r0, i0, r1, i1, wr, wi, h);
+				for (; j < h; ++j) {
+					S tr = r1[j]*wr[j] - i1[j]*wi[j];
+					S ti = i1[j]*wr[j] + r1[j]*wi[j];
+
+					r1[j] = r0[j] - tr;
+					i1[j] = i0[j] - ti;
+					r0[j] += tr;
+					i0[j] += ti;
+				}
+			}
+		}
+	}
+
+	// butterflies of a section four at a time, returns how many were done
+	static Int VectorButterflies(Float *r0, Float *i0, Float *r1, Float *i1,
+		const Float *wr, const Float *wi, Int h) {
+		Int j = 0;
+#ifdef FFT_SIMD
+		for (; j + 4 <= h; j += 4) {
+			FFTVec c = FFT_LOAD(wr + j);
+			FFTVec s = FFT_LOAD(wi + j);
+			FFTVec xr = FFT_LOAD(r1 + j);
+			FFTVec xi = FFT_LOAD(i1 + j);
+
+			FFTVec tr = FFT_SUB(FFT_MUL(xr, c), FFT_MUL(xi, s));
+			FFTVec ti = FFT_ADD(FFT_MUL(xi, c), FFT_MUL(xr, s));
+
+			FFTVec ar = FFT_LOAD(r0 + j);
+			FFTVec ai = FFT_LOAD(i0 + j);
+
+			FFT_STORE(r1 + j, FFT_SUB(ar, tr));
+			FFT_STORE(i1 + j, FFT_SUB(ai, ti));
+			FFT_STORE(r0 + j, FFT_ADD(ar, tr));
+			FFT_STORE(i0 + j, FFT_ADD(ai, ti));
+		}
+#else
+		(void)r0; (void)i0; (void)r1; (void)i1; (void)wr; (void)wi; (void)h;
+#endif
+		return j;
+	}
+
+	// the double transform has no vector path
+	static Int VectorButterflies(Double * /* r0 */, Double * /* i0 */, Double * /* r1 */, Double * /* i1 */,
+		const Double * /* wr */, const Double * /* wi */, Int /* h */) {
+		return 0;
+	}
+
+private:
+	Int iSize;
+	Int iBits;
+
+	vector<Int> iSwapA;
+	vector<Int> iSwapB;
+	vector<Float> iTwiddleReal;
+	vector<Float> iTwiddleImag;
+	vector<Double> iTwiddleRealD;
+	vector<Double> iTwiddleImagD;
+};
+
+// Real input transform of power of 2 length N, computed with a complex
+// transform of length N/2. The spectrum is returned as bins [0, N/2].
+// Lengths below 2 have no half length transform and are copied through.
+class FFTRealPlan {
+public:
+	FFTRealPlan() {
+		iSize = 0;
+	}
+	FFTRealPlan(Int aSize) {
+		Construct(aSize);
+	}
+
+	void Construct(Int aSize) {
+		static const Double pi = 3.14159265358979;
+
+		iSize = aSize;
+		Int half = iSize >> 1;
+		iHalfPlan.Construct(half);
+
+		iBufReal.resize(half);
+		iBufImag.resize(half);
+
+		// post processing twiddles exp(-2 pi i k / N)
+		iTwiddleReal.resize(half + 1);
+		iTwiddleImag.resize(half + 1);
+		for (Int k = 0; k <= half; ++k) {
+			Double arg = -2 * pi * k / iSize;
+			iTwiddleReal[k] = cos(arg);
+			iTwiddleImag[k] = sin(arg);
+		}
+	}
+
+	Int Size() { return iSize; }
+	Int NumBins() { return (iSize >> 1) + 1; }
+
+	// aIn has Size() values, aReal and aImag receive NumBins() values
+	void Forward(const Float *aIn, Float *aReal, Float *aImag) {
+		if (iSize < 2) {
+			if (iSize == 1) {
+				aReal[0] = aIn[0];
+				aImag[0] = 0;
+			}
+			return;
+		}
+
+		Int half = iSize >> 1;
+		Float *zr = &iBufReal[0];
+		Float *zi = &iBufImag[0];
+
+		// pack even samples as real and odd samples as imaginary
+		for (Int k = 0; k < half; ++k) {
+			zr[k] = aIn[2*k];
+			zi[k] = aIn[2*k + 1];
+		}
+
+		iHalfPlan.Transform(zr, zi);
+
+		// separate the two interleaved spectra and combine
+		for (Int k = 0; k <= half; ++k) {
+			Int a = k < half ? k : 0;
+			Int b = k > 0 ? half - k : 0;
+
+			Float er = 0.5f * (zr[a] + zr[b]);
+			Float ei = 0.5f * (zi[a] - zi[b]);
+			Float orr = 0.5f * (zi[a] + zi[b]);
+			Float oi = -0.5f * (zr[a] - zr[b]);
+
+			Float c = iTwiddleReal[k];
+			Float s = iTwiddleImag[k];
+
+			aReal[k] = er + orr*c - oi*s;
+			aImag[k] = ei + oi*c + orr*s;
+		}
+	}
+
+	// inverse of Forward, aOut receives Size() values scaled by Size()
+	void Inverse(const Float *aReal, const Float *aImag, Float *aOut) {
+		if (iSize < 2) {
+			if (iSize == 1) {
+				aOut[0] = aReal[0];
+			}
+			return;
+		}
+
+		Int half = iSize >> 1;
+		Float *zr = &iBufReal[0];
+		Float *zi = &iBufImag[0];
+
+		// rebuild the packed half length spectrum
+		for (Int k = 0; k < half; ++k) {
+			Int b = half - k;
+
+			Float er = aReal[k] + aReal[b];
+			Float ei = aImag[k] - aImag[b];
+			Float dr = aReal[k] - aReal[b];
+			Float di = aImag[k] + aImag[b];
+
+			// multiply the difference by the conjugate twiddle
+			Float c = iTwiddleReal[k];
+			Float s = -iTwiddleImag[k];
+			Float orr = dr*c - di*s;
+			Float oi = di*c + dr*s;
+
+			zr[k] = er - oi;
+			zi[k] = ei + orr;
+		}
+
+		iHalfPlan.Transform(zr, zi, true);
+
+		for (Int k = 0; k < half; ++k) {
+			aOut[2*k] = zr[k];
+			aOut[2*k + 1] = zi[k];
+		}
+	}
+
+private:
+	Int iSize;
+	FFTPlan iHalfPlan;
+
+	vector<Float> iBufReal;
+	vector<Float> iBufImag;
+	vector<Float> iTwiddleReal;
+	vector<Float> iTwiddleImag;
+};
+
+// 2D transforms over row major planes. Rows are transformed in place,
+// columns are transformed as rows of a blocked transpose.
+class FFTPlan2D {
+public:
+	FFTPlan2D() {
+		iWidth = 0;
+		iHeight = 0;
+	}
+	FFTPlan2D(Int aWidth, Int aHeight) {
+		Construct(aWidth, aHeight);
+	}
+
+	void Construct(Int aWidth, Int aHeight) {
+		iWidth = aWidth;
+		iHeight = aHeight;
+
+		iRowPlan.Construct(iWidth);
+		iColPlan.Construct(iHeight);
+		iRealPlan.Construct(iWidth);
+
+		Int size = NumBins() > iWidth ? NumBins() : iWidth;
+		iTransReal.resize(size * iHeight);
+		iTransImag.resize(size * iHeight);
+	}
+
+	Int Width() { return iWidth; }
+	Int Height() { return iHeight; }
+
+	// width of the half spectrum produced by ForwardReal
+	Int NumBins() { return (iWidth >> 1) + 1; }
+
+	// in place complex transform of a width x height plane
+	void Transform(Float *aReal, Float *aImag, Bool aInverse = false) {
+		for (Int y = 0; y < iHeight; ++y) {
+			iRowPlan.Transform(aReal + y*iWidth, aImag + y*iWidth, aInverse);
+		}
+
+		TransformColumns(aReal, aImag, iWidth, aInverse);
+	}
+
+	// real width x height plane to NumBins() x height half spectrum
+	void ForwardReal(const Float *aIn, Float *aReal, Float *aImag) {
+		Int bins = NumBins();
+		for (Int y = 0; y < iHeight; ++y) {
+			iRealPlan.Forward(aIn + y*iWidth, aReal + y*bins, aImag + y*bins);
+		}
+
+		TransformColumns(aReal, aImag, bins, false);
+	}
+
+	// inverse of ForwardReal, aOut is scaled by width * height.
+	// The spectrum is used as scratch and is overwritten.
+	void InverseReal(Float *aReal, Float *aImag, Float *aOut) {
+		Int bins = NumBins();
+		TransformColumns(aReal, aImag, bins, true);
+
+		for (Int y = 0; y < iHeight; ++y) {
+			iRealPlan.Inverse(aReal + y*bins, aImag + y*bins, aOut + y*iWidth);
+		}
+	}
+
+	// transpose a w x h plane into a h x w plane in cache sized blocks
+	static void Transpose(const Float *aSrc, Int aW, Int aH, Float *aDst) {
+		const Int block = 16;
+
+		for (Int y0 = 0; y0 < aH; y0 += block) {
+			Int y1 = y0 + block < aH ? y0 + block : aH;
+
+			for (Int x0 = 0; x0 < aW; x0 += block) {
+				Int x1 = x0 + block < aW ? x0 + block : aW;
+
+				for (Int y = y0; y < y1; ++y) {
+					const Float *src = aSrc + y*aW;
+					for (Int x = x0; x < x1; ++x) {
+						aDst[x*aH + y] = src[x];
+					}
+				}
+			}
+		}
+	}
+
+private:
+	void TransformColumns(Float *aReal, Float *aImag, Int aCols, Bool aInverse) {
+		Float *tr = &iTransReal[0];
+		Float *ti = &iTransImag[0];
+
+		Transpose(aReal, aCols, iHeight, tr);
+		Transpose(aImag, aCols, iHeight, ti);
+
+		for (Int x = 0; x < aCols; ++x) {
+			iColPlan.Transform(tr + x*iHeight, ti + x*iHeight, aInverse);
+		}
+
+		Transpose(tr, iHeight, aCols, aReal);
+		Transpose(ti, iHeight, aCols, aImag);
+	}
+
+private:
+	Int iWidth;
+	Int iHeight;
+
+	FFTPlan iRowPlan;
+	FFTPlan iColPlan;
+	FFTRealPlan iRealPlan;
+
+	vector<Float> iTransReal;
+	vector<Float> iTransImag;
+};
+
+#endif
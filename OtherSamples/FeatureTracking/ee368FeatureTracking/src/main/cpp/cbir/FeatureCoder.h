@@ -0,0 +1,253 @@
+#ifndef FEATURE_CODER_H
+#define FEATURE_CODER_H
+
+#include <math.h>
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+#include "cbir/FeatureStore.h"
+#include "cbir/RangeCoder.h"
+
+// Compact bitstream of the features of an image, to send them to a server
+// in place of the image. A RIFF feature takes about 20 bytes.
+//
+// The keypoints are sorted by position, rounded to half a pixel and coded as
+// the difference to the previous one. Histogram bins are quantized to
+// multiples of 1 / iStep, each descriptor dimension with its own adaptive
+// model. Orientation and response are not sent, and the decoded features
+// come in position order rather than in the order they were extracted.
+class FeatureCoder {
+	// a feature in coding order
+	class Key {
+	public:
+		Int y;
+		Int x;
+		Int index;
+
+		Bool operator<(const Key &aOther) const {
+			if (y != aOther.y) return y < aOther.y;
+			return x < aOther.x;
+		}
+	};
+
+	// adaptive probabilities of one bitstream
+	class Model {
+	public:
+		void Construct(Int aDescDim) {
+			RangeCoder::InitProbs(dy, RangeCoder::KIntProbs);
+			RangeCoder::InitProbs(dx, RangeCoder::KIntProbs);
+			RangeCoder::InitProbs(x, RangeCoder::KIntProbs);
+			RangeCoder::InitProbs(scale, RangeCoder::KIntProbs);
+			RangeCoder::InitProbs(bins, aDescDim << KLevelBits);
+		}
+
+		vector<RangeCoder::Prob> dy;
+		vector<RangeCoder::Prob> dx;	// on the same row
+		vector<RangeCoder::Prob> x;	// first on a row
+		vector<RangeCoder::Prob> scale;
+		vector<RangeCoder::Prob> bins;	// a bit tree per dimension
+	};
+
+public:
+	FeatureCoder() {
+		iStep = KNumLevels - 1;
+	}
+
+	// replaces aBits with the bitstream of aFS
+	void Encode(FeatureStore &aFS, vector<Byte> &aBits) {
+		aBits.resize(0);
+
+		Int numFeatures = aFS.Size();
+		Int descDim = numFeatures > 0 ? aFS.GetDescriptor(0).size() : 0;
+		Int step = iStep < 1 ? 1 : iStep > KNumLevels - 1 ? KNumLevels - 1 : iStep;
+
+		// header
+		PutUint32(aBits, KMagic);
+		aBits.push_back(Byte(KVersion));
+		aBits.push_back(step);
+		PutUint16(aBits, descDim);
+		PutUint32(aBits, numFeatures);
+
+		vector<Key> keys(numFeatures);
+		for (Int i = 0; i < numFeatures; ++i) {
+			Frame &frame = aFS.GetFrame(i);
+			keys[i].x = Position(frame[KX]);
+			keys[i].y = Position(frame[KY]);
+			keys[i].index = i;
+		}
+		sort(keys.begin(), keys.end());
+
+		Model model;
+		model.Construct(descDim);
+
+		RangeEncoder encoder(aBits);
+		Int prevX = 0;
+		Int prevY = 0;
+		for (Int i = 0; i < numFeatures; ++i) {
+			Key &key = keys[i];
+
+			Int dy = key.y - prevY;
+			encoder.EncodeInt(&model.dy[0], dy);
+			if (dy == 0) {
+				encoder.EncodeInt(&model.dx[0], key.x - prevX);
+			} else {
+				encoder.EncodeInt(&model.x[0], key.x);
+			}
+			prevX = key.x;
+			prevY = key.y;
+
+			Frame &frame = aFS.GetFrame(key.index);
+			Int scale = Round(frame[KScl] * KScaleSteps);
+			encoder.EncodeInt(&model.scale[0], ZigZag(scale));
+
+			Descriptor &desc = aFS.GetDescriptor(key.index);
+			Int size = desc.size();
+			for (Int d = 0; d < descDim; ++d) {
+				Int level = d < size ? Quantize(desc[d], step) : 0;
+				encoder.EncodeTree(&model.bins[d << KLevelBits], KLevelBits, level);
+			}
+		}
+		encoder.Flush();
+	}
+
+	// Replaces aFS with the features of a bitstream from Encode, all with
+	// image id aImageID. False if the bitstream is damaged.
+	Bool Decode(const Byte *aBits, Int aSize, FeatureStore &aFS, IDType aImageID) {
+		aFS.Resize(0);
+		if (aSize < KHeaderSize) return false;
+
+		if (GetUint32(aBits) != KMagic || aBits[4] != KVersion) return false;
+		Int step = aBits[5];
+		Int descDim = GetUint16(aBits + 6);
+		Uint32 numFeatures = GetUint32(aBits + 8);
+		if (step == 0 || descDim > KMaxDescDim || numFeatures > KMaxFeatures) return false;
+
+		Model model;
+		model.Construct(descDim);
+
+		RangeDecoder decoder(aBits + KHeaderSize, aSize - KHeaderSize);
+		Frame frame(KFrameDim);
+		Descriptor desc(descDim);
+		Uint32 prevX = 0;
+		Uint32 prevY = 0;
+		for (Uint32 i = 0; i < numFeatures; ++i) {
+			Uint32 dy = decoder.DecodeInt(&model.dy[0]);
+			Uint32 x;
+			if (dy == 0) {
+				x = prevX + decoder.DecodeInt(&model.dx[0]);
+			} else {
+				x = decoder.DecodeInt(&model.x[0]);
+			}
+			Uint32 y = prevY + dy;
+			prevX = x;
+			prevY = y;
+
+			Int scale = UnZigZag(decoder.DecodeInt(&model.scale[0]));
+
+			frame[KX] = 0.5 * x;
+			frame[KY] = 0.5 * y;
+			frame[KScl] = Float(scale) / KScaleSteps;
+			frame[KOri] = 0;
+			frame[KRes] = 0;
+
+			for (Int d = 0; d < descDim; ++d) {
+				Int level = decoder.DecodeTree(&model.bins[d << KLevelBits], KLevelBits);
+				desc[d] = Dequantize(level, step);
+			}
+
+			// truncated or out of range
+			if (decoder.Overrun() || x > KMaxPosition || y > KMaxPosition) {
+				aFS.Resize(0);
+				return false;
+			}
+
+			aFS.Append(desc, frame, aImageID);
+		}
+
+		return true;
+	}
+
+	Bool Decode(vector<Byte> &aBits, FeatureStore &aFS, IDType aImageID) {
+		if (aBits.empty()) return false;
+		return Decode(&aBits[0], aBits.size(), aFS, aImageID);
+	}
+
+private:
+	static inline Int Round(Float aValue) {
+		return Int(aValue < 0 ? aValue - 0.5 : aValue + 0.5);
+	}
+
+	// half pixels, positions are never negative
+	static inline Int Position(Float aValue) {
+		Int position = Round(2 * aValue);
+		if (position < 0) return 0;
+		return Uint32(position) < KMaxPosition ? position : Int(KMaxPosition);
+	}
+
+	static inline Int Quantize(Float aValue, Int aStep) {
+		Int level = Round(aValue * aStep);
+		if (level < 0) return 0;
+		return level < KNumLevels ? level : KNumLevels - 1;
+	}
+
+	// bins below half a step come back as a quarter step, not zero, which
+	// the KL distance could not take
+	static inline Float Dequantize(Int aLevel, Int aStep) {
+		if (aLevel == 0) return 0.25 / aStep;
+		return Float(aLevel) / aStep;
+	}
+
+	// small signed values to small unsigned ones
+	static inline Uint32 ZigZag(Int aValue) {
+		return aValue < 0 ? Uint32(-2 * aValue - 1) : Uint32(2 * aValue);
+	}
+
+	static inline Int UnZigZag(Uint32 aValue) {
+		return (aValue & 1) ? -Int(aValue >> 1) - 1 : Int(aValue >> 1);
+	}
+
+	// little endian, whatever the platform
+	static void PutUint16(vector<Byte> &aBits, Uint32 aValue) {
+		aBits.push_back(aValue & 0xFF);
+		aBits.push_back((aValue >> 8) & 0xFF);
+	}
+
+	static void PutUint32(vector<Byte> &aBits, Uint32 aValue) {
+		PutUint16(aBits, aValue & 0xFFFF);
+		PutUint16(aBits, aValue >> 16);
+	}
+
+	static Uint32 GetUint16(const Byte *aBits) {
+		return aBits[0] | (Uint32(aBits[1]) << 8);
+	}
+
+	static Uint32 GetUint32(const Byte *aBits) {
+		return GetUint16(aBits) | (GetUint16(aBits + 2) << 16);
+	}
+
+public:
+	// Quantization levels per unit of a histogram bin, from 1 to 63. There
+	// are 64 levels, so a larger step would clip the bins above 63 / iStep.
+	Int iStep;
+
+private:
+	const static Uint32 KMagic = 0x53464652;	// "RFFS"
+	const static Int KVersion = 1;
+	const static Int KHeaderSize = 12;
+
+	const static Int KLevelBits = 6;
+	const static Int KNumLevels = 1 << KLevelBits;
+	const static Int KScaleSteps = 12;		// per octave
+	const static Uint32 KMaxPosition = 1 << 30;
+	const static Int KMaxDescDim = 1024;
+	const static Uint32 KMaxFeatures = 1 << 20;
+	const static Int KFrameDim = 5;
+
+	const static Int KX = 0;
+	const static Int KY = 1;
+	const static Int KScl = 2;
+	const static Int KOri = 3;
+	const static Int KRes = 4;
+};
+
+#endif
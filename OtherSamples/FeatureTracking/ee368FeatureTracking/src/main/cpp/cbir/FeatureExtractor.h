@@ -6,6 +6,8 @@
 
 class FeatureExtractor {
 public:
+	virtual ~FeatureExtractor() {}
+
 	virtual void ExtractFeatures(Image<Byte> &aImage, FeatureStore &aFeatureStore, IDType aImageID)=0;
 };
 
@@ -62,6 +62,17 @@ public:
 		Int xBin = Int(aFrame[KX]) >> iLog2BinSize;
 		Int yBin = Int(aFrame[KY]) >> iLog2BinSize;
 
+		return iHashTable[xBin][yBin];
+	}
+	// lookup at an arbitrary position, empty if outside the table
+	vector<Int> &GetNeighbors(Float aX, Float aY) {
+		if (aX < 0 || aY < 0) return iEmpty;
+
+		Int xBin = Int(aX) >> iLog2BinSize;
+		Int yBin = Int(aY) >> iLog2BinSize;
+
+		if (xBin >= iTableWidth || yBin >= iTableHeight) return iEmpty;
+
 		return iHashTable[xBin][yBin];
 	}
 public:
@@ -99,6 +110,7 @@ public:
 	Int iTableWidth;
 	Int iTableHeight;
 	vector< vector< vector<Int> > > iHashTable;
+	vector<Int> iEmpty;
 private:
 	const static Int KX = 0;
 	const static Int KY = 1;
@@ -11,6 +11,7 @@
 #include "cbir/Fixed.h"
 #include "cbir/Font.h"
 #include "cbir/RingBuffer.h"
+#include "cbir/FFTPlan.h"
 
 template <class T>
 class Image {
@@ -173,59 +174,37 @@ public:
 	// inverse true for ifft
 	template <class S>
 	static void FFT(vector<S> &real, vector<S> &imag, Bool inverse = false) {
-		static const Double pi = 3.14159265358979;
-
 		Int N = real.size();
 		if (N <= 0) return;
 
-		// only use power of two poInts	
+		// only use power of two points
 		Int bits = 0;
 		for (bits = 0; (1 << bits) <= N; ++bits );
 		--bits;
-		Int n = 1 << bits;			// crop vectors
-	
-		// arrange the input vector in bit reversed order
-		BitReverseVect(real);
-		BitReverseVect(imag);
-
-		// perform butterfly process
-		for (Int i = 0; i < bits; ++i) {		// for each log N stage
-			Int sectSize = (Int)pow(2.0, Double(i));	// section size of butterfly
-		
-			// traverse each n component
-			for (Int k = 0; k < n-1; k += 2*sectSize) {
-			
-				// traverse sections
-				for (Int j = 0; j < sectSize; ++j) {
-					S arg = -pi*j/sectSize;
-				
-					if (inverse) arg = -arg;
-				
-					S c = cos(arg);
-					S s = sin(arg);
-					
-					Int m = k + j;
-
-					S tmpReal = real[m+sectSize]*c-imag[m+sectSize]*s;
-					S tmpImag = imag[m+sectSize]*c+real[m+sectSize]*s;
+		Int n = 1 << bits;
 
-					real[m+sectSize] = real[m] - tmpReal;
-					imag[m+sectSize] = imag[m] - tmpImag;
-
-					real[m] += tmpReal;
-					imag[m] += tmpImag;
-				}
-			}
+		// Float data is transformed in Float, anything else in Double
+		typedef typename FFTScalar<S>::Type W;
+		vector<W> re(n);
+		vector<W> im(n);
+		for (Int i = 0; i < n; ++i) {
+			re[i] = real[i];
+			im[i] = imag[i];
 		}
 
-		S nSqrtInv = 1.0 / sqrt(n);
+		// callers in a loop should keep their own FFTPlan
+		FFTPlan plan(n);
+		plan.Transform(&re[0], &im[0], inverse);
+
+		W nSqrtInv = 1.0 / sqrt(Double(n));
 		for (Int i = 0; i < n; ++i) {
-			real[i] *= nSqrtInv;
-			imag[i] *= nSqrtInv;
+			real[i] = re[i] * nSqrtInv;
+			imag[i] = im[i] * nSqrtInv;
 		}
 	}
 
-	// 2D fourier transform
+	// 2D fourier transform, as the 1D transform of each column and then
+	// each row, both truncated to the next smallest power of 2
 	static void FFT(Image<Float> &aReal, Image<Float> &aImaginary, Bool aInverse = false) {
 		Int w = aReal.Width();
 		Int h = aReal.Height();
@@ -235,48 +214,94 @@ public:
 			printf("Size mismatch\n");
 			return;
 		}
+		if (w <= 0 || h <= 0) return;
+		if ((w & (w-1)) || (h & (h-1))) {
+			FFTCropped(aReal, aImaginary, aInverse);
+			return;
+		}
 
-		// do each channel independently
-		for (Int c = 0; c < chan; ++c) {
+		FFTPlan2D plan(w, h);
+		Float nSqrtInv = 1.0 / sqrt(Float(w * h));
 
-			// transform each column
-			for (Int x = 0; x < w; ++x) {
+		// single channel images are transformed in place
+		if (chan == 1) {
+			Float *re = aReal.ScanLine(0);
+			Float *im = aImaginary.ScanLine(0);
+			plan.Transform(re, im, aInverse);
 
-				vector<Float> real(h);
-				vector<Float> imaginary(h);
+			for (Int i = w*h-1; i >= 0; --i) {
+				re[i] *= nSqrtInv;
+				im[i] *= nSqrtInv;
+			}
+			return;
+		}
 
-				for (Int y = 0; y < h; ++y) {
-					real[y] = aReal(x, y, c);
-					imaginary[y] = aImaginary(x, y, c);
+		// do each channel independently
+		vector<Float> re(w * h);
+		vector<Float> im(w * h);
+		for (Int c = 0; c < chan; ++c) {
+			for (Int y = 0; y < h; ++y) {
+				for (Int x = 0; x < w; ++x) {
+					re[y*w + x] = aReal(x, y, c);
+					im[y*w + x] = aImaginary(x, y, c);
 				}
+			}
 
-				FFT(real, imaginary, aInverse);
+			plan.Transform(&re[0], &im[0], aInverse);
 
-				for (Int y = 0; y < h; ++y) {
-					aReal(x, y, c) = real[y];
-					aImaginary(x, y, c) = imaginary[y];
+			for (Int y = 0; y < h; ++y) {
+				for (Int x = 0; x < w; ++x) {
+					aReal(x, y, c) = re[y*w + x] * nSqrtInv;
+					aImaginary(x, y, c) = im[y*w + x] * nSqrtInv;
 				}
 			}
+		}
+	}
 
-			// transform each row
-			for (Int y = 0; y < h; ++y) {
-
-				vector<Float> real(w);
-				vector<Float> imaginary(w);
+	// 2D transform of an image whose sides are not both powers of 2. Each
+	// column and then each row is transformed over its first power of 2
+	// samples, the rest is left as is.
+	static void FFTCropped(Image<Float> &aReal, Image<Float> &aImaginary, Bool aInverse) {
+		Int w = aReal.Width();
+		Int h = aReal.Height();
+		Int chan = aReal.NumChan();
 
-				for (Int x = 0; x < w; ++x) {
-					real[x] = aReal(x, y, c);
-					imaginary[x] = aImaginary(x, y, c);
-				}
+		Int cropW = 1;
+		while (2*cropW <= w) cropW *= 2;
+		Int cropH = 1;
+		while (2*cropH <= h) cropH *= 2;
 
-				FFT(real, imaginary, aInverse);
+		FFTPlan colPlan(cropH);
+		FFTPlan rowPlan(cropW);
+		Float colSqrtInv = 1.0 / sqrt(Float(cropH));
+		Float rowSqrtInv = 1.0 / sqrt(Float(cropW));
+		vector<Float> re(cropW > cropH ? cropW : cropH);
+		vector<Float> im(re.size());
 
-				for (Int x = 0; x < w; ++x) {
-					aReal(x, y, c) = real[x];
-					aImaginary(x, y, c) = imaginary[x];
+		for (Int c = 0; c < chan; ++c) {
+			for (Int x = 0; x < w; ++x) {
+				for (Int y = 0; y < cropH; ++y) {
+					re[y] = aReal(x, y, c);
+					im[y] = aImaginary(x, y, c);
+				}
+				colPlan.Transform(&re[0], &im[0], aInverse);
+				for (Int y = 0; y < cropH; ++y) {
+					aReal(x, y, c) = re[y] * colSqrtInv;
+					aImaginary(x, y, c) = im[y] * colSqrtInv;
 				}
 			}
 
+			for (Int y = 0; y < h; ++y) {
+				for (Int x = 0; x < cropW; ++x) {
+					re[x] = aReal(x, y, c);
+					im[x] = aImaginary(x, y, c);
+				}
+				rowPlan.Transform(&re[0], &im[0], aInverse);
+				for (Int x = 0; x < cropW; ++x) {
+					aReal(x, y, c) = re[x] * rowSqrtInv;
+					aImaginary(x, y, c) = im[x] * rowSqrtInv;
+				}
+			}
 		}
 	}
 
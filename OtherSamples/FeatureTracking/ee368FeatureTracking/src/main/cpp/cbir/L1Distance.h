@@ -63,6 +63,27 @@ public:
 		return dist;
 	}
 
+	inline Int operator() (vector<Byte> &aDesc1, vector<Byte> &aDesc2) {
+		return (*this)(aDesc1, aDesc2, numeric_limits<Int>::max());
+	}
+
+	inline Int operator() (vector<Byte> &aDesc1, vector<Byte> &aDesc2, Int aBestDist) {
+		Int size1 = aDesc1.size();
+		if (size1 == 0) return 0;
+
+		Byte *p1 = &aDesc1[0];
+		Byte *p2 = &aDesc2[0];
+
+		Int dist = 0;
+		for (Int i = 0; i < size1; ++i) {
+			Int d = Int(p1[i]) - Int(p2[i]);
+			dist += d < 0 ? -d : d;
+
+			if (dist >= aBestDist) break;
+		}
+		return dist;
+	}
+
 	template <class T>
 	inline Float operator() (T &aDesc1, T &aDesc2, Float aBestDist) {
 		Int size1 = aDesc1.size();
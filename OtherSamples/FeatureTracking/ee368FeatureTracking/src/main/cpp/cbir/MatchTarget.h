@@ -0,0 +1,88 @@
+#ifndef MATCH_TARGET_H
+#define MATCH_TARGET_H
+
+#include <string>
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+#include "cbir/Image.h"
+#include "cbir/FrameArray.h"
+#include "cbir/BinaryDescriptor.h"
+
+// One recognition target of the Matcher. Only what matching needs is kept:
+// the frames, the descriptors quantized to bytes or only their binary
+// descriptors, the vocabulary words of a paged database and the target size.
+// Targets are never changed once they are published, queries hold a
+// reference to the ones they search and the last reference frees the target.
+class MatchTarget {
+public:
+	typedef Byte DbDescType;
+
+	MatchTarget(IDType aId, const string &aLabel) {
+		iId = aId;
+		iLabel = aLabel;
+		iWidth = 0;
+		iHeight = 0;
+		iRefCount = 1;
+	}
+
+	Int Size() {
+		return iFrames.Size();
+	}
+
+	void Retain() {
+		__sync_add_and_fetch(&iRefCount, 1);
+	}
+
+	// returns true when the caller dropped the last reference
+	Bool Release() {
+		return __sync_sub_and_fetch(&iRefCount, 1) == 0;
+	}
+
+	// approximate heap size, for memory budgets
+	Int64 Bytes() {
+		Int64 bytes = sizeof(MatchTarget) + iLabel.size();
+		Int numFeatures = Size();
+		for (Int i = 0; i < numFeatures; ++i) {
+			bytes += sizeof(Frame) + iFrames[i].Size() * sizeof(FrameType);
+		}
+		Int numDescriptors = iDescriptors.size();
+		for (Int i = 0; i < numDescriptors; ++i) {
+			bytes += sizeof(vector<DbDescType>) + iDescriptors[i].size();
+		}
+		Int numBinary = iBinary.size();
+		for (Int i = 0; i < numBinary; ++i) {
+			bytes += sizeof(BinaryDescriptor) + iBinary[i].size() * sizeof(Uint32);
+		}
+		bytes += iWords.size() * sizeof(Int);
+		bytes += Int64(iImage.Width()) * iImage.Height() * iImage.NumChan();
+		return bytes;
+	}
+
+public:
+	IDType iId;
+	string iLabel;
+
+	// size of the target, the outline drawn by the tracker
+	Int iWidth;
+	Int iHeight;
+
+	// only kept for debugging, see Matcher::iKeepImages
+	Image<Byte> iImage;
+
+	FrameArray iFrames;
+
+	// empty once a Matcher in binary mode has built iBinary from them
+	vector< vector<DbDescType> > iDescriptors;
+
+	// binary descriptors, empty unless the Matcher uses them
+	vector<BinaryDescriptor> iBinary;
+
+	// distinct vocabulary words of the descriptors, see TargetPager::Write
+	vector<Int> iWords;
+
+private:
+	Int iRefCount;
+};
+
+#endif
@@ -3,35 +3,67 @@
 
 #include <string>
 #include <time.h>
+#include <pthread.h>
 
 #include "cbir/RifFeatureExtractor.h"
 #include "cbir/BruteForce.h"
 #include "cbir/L1Distance.h"
 #include "cbir/MatchVisualizer.h"
 #include "cbir/Ransac.h"
+#include "cbir/ThreadPool.h"
+#include "cbir/MatchTarget.h"
+#include "cbir/TargetPager.h"
+#include "cbir/FeatureCoder.h"
 
 class Matcher {
 	// local typedef
 	typedef vector< pair<Float, Float> > Polygon;
-	typedef Int DbDescType;
+	typedef MatchTarget::DbDescType DbDescType;
+	typedef RifFeatureExtractor<Quantize5x5> DbExtractor;
+
+	// shared state of the parallel database build
+	class BuildTask {
+	public:
+		Matcher *matcher;
+		vector<Char *> *files;
+		Int numScales;
+		vector<MatchTarget *> targets;
+		vector<FeatureStore> stores;	// one per image and scale
+	};
 
 public:
 	Matcher() {
+		pthread_mutex_init(&iTargetMutex, NULL);
+		pthread_mutex_init(&iWriteMutex, NULL);
+		pthread_mutex_init(&iResultMutex, NULL);
+
 		Construct();
 	}
+	~Matcher() {
+		FreeBuildExtractors();
+
+		ReleaseTargets(iModelTargets);
+		ReleaseTargets(iTargets);
+
+		pthread_mutex_destroy(&iResultMutex);
+		pthread_mutex_destroy(&iWriteMutex);
+		pthread_mutex_destroy(&iTargetMutex);
+	}
 
 	void Construct() {
 		iDbValid = false;
 		iRatioThresh = 0.8;
 		iNumDB = 0;
 		iNumDbDesc = 0;
+		iNextTargetId = 0;
 		iUniqueDescThresh = 150;
+		iNumBuildThreads = 4;
+		iKeepImages = false;
+		iKeepWords = false;
+		iMaxCandidates = 8;
+		iVocabDim = 0;
 
-		Char cellConfig[] = "Annuli4Patch35";
-		iDbRif.Construct(cellConfig);
-
-		iDbRif.iNumOctaves = 3;
-		iDbRif.iScalesPerOctave = 3;
+		ConstructDbExtractor(iDbRif);
 
 		iQueryPeriod = 1;
 		iMinMatches = 4;
@@ -44,104 +76,537 @@ public:
 		aQuantDesc.resize(size);
 
 		for (Int i = 0; i < size; ++i) {
-			aQuantDesc[i] = Int(255 * aDesc[i]);
+			Int value = Int(255 * aDesc[i]);
+			aQuantDesc[i] = value > 255 ? 255 : value;
 			//aQuantDesc[i] = aDesc[i];
 		}
 	}
 
+	void QuantizeDescriptors(DescriptorArray &aDescs, vector< vector<DbDescType> > &aQuantDescs) {
+		Int size = aDescs.Size();
+		aQuantDescs.resize(size);
+
+		for (Int i = 0; i < size; ++i) {
+			QuantizeDescriptor(aDescs[i], aQuantDescs[i]);
+		}
+	}
+
+	// Search with aNumBits binary descriptors and the Hamming distance
+	// instead of the L1 distance, 0 goes back to L1. Targets then keep only
+	// their binary descriptors. Set it before the database is built or
+	// opened and not while querying.
+	void SetBinaryBits(Int aNumBits) {
+		iDbRif.SetBinaryBits(aNumBits);
+	}
+
+	Bool UseBinary() {
+		return iDbRif.BinaryBits() > 0;
+	}
+
+	void ConstructDbExtractor(DbExtractor &aRif) {
+		Char cellConfig[] = "Annuli4Patch35";
+		aRif.Construct(cellConfig);
+
+		aRif.iNumOctaves = 3;
+		aRif.iScalesPerOctave = 3;
+	}
+
+	// Replaces all targets. Images are loaded, described and pruned in
+	// parallel. Every (image, scale) pair is its own task, and the scales are
+	// appended in order so the targets are the same for any number of threads.
+	// Queries keep using the previous targets until the new ones are ready.
 	void BuildDatabase(vector<Char *> &aDbFiles, vector<Char *> &aLabels) {
-		// init
-		iDbValid = false;
-		iNumDB = aDbFiles.size();
+		pthread_mutex_lock(&iWriteMutex);
 
-		iDatabase.resize(iNumDB);
-		iDbDescriptors.resize(iNumDB);
-		iLabels.resize(iNumDB);
-		iDbImages.resize(iNumDB);
+		Int numDB = aDbFiles.size();
 
-		// extract features;
-		iNumDbDesc = 0;
-		for (Int i = 0; i < iNumDB; ++i) {
-			// load image
-			Image<Byte> *image = ImageIO::ReadPGM(aDbFiles[i]);
-			iDbImages[i].Copy(*image);
-			delete image;
-
-			// extract features at integer octaves
-			iDatabase[i].Resize(0);
-			iDbRif.ExtractFeatures(iDbImages[i], iDatabase[i], i);
-
-			// make label
-			//Char buffer[64];
-			//sprintf(buffer, "CD %02d", i);
-			//iLabels[i] = buffer;
-			iLabels[i] = aLabels[i];
-
-			// flatten descriptors into a 2D array of floats for searching
-			iDbDescriptors[i].resize(iDatabase[i].Size());
-			for (Int j = 0; j < iDatabase[i].Size(); ++j) {
-				Descriptor &desc = iDatabase[i].GetDescriptor(j);
-				QuantizeDescriptor(desc, iDbDescriptors[i][j]);
-			}
+		// started here so the workers inherit the priority of the calling thread
+		iBuildPool.Construct(iNumBuildThreads);
+		ConstructBuildExtractors(iBuildPool.NumThreads());
 
-			iNumDbDesc += iDatabase[i].Size();
+		BuildTask task;
+		task.matcher = this;
+		task.files = &aDbFiles;
+		task.numScales = iDbRif.NumScales();
+
+		for (Int i = 0; i < numDB; ++i) {
+			task.targets.push_back(new MatchTarget(iNextTargetId++, aLabels[i]));
 		}
 
-		RemoveSimilarDescriptors();
+		iBuildPool.Run(numDB, LoadImageFunction, &task);
+
+		// images that could not be read get no target
+		RemoveMissingTargets(task.targets);
+		numDB = task.targets.size();
+		task.stores.resize(numDB * task.numScales);
+
+		iBuildPool.Run(numDB * task.numScales, ExtractScaleFunction, &task);
+		iBuildPool.Run(numDB, MergeScalesFunction, &task);
+		iBuildPool.Run(numDB, RemoveSimilarFunction, &task);
+
+		// the vocabulary is trained on the new targets when they are first
+		// written, or now if binary mode is about to drop their descriptors
+		iVocab.clear();
+		if (UseBinary() && iKeepWords) TrainVocabulary(task.targets);
+		iBuildPool.Run(numDB, IndexTargetFunction, &task);
+
+		// no idle threads while tracking
+		FreeBuildExtractors();
+		iBuildPool.Construct(1);
+
+		// swap in the new targets
+		pthread_mutex_lock(&iTargetMutex);
+		vector<MatchTarget *> oldTargets;
+		oldTargets.swap(iTargets);
+		iTargets.swap(task.targets);
+		UpdateCounts();
+		pthread_mutex_unlock(&iTargetMutex);
+
+		ReleaseTargets(oldTargets);
 
 		iDbValid = true;
+
+		pthread_mutex_unlock(&iWriteMutex);
+	}
+
+	// Adds a target described from aImage and returns its id, or -1 if no
+	// features are found in it. Only writers wait for each other, queries
+	// in flight keep their own target list.
+	IDType AddTarget(Image<Byte> &aImage, const string &aLabel) {
+		pthread_mutex_lock(&iWriteMutex);
+
+		MatchTarget *target = new MatchTarget(iNextTargetId++, aLabel);
+		target->iWidth = aImage.Width();
+		target->iHeight = aImage.Height();
+
+		FeatureStore features;
+		iDbRif.ExtractFeatures(aImage, features, target->iId);
+		if (features.Size() == 0) {
+			delete target;
+			pthread_mutex_unlock(&iWriteMutex);
+			return -1;
+		}
+
+		if (iKeepImages) target->iImage.Copy(aImage);
+		SetFeatures(*target, features);
+		FinishTarget(*target);
+
+		PublishTarget(target);
+
+		pthread_mutex_unlock(&iWriteMutex);
+		return target->iId;
+	}
+
+	// Adds a target from features written by FeatureStore::Write, for a
+	// target image of aWidth x aHeight. Returns -1 if there are no features.
+	IDType AddTarget(Char *aFeatureFile, const string &aLabel, Int aWidth, Int aHeight) {
+		pthread_mutex_lock(&iWriteMutex);
+
+		MatchTarget *target = new MatchTarget(iNextTargetId++, aLabel);
+		target->iWidth = aWidth;
+		target->iHeight = aHeight;
+
+		FeatureStore features;
+		features.Read(aFeatureFile);
+		if (features.Size() == 0) {
+			delete target;
+			pthread_mutex_unlock(&iWriteMutex);
+			return -1;
+		}
+
+		SetFeatures(*target, features);
+		FinishTarget(*target);
+
+		PublishTarget(target);
+
+		pthread_mutex_unlock(&iWriteMutex);
+		return target->iId;
+	}
+
+	// Retires a target. Queries that already have it finish with it, it is
+	// freed with the last of them. Returns false for an unknown id.
+	Bool RemoveTarget(IDType aId) {
+		pthread_mutex_lock(&iWriteMutex);
+		pthread_mutex_lock(&iTargetMutex);
+
+		vector<MatchTarget *> removed;
+		Int numTargets = iTargets.size();
+		for (Int i = 0; i < numTargets; ++i) {
+			if (iTargets[i]->iId == aId) {
+				removed.push_back(iTargets[i]);
+				iTargets.erase(iTargets.begin() + i);
+				break;
+			}
+		}
+		UpdateCounts();
+
+		pthread_mutex_unlock(&iTargetMutex);
+
+		Bool found = !removed.empty();
+		ReleaseTargets(removed);
+
+		pthread_mutex_unlock(&iWriteMutex);
+		return found;
+	}
+
+	// Pages in targets from a file written by WritePagedDatabase, keeping
+	// up to aBudget bytes of them in memory. The paged targets are searched
+	// next to the ones added at runtime, iMaxCandidates per query, and get
+	// new ids after those given so far. The file must have been written in
+	// the same descriptor mode.
+	Bool OpenPagedDatabase(Char *aFile, Int64 aBudget) {
+		pthread_mutex_lock(&iWriteMutex);
+		Bool ok = iPager.Open(aFile, aBudget, iNextTargetId);
+		if (ok && iPager.BinaryBits() != iDbRif.BinaryBits()) {
+			iPager.Close();
+			ok = false;
+		}
+		if (ok) {
+			iNextTargetId += iPager.Size();
+			iDbValid = true;
+		}
+		pthread_mutex_unlock(&iWriteMutex);
+
+		return ok;
+	}
+
+	void ClosePagedDatabase() {
+		pthread_mutex_lock(&iWriteMutex);
+		iPager.Close();
+		pthread_mutex_unlock(&iWriteMutex);
+	}
+
+	// Writes the current targets for OpenPagedDatabase. In binary mode the
+	// targets must have been added with iKeepWords set.
+	Bool WritePagedDatabase(Char *aFile) {
+		pthread_mutex_lock(&iWriteMutex);
+		vector<MatchTarget *> targets;
+		AcquireTargets(targets);
+		Bool ok = PrepareWords(targets) &&
+			TargetPager::Write(aFile, targets, iVocab, KVocabBranch, iDbRif.BinaryBits());
+		ReleaseTargets(targets);
+		pthread_mutex_unlock(&iWriteMutex);
+
+		return ok;
+	}
+
+	// copies the current target list and holds a reference to each target
+	void AcquireTargets(vector<MatchTarget *> &aTargets) {
+		pthread_mutex_lock(&iTargetMutex);
+		aTargets = iTargets;
+		Int numTargets = aTargets.size();
+		for (Int i = 0; i < numTargets; ++i) aTargets[i]->Retain();
+		pthread_mutex_unlock(&iTargetMutex);
+	}
+
+	// drops the references taken by AcquireTargets, and clears aTargets
+	void ReleaseTargets(vector<MatchTarget *> &aTargets) {
+		Int numTargets = aTargets.size();
+		for (Int i = 0; i < numTargets; ++i) {
+			if (aTargets[i]->Release()) delete aTargets[i];
+		}
+
+		aTargets.clear();
+	}
+
+	Int NumTargets() {
+		pthread_mutex_lock(&iTargetMutex);
+		Int numTargets = iTargets.size();
+		pthread_mutex_unlock(&iTargetMutex);
+
+		return numTargets;
+	}
+
+	// a target whose image can not be read keeps a size of 0
+	static void LoadImageFunction(void *aArg, Int aTask, Int /* aThread */) {
+		BuildTask &task = *(BuildTask *)aArg;
+		MatchTarget &target = *task.targets[aTask];
+
+		Char *file = (*task.files)[aTask];
+		Image<Byte> *image = ImageIO::ReadPGM(file);
+		if (image == NULL) {
+			printf("could not load %s, skipped\n", file);
+			return;
+		}
+
+		target.iImage.Copy(*image);
+		target.iWidth = image->Width();
+		target.iHeight = image->Height();
+		delete image;
+	}
+
+	// not published yet, so nothing else holds a reference
+	void RemoveMissingTargets(vector<MatchTarget *> &aTargets) {
+		Int numTargets = aTargets.size();
+		Int numKept = 0;
+		for (Int i = 0; i < numTargets; ++i) {
+			if (aTargets[i]->iWidth > 0) aTargets[numKept++] = aTargets[i];
+			else delete aTargets[i];
+		}
+
+		aTargets.resize(numKept);
+	}
+
+	static void ExtractScaleFunction(void *aArg, Int aTask, Int aThread) {
+		BuildTask &task = *(BuildTask *)aArg;
+		Matcher &matcher = *task.matcher;
+
+		// all images at the finest scale first, those are the slowest tasks
+		Int numDB = task.targets.size();
+		Int image = aTask % numDB;
+		Int scale = aTask / numDB;
+
+		MatchTarget &target = *task.targets[image];
+		FeatureStore &store = task.stores[image * task.numScales + scale];
+		matcher.BuildExtractor(aThread).ExtractScale(target.iImage, scale, store, target.iId);
+	}
+
+	static void MergeScalesFunction(void *aArg, Int aTask, Int /* aThread */) {
+		BuildTask &task = *(BuildTask *)aArg;
+		MatchTarget &target = *task.targets[aTask];
+
+		FeatureStore features;
+		for (Int j = 0; j < task.numScales; ++j) {
+			FeatureStore &store = task.stores[aTask * task.numScales + j];
+			features.Append(store);
+
+			FeatureStore empty;
+			store = empty;
+		}
+
+		task.matcher->SetFeatures(target, features);
+
+		// only the size is needed from here on
+		if (!task.matcher->iKeepImages) target.iImage.Destroy();
+	}
+
+	static void RemoveSimilarFunction(void *aArg, Int aTask, Int /* aThread */) {
+		BuildTask &task = *(BuildTask *)aArg;
+		task.matcher->RemoveSimilarDescriptors(*task.targets[aTask]);
+	}
+
+	static void IndexTargetFunction(void *aArg, Int aTask, Int /* aThread */) {
+		BuildTask &task = *(BuildTask *)aArg;
+		task.matcher->IndexTarget(*task.targets[aTask]);
+	}
+
+	// keeps the frames and the quantized descriptors for searching
+	void SetFeatures(MatchTarget &aTarget, FeatureStore &aFeatures) {
+		aTarget.iFrames = aFeatures.GetFrameArray();
+		QuantizeDescriptors(aFeatures.GetDescriptorArray(), aTarget.iDescriptors);
+	}
+
+	// Everything that needs the quantized descriptors of a single target.
+	// If binary mode needs the words now, the vocabulary comes from the
+	// target itself when there is none yet. Call with iWriteMutex held.
+	void FinishTarget(MatchTarget &aTarget) {
+		RemoveSimilarDescriptors(aTarget);
+
+		if (iVocab.empty() && UseBinary() && iKeepWords) {
+			vector<MatchTarget *> targets(1, &aTarget);
+			TrainVocabulary(targets);
+		}
+		IndexTarget(aTarget);
+	}
+
+	// Vocabulary for WritePagedDatabase, from the targets that still have
+	// their quantized descriptors. Left empty if none of them does.
+	// Call with iWriteMutex held.
+	void TrainVocabulary(vector<MatchTarget *> &aTargets) {
+		vector<MatchTarget *> described;
+		Int numTargets = aTargets.size();
+		for (Int i = 0; i < numTargets; ++i) {
+			MatchTarget *target = aTargets[i];
+			if (target->Size() > 0 && (Int) target->iDescriptors.size() == target->Size()) {
+				described.push_back(target);
+			}
+		}
+		if (described.empty()) return;
+
+		iVocabDim = described[0]->iDescriptors[0].size();
+		TargetPager::TrainVocabulary(described, iVocabDim, KVocabBranch, iVocab);
+	}
+
+	// Trains the vocabulary on the first write and gives its words to the
+	// targets that have none. False if a target can't get them, which is a
+	// binary target added without iKeepWords. Call with iWriteMutex held.
+	Bool PrepareWords(vector<MatchTarget *> &aTargets) {
+		if (iVocab.empty()) TrainVocabulary(aTargets);
+
+		Int numTargets = aTargets.size();
+		for (Int i = 0; i < numTargets; ++i) {
+			MatchTarget &target = *aTargets[i];
+			if (target.Size() == 0 || !target.iWords.empty()) continue;
+			if (iVocab.empty() || (Int) target.iDescriptors.size() != target.Size()) return false;
+
+			TargetPager::AssignWords(&iVocab[0], KVocabBranch, iVocabDim, target);
+		}
+		return true;
+	}
+
+	// Vocabulary words and binary descriptors of the quantized descriptors,
+	// which binary mode drops afterwards. The binary descriptors are what a
+	// query sees too.
+	void IndexTarget(MatchTarget &aTarget) {
+		if (!iVocab.empty()) {
+			TargetPager::AssignWords(&iVocab[0], KVocabBranch, iVocabDim, aTarget);
+		}
+
+		aTarget.iBinary.clear();
+		if (UseBinary()) {
+			iDbRif.iBinaryTests.Binarize(aTarget.iDescriptors, aTarget.iBinary);
+			vector< vector<DbDescType> >().swap(aTarget.iDescriptors);
+		}
+	}
+
+	// thread 0 uses iDbRif, the others a copy of its configuration
+	DbExtractor &BuildExtractor(Int aThread) {
+		if (aThread == 0) return iDbRif;
+		return *iBuildRif[aThread - 1];
+	}
+
+	void ConstructBuildExtractors(Int aNumThreads) {
+		FreeBuildExtractors();
+
+		for (Int i = 1; i < aNumThreads; ++i) {
+			DbExtractor *rif = new DbExtractor();
+			ConstructDbExtractor(*rif);
+
+			rif->iNumOctaves = iDbRif.iNumOctaves;
+			rif->iScalesPerOctave = iDbRif.iScalesPerOctave;
+			rif->iBlurImage = iDbRif.iBlurImage;
+
+			iBuildRif.push_back(rif);
+		}
+	}
+
+	void FreeBuildExtractors() {
+		Int size = iBuildRif.size();
+		for (Int i = 0; i < size; ++i) delete iBuildRif[i];
+		iBuildRif.clear();
+	}
+
+	// Copies the results of the last query, aModels[i] is the model of
+	// aTargets[i], empty if there is no match. The targets are held until
+	// the caller gives them back with ReleaseTargets.
+	void AcquireResults(vector< vector<Float> > &aModels, vector<MatchTarget *> &aTargets) {
+		pthread_mutex_lock(&iResultMutex);
+		aModels = iModels;
+		aTargets = iModelTargets;
+		Int numTargets = aTargets.size();
+		for (Int i = 0; i < numTargets; ++i) aTargets[i]->Retain();
+		pthread_mutex_unlock(&iResultMutex);
 	}
 
+	// the results are read with AcquireResults
 	void Query(Image<Byte> &aImage, FeatureStore &aQueryFS) {
 		// get current frames descriptors
-		DescriptorArray &queryDescArray = aQueryFS.GetDescriptorArray();
+		vector< vector<DbDescType> > queryDesc;
+		QuantizeDescriptors(aQueryFS.GetDescriptorArray(), queryDesc);
+
+		Bool binary = UseBinary();
+		vector<BinaryDescriptor> queryBits;
+		if (binary) iDbRif.iBinaryTests.Binarize(queryDesc, queryBits);
+
+		// targets added or removed from now on don't affect this query
+		vector<MatchTarget *> targets;
+		AcquireTargets(targets);
+
+		// and the paged targets most likely to match
+		if (iPager.IsOpen()) {
+			vector<Int> candidates;
+			iPager.SelectCandidates(queryDesc, iMaxCandidates, candidates);
+
+			Int numCandidates = candidates.size();
+			for (Int i = 0; i < numCandidates; ++i) {
+				MatchTarget *target = iPager.Acquire(candidates[i]);
+				if (target) targets.push_back(target);
+			}
+		}
+		Int numDB = targets.size();
 		
-		vector< vector<Float> > models(iNumDB);
-		vector< vector<Int> > inliers(iNumDB);
-		vector< vector< pair<Int,Int> > > matches(iNumDB);
+		vector< vector<Float> > models(numDB);
+		vector< vector<Int> > inliers(numDB);
+		vector< vector< pair<Int,Int> > > matches(numDB);
+
+		for (Int i = 0; i < numDB; ++i) {
+			FrameArray &dbFrames = targets[i]->iFrames;
 
-		for (Int i = 0; i < iNumDB; ++i) {
 			// search each query descriptor into database
 			vector< vector<Int> > nn;		// nearest neighbors
 			vector< vector<DistType> > dist;	// distance to nearest neighbors
-			ComputeNeighbors(queryDescArray, iDbDescriptors[i], nn, dist);
+			if (binary) {
+				ComputeNeighbors(queryBits, targets[i]->iBinary, nn, dist);
+			} else {
+				ComputeNeighbors(queryDesc, targets[i]->iDescriptors, nn, dist);
+			}
 
 			// compute matches
 			ComputeMatches(nn, dist, matches[i]);
 		
 			// compute models
-			ComputeModel(aQueryFS, iDatabase[i], matches[i], models[i]);
+			ComputeModel(aQueryFS, dbFrames, matches[i], models[i]);
 
 			// outlier removal
 			FrameArray &qFrames = aQueryFS.GetFrameArray();
-			FrameArray &dbFrames = iDatabase[i].GetFrameArray();
 			iRansac.Verify(qFrames, dbFrames, matches[i], inliers[i], models[i]);
 		}
 
 		// process results
-		if (iPlotMatches) {
-			PlotMatches(aImage, aQueryFS, matches, inliers);
+		if (iPlotMatches && aImage.Width() > 0) {
+			PlotMatches(aImage, aQueryFS, targets, matches, inliers);
 		}
 
-		iModels = models;
+		// the results keep their targets alive until the next query
+		pthread_mutex_lock(&iResultMutex);
+		iModelTargets.swap(targets);
+		iModels.swap(models);
+		pthread_mutex_unlock(&iResultMutex);
+
+		ReleaseTargets(targets);
+	}
+
+	// Queries with features sent as a FeatureCoder bitstream, without the
+	// image. Returns false and leaves the results alone if it is damaged.
+	Bool Query(vector<Byte> &aBitstream) {
+		FeatureStore queryFS;
+		FeatureCoder coder;
+		if (!coder.Decode(aBitstream, queryFS, 0)) return false;
+
+		Image<Byte> noImage;
+		Query(noImage, queryFS);
+		return true;
 	}
 
 	void PlotMatches(
 			Image<Byte> &aImage,
 			FeatureStore &aQueryFeatureStore,
+			vector<MatchTarget *> &aTargets,
 			vector< vector< pair<Int,Int> > > &aMatches,
 			vector< vector<Int> > &aInliers) {
 
 		static Int frameNumber = 0;
 
 		printf("frame %03d\n", frameNumber);
-		for (Int i = 0; i < iNumDB; ++i) {
-			printf("\t%d: %d %d\n", i, aMatches[i].size(), aInliers[i].size());
+		Int numDB = aTargets.size();
+		for (Int i = 0; i < numDB; ++i) {
+			MatchTarget &target = *aTargets[i];
+			printf("\t%d: %d %d\n", target.iId, aMatches[i].size(), aInliers[i].size());
+
+			// only with iKeepImages, and not for targets added from features
+			if (target.iImage.Width() == 0) continue;
+
+			// the visualizer only looks at the frames
+			FeatureStore dbFeatures;
+			Descriptor noDesc;
+			for (Int j = 0; j < target.Size(); ++j) {
+				dbFeatures.Append(noDesc, target.iFrames[j], target.iId);
+			}
 			
 			Char outFile[256];
-			sprintf(outFile, "frame%03d_id%02d.ppm", frameNumber, i);
-			MatchVisualizer::PlotMatches(iDbImages[i], aImage, 
-				iDatabase[i], aQueryFeatureStore,
+			sprintf(outFile, "frame%03d_id%02d.ppm", frameNumber, target.iId);
+			MatchVisualizer::PlotMatches(target.iImage, aImage, 
+				dbFeatures, aQueryFeatureStore,
 				aMatches[i], outFile, aInliers[i]);
 		}
 
@@ -150,23 +615,23 @@ public:
 
 	// compute nearest neighbors and distances
 	void ComputeNeighbors(
-			DescriptorArray &aQueryDesc,
+			vector< vector<DbDescType> > &aQueryDesc,
 			vector< vector<DbDescType> > &aDbDesc,
 			vector< vector<Int> > &aNN, 
 			vector< vector<DistType> > &aDist) {
 
 		Int k = 2;				// num neighbors
-		Int qNumDesc = aQueryDesc.Size();
-
-		aNN.resize(qNumDesc);
-		aDist.resize(qNumDesc);
+		iBruteForce.FindNN(k, aQueryDesc, aDbDesc, aNN, aDist);
+	}
 
-		vector<DbDescType> q;
-		for (Int i = 0; i < qNumDesc; ++i) {
-			QuantizeDescriptor(aQueryDesc[i], q);
+	void ComputeNeighbors(
+			vector<BinaryDescriptor> &aQueryDesc,
+			vector<BinaryDescriptor> &aDbDesc,
+			vector< vector<Int> > &aNN, 
+			vector< vector<DistType> > &aDist) {
 
-			iBruteForce.FindNN(k, q, aDbDesc, aNN[i], aDist[i]);
-		}
+		Int k = 2;				// num neighbors
+		iHammingBruteForce.FindNN(k, aQueryDesc, aDbDesc, aNN, aDist);
 	}
 
 	// compute matches given neighbors and distances
@@ -193,7 +658,7 @@ public:
 	// compute models given matches
 	void ComputeModel(
 			FeatureStore &aQuery,
-			FeatureStore &aDatabase,
+			FrameArray &aDbFrames,
 			vector< pair<Int,Int> > &aMatches, 
 			vector<Float> &aModel) {
 
@@ -210,7 +675,7 @@ public:
 			Int dbIdx = aMatches[j].second;
 
 			Frame &qFrame = aQuery.GetFrame(qIdx);
-			Frame &dbFrame = aDatabase.GetFrame(dbIdx);
+			Frame &dbFrame = aDbFrames[dbIdx];
 
 			solver.AddMatch(dbFrame[KX], dbFrame[KY], qFrame[KX], qFrame[KY]);
 		}
@@ -219,56 +684,64 @@ public:
 	}
 	
 	// removes descriptors that are too similar to each other
-	void RemoveSimilarDescriptors() {
-		iNumDbDesc = 0;
-
-		for (Int i = 0; i < iNumDB; ++i) {
-			DescriptorArray &descArray = iDatabase[i].GetDescriptorArray();
-
-			// search each descriptor into database
-			vector< vector<Int> > nn;		// nearest neighbors
-			vector< vector<DistType> > dist;	// distance to nearest neighbors
-			ComputeNeighbors(descArray, iDbDescriptors[i], nn, dist);
-
-			// find unique descriptors
-			vector<Int> keepIndices;
-			Int numQ = dist.size();
-			for (Int j = 0; j < numQ; ++j) {
-				// first distance is zero (self), use second distance
-				if (dist[j][1] >= iUniqueDescThresh) {	
-					keepIndices.push_back(j);
-				}
+	void RemoveSimilarDescriptors(MatchTarget &aTarget) {
+		// search each descriptor into database
+		vector< vector<Int> > nn;		// nearest neighbors
+		vector< vector<DistType> > dist;	// distance to nearest neighbors
+		ComputeNeighbors(aTarget.iDescriptors, aTarget.iDescriptors, nn, dist);
+
+		// find unique descriptors
+		vector<Int> keepIndices;
+		Int numQ = dist.size();
+		for (Int j = 0; j < numQ; ++j) {
+			// first distance is zero (self), use second distance
+			if (dist[j][1] >= iUniqueDescThresh) {	
+				keepIndices.push_back(j);
 			}
+		}
 
-			printf("before: %d\tafter: %d\n", numQ, keepIndices.size());
-
-			// replace database
-			vector< vector<DbDescType> > tempDesc = iDbDescriptors[i];
-			FeatureStore tempStore = iDatabase[i];
+		printf("before: %d\tafter: %d\n", numQ, keepIndices.size());
 
-			iDbDescriptors[i].clear();
-			iDatabase[i].Clear();
+		// replace database
+		vector< vector<DbDescType> > tempDesc;
+		FrameArray tempFrames;
+		tempDesc.swap(aTarget.iDescriptors);
+		tempFrames = aTarget.iFrames;
+		aTarget.iFrames.Resize(0);
 
-			Int numKeep = keepIndices.size();
-			for (Int j = 0; j < numKeep; ++j) {
-				Int idx = keepIndices[j];
+		Int numKeep = keepIndices.size();
+		aTarget.iDescriptors.resize(numKeep);
+		for (Int j = 0; j < numKeep; ++j) {
+			Int idx = keepIndices[j];
 
-				Descriptor &desc = tempStore.GetDescriptor(idx);
-				Frame &frame = tempStore.GetFrame(idx);
-				IDType id = tempStore.GetImageId(idx);
+			aTarget.iDescriptors[j].swap( tempDesc[idx] );
+			aTarget.iFrames.Append( tempFrames[idx] );
+		}
+	}
 
-				iDbDescriptors[i].push_back( tempDesc[idx] );
-				iDatabase[i].Append(desc, frame, id);
-			}
+	// call with iTargetMutex held
+	void UpdateCounts() {
+		iNumDB = iTargets.size();
 
-			iNumDbDesc += numKeep;
+		iNumDbDesc = 0;
+		for (Int i = 0; i < iNumDB; ++i) {
+			iNumDbDesc += iTargets[i]->Size();
 		}
 	}
 
+	void PublishTarget(MatchTarget *aTarget) {
+		pthread_mutex_lock(&iTargetMutex);
+		iTargets.push_back(aTarget);
+		UpdateCounts();
+		pthread_mutex_unlock(&iTargetMutex);
+	}
+
 public:
 	// parameters
 	Int iNumDB;
 	Int iNumDbDesc;
+	Int iNumBuildThreads;
+	Int iMaxCandidates;
 	Float iRatioThresh;
 	Int iQueryPeriod;
 	Int iMinMatches;
@@ -276,20 +749,47 @@ public:
 
 	Bool iPlotMatches;
 
+	// keep the target pixels, for PlotMatches
+	Bool iKeepImages;
+
+	// Give the targets their vocabulary words as they are added, which
+	// WritePagedDatabase needs in binary mode as the descriptors the words
+	// come from are dropped. Otherwise the words wait for the first write.
+	Bool iKeepWords;
+
 	// function objects
-	RifFeatureExtractor<Quantize5x5> iDbRif;
+	DbExtractor iDbRif;
 	BruteForce<DbDescType, DistType, L1Distance> iBruteForce;
+	BruteForce<Uint32, DistType, HammingDistance> iHammingBruteForce;
 	Ransac iRansac;
 
 	// database
 	Bool iDbValid;
-	vector<FeatureStore> iDatabase;
-	vector< vector< vector<DbDescType> > > iDbDescriptors;
-	vector< Image<Byte> > iDbImages;
+
+	// paged database, see OpenPagedDatabase
+	TargetPager iPager;
+
+	// words of the targets, for WritePagedDatabase
+	vector<DbDescType> iVocab;
+	Int iVocabDim;
+
+private:
+	// results of the last query, guarded by iResultMutex
 	vector< vector<Float> > iModels;
+	vector<MatchTarget *> iModelTargets;
+	pthread_mutex_t iResultMutex;
+
+	// published targets, guarded by iTargetMutex
+	vector<MatchTarget *> iTargets;
+	pthread_mutex_t iTargetMutex;
 
-	// label data
-	vector<string> iLabels;
+	// serializes changes to the targets, never taken by Query
+	pthread_mutex_t iWriteMutex;
+	IDType iNextTargetId;
+
+	// database build
+	ThreadPool iBuildPool;
+	vector<DbExtractor *> iBuildRif;
 
 public:
 	const static Int KX = 0;
@@ -297,6 +797,8 @@ public:
 	const static Int KScl = 2;
 	const static Int KOri = 3;
 	const static Int KRes = 4;
+
+	const static Int KVocabBranch = 32;
 };
 
 #endif
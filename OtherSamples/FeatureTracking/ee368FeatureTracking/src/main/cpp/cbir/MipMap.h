@@ -20,6 +20,14 @@ public:
 		//ConstructAccurate(aImage);
 	}
 
+	// Image can't be copied, so never let the vector move allocated layers
+	void ResizeLevels(Int aNumLevels) {
+		if ((Int) iImages.size() != aNumLevels) {
+			iImages.clear();
+			iImages.resize(aNumLevels);
+		}
+	}
+
 	void ConstructFast(Image<T_type> &aImage) {
 		Int height = aImage.Height();	
 		Int width = aImage.Width();
@@ -28,7 +36,7 @@ public:
 		// Allocate mipmap layers, rouding up
 		Float maxDim = Max(width, height);
 		Int numMipMaps = (Int) ceil( log(maxDim) * KInvLog2 );	// log_2(maxDim)
-		iImages.resize(numMipMaps);
+		ResizeLevels(numMipMaps);
 		
 		// Compute total allocation space for each individual layer 
 		Int curWidth = width;
@@ -142,7 +150,7 @@ public:
 		// Allocate mipmap layers, rouding up
 		Float maxDim = Max(width, height);
 		Int numMipMaps = (Int) ceil( log(maxDim) * KInvLog2 );	// log_2(maxDim)
-		iImages.resize(numMipMaps);
+		ResizeLevels(numMipMaps);
 		
 		// Compute total allocation space for each individual layer 
 		Int curWidth = width;
@@ -208,7 +216,7 @@ public:
 		// Allocate mipmap layers, rouding up
 		Float maxDim = Max(width, height);
 		Int numMipMaps = (Int) ceil( log(maxDim) * KInvLog2 );	// log_2(maxDim)
-		iImages.resize(numMipMaps);
+		ResizeLevels(numMipMaps);
 		
 		// Compute total allocation space for each individual layer 
 		Int curWidth = width;
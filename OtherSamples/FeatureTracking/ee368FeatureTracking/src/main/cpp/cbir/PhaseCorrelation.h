@@ -0,0 +1,210 @@
+#ifndef PHASE_CORRELATION_H
+#define PHASE_CORRELATION_H
+
+#include <math.h>
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+#include "cbir/Image.h"
+#include "cbir/FFTPlan.h"
+
+// Estimates the dominant translation between consecutive frames by phase
+// correlation of a small, windowed thumbnail of each frame. Only the
+// spectrum of the previous frame is kept between calls.
+class PhaseCorrelation {
+public:
+	PhaseCorrelation() {
+		Construct(64);
+	}
+	PhaseCorrelation(Int aSize) {
+		Construct(aSize);
+	}
+
+	// aSize is the thumbnail side and must be a power of 2
+	void Construct(Int aSize) {
+		iSize = aSize;
+		iMinPeak = 0.15;
+		iPeak = 0;
+
+		iPlan.Construct(iSize, iSize);
+
+		Int bins = iPlan.NumBins() * iSize;
+		iThumb.resize(iSize * iSize);
+		iCorr.resize(iSize * iSize);
+		iCurrReal.resize(bins);
+		iCurrImag.resize(bins);
+		iPrevReal.resize(bins);
+		iPrevImag.resize(bins);
+		iCrossReal.resize(bins);
+		iCrossImag.resize(bins);
+
+		// separable window, suppresses the edges of the thumbnail
+		iWindow.resize(iSize);
+		for (Int i = 0; i < iSize; ++i) iWindow[i] = 1;
+		Image<Float>::HammingWindow(iWindow);
+
+		Reset();
+	}
+
+	void Reset() {
+		iHasPrev = false;
+	}
+
+	// Returns true if a reliable shift from the previous frame was found.
+	// (aDx, aDy) is the motion of the image content in full frame pixels.
+	Bool Estimate(Image<Byte> &aImage, Float &aDx, Float &aDy) {
+		aDx = 0;
+		aDy = 0;
+		iPeak = 0;
+
+		Int w = aImage.Width();
+		Int h = aImage.Height();
+		if (w < iSize || h < iSize) return false;
+
+		MakeThumbnail(aImage);
+		iPlan.ForwardReal(&iThumb[0], &iCurrReal[0], &iCurrImag[0]);
+
+		Bool valid = false;
+		if (iHasPrev) {
+			valid = Correlate(aDx, aDy);
+
+			// thumbnail pixels to frame pixels
+			aDx *= Float(w) / iSize;
+			aDy *= Float(h) / iSize;
+		}
+
+		// current spectrum becomes the previous one
+		iCurrReal.swap(iPrevReal);
+		iCurrImag.swap(iPrevImag);
+		iHasPrev = true;
+
+		return valid;
+	}
+
+private:
+	// box filter the frame down to iSize x iSize, remove the mean and window.
+	// Every other pixel is sampled once the boxes are large enough.
+	void MakeThumbnail(Image<Byte> &aImage) {
+		Int w = aImage.Width();
+		Int h = aImage.Height();
+
+		Int xStep = w >= 4 * iSize ? 2 : 1;
+		Int yStep = h >= 4 * iSize ? 2 : 1;
+
+		Float sum = 0;
+		for (Int ty = 0; ty < iSize; ++ty) {
+			Int y0 = ty * h / iSize;
+			Int y1 = (ty + 1) * h / iSize;
+
+			for (Int tx = 0; tx < iSize; ++tx) {
+				Int x0 = tx * w / iSize;
+				Int x1 = (tx + 1) * w / iSize;
+
+				Int acc = 0;
+				Int count = 0;
+				for (Int y = y0; y < y1; y += yStep) {
+					Byte *p = aImage.PixelPointer(0, y);
+					for (Int x = x0; x < x1; x += xStep) {
+						acc += p[x];
+						++count;
+					}
+				}
+
+				Float val = Float(acc) / count;
+				iThumb[ty*iSize + tx] = val;
+				sum += val;
+			}
+		}
+
+		Float mean = sum / (iSize * iSize);
+		for (Int ty = 0; ty < iSize; ++ty) {
+			for (Int tx = 0; tx < iSize; ++tx) {
+				Float &val = iThumb[ty*iSize + tx];
+				val = (val - mean) * iWindow[tx] * iWindow[ty];
+			}
+		}
+	}
+
+	// normalized cross power spectrum, peak of its inverse is the shift
+	Bool Correlate(Float &aDx, Float &aDy) {
+		Int bins = iPlan.NumBins() * iSize;
+		for (Int i = 0; i < bins; ++i) {
+			Float cr = iCurrReal[i];
+			Float ci = iCurrImag[i];
+			Float pr = iPrevReal[i];
+			Float pi = iPrevImag[i];
+
+			Float re = cr*pr + ci*pi;
+			Float im = ci*pr - cr*pi;
+
+			Float mag = sqrt(re*re + im*im) + 1e-6;
+			iCrossReal[i] = re / mag;
+			iCrossImag[i] = im / mag;
+		}
+
+		iPlan.InverseReal(&iCrossReal[0], &iCrossImag[0], &iCorr[0]);
+
+		// find the peak
+		Int n = iSize * iSize;
+		Int maxIdx = 0;
+		for (Int i = 1; i < n; ++i) {
+			if (iCorr[i] > iCorr[maxIdx]) maxIdx = i;
+		}
+
+		Int px = maxIdx % iSize;
+		Int py = maxIdx / iSize;
+		iPeak = iCorr[maxIdx] / n;
+
+		// sub pixel refinement with a parabola through the neighbors
+		Float fx = px + Parabola(Corr(px-1, py), Corr(px, py), Corr(px+1, py));
+		Float fy = py + Parabola(Corr(px, py-1), Corr(px, py), Corr(px, py+1));
+
+		// shifts wrap around
+		if (fx > iSize / 2) fx -= iSize;
+		if (fy > iSize / 2) fy -= iSize;
+
+		aDx = fx;
+		aDy = fy;
+
+		return iPeak >= iMinPeak;
+	}
+
+	inline Float Corr(Int aX, Int aY) {
+		if (aX < 0) aX += iSize;
+		if (aY < 0) aY += iSize;
+		if (aX >= iSize) aX -= iSize;
+		if (aY >= iSize) aY -= iSize;
+		return iCorr[aY*iSize + aX];
+	}
+
+	static inline Float Parabola(Float aLeft, Float aCenter, Float aRight) {
+		Float denom = aLeft - 2*aCenter + aRight;
+		if (denom >= 0) return 0;
+		return 0.5 * (aLeft - aRight) / denom;
+	}
+
+public:
+	// minimum normalized correlation peak for a valid shift
+	Float iMinPeak;
+
+	// peak of the last estimate
+	Float iPeak;
+
+private:
+	Int iSize;
+	Bool iHasPrev;
+
+	FFTPlan2D iPlan;
+
+	vector<Float> iWindow;
+	vector<Float> iThumb;
+	vector<Float> iCorr;
+	vector<Float> iCurrReal;
+	vector<Float> iCurrImag;
+	vector<Float> iPrevReal;
+	vector<Float> iPrevImag;
+	vector<Float> iCrossReal;
+	vector<Float> iCrossImag;
+};
+
+#endif
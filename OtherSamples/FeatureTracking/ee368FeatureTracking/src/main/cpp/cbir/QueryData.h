@@ -20,7 +20,7 @@ public:
 		iImage = aImage;
 		iDbFiles = aDbFiles;
 		iBuildingDB = aBuildingDB;
-		iQueryInProgress = iQueryInProgress;
+		iQueryInProgress = aQueryInProgress;
 	}
 public:
 	Matcher *iMatcher;
@@ -0,0 +1,210 @@
+#ifndef RANGE_CODER_H
+#define RANGE_CODER_H
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+
+// Adaptive binary range coder, the one of LZMA. Each bit is coded with a
+// probability that follows the bits already coded with it. Larger symbols
+// are coded as a tree of bits, or as a bit length and the bits after the
+// leading one for unbounded integers.
+class RangeCoder {
+public:
+	typedef Uint16 Prob;
+
+	const static Int KProbBits = 11;
+	const static Int KProbInit = 1 << (KProbBits - 1);
+	const static Int KMoveBits = 5;
+	const static Uint32 KTop = 1 << 24;
+
+	// bit length of an integer coded by EncodeInt, and its probabilities
+	const static Int KIntBitsLog = 5;
+	const static Int KIntProbs = 1 << KIntBitsLog;
+
+	// every probability starts at one half
+	static void InitProbs(vector<Prob> &aProbs, Int aSize) {
+		aProbs.assign(aSize, KProbInit);
+	}
+};
+
+class RangeEncoder : public RangeCoder {
+public:
+	RangeEncoder(vector<Byte> &aOut) : iOut(aOut) {
+		iLow = 0;
+		iRange = 0xFFFFFFFF;
+		iCache = 0;
+		iCacheSize = 1;
+	}
+
+	void EncodeBit(Prob &aProb, Int aBit) {
+		Uint32 bound = (iRange >> KProbBits) * aProb;
+		if (aBit == 0) {
+			iRange = bound;
+			aProb += ((1 << KProbBits) - aProb) >> KMoveBits;
+		} else {
+			iLow += bound;
+			iRange -= bound;
+			aProb -= aProb >> KMoveBits;
+		}
+		Normalize();
+	}
+
+	// equiprobable bits, most significant first
+	void EncodeDirect(Uint32 aValue, Int aNumBits) {
+		for (Int i = aNumBits - 1; i >= 0; --i) {
+			iRange >>= 1;
+			if ((aValue >> i) & 1) iLow += iRange;
+			Normalize();
+		}
+	}
+
+	// aValue in [0, 2^aNumBits), aProbs has 2^aNumBits entries
+	void EncodeTree(Prob *aProbs, Int aNumBits, Uint32 aValue) {
+		Uint32 node = 1;
+		for (Int i = aNumBits - 1; i >= 0; --i) {
+			Int bit = (aValue >> i) & 1;
+			EncodeBit(aProbs[node], bit);
+			node = (node << 1) | bit;
+		}
+	}
+
+	// any unsigned value below 2^31, aProbs has KIntProbs entries
+	void EncodeInt(Prob *aProbs, Uint32 aValue) {
+		Uint32 v = aValue + 1;
+		Int length = 0;
+		while ((v >> length) > 1) ++length;
+
+		EncodeTree(aProbs, KIntBitsLog, length);
+		EncodeDirect(v, length);	// below the leading one
+	}
+
+	// call once after the last symbol
+	void Flush() {
+		for (Int i = 0; i < 5; ++i) ShiftLow();
+	}
+
+private:
+	void Normalize() {
+		while (iRange < KTop) {
+			iRange <<= 8;
+			ShiftLow();
+		}
+	}
+
+	// outputs the top byte of iLow once no carry can change it
+	void ShiftLow() {
+		if (Uint32(iLow) < 0xFF000000 || (iLow >> 32) != 0) {
+			Byte carry = Byte(iLow >> 32);
+			Byte temp = iCache;
+			do {
+				iOut.push_back(Byte(temp + carry));
+				temp = 0xFF;
+			} while (--iCacheSize != 0);
+			iCache = Byte(Uint32(iLow) >> 24);
+		}
+		++iCacheSize;
+		iLow = (iLow & 0x00FFFFFF) << 8;
+	}
+
+private:
+	vector<Byte> &iOut;
+	unsigned long long iLow;
+	Uint32 iRange;
+	Byte iCache;
+	Int iCacheSize;
+};
+
+// Reads what RangeEncoder wrote. Reading past the end gives zero bytes and
+// sets Overrun(), so a damaged stream decodes to garbage but never faults.
+class RangeDecoder : public RangeCoder {
+public:
+	RangeDecoder(const Byte *aData, Int aSize) {
+		iData = aData;
+		iSize = aSize;
+		iPos = 0;
+		iOverrun = false;
+
+		iRange = 0xFFFFFFFF;
+		iCode = 0;
+		for (Int i = 0; i < 5; ++i) iCode = (iCode << 8) | NextByte();
+	}
+
+	Int DecodeBit(Prob &aProb) {
+		Uint32 bound = (iRange >> KProbBits) * aProb;
+		Int bit;
+		if (iCode < bound) {
+			iRange = bound;
+			aProb += ((1 << KProbBits) - aProb) >> KMoveBits;
+			bit = 0;
+		} else {
+			iCode -= bound;
+			iRange -= bound;
+			aProb -= aProb >> KMoveBits;
+			bit = 1;
+		}
+		Normalize();
+		return bit;
+	}
+
+	Uint32 DecodeDirect(Int aNumBits) {
+		Uint32 value = 0;
+		for (Int i = 0; i < aNumBits; ++i) {
+			iRange >>= 1;
+			Int bit = 0;
+			if (iCode >= iRange) {
+				iCode -= iRange;
+				bit = 1;
+			}
+			value = (value << 1) | bit;
+			Normalize();
+		}
+		return value;
+	}
+
+	Uint32 DecodeTree(Prob *aProbs, Int aNumBits) {
+		Uint32 node = 1;
+		for (Int i = 0; i < aNumBits; ++i) {
+			node = (node << 1) | DecodeBit(aProbs[node]);
+		}
+		return node - (1 << aNumBits);
+	}
+
+	Uint32 DecodeInt(Prob *aProbs) {
+		Int length = DecodeTree(aProbs, KIntBitsLog);
+		if (length > 31) length = 31;
+
+		Uint32 v = (Uint32(1) << length) | DecodeDirect(length);
+		return v - 1;
+	}
+
+	Bool Overrun() {
+		return iOverrun;
+	}
+
+private:
+	void Normalize() {
+		while (iRange < KTop) {
+			iRange <<= 8;
+			iCode = (iCode << 8) | NextByte();
+		}
+	}
+
+	Byte NextByte() {
+		if (iPos >= iSize) {
+			iOverrun = true;
+			return 0;
+		}
+		return iData[iPos++];
+	}
+
+private:
+	const Byte *iData;
+	Int iSize;
+	Int iPos;
+	Bool iOverrun;
+
+	Uint32 iRange;
+	Uint32 iCode;
+};
+
+#endif
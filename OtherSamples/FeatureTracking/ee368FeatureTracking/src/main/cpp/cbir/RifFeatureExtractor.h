@@ -9,6 +9,8 @@
 #include "cbir/ImageIO.h"
 #include "cbir/MipMap.h"
 #include "cbir/CellMap.h"
+#include "cbir/ThreadPool.h"
+#include "cbir/BinaryDescriptor.h"
 
 #include <time.h>
 #include <math.h>
@@ -55,6 +57,51 @@ public:
 		Int x0, x1, y0, y1;
 		Int baselineIdx;
 	};
+	// per thread working memory for descriptor computation
+	class Scratch {
+	public:
+		Descriptor desc;
+		vector<Int> pdf;
+		vector<TFixed> baselineTable;
+	};
+	// one horizontal band of the image for parallel FAST
+	class Stripe {
+	public:
+		Stripe() {
+			y0 = 0;
+			y1 = 0;
+			corners = NULL;
+			scores = NULL;
+			numCorners = 0;
+			first = 0;
+		}
+	public:
+		Int y0, y1;
+		xy *corners;
+		Int *scores;
+		Int numCorners;
+		Int first;
+		vector<xy> nonmax;
+	};
+	class DetectTask {
+	public:
+		Byte *im;
+		Int width;
+		Int height;
+		vector<Stripe> stripes;
+		xy *corners;
+		Int *scores;
+		Int numCorners;
+	};
+	class ExtractTask {
+	public:
+		RifFeatureExtractor *extractor;
+		FrameArray *frames;
+		Image<Byte> *image;
+		Int chunkSize;
+		vector<Descriptor> descs;
+		vector<Byte> valid;
+	};
 public:
 	RifFeatureExtractor() {
 		Construct();
@@ -72,6 +119,10 @@ public:
 
 		iBlurImage = false;
 
+		// serial unless a thread pool is set
+		iThreadPool = NULL;
+		iScratch.resize(1);
+
 		// cell config
 		iCells.Construct(aCellConfig);
 		iPatchSize = iCells.iPatchSize;
@@ -80,8 +131,40 @@ public:
 
 		PrecomputeGradientData();
 
+		SetBinaryBits(0);
+
 		//DrawCells();
 	}
+
+	// Binary descriptor mode, aNumBits bin comparisons packed by Binarize(),
+	// usually 128 or 256. The float descriptors are still extracted.
+	// 0 turns it off.
+	void SetBinaryBits(Int aNumBits) {
+		Int numCells = iCells.Size();
+		Int numBins = iQuantizer.iNumBins;
+
+		vector<Int> order;
+#ifndef USE_RIFF_POLAR
+		// bins are stored in the order of ReOrderDescriptor
+		if (numCells * numBins == KReOrderDim) {
+			order.resize(KReOrderDim);
+			for (Int i = 0; i < KReOrderDim; ++i) order[i] = ReOrderTable()[i] - 1;
+		}
+#endif
+		iBinaryTests.Construct(numCells, numBins, aNumBits, order.empty() ? NULL : &order[0]);
+	}
+
+	Int BinaryBits() {
+		return iBinaryTests.NumBits();
+	}
+
+	void Binarize(FeatureStore &aFS, vector<BinaryDescriptor> &aBits) {
+		Int size = aFS.Size();
+		aBits.resize(size);
+		for (Int i = 0; i < size; ++i) {
+			iBinaryTests.Binarize(aFS.GetDescriptor(i), aBits[i]);
+		}
+	}
 	void DrawCells() {
 		Image<Float> image(iPatchSize, iPatchSize, 1);
 
@@ -102,12 +185,24 @@ public:
 		ImageIO::WritePGM((Char*)"cells.pgm", &image);
 	}
 
-	void ComputeBaselineTable(Float aStdevInv = 1) {
-		iBaselineTable.resize(4);
-		iBaselineTable[0] = TFixed::FromReal(aStdevInv * 0.5);
-		iBaselineTable[1] = TFixed::FromReal(aStdevInv);
-		iBaselineTable[2] = TFixed::FromReal(aStdevInv * 0.353553390593274);
-		iBaselineTable[3] = TFixed::FromReal(aStdevInv * 0.707106781186547);
+	// spread descriptor computation and FAST over a pool, NULL for serial
+	void SetThreadPool(ThreadPool *aThreadPool) {
+		iThreadPool = aThreadPool;
+
+		Int numThreads = iThreadPool ? iThreadPool->NumThreads() : 1;
+		if ((Int) iScratch.size() < numThreads) iScratch.resize(numThreads);
+	}
+
+	Bool IsParallel() {
+		return iThreadPool && iThreadPool->NumThreads() > 1;
+	}
+
+	void ComputeBaselineTable(vector<TFixed> &aBaselineTable, Float aStdevInv = 1) {
+		aBaselineTable.resize(4);
+		aBaselineTable[0] = TFixed::FromReal(aStdevInv * 0.5);
+		aBaselineTable[1] = TFixed::FromReal(aStdevInv);
+		aBaselineTable[2] = TFixed::FromReal(aStdevInv * 0.353553390593274);
+		aBaselineTable[3] = TFixed::FromReal(aStdevInv * 0.707106781186547);
 	}
 	void ComputeGradDir() {
 		iGradDir.Construct(iPatchSize, iPatchSize, 1);
@@ -159,131 +254,221 @@ public:
 
 		// extract at multiple scales
 		} else if (iNumOctaves > 1) {
-			Int prevStoreSize = aFeatureStore.Size();
-
 			for (Int j = 0; j < iScalesPerOctave; ++j) {
-				Image<Byte> *baseImage = image;
+				ExtractPyramid(*image, j, aFeatureStore, aImageID, aThreshold, aMaxFeatures);
+			}
+		}
 
-				Float exponent = Float(j) / iScalesPerOctave;
-				if (j > 0) {
-					Float scaleFactor = pow(2.0, -exponent);
+	}
 
-					Int newWidth  = scaleFactor * image->Width();
-					Int newHeight = scaleFactor * image->Height();
-	
-					baseImage = image->Resize(newWidth, newHeight);
-				}
+	// number of independent pieces ExtractScale() splits an image into
+	Int NumScales() {
+		return iNumOctaves > 1 ? iScalesPerOctave : 1;
+	}
 
-				// create image pyramid
-				iMipMap.Construct(*baseImage);
+	// Same features as ExtractFeatures(), one scale per octave at a time.
+	// Scales don't depend on each other, so they can run on separate
+	// extractors and be appended in order afterwards.
+	void ExtractScale(Image<Byte> &aImage, Int aScale, FeatureStore &aFeatureStore, IDType aImageID, Float aThreshold = 0, Int aMaxFeatures = -1) {
+		if (iNumOctaves <= 1) {
+			ExtractFeatures(aImage, aFeatureStore, aImageID, aThreshold, aMaxFeatures);
+			return;
+		}
 
-				// loop over scales
-				for (Int i = 0; i < iNumOctaves; ++i) {
-					Int numLevels = iMipMap.iImages.size();
-					if (i >= numLevels) break;
-					Float scale = exponent + i;
+		Image<Byte> *image = &aImage;
 
-					Image<Byte> &level = iMipMap.iImages[i];
-					DetectInterestPoints(level, frames, aThreshold, aMaxFeatures, scale);
-					ExtractFeatures(frames, level, aFeatureStore, aImageID, aThreshold, aMaxFeatures);
-				}
+		Image<Byte> blurImage;
+		if (iBlurImage) {
+			blurImage.Copy(aImage);
+			blurImage.BlurPow2(4);
+			image = &blurImage;
+		}
 
-				if (j > 0) delete baseImage;
-			}
+		ExtractPyramid(*image, aScale, aFeatureStore, aImageID, aThreshold, aMaxFeatures);
+	}
 
-			// change (x,y) positions to match those in the full image
-			Float prevScale = 0;
-			Float scaleFactor = 1;
-			for (Int i = prevStoreSize; i < aFeatureStore.Size(); ++i) {
-				Frame &frame = aFeatureStore.GetFrame(i);
+	// extracts all octaves of the aScale-th scale per octave
+	void ExtractPyramid(Image<Byte> &aImage, Int aScale, FeatureStore &aFeatureStore, IDType aImageID, Float aThreshold, Int aMaxFeatures = -1) {
+		Int prevStoreSize = aFeatureStore.Size();
+		Image<Byte> *baseImage = &aImage;
 
-				if (prevScale != frame[KScl]) {
-					scaleFactor = pow(2.0, frame[KScl]);
-					prevScale = frame[KScl];
-				}
+		Float exponent = Float(aScale) / iScalesPerOctave;
+		if (aScale > 0) {
+			Float scaleFactor = pow(2.0, -exponent);
 
-				frame[KX] *= scaleFactor;
-				frame[KY] *= scaleFactor;
-			}
+			Int newWidth  = scaleFactor * aImage.Width();
+			Int newHeight = scaleFactor * aImage.Height();
+
+			baseImage = aImage.Resize(newWidth, newHeight);
+		}
+
+		// create image pyramid
+		iMipMap.Construct(*baseImage);
+
+		// loop over scales
+		for (Int i = 0; i < iNumOctaves; ++i) {
+			Int numLevels = iMipMap.iImages.size();
+			if (i >= numLevels) break;
+			Float scale = exponent + i;
+
+			// only describe the interest points of this level
+			FrameArray frames;
+			Image<Byte> &level = iMipMap.iImages[i];
+			DetectInterestPoints(level, frames, aThreshold, aMaxFeatures, scale);
+			ExtractFeatures(frames, level, aFeatureStore, aImageID, aThreshold, aMaxFeatures);
 		}
 
+		if (aScale > 0) delete baseImage;
+
+		// change (x,y) positions to match those in the full image
+		Float prevScale = 0;
+		Float scaleFactor = 1;
+		for (Int i = prevStoreSize; i < aFeatureStore.Size(); ++i) {
+			Frame &frame = aFeatureStore.GetFrame(i);
+
+			if (prevScale != frame[KScl]) {
+				scaleFactor = pow(2.0, frame[KScl]);
+				prevScale = frame[KScl];
+			}
+
+			frame[KX] *= scaleFactor;
+			frame[KY] *= scaleFactor;
+		}
 	}
 		
 	void ExtractFeatures(FrameArray &aFrames, Image<Byte> &aImage, FeatureStore &aFeatureStore, IDType aImageID, Float aThreshold, Int aMaxFeatures = -1) {
 		Int numFrames = aFrames.Size();
-		
-		// compute interest points
-		iImage = &aImage;
+
+		if (IsParallel() && numFrames > 1) {
+			ExtractFeaturesParallel(aFrames, aImage, aFeatureStore, aImageID);
+			return;
+		}
 
 		// loop over interest points
-		Int numCells = iCells.Size();
-		Int numBins = iQuantizer.iNumBins;
-		Int descDim = numCells * numBins;
-		Descriptor desc(descDim);
-		vector<Int> pdf(numBins);
+		Scratch &scratch = iScratch[0];
+		for (Int k = 0; k < numFrames; ++k) {
+			// do not worry about points that are at edge of image
+			if (!ComputeDescriptor(aFrames[k], aImage, scratch)) continue;
+
+			// store feature
+			aFeatureStore.Append(scratch.desc, aFrames[k], aImageID);
+		}
+	}
+
+	// same result as the serial loop, descriptors are stored in frame order
+	void ExtractFeaturesParallel(FrameArray &aFrames, Image<Byte> &aImage, FeatureStore &aFeatureStore, IDType aImageID) {
+		Int numFrames = aFrames.Size();
+		Int numThreads = iThreadPool->NumThreads();
+		if ((Int) iScratch.size() < numThreads) iScratch.resize(numThreads);
+
+		// a few chunks per thread to balance the load
+		Int numTasks = numThreads * 4;
+		ExtractTask task;
+		task.extractor = this;
+		task.frames = &aFrames;
+		task.image = &aImage;
+		task.chunkSize = (numFrames + numTasks - 1) / numTasks;
+		task.descs.resize(numFrames);
+		task.valid.resize(numFrames);
+
+		numTasks = (numFrames + task.chunkSize - 1) / task.chunkSize;
+		iThreadPool->Run(numTasks, ExtractTaskFunction, &task);
 
 		for (Int k = 0; k < numFrames; ++k) {
+			if (!task.valid[k]) continue;
+			aFeatureStore.Append(task.descs[k], aFrames[k], aImageID);
+		}
+	}
 
-			// find patch extent
-			PatchData patchData;
-			ComputePatchData(aFrames[k], patchData);
-			
-			// do not worry about points that are at edge of image
-			if (patchData.outOfBounds) continue;
+	static void ExtractTaskFunction(void *aArg, Int aTask, Int aThread) {
+		ExtractTask &task = *(ExtractTask *)aArg;
+		Scratch &scratch = task.extractor->iScratch[aThread];
 
-			// compute mean and variance for normalization
-			Float mean = 0;
-			Float variance = 1;
-			ComputeVariance(patchData, mean, variance);
-			Float stdevInv = 1.0 / sqrt(variance);
-			ComputeBaselineTable(stdevInv);
+		Int k0 = aTask * task.chunkSize;
+		Int k1 = k0 + task.chunkSize;
+		if (k1 > task.frames->Size()) k1 = task.frames->Size();
 
-			// loop over cells, compute gradients and build histogram
-			Int descIdx = 0;
-			for (Int i = 0; i < numCells; ++i) {
+		for (Int k = k0; k < k1; ++k) {
+			Frame &frame = (*task.frames)[k];
+			task.valid[k] = task.extractor->ComputeDescriptor(frame, *task.image, scratch);
+			if (task.valid[k]) task.descs[k] = scratch.desc;
+		}
+	}
 
-				// initialize with prior
-				for (Int j = 0; j < numBins; ++j) pdf[j] = 1;
+	// descriptor of one interest point into aScratch.desc,
+	// false if the patch is not inside the image
+	Bool ComputeDescriptor(Frame &aFrame, Image<Byte> &aImage, Scratch &aScratch) {
+		Int numCells = iCells.Size();
+		Int numBins = iQuantizer.iNumBins;
+		Int descDim = numCells * numBins;
 
-				// iCells[i] is a vector of pairs
-				Int numPixels = iCells[i].size();
-				for (Int j = 0; j < numPixels; ++j) {
-					Int x = iCells[i][j].first;
-					Int y = iCells[i][j].second;
+		Descriptor &desc = aScratch.desc;
+		vector<Int> &pdf = aScratch.pdf;
+		desc.Resize(descDim);
+		pdf.resize(numBins);
+
+		// find patch extent
+		PatchData patchData;
+		ComputePatchData(aFrame, aImage, patchData);
+		if (patchData.outOfBounds) return false;
+
+		// compute mean and variance for normalization
+		Float mean = 0;
+		Float variance = 1;
+		ComputeVariance(aImage, patchData, mean, variance);
+		Float stdevInv = 1.0 / sqrt(variance);
+		ComputeBaselineTable(aScratch.baselineTable, stdevInv);
+
+		// loop over cells, compute gradients and build histogram
+		Int descIdx = 0;
+		for (Int i = 0; i < numCells; ++i) {
 
-					Int idx = (x << iLog2PatchStride) + y;
+			// initialize with prior
+			for (Int j = 0; j < numBins; ++j) pdf[j] = 1;
 
-					TFixed dr = ComputeGradient(patchData, iGradDataR[idx]);
-					TFixed dt = ComputeGradient(patchData, iGradDataT[idx]);
+			// iCells[i] is a vector of pairs
+			Int numPixels = iCells[i].size();
+			for (Int j = 0; j < numPixels; ++j) {
+				Int x = iCells[i][j].first;
+				Int y = iCells[i][j].second;
 
-					Int idxQ = iQuantizer(dr, dt);
-					++pdf[idxQ];
-				}
+				Int idx = (x << iLog2PatchStride) + y;
 
-				// normalize pdf
-				Int sum = 0;
-				for (Int j = 0; j < numBins; ++j) sum += pdf[j];
-				Float sumInv = 1.0 / sum;
-				
-				for (Int j = 0; j < numBins; ++j) {
-					desc[descIdx] = pdf[j] * sumInv;
-					++descIdx;
-				}
+				TFixed dr = ComputeGradient(aImage, patchData, iGradDataR[idx], aScratch.baselineTable);
+				TFixed dt = ComputeGradient(aImage, patchData, iGradDataT[idx], aScratch.baselineTable);
+
+				Int idxQ = iQuantizer(dr, dt);
+				++pdf[idxQ];
 			}
 
+			// normalize pdf
+			Int sum = 0;
+			for (Int j = 0; j < numBins; ++j) sum += pdf[j];
+			Float sumInv = 1.0 / sum;
+			
+			for (Int j = 0; j < numBins; ++j) {
+				desc[descIdx] = pdf[j] * sumInv;
+				++descIdx;
+			}
+		}
+
 #ifndef USE_RIFF_POLAR
-			// new order speeds up distance computation
-			// sorted by variance
-			ReOrderDescriptor(desc);
+		// new order speeds up distance computation
+		// sorted by variance
+		ReOrderDescriptor(desc);
 #endif
 
-			// store feature
-			aFeatureStore.Append(desc, aFrames[k], aImageID);
-		}
+		return true;
+	}
+
+	// matlab (1 based) index of the value stored at each descriptor index
+	static const Int *ReOrderTable() {
+		static const Int idx[KReOrderDim] = {88,63,38,13,5,21,1,25,23,3,8,18,43,68,33,93,58,83,26,30,50,46,37,39,4,2,28,24,62,22,64,87,51,89,55,14,12,48,71,75,76,80,53,100,96,78,73,98,15,11,9,17,19,7,42,44,32,34,36,40,67,10,69,57,59,16,6,20,61,27,92,29,65,94,82,84,49,47,86,90,52,41,35,31,45,54,74,72,77,99,79,97,66,60,70,56,85,91,81,95};
+		return idx;
 	}
 
 	inline void ReOrderDescriptor(Descriptor &aDesc) {
-		static Int idx[] = {88,63,38,13,5,21,1,25,23,3,8,18,43,68,33,93,58,83,26,30,50,46,37,39,4,2,28,24,62,22,64,87,51,89,55,14,12,48,71,75,76,80,53,100,96,78,73,98,15,11,9,17,19,7,42,44,32,34,36,40,67,10,69,57,59,16,6,20,61,27,92,29,65,94,82,84,49,47,86,90,52,41,35,31,45,54,74,72,77,99,79,97,66,60,70,56,85,91,81,95};
+		const Int *idx = ReOrderTable();
 
 		Int dim = aDesc.size();
 		Descriptor tempDesc = aDesc;
@@ -293,8 +478,7 @@ public:
 		}
 	}
 	
-	inline TFixed ComputeGradient(PatchData &pd, GradientData &gd) {
-		Image<Byte> &image = *iImage;
+	inline TFixed ComputeGradient(Image<Byte> &image, PatchData &pd, GradientData &gd, vector<TFixed> &aBaselineTable) {
 
 		// compute finite difference
 		TFixed grad;
@@ -303,14 +487,13 @@ public:
 		grad -= image(gd.x1 + pd.xStart, gd.y1 + pd.yStart);
 		
 		// includes intensity normalization
-		grad *= iBaselineTable[gd.baselineIdx];
+		grad *= aBaselineTable[gd.baselineIdx];
 
 		return grad;
 	}
 
 	// single pass variance
-	void ComputeVariance(PatchData &aPatchData, Float &aMean, Float &aVariance) {
-		Image<Byte> &image = *iImage;
+	void ComputeVariance(Image<Byte> &image, PatchData &aPatchData, Float &aMean, Float &aVariance) {
 
 		// var = E[(x-E[x])^2] 
 		//     = E[x^2] - E[x]^2
@@ -440,10 +623,9 @@ public:
 		aGradData.baselineIdx = baselineIdx;
 	}
 	
-	void ComputePatchData(Frame &aFrame, PatchData &aData) {
+	void ComputePatchData(Frame &aFrame, Image<Byte> &image, PatchData &aData) {
 		aData.octave = Int(aFrame[KScl]);
 
-		Image<Byte> &image = *iImage;
 		Int width = image.Width();
 		Int height = image.Height();
 
@@ -479,6 +661,12 @@ public:
 		DetectInterestPoints(aImage, aFrames, 0, -1);
 	}
 	virtual void DetectInterestPoints(Image<Byte> &aImage, FrameArray &aFrames, Float aThresh, Int aMaxFeatures, Float aScale = 0) {
+		// stripes need room for the FAST border above and below
+		if (IsParallel() && aImage.Height() >= 8 * iThreadPool->NumThreads()) {
+			DetectInterestPointsParallel(aImage, aFrames, aThresh, aMaxFeatures, aScale);
+			return;
+		}
+
 		FAST fast;
 
 		// run FAST
@@ -498,19 +686,7 @@ public:
 		nonmax = fast.nonmax_suppression(corners, scores, numCorners, &nonMaxCorners);
 
 		// copy results
-		Int frameSize = 5;
-		Frame frame(frameSize);
-		for (Int i = 0; i < nonMaxCorners; ++i) {
-			frame[KX] = nonmax[i].x;
-			frame[KY] = nonmax[i].y;
-			frame[KScl] = aScale;
-			frame[KOri] = 0;
-			frame[KRes] = -scores[i];
-
-			if (scores[i] < aThresh) continue;
-
-			aFrames.Append(frame);
-		}
+		AppendCorners(nonmax, nonMaxCorners, scores, aFrames, aThresh, aScale);
 
 		free(corners);
 		free(scores);
@@ -522,6 +698,131 @@ public:
 		}
 	}
 
+	// FAST over horizontal stripes, gives the same frames as the serial path
+	void DetectInterestPointsParallel(Image<Byte> &aImage, FrameArray &aFrames, Float aThresh, Int aMaxFeatures, Float aScale = 0) {
+		DetectTask task;
+		task.im = aImage.PixelPointer(0,0);
+		task.width = aImage.Width();
+		task.height = aImage.Height();
+
+		// FAST only fires on rows [3, h-3)
+		Int numStripes = iThreadPool->NumThreads();
+		Int rows = task.height - 6;
+		task.stripes.resize(numStripes);
+		for (Int s = 0; s < numStripes; ++s) {
+			task.stripes[s].y0 = 3 + s * rows / numStripes;
+			task.stripes[s].y1 = 3 + (s + 1) * rows / numStripes;
+		}
+
+		// detect and score each stripe
+		iThreadPool->Run(numStripes, DetectStripeFunction, &task);
+
+		// stitch into one raster ordered list
+		task.numCorners = 0;
+		for (Int s = 0; s < numStripes; ++s) {
+			task.stripes[s].first = task.numCorners;
+			task.numCorners += task.stripes[s].numCorners;
+		}
+
+		Int size = task.numCorners > 0 ? task.numCorners : 1;
+		task.corners = (xy *)malloc(size * sizeof(xy));
+		task.scores = (Int *)malloc(size * sizeof(Int));
+		for (Int s = 0; s < numStripes; ++s) {
+			Stripe &stripe = task.stripes[s];
+			for (Int i = 0; i < stripe.numCorners; ++i) {
+				task.corners[stripe.first + i] = stripe.corners[i];
+				task.scores[stripe.first + i] = stripe.scores[i];
+			}
+			free(stripe.corners);
+			free(stripe.scores);
+			stripe.corners = NULL;
+			stripe.scores = NULL;
+		}
+
+		// non-max suppression per stripe, with the neighboring rows as overlap
+		iThreadPool->Run(numStripes, NonmaxStripeFunction, &task);
+
+		vector<xy> nonmax;
+		for (Int s = 0; s < numStripes; ++s) {
+			vector<xy> &stripeNonmax = task.stripes[s].nonmax;
+			nonmax.insert(nonmax.end(), stripeNonmax.begin(), stripeNonmax.end());
+		}
+
+		// copy results
+		Int numNonmax = nonmax.size();
+		if (numNonmax > 0) {
+			AppendCorners(&nonmax[0], numNonmax, task.scores, aFrames, aThresh, aScale);
+		}
+
+		free(task.corners);
+		free(task.scores);
+
+		if (aMaxFeatures >= 0 && aFrames.Size() > aMaxFeatures) {
+			aFrames.Sort(KRes);
+			aFrames.Resize(aMaxFeatures);
+		}
+	}
+
+	static void DetectStripeFunction(void *aArg, Int aTask, Int /* aThread */) {
+		DetectTask &task = *(DetectTask *)aArg;
+		Stripe &stripe = task.stripes[aTask];
+		FAST fast;
+
+		// run FAST on a sub image that includes the 3 row border
+		Int top = stripe.y0 - 3;
+		Byte *im = task.im + top * task.width;
+		Int h = stripe.y1 - stripe.y0 + 6;
+
+		Int numCorners;
+		stripe.corners = fast.fast9_detect(im, task.width, h, task.width, iThresh, &numCorners);
+		for (Int i = 0; i < numCorners; ++i) stripe.corners[i].y += top;
+
+		stripe.scores = fast.fast9_score(task.im, task.width, stripe.corners, numCorners, iThresh);
+		stripe.numCorners = numCorners;
+	}
+
+	static void NonmaxStripeFunction(void *aArg, Int aTask, Int /* aThread */) {
+		DetectTask &task = *(DetectTask *)aArg;
+		Stripe &stripe = task.stripes[aTask];
+		FAST fast;
+
+		// extend the range by one row of corners on either side
+		Int begin = stripe.first;
+		Int end = stripe.first + stripe.numCorners;
+		while (begin > 0 && task.corners[begin-1].y >= stripe.y0 - 1) --begin;
+		while (end < task.numCorners && task.corners[end].y <= stripe.y1) ++end;
+
+		stripe.nonmax.resize(0);
+		if (end <= begin) return;
+
+		Int numNonmax;
+		xy *nonmax = fast.nonmax_suppression(task.corners + begin, task.scores + begin, end - begin, &numNonmax);
+
+		// keep only the corners that belong to this stripe
+		for (Int i = 0; i < numNonmax; ++i) {
+			if (nonmax[i].y < stripe.y0 || nonmax[i].y >= stripe.y1) continue;
+			stripe.nonmax.push_back(nonmax[i]);
+		}
+
+		free(nonmax);
+	}
+
+	void AppendCorners(xy *aNonmax, Int aNumNonmax, Int *aScores, FrameArray &aFrames, Float aThresh, Float aScale) {
+		Int frameSize = 5;
+		Frame frame(frameSize);
+		for (Int i = 0; i < aNumNonmax; ++i) {
+			frame[KX] = aNonmax[i].x;
+			frame[KY] = aNonmax[i].y;
+			frame[KScl] = aScale;
+			frame[KOri] = 0;
+			frame[KRes] = -aScores[i];
+
+			if (aScores[i] < aThresh) continue;
+
+			aFrames.Append(frame);
+		}
+	}
+
 	template<class T>
 	inline T Floor(T x) {
 		if (x < 0) return (T) Int(x-1);
@@ -555,16 +856,19 @@ public:
 	Int iNumOctaves;
 	Int iScalesPerOctave;
 
+	// bit tests of the binary mode, see SetBinaryBits
+	BinaryTests iBinaryTests;
+
 private:
 	Int iPatchSize;
 	Int iLog2PatchStride;
 
-	Image<Byte> *iImage;
-
 	Image<Byte> iGradDir;
 	vector<GradientData> iGradDataT;
 	vector<GradientData> iGradDataR;
-	vector<TFixed> iBaselineTable;
+
+	ThreadPool *iThreadPool;
+	vector<Scratch> iScratch;
 
 	Quantizer iQuantizer;
 
@@ -578,6 +882,9 @@ private:
 	const static Int KOri = 3;
 	const static Int KRes = 4;
 
+	// length of the descriptor ReOrderDescriptor knows
+	const static Int KReOrderDim = 100;
+
 	const static Float KPi = 3.14159265358979;
 };
 
@@ -7,11 +7,13 @@
 #include "cbir/types.h"
 #include "cbir/Image.h"
 #include "cbir/FastKLDistance.h"
+#include "cbir/BinaryDescriptor.h"
 #include "cbir/AffineSolver.h"
 #include "cbir/ImageIO.h"
 #include "cbir/Quantizers.h"
 #include "cbir/RifFeatureExtractor.h"
 #include "cbir/FeatureHash.h"
+#include "cbir/PhaseCorrelation.h"
 
 class RifTrack {
 public:
@@ -47,10 +49,19 @@ public:
 		iThresh = 1.0;
 		iEarlyTermThresh = 0.5;
 #endif
+		iBinaryThresh = 0;
+		iBinaryEarlyTermThresh = 0;
+
 		iMaxFeatures = 100;	// affects speed
 		iBinSize = 8;
 		iMinTrackedPoints = 3;
 
+		// global motion pre-alignment, seeds the feature search
+		iUsePhaseCorrelation = false;
+		iShiftX = 0;
+		iShiftY = 0;
+		iShiftValid = false;
+
 		iFrameNumber = 0;
 
 		InitTransform(iTransform);
@@ -66,13 +77,34 @@ public:
 		// initialize feature store buffer
 		iBufferSize = 5;
 		iFeatureStores.resize(iBufferSize);
+		iBinaryStores.resize(iBufferSize);
 		iQueue.Construct(iBufferSize);
+		iCurrBits = NULL;
+		iPrevBits = NULL;
 
 		iCurrIndex = 0;
 	}
 
+	// extract features on aNumThreads threads, 1 is serial
+	void SetNumThreads(Int aNumThreads) {
+		iThreadPool.Construct(aNumThreads);
+		iRif.SetThreadPool(aNumThreads > 1 ? &iThreadPool : NULL);
+	}
+
+	// Match with aNumBits binary descriptors and the Hamming distance
+	// instead of the KL distance, 0 goes back to the KL distance.
+	void SetBinaryDescriptors(Int aNumBits) {
+		iRif.SetBinaryBits(aNumBits);
+
+		// fractions of the bits that differ
+		Int numBits = iRif.BinaryBits();
+		iBinaryThresh = numBits / 8;
+		iBinaryEarlyTermThresh = numBits / 32;
+	}
+
 	FeatureStore *GetNextFeatureStore() {
 		FeatureStore *pointer = &iFeatureStores[iCurrIndex];
+		iCurrBits = &iBinaryStores[iCurrIndex];
 		++iCurrIndex;
 
 		if (iCurrIndex >= iBufferSize) iCurrIndex = 0;
@@ -93,9 +125,19 @@ public:
 		Float thresh = 0.0;
 		iCurrFeatureStore->Resize(0);
 		iRif.ExtractFeatures(aImage, *iCurrFeatureStore, iFrameNumber, thresh, iMaxFeatures);
+		iCurrBits->resize(0);
+		if (iRif.BinaryBits() > 0) iRif.Binarize(*iCurrFeatureStore, *iCurrBits);
 		iMatches.resize(0);
 		aMatchedPoints.resize(0);
 
+		// estimate the dominant translation from the previous frame
+		iShiftX = 0;
+		iShiftY = 0;
+		iShiftValid = false;
+		if (iUsePhaseCorrelation) {
+			iShiftValid = iPhaseCorr.Estimate(aImage, iShiftX, iShiftY);
+		}
+
 		AffineSolver affine;
 		InitTransform(iTransform);
 
@@ -130,6 +172,12 @@ public:
 			if (numMatches >= iMinTrackedPoints) {
 				affine.ComputeTransform(iTransform);
 				valid = true;
+
+			// fall back to the global shift rather than losing track
+			} else if (iShiftValid) {
+				iTransform[2] = iShiftX;
+				iTransform[5] = iShiftY;
+				valid = true;
 			}
 
 			iCumulativeTransform = AffineSolver::AffineMultiply(iCumulativeTransform, iTransform);
@@ -145,6 +193,7 @@ public:
 		// set pointer to previous frame store
 		Int len = iQueue.Size();
 		iPrevFeatureStore = iQueue[len-1];
+		iPrevBits = iCurrBits;
 
 		// increment frame count
 		++iFrameNumber;
@@ -220,31 +269,43 @@ public:
 		Frame &frame = iCurrFeatureStore->GetFrame(aIndex);
 		Descriptor &desc = iCurrFeatureStore->GetDescriptor(aIndex);
 
-		vector<Int> &neighbors = iPrevHashTable.GetNeighbors(frame);
+		// search around where the feature was before the global shift
+		vector<Int> &neighbors = iShiftValid ?
+			iPrevHashTable.GetNeighbors(frame[KX] - iShiftX, frame[KY] - iShiftY) :
+			iPrevHashTable.GetNeighbors(frame);
 		Int num = neighbors.size();
 
 		// enforce a maximum number of comparisons
 		Int maxCompares = 8;
 		num = FeatureHash::Min(num, maxCompares);
 
+		// binary only if both frames have binary descriptors
+		Bool binary = !iCurrBits->empty() && (Int) iPrevBits->size() == iPrevFeatureStore->Size();
+		Float thresh = binary ? iBinaryThresh : iThresh;
+		Float earlyTermThresh = binary ? iBinaryEarlyTermThresh : iEarlyTermThresh;
+
 		Int minIdx = -1;
 		Float minDist = ns::numeric_limits<Float>::max();
 		for (Int i = 0; i < num; ++i) {
 			Int j = neighbors[i];
 
-			Descriptor &prevDesc = iPrevFeatureStore->GetDescriptor(j);
-
-			Float dist = iDist(desc, prevDesc);
+			Float dist;
+			if (binary) {
+				dist = iHamming((*iCurrBits)[aIndex], (*iPrevBits)[j]);
+			} else {
+				Descriptor &prevDesc = iPrevFeatureStore->GetDescriptor(j);
+				dist = iDist(desc, prevDesc);
+			}
 
 			// terminate early if we have a very good match
-			if (dist < iEarlyTermThresh) {
+			if (dist < earlyTermThresh) {
 				minIdx = j;
 				minDist = dist;
 				break;
 			}
 
 			// otherwise find the best match so far subject to a threshold
-			if (dist < minDist && dist < iThresh) {
+			if (dist < minDist && dist < thresh) {
 				minIdx = j;
 				minDist = dist;
 			}
@@ -324,15 +385,28 @@ public:	// members
 	vector< pair<Int,Int> > iMatches;
 
 	FastKLDistance iDist;
+	HammingDistance iHamming;
 
 	RifFeatureExtractor<QuantizerType> iRif;
+	ThreadPool iThreadPool;
 	
 	FeatureHash iPrevHashTable;
+
+	PhaseCorrelation iPhaseCorr;
+	Bool iUsePhaseCorrelation;
+	Bool iShiftValid;
+	Float iShiftX;
+	Float iShiftY;
 	
 	FeatureStore *iCurrFeatureStore;
 	FeatureStore *iPrevFeatureStore;
 	vector<FeatureStore> iFeatureStores;
 	RingBuffer<FeatureStore *> iQueue;
+
+	// binary descriptors of each feature store, empty if not in binary mode
+	vector< vector<BinaryDescriptor> > iBinaryStores;
+	vector<BinaryDescriptor> *iCurrBits;
+	vector<BinaryDescriptor> *iPrevBits;
 	RingBuffer<Int> iFrameNumbers;
 	Int iCurrIndex;
 	Int iBufferSize;
@@ -347,6 +421,8 @@ public:	// members
 
 	Float iThresh;
 	Float iEarlyTermThresh;
+	Int iBinaryThresh;		// in bits
+	Int iBinaryEarlyTermThresh;
 
 	vector<Float> iTransform;
 	vector<Float> iCumulativeTransform;
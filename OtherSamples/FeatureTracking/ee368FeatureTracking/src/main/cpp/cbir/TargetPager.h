@@ -0,0 +1,653 @@
+#ifndef TARGET_PAGER_H
+#define TARGET_PAGER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+#include "cbir/MatchTarget.h"
+
+// Target database for catalogues that don't fit in memory.
+//
+// The file starts with a two level vocabulary of quantized descriptors and a
+// small index entry per target, which stay resident together with an
+// inverted file of vocabulary words. These pick the candidate targets of a
+// query. The frames and descriptors of a target are in a block of their own,
+// mapped in when the target is searched and cached under a memory budget,
+// least recently used out first. The descriptors are either the quantized
+// histograms or, for a binary database, only their packed bits.
+class TargetPager {
+	typedef MatchTarget::DbDescType DbDescType;
+
+	// resident part of a target
+	class Entry {
+	public:
+		IDType id;
+		string label;
+		Int width;
+		Int height;
+		Int numFeatures;
+		Int64 offset;		// of the block in the file
+		Int numWords;		// distinct vocabulary words
+
+		MatchTarget *target;	// NULL while paged out
+		Int64 bytes;
+		Int lastUse;
+	};
+
+public:
+	TargetPager() {
+		iFile = -1;
+		iBranch = 0;
+		iDescDim = 0;
+		iFrameDim = 0;
+		iNumBits = 0;
+		iBitWords = 0;
+		iBudget = 0;
+		iResident = 0;
+		iClock = 0;
+
+		pthread_mutex_init(&iMutex, NULL);
+	}
+	~TargetPager() {
+		Close();
+
+		pthread_mutex_destroy(&iMutex);
+	}
+
+	// Writes aTargets to aFile. aVocab has aBranch^2 words, see
+	// TrainVocabulary, and every target has its words from AssignWords.
+	// With aNumBits > 0 the blocks keep the binary descriptors of the
+	// targets, otherwise their quantized descriptors.
+	static Bool Write(Char *aFile, vector<MatchTarget *> &aTargets, vector<DbDescType> &aVocab, Int aBranch, Int aNumBits) {
+		Int numTargets = aTargets.size();
+		if (numTargets == 0 || aBranch <= 0 || aVocab.empty()) return false;
+
+		Int descDim = aVocab.size() / (aBranch + aBranch * aBranch);
+		Int bitWords = (aNumBits + 31) / 32;
+
+		// all targets must have the same dimensions
+		Int frameDim = 0;
+		for (Int i = 0; i < numTargets; ++i) {
+			MatchTarget &target = *aTargets[i];
+			if (target.Size() == 0) continue;
+
+			if (frameDim == 0) frameDim = target.iFrames[0].Size();
+			if (aNumBits > 0 && (Int) target.iBinary.size() != target.Size()) return false;
+			if (aNumBits == 0 && (Int) target.iDescriptors.size() != target.Size()) return false;
+
+			for (Int j = 0; j < target.Size(); ++j) {
+				if (target.iFrames[j].Size() != frameDim) return false;
+				if (aNumBits > 0 && (Int) target.iBinary[j].size() != bitWords) return false;
+				if (aNumBits == 0 && (Int) target.iDescriptors[j].size() != descDim) return false;
+			}
+		}
+		Int descBytes = aNumBits > 0 ? bitWords * sizeof(Uint32) : descDim;
+
+		// blocks follow the index
+		Int64 offset = 7 * sizeof(Int) + aVocab.size();
+		for (Int i = 0; i < numTargets; ++i) {
+			offset += 5 * sizeof(Int) + sizeof(Int64) + aTargets[i]->iLabel.size();
+			offset += (1 + aTargets[i]->iWords.size()) * sizeof(Int);
+		}
+
+		FILE *file = fopen(aFile, "wb");
+		if (!file) return false;
+
+		Int header[7] = {KMagic, KVersion, descDim, frameDim, aBranch, aNumBits, numTargets};
+		fwrite(header, sizeof(Int), 7, file);
+		fwrite(&aVocab[0], 1, aVocab.size(), file);
+
+		for (Int i = 0; i < numTargets; ++i) {
+			MatchTarget &target = *aTargets[i];
+
+			Int labelSize = target.iLabel.size();
+			Int entry[4] = {target.iId, target.iWidth, target.iHeight, target.Size()};
+			fwrite(entry, sizeof(Int), 4, file);
+			fwrite(&offset, sizeof(Int64), 1, file);
+			fwrite(&labelSize, sizeof(Int), 1, file);
+			fwrite(target.iLabel.c_str(), 1, labelSize, file);
+
+			Int numWords = target.iWords.size();
+			fwrite(&numWords, sizeof(Int), 1, file);
+			if (numWords > 0) fwrite(&target.iWords[0], sizeof(Int), numWords, file);
+
+			offset += Int64(target.Size()) * (frameDim * sizeof(Float) + descBytes);
+		}
+
+		for (Int i = 0; i < numTargets; ++i) {
+			MatchTarget &target = *aTargets[i];
+			for (Int j = 0; j < target.Size(); ++j) {
+				for (Int k = 0; k < frameDim; ++k) {
+					Float value = target.iFrames[j][k];
+					fwrite(&value, sizeof(Float), 1, file);
+				}
+			}
+			for (Int j = 0; j < target.Size(); ++j) {
+				if (aNumBits > 0) fwrite(&target.iBinary[j][0], sizeof(Uint32), bitWords, file);
+				else fwrite(&target.iDescriptors[j][0], 1, descDim, file);
+			}
+		}
+
+		Bool ok = !ferror(file);
+		fclose(file);
+		return ok;
+	}
+
+	// Reads the index of aFile, blocks are cached up to aBudget bytes. The
+	// targets get the ids aFirstId on, in file order, so that they don't
+	// collide with the ids of the reader.
+	Bool Open(Char *aFile, Int64 aBudget, IDType aFirstId) {
+		Close();
+
+		FILE *file = fopen(aFile, "rb");
+		if (!file) return false;
+
+		fseek(file, 0, SEEK_END);
+		Int64 fileSize = ftell(file);
+		rewind(file);
+
+		pthread_mutex_lock(&iMutex);
+		Bool ok = ReadIndex(file, fileSize, aFirstId);
+		fclose(file);
+
+		if (ok) iFile = open(aFile, O_RDONLY);
+		if (iFile >= 0) {
+			BuildInvertedFile();
+		} else {
+			ok = false;
+			ClearIndex();
+		}
+		iBudget = aBudget;
+		pthread_mutex_unlock(&iMutex);
+
+		return ok;
+	}
+
+	// cached targets stay valid for the queries that hold them
+	void Close() {
+		pthread_mutex_lock(&iMutex);
+		Int numLoaded = iLoaded.size();
+		for (Int i = 0; i < numLoaded; ++i) {
+			Entry &entry = iEntries[iLoaded[i]];
+			if (entry.target->Release()) delete entry.target;
+			entry.target = NULL;
+		}
+		iLoaded.clear();
+		iResident = 0;
+
+		ClearIndex();
+		if (iFile >= 0) close(iFile);
+		iFile = -1;
+		pthread_mutex_unlock(&iMutex);
+	}
+
+	Bool IsOpen() {
+		pthread_mutex_lock(&iMutex);
+		Bool open = iFile >= 0;
+		pthread_mutex_unlock(&iMutex);
+
+		return open;
+	}
+
+	Int Size() {
+		pthread_mutex_lock(&iMutex);
+		Int size = iEntries.size();
+		pthread_mutex_unlock(&iMutex);
+
+		return size;
+	}
+
+	Int64 ResidentBytes() {
+		pthread_mutex_lock(&iMutex);
+		Int64 resident = iResident;
+		pthread_mutex_unlock(&iMutex);
+
+		return resident;
+	}
+
+	// bits of the binary descriptors of the targets, 0 if they keep their
+	// quantized descriptors
+	Int BinaryBits() {
+		pthread_mutex_lock(&iMutex);
+		Int numBits = iNumBits;
+		pthread_mutex_unlock(&iMutex);
+
+		return numBits;
+	}
+
+	// Targets with the most vocabulary words in common with the query,
+	// weighted by how rare the words are, best first.
+	void SelectCandidates(vector< vector<DbDescType> > &aQuery, Int aMaxCandidates, vector<Int> &aCandidates) {
+		aCandidates.clear();
+
+		pthread_mutex_lock(&iMutex);
+		Int numTargets = iEntries.size();
+		Int numQuery = aQuery.size();
+		if (numTargets == 0 || numQuery == 0) {
+			pthread_mutex_unlock(&iMutex);
+			return;
+		}
+
+		vector<Int> words;
+		for (Int i = 0; i < numQuery; ++i) {
+			if ((Int) aQuery[i].size() != iDescDim) continue;
+			words.push_back(Word(&iVocab[0], iBranch, iDescDim, &aQuery[i][0]));
+		}
+		sort(words.begin(), words.end());
+		words.erase(unique(words.begin(), words.end()), words.end());
+
+		vector<Float> scores(numTargets, 0);
+		Int numWords = words.size();
+		for (Int i = 0; i < numWords; ++i) {
+			Int w = words[i];
+			for (Int j = iWordStart[w]; j < iWordStart[w+1]; ++j) {
+				scores[iPostings[j]] += iIdf[w];
+			}
+		}
+
+		vector< pair<Float, Int> > ranked;
+		for (Int i = 0; i < numTargets; ++i) {
+			if (scores[i] <= 0) continue;
+
+			// don't favor targets just for having many features
+			Float score = scores[i] / sqrt(Float(iEntries[i].numWords));
+			ranked.push_back(pair<Float, Int>(-score, i));
+		}
+		pthread_mutex_unlock(&iMutex);
+
+		Int numRanked = ranked.size();
+		Int numCandidates = aMaxCandidates < numRanked ? aMaxCandidates : numRanked;
+		partial_sort(ranked.begin(), ranked.begin() + numCandidates, ranked.end());
+		for (Int i = 0; i < numCandidates; ++i) aCandidates.push_back(ranked[i].second);
+	}
+
+	// Returns the target with a reference for the caller, NULL on a read
+	// error. Loading may evict other targets to stay within the budget, but
+	// never the target itself, which stays resident even if alone it is
+	// larger than the budget.
+	MatchTarget *Acquire(Int aIndex) {
+		pthread_mutex_lock(&iMutex);
+		if (aIndex < 0 || aIndex >= (Int) iEntries.size()) {
+			pthread_mutex_unlock(&iMutex);
+			return NULL;
+		}
+
+		Entry &entry = iEntries[aIndex];
+		if (!entry.target) {
+			entry.target = Load(entry);
+			if (!entry.target) {
+				pthread_mutex_unlock(&iMutex);
+				return NULL;
+			}
+
+			entry.bytes = entry.target->Bytes();
+			iResident += entry.bytes;
+			iLoaded.push_back(aIndex);
+		}
+		entry.lastUse = ++iClock;
+
+		MatchTarget *target = entry.target;
+		target->Retain();
+
+		Evict(aIndex);
+		pthread_mutex_unlock(&iMutex);
+
+		return target;
+	}
+
+	// nearest vocabulary word of a descriptor
+	static Int Word(DbDescType *aVocab, Int aBranch, Int aDescDim, DbDescType *aDesc) {
+		Int top = Nearest(aVocab, aBranch, aDescDim, aDesc);
+
+		DbDescType *leaves = aVocab + (aBranch + top * aBranch) * aDescDim;
+		Int leaf = Nearest(leaves, aBranch, aDescDim, aDesc);
+
+		return top * aBranch + leaf;
+	}
+
+	// aBranch top level words, each split in aBranch leaves, trained on a
+	// sample of the quantized descriptors of aTargets
+	static void TrainVocabulary(vector<MatchTarget *> &aTargets, Int aDescDim, Int aBranch, vector<DbDescType> &aVocab) {
+		// evenly spaced sample of the descriptors
+		Int total = 0;
+		Int numTargets = aTargets.size();
+		for (Int i = 0; i < numTargets; ++i) total += aTargets[i]->Size();
+
+		Int step = total / KMaxSamples + 1;
+		vector<DbDescType *> samples;
+		Int count = 0;
+		for (Int i = 0; i < numTargets; ++i) {
+			MatchTarget &target = *aTargets[i];
+			for (Int j = 0; j < target.Size(); ++j, ++count) {
+				if (count % step == 0) samples.push_back(&target.iDescriptors[j][0]);
+			}
+		}
+
+		aVocab.resize((aBranch + aBranch * aBranch) * aDescDim);
+
+		vector<Int> labels;
+		KMeans(samples, aDescDim, aBranch, &aVocab[0], labels);
+
+		Int numSamples = samples.size();
+		for (Int c = 0; c < aBranch; ++c) {
+			vector<DbDescType *> members;
+			for (Int i = 0; i < numSamples; ++i) {
+				if (labels[i] == c) members.push_back(samples[i]);
+			}
+
+			// a cluster without samples splits into copies of itself
+			if (members.empty()) members.push_back(&aVocab[c * aDescDim]);
+
+			vector<Int> leafLabels;
+			DbDescType *leaves = &aVocab[(aBranch + c * aBranch) * aDescDim];
+			KMeans(members, aDescDim, aBranch, leaves, leafLabels);
+		}
+	}
+
+	// the distinct words of the quantized descriptors of aTarget
+	static void AssignWords(DbDescType *aVocab, Int aBranch, Int aDescDim, MatchTarget &aTarget) {
+		aTarget.iWords.clear();
+		for (Int j = 0; j < aTarget.Size(); ++j) {
+			aTarget.iWords.push_back(Word(aVocab, aBranch, aDescDim, &aTarget.iDescriptors[j][0]));
+		}
+		sort(aTarget.iWords.begin(), aTarget.iWords.end());
+		aTarget.iWords.erase(unique(aTarget.iWords.begin(), aTarget.iWords.end()), aTarget.iWords.end());
+	}
+
+private:
+	static Int Nearest(DbDescType *aCenters, Int aNumCenters, Int aDescDim, DbDescType *aDesc) {
+		Int best = 0;
+		Int bestDist = numeric_limits<Int>::max();
+		for (Int c = 0; c < aNumCenters; ++c) {
+			DbDescType *center = aCenters + c * aDescDim;
+
+			Int dist = 0;
+			for (Int i = 0; i < aDescDim && dist < bestDist; ++i) {
+				Int d = Int(center[i]) - Int(aDesc[i]);
+				dist += d * d;
+			}
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = c;
+			}
+		}
+		return best;
+	}
+
+	// Lloyd's algorithm, centers start at evenly spaced samples
+	static void KMeans(vector<DbDescType *> &aSamples, Int aDescDim, Int aK, DbDescType *aCenters, vector<Int> &aLabels) {
+		Int numSamples = aSamples.size();
+		aLabels.assign(numSamples, 0);
+
+		for (Int c = 0; c < aK; ++c) {
+			DbDescType *sample = aSamples[(Int64(c) * numSamples / aK) % numSamples];
+			memcpy(aCenters + c * aDescDim, sample, aDescDim);
+		}
+
+		vector<Float> sums(aK * aDescDim);
+		vector<Int> counts(aK);
+		for (Int iter = 0; iter < KIterations; ++iter) {
+			for (Int i = 0; i < numSamples; ++i) {
+				aLabels[i] = Nearest(aCenters, aK, aDescDim, aSamples[i]);
+			}
+
+			fill(sums.begin(), sums.end(), 0);
+			fill(counts.begin(), counts.end(), 0);
+			for (Int i = 0; i < numSamples; ++i) {
+				Float *sum = &sums[aLabels[i] * aDescDim];
+				for (Int j = 0; j < aDescDim; ++j) sum[j] += aSamples[i][j];
+				++counts[aLabels[i]];
+			}
+
+			// empty clusters keep their center
+			for (Int c = 0; c < aK; ++c) {
+				if (counts[c] == 0) continue;
+				for (Int j = 0; j < aDescDim; ++j) {
+					aCenters[c * aDescDim + j] = DbDescType(sums[c * aDescDim + j] / counts[c] + 0.5);
+				}
+			}
+		}
+	}
+
+	// true if aBytes more bytes can be read from aFile of aFileSize bytes
+	static Bool Fits(FILE *aFile, Int64 aFileSize, Int64 aBytes) {
+		return aBytes >= 0 && aBytes <= aFileSize - ftell(aFile);
+	}
+
+	// Every count is checked against what is left of the file and every
+	// word against the vocabulary, so a damaged file fails here instead of
+	// in BuildInvertedFile or Load. Call with iMutex held.
+	Bool ReadIndex(FILE *aFile, Int64 aFileSize, IDType aFirstId) {
+		Int header[7];
+		if (fread(header, sizeof(Int), 7, aFile) != 7) return false;
+		if (header[0] != KMagic || header[1] != KVersion) return false;
+
+		iDescDim = header[2];
+		iFrameDim = header[3];
+		iBranch = header[4];
+		iNumBits = header[5];
+		Int numTargets = header[6];
+		if (iDescDim <= 0 || iFrameDim < 0 || iBranch <= 0 || iNumBits < 0 || numTargets < 0) return false;
+		iBitWords = (Int64(iNumBits) + 31) / 32;
+
+		// the vocabulary alone bounds the branch factor by the file size
+		Int64 vocabSize = (Int64(iBranch) + Int64(iBranch) * iBranch) * iDescDim;
+		if (iBranch > KMaxBranch || !Fits(aFile, aFileSize, vocabSize)) return false;
+
+		iVocab.resize(vocabSize);
+		if (fread(&iVocab[0], 1, iVocab.size(), aFile) != iVocab.size()) return false;
+
+		// smallest index entry, an empty label and no words
+		Int64 minEntry = 6 * sizeof(Int) + sizeof(Int64);
+		if (!Fits(aFile, aFileSize, Int64(numTargets) * minEntry)) return false;
+
+		Int numWords = iBranch * iBranch;
+		Int64 descBytes = iNumBits > 0 ? Int64(iBitWords) * sizeof(Uint32) : iDescDim;
+		Int64 featureBytes = iFrameDim * sizeof(Float) + descBytes;
+
+		iEntries.resize(numTargets);
+		iTargetWords.clear();
+		iTargetWordStart.assign(1, 0);
+		for (Int i = 0; i < numTargets; ++i) {
+			Entry &entry = iEntries[i];
+
+			Int values[4];
+			Int labelSize;
+			if (fread(values, sizeof(Int), 4, aFile) != 4) return false;
+			if (fread(&entry.offset, sizeof(Int64), 1, aFile) != 1) return false;
+			if (fread(&labelSize, sizeof(Int), 1, aFile) != 1) return false;
+
+			// values[0] is the id in the writer
+			entry.id = aFirstId + i;
+			entry.width = values[1];
+			entry.height = values[2];
+			entry.numFeatures = values[3];
+
+			if (entry.numFeatures < 0 || entry.offset < 0) return false;
+			if (entry.offset > aFileSize - entry.numFeatures * featureBytes) return false;
+			if (!Fits(aFile, aFileSize, labelSize)) return false;
+
+			vector<Char> label(labelSize + 1, 0);
+			if (labelSize > 0 && fread(&label[0], 1, labelSize, aFile) != (size_t) labelSize) return false;
+			entry.label = &label[0];
+
+			if (fread(&entry.numWords, sizeof(Int), 1, aFile) != 1) return false;
+			if (!Fits(aFile, aFileSize, Int64(entry.numWords) * sizeof(Int))) return false;
+
+			Int first = iTargetWords.size();
+			iTargetWords.resize(first + entry.numWords);
+			if (entry.numWords > 0 && fread(&iTargetWords[first], sizeof(Int), entry.numWords, aFile) != (size_t) entry.numWords) return false;
+			for (Int j = first; j < (Int) iTargetWords.size(); ++j) {
+				if (iTargetWords[j] < 0 || iTargetWords[j] >= numWords) return false;
+			}
+			iTargetWordStart.push_back(iTargetWords.size());
+
+			entry.target = NULL;
+			entry.bytes = 0;
+			entry.lastUse = 0;
+		}
+		return true;
+	}
+
+	// word -> targets, and the word weights. Call with iMutex held.
+	void BuildInvertedFile() {
+		Int numWords = iBranch * iBranch;
+		Int numTargets = iEntries.size();
+
+		iWordStart.assign(numWords + 1, 0);
+		Int numPostings = iTargetWords.size();
+		for (Int i = 0; i < numPostings; ++i) ++iWordStart[iTargetWords[i] + 1];
+		for (Int w = 0; w < numWords; ++w) iWordStart[w+1] += iWordStart[w];
+
+		iPostings.resize(numPostings);
+		vector<Int> next(iWordStart.begin(), iWordStart.end() - 1);
+		for (Int i = 0; i < numTargets; ++i) {
+			for (Int j = iTargetWordStart[i]; j < iTargetWordStart[i+1]; ++j) {
+				iPostings[next[iTargetWords[j]]++] = i;
+			}
+		}
+
+		iIdf.resize(numWords);
+		for (Int w = 0; w < numWords; ++w) {
+			Int df = iWordStart[w+1] - iWordStart[w];
+			iIdf[w] = df > 0 ? log(Float(numTargets) / df) : 0;
+		}
+
+		// only needed to build the inverted file
+		vector<Int>().swap(iTargetWords);
+		vector<Int>().swap(iTargetWordStart);
+	}
+
+	void ClearIndex() {
+		iEntries.clear();
+		iVocab.clear();
+		iWordStart.clear();
+		iPostings.clear();
+		iIdf.clear();
+		iTargetWords.clear();
+		iTargetWordStart.clear();
+	}
+
+	// maps in the block of a target and copies it out
+	MatchTarget *Load(Entry &aEntry) {
+		MatchTarget *target = new MatchTarget(aEntry.id, aEntry.label);
+		target->iWidth = aEntry.width;
+		target->iHeight = aEntry.height;
+
+		Int numFeatures = aEntry.numFeatures;
+		if (numFeatures == 0) return target;
+
+		Int64 frameBytes = Int64(numFeatures) * iFrameDim * sizeof(Float);
+		Int64 descBytes = iNumBits > 0 ? iBitWords * sizeof(Uint32) : iDescDim;
+		Int64 size = frameBytes + numFeatures * descBytes;
+
+		// mappings start on a page
+		Int64 page = sysconf(_SC_PAGESIZE);
+		Int64 start = aEntry.offset / page * page;
+		Int64 skip = aEntry.offset - start;
+
+		void *map = mmap(NULL, skip + size, PROT_READ, MAP_PRIVATE, iFile, (off_t) start);
+		if (map == MAP_FAILED) {
+			delete target;
+			return NULL;
+		}
+
+		// blocks follow labels of any length, so nothing is aligned
+		Byte *frames = (Byte *)map + skip;
+		Byte *descs = frames + frameBytes;
+
+		Frame frame(iFrameDim);
+		for (Int i = 0; i < numFeatures; ++i) {
+			for (Int k = 0; k < iFrameDim; ++k) {
+				Float value;
+				memcpy(&value, frames + (i * iFrameDim + k) * sizeof(Float), sizeof(Float));
+				frame[k] = value;
+			}
+			target->iFrames.Append(frame);
+		}
+
+		if (iNumBits > 0) {
+			target->iBinary.resize(numFeatures);
+			for (Int i = 0; i < numFeatures; ++i) {
+				target->iBinary[i].resize(iBitWords);
+				memcpy(&target->iBinary[i][0], descs + i * descBytes, descBytes);
+			}
+		} else {
+			target->iDescriptors.resize(numFeatures);
+			for (Int i = 0; i < numFeatures; ++i) {
+				DbDescType *desc = descs + i * descBytes;
+				target->iDescriptors[i].assign(desc, desc + iDescDim);
+			}
+		}
+
+		munmap(map, skip + size);
+		return target;
+	}
+
+	// Drops least recently used targets until within budget, except aKeep,
+	// so the budget may be exceeded by aKeep alone.
+	void Evict(Int aKeep) {
+		while (iResident > iBudget && iLoaded.size() > 1) {
+			Int oldest = -1;
+			Int numLoaded = iLoaded.size();
+			for (Int i = 0; i < numLoaded; ++i) {
+				if (iLoaded[i] == aKeep) continue;
+				if (oldest < 0 || iEntries[iLoaded[i]].lastUse < iEntries[iLoaded[oldest]].lastUse) {
+					oldest = i;
+				}
+			}
+
+			Entry &entry = iEntries[iLoaded[oldest]];
+			iResident -= entry.bytes;
+
+			// queries still searching it keep it alive
+			if (entry.target->Release()) delete entry.target;
+			entry.target = NULL;
+			entry.bytes = 0;
+
+			iLoaded.erase(iLoaded.begin() + oldest);
+		}
+	}
+
+private:
+	const static Int KMagic = 0x42445054;	// "TPDB"
+	const static Int KVersion = 2;
+	const static Int KMaxSamples = 50000;
+	const static Int KIterations = 8;
+	const static Int KMaxBranch = 46340;	// branch^2 words fit an Int
+
+	Int iFile;
+	Int iBranch;
+	Int iDescDim;
+	Int iFrameDim;
+	Int iNumBits;
+	Int iBitWords;
+
+	// resident index
+	vector<Entry> iEntries;
+	vector<DbDescType> iVocab;
+	vector<Int> iWordStart;		// into iPostings, per word
+	vector<Int> iPostings;		// target indices
+	vector<Float> iIdf;
+
+	// words of each target, only while opening
+	vector<Int> iTargetWords;
+	vector<Int> iTargetWordStart;
+
+	// block cache
+	vector<Int> iLoaded;
+	Int64 iBudget;
+	Int64 iResident;
+	Int iClock;
+
+	pthread_mutex_t iMutex;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+#include "cbir/stl.h"
+#include "cbir/types.h"
+
+// Small fixed pool of worker threads for fork/join loops. Run() hands out
+// task indices to the workers and the calling thread, and returns when all
+// tasks are done. Tasks receive the index of the thread running them, in
+// [0, NumThreads()), for per-thread scratch. Run() must not be called from
+// more than one thread at a time.
+class ThreadPool {
+public:
+	typedef void (*TaskFunction)(void *aArg, Int aTask, Int aThread);
+
+	ThreadPool() {
+		Init();
+	}
+	ThreadPool(Int aNumThreads) {
+		Init();
+		Construct(aNumThreads);
+	}
+	~ThreadPool() {
+		StopWorkers();
+
+		pthread_cond_destroy(&iDone);
+		pthread_cond_destroy(&iWake);
+		pthread_mutex_destroy(&iMutex);
+	}
+
+	void Init() {
+		iNumThreads = 1;
+		iQuit = false;
+		iGeneration = 0;
+		iBusy = 0;
+		iNumTasks = 0;
+		iNextTask = 0;
+		iFunction = NULL;
+		iArg = NULL;
+
+		pthread_mutex_init(&iMutex, NULL);
+		pthread_cond_init(&iWake, NULL);
+		pthread_cond_init(&iDone, NULL);
+	}
+
+	// aNumThreads counts the calling thread, 1 runs everything inline
+	void Construct(Int aNumThreads) {
+		StopWorkers();
+
+		iNumThreads = aNumThreads < 1 ? 1 : aNumThreads;
+
+		Int numWorkers = iNumThreads - 1;
+		iWorkers.resize(numWorkers);
+		iWorkerData.resize(numWorkers);
+		for (Int i = 0; i < numWorkers; ++i) {
+			iWorkerData[i].pool = this;
+			iWorkerData[i].thread = i + 1;
+			iWorkerData[i].generation = iGeneration;
+
+			pthread_create(&iWorkers[i], NULL, WorkerThread, &iWorkerData[i]);
+		}
+	}
+
+	Int NumThreads() { return iNumThreads; }
+
+	void Run(Int aNumTasks, TaskFunction aFunction, void *aArg) {
+		if (iNumThreads <= 1 || aNumTasks <= 1) {
+			for (Int i = 0; i < aNumTasks; ++i) aFunction(aArg, i, 0);
+			return;
+		}
+
+		pthread_mutex_lock(&iMutex);
+		iFunction = aFunction;
+		iArg = aArg;
+		iNumTasks = aNumTasks;
+		iNextTask = 0;
+		iBusy = iNumThreads - 1;
+		++iGeneration;
+		pthread_cond_broadcast(&iWake);
+		pthread_mutex_unlock(&iMutex);
+
+		DoTasks(0);
+
+		// wait for the workers to finish their last task
+		pthread_mutex_lock(&iMutex);
+		while (iBusy > 0) pthread_cond_wait(&iDone, &iMutex);
+		pthread_mutex_unlock(&iMutex);
+	}
+
+private:
+	class WorkerData {
+	public:
+		ThreadPool *pool;
+		Int thread;
+		Int generation;
+	};
+
+	// not copyable, workers hold a pointer to the pool
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	static void *WorkerThread(void *aArg) {
+		WorkerData *data = (WorkerData *)aArg;
+		data->pool->WorkerLoop(data->thread, data->generation);
+		return NULL;
+	}
+
+	void WorkerLoop(Int aThread, Int aGeneration) {
+		pthread_mutex_lock(&iMutex);
+		while (true) {
+			while (!iQuit && iGeneration == aGeneration) {
+				pthread_cond_wait(&iWake, &iMutex);
+			}
+			if (iQuit) break;
+			aGeneration = iGeneration;
+			pthread_mutex_unlock(&iMutex);
+
+			DoTasks(aThread);
+
+			pthread_mutex_lock(&iMutex);
+			if (--iBusy == 0) pthread_cond_signal(&iDone);
+		}
+		pthread_mutex_unlock(&iMutex);
+	}
+
+	void DoTasks(Int aThread) {
+		while (true) {
+			pthread_mutex_lock(&iMutex);
+			Int task = iNextTask++;
+			Int numTasks = iNumTasks;
+			pthread_mutex_unlock(&iMutex);
+
+			if (task >= numTasks) break;
+			iFunction(iArg, task, aThread);
+		}
+	}
+
+	void StopWorkers() {
+		pthread_mutex_lock(&iMutex);
+		iQuit = true;
+		pthread_cond_broadcast(&iWake);
+		pthread_mutex_unlock(&iMutex);
+
+		Int numWorkers = iWorkers.size();
+		for (Int i = 0; i < numWorkers; ++i) {
+			pthread_join(iWorkers[i], NULL);
+		}
+		iWorkers.clear();
+		iWorkerData.clear();
+
+		iQuit = false;
+		iNumThreads = 1;
+	}
+
+private:
+	Int iNumThreads;
+	vector<pthread_t> iWorkers;
+	vector<WorkerData> iWorkerData;
+
+	pthread_mutex_t iMutex;
+	pthread_cond_t iWake;
+	pthread_cond_t iDone;
+
+	Bool iQuit;
+	Int iGeneration;
+	Int iBusy;
+
+	TaskFunction iFunction;
+	void *iArg;
+	Int iNumTasks;
+	Int iNextTask;
+};
+
+#endif
@@ -22,6 +22,12 @@ public:
 		iBuildPriority = 10;
 		iQueryPriority = 90;
 
+		// threads that share feature extraction of tracked frames
+		iNumTrackThreads = 2;
+
+		// keep tracking through large motion instead of resetting
+		iTracker.iTracker.iUsePhaseCorrelation = true;
+
 		// init
 		iFrame = 0;
 		iCumModel = AffineSolver::Eye();
@@ -61,13 +67,11 @@ public:
 	//==========================================
 	// thread functions
 
-	// performs querying in separate thread
+	// performs querying in separate thread, started with
+	// iQueryInProgress already set
 	static void *QueryDatabaseThread(void *aArg) {
 		QueryData *data = (QueryData *)aArg;
 
-		if (data->iQueryInProgress) return NULL;
-		data->iQueryInProgress = true;
-	
 		data->iMatcher->Query(*data->iImage, data->iFeatureStore);
 		data->iQueryInProgress = false;
 	
@@ -96,6 +100,9 @@ public:
 		param.sched_priority = iTrackPriority;
 		pthread_setschedparam(pthread_self(), SCHED_RR, &param);
 
+		// started here so the workers inherit the tracking priority
+		if (iFrame == 1) iTracker.iTracker.SetNumThreads(iNumTrackThreads);
+
 		// spawn thread to build database
 		if (!iMatcher.iDbValid && !iQueryData.iBuildingDB) {
 			iQueryData.iBuildingDB = true;
@@ -123,8 +130,10 @@ public:
 
 		// query has finished
 		if (!iQueryData.iQueryInProgress && iMatcher.iDbValid) {
-			// update models
-			vector< vector<Float> > models = iMatcher.iModels;
+			// update models, the targets are held while they are read
+			vector< vector<Float> > models;
+			vector<MatchTarget *> targets;
+			iMatcher.AcquireResults(models, targets);
 
 			Int numModels = models.size();
 			for (Int j = 0; j < numModels; ++j) {
@@ -133,8 +142,8 @@ public:
 					AffineMultiply(iCumModel, models[j]);
 			}
 
-			iTracker.UpdatePolygons(models, iMatcher.iDbImages, 
-					iMatcher.iLabels);
+			iTracker.UpdatePolygons(models, targets);
+			iMatcher.ReleaseTargets(targets);
 		}
 
 		// track
@@ -168,11 +177,16 @@ public:
 			pthread_attr_setschedparam(&attr, &param);
 //			pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
 	
+			// set before the thread starts, so the next frames see it
+			iQueryData.iQueryInProgress = true;
+
 			// create database thread for periodic matching
 			void *arg = (void *)&iQueryData;
 			pthread_t databaseThreadID;
-			pthread_create(&databaseThreadID, &attr, 
-					QueryDatabaseThread, arg);
+			if (pthread_create(&databaseThreadID, &attr, 
+					QueryDatabaseThread, arg) != 0) {
+				iQueryData.iQueryInProgress = false;
+			}
 		}
 
 		// indicate to user when we are querying
@@ -194,6 +208,7 @@ public:
 	// Member variables 
 
 	Int iQueryPeriod;
+	Int iNumTrackThreads;
 	Int iFrame;
 
 	vector<Char *> iDbFiles;
@@ -9,6 +9,7 @@
 #include "cbir/MatchVisualizer.h"
 #include "cbir/Ransac.h"
 #include "cbir/Font.h"
+#include "cbir/MatchTarget.h"
 
 class Tracker {
 	// local typedef
@@ -171,9 +172,9 @@ public:
 		}
 	}
 
+	// aModels[i] maps aTargets[i] into the current frame
 	void UpdatePolygons(vector< vector<Float> > &aModels, 
-			vector< Image<Byte> > &aDbImages,
-			vector<string> &aLabels) {
+			vector<MatchTarget *> &aTargets) {
 
 		Int numDB = aModels.size();
 
@@ -182,15 +183,15 @@ public:
 			Bool isTracked = false;
 			Int numPoly = iPolyIDs.size();
 			for (Int j = 0; j < numPoly; ++j) {
-				if (iPolyIDs[j] == i) isTracked = true;
+				if (iPolyIDs[j] == aTargets[i]->iId) isTracked = true;
 			}
 
 			Bool hasModel = aModels[i].size();
 
 			if (hasModel && !isTracked) {
 				// create database polygon
-				Int w = aDbImages[i].Width();
-				Int h = aDbImages[i].Height();
+				Int w = aTargets[i]->iWidth;
+				Int h = aTargets[i]->iHeight;
 
 				Int numCorners = 4;
 				Polygon poly(numCorners);
@@ -221,9 +222,9 @@ public:
 				}
 
 				// store polygon
-				iPolyIDs.push_back(i);
+				iPolyIDs.push_back(aTargets[i]->iId);
 				iPolygons.push_back(poly);
-				iLabels.push_back(aLabels[i]);
+				iLabels.push_back(aTargets[i]->iLabel);
 			}
 		}
 	}
@@ -18,6 +18,7 @@ vector< vector<float> > m_matchedPoints;
 
 void initializeTracker(unsigned int width, unsigned int height) {
     m_rifTrack = new RifTrack();
+    m_rifTrack->SetNumThreads(2);
     m_frame = new Image<Byte>(width, height, 1);
     m_frameWidth = width;
     m_frameHeight = height;
@@ -0,0 +1,72 @@
+// Host tests of the cbir Matcher, built from src/test/cpp with
+//   g++ -std=gnu++98 -I../../main/cpp -o MatcherTest MatcherTest.cpp -lpthread
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cbir/Tracker.h"
+#include "cbir/Matcher.h"
+
+// gray image with random discs, which give plenty of features
+static Image<Byte> *MakeImage(Int aSeed) {
+	Int w = 320;
+	Int h = 240;
+	Image<Byte> *image = new Image<Byte>(w, h, 1);
+	Byte *p = image->PixelPointer(0, 0);
+	for (Int i = 0; i < w*h; ++i) p[i] = 128;
+
+	srand(aSeed);
+	for (Int b = 0; b < 300; ++b) {
+		Int cx = rand() % w;
+		Int cy = rand() % h;
+		Int r = 3 + rand() % 12;
+		Int v = rand() % 256;
+		for (Int y = cy-r; y <= cy+r; ++y) {
+			for (Int x = cx-r; x <= cx+r; ++x) {
+				if (x < 0 || y < 0 || x >= w || y >= h) continue;
+				if ((x-cx)*(x-cx) + (y-cy)*(y-cy) <= r*r) p[y*w + x] = v;
+			}
+		}
+	}
+
+	return image;
+}
+
+// a target without features is refused, and queries still work
+static void TestAddEmptyTarget() {
+	Matcher matcher;
+
+	Image<Byte> flat(320, 240, 1);
+	Byte *p = flat.PixelPointer(0, 0);
+	for (Int i = 0; i < 320*240; ++i) p[i] = 128;
+	assert(matcher.AddTarget(flat, "flat") == -1);
+	assert(matcher.NumTargets() == 0);
+
+	Image<Byte> *image = MakeImage(1);
+	IDType id = matcher.AddTarget(*image, "discs");
+	assert(id >= 0);
+	assert(matcher.NumTargets() == 1);
+	assert(matcher.AddTarget(flat, "flat") == -1);
+	assert(matcher.NumTargets() == 1);
+
+	FeatureStore features;
+	matcher.iDbRif.ExtractFeatures(*image, features, 0);
+	matcher.Query(*image, features);
+
+	vector< vector<Float> > models;
+	vector<MatchTarget *> targets;
+	matcher.AcquireResults(models, targets);
+	assert(targets.size() == 1 && targets[0]->iId == id);
+	assert(models[0].size() > 0);
+	matcher.ReleaseTargets(targets);
+
+	delete image;
+}
+
+int main() {
+	TestAddEmptyTarget();
+
+	printf("ok\n");
+	return 0;
+}
@@ -39,7 +39,7 @@ GrayImg = single(rgb2gray(InputImg)) ;
 % --------------------------------------------------------------------
 %                                                             Run SIFT
 % --------------------------------------------------------------------
-[f,d] = vl_sift(GrayImg) ;
+[f,d] = vl_sift(GrayImg, 'Approximate') ;
 
 
 %Construct output image 
@@ -66,10 +66,13 @@ h1   = vl_plotframe(f(:,sel)) ; set(h1,'color','k','linewidth',1.75) ;
 h2   = vl_plotframe(f(:,sel)) ; set(h2,'color','y','linewidth',1) ;
 
 truesize(h, [size(InputImg,1) size(InputImg,2)]); %adjust figure
-print(h,'-painters','-dbmp16m','./output/temp.bmp')
+%unique temporary file, several sessions may run at once
+tempFile = [tempname '.bmp'];
+print(h,'-painters','-dbmp16m',tempFile)
 
 %convert figure to correct image perspective ratio
-outI = imread('./output/temp.bmp') ;
+outI = imread(tempFile) ;
+delete(tempFile);
 outI = imresize(outI, [size(InputImg,1) size(InputImg,2)]);
 imwrite(outI, output_img_path,'Quality',100);
 toc
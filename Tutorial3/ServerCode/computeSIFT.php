@@ -32,10 +32,81 @@ function streamFile($location, $filename, $mimeType='application/octet-stream')
 	
 }
 
+#function for converting an uploaded photo to the BMP read by siftd, scaled
+#down to at most 640 pixels wide like computeSIFT.m. siftd converts it to gray,
+#so GD only decodes and encodes whole images (imagebmp needs PHP 7.2)
+function writeBMP($location, $bmpLocation, $maxWidth=640)
+{ $image = @imagecreatefromstring(file_get_contents($location));
+  if(!$image) return false;
+
+  $width = imagesx($image);
+  $height = imagesy($image);
+  if($width > $maxWidth)
+  { $scaledHeight = max(1, round($height * $maxWidth / $width));
+    $scaled = imagecreatetruecolor($maxWidth, $scaledHeight);
+    imagecopyresampled($scaled, $image, 0, 0, 0, 0, $maxWidth, $scaledHeight, $width, $height);
+    imagedestroy($image);
+    $image = $scaled;
+  }
+
+  $ok = imagebmp($image, $bmpLocation, false);
+  imagedestroy($image);
+  return $ok;
+}
+
+#function for converting the BMP written by siftd to a JPEG the client can decode
+function writeJPEG($bmpLocation, $location)
+{ $image = @imagecreatefrombmp($bmpLocation);
+  if(!$image) return false;
+
+  $ok = imagejpeg($image, $location, 100);
+  imagedestroy($image);
+  return $ok;
+}
+
+#function for sending one job to the SIFT server (vlfeat-0.9.14/bin/<arch>/siftd),
+#given as the list of its fields, returns the keypoints as rows of x, y, scale,
+#orientation or false on error
+function querySIFTServer($fields, $socket='/tmp/siftd.sock')
+{ $connection = @stream_socket_client("unix://$socket", $errno, $errstr, 5);
+  if(!$connection) return false;
+
+  #each field ends with a NUL byte, which cannot be part of a path
+  fwrite($connection, implode("\0", $fields)."\0");
+  $status = fgets($connection);
+  if($status === false || strncmp($status, 'ok ', 3) != 0)
+  { fclose($connection);
+    return false;
+  }
+
+  $frames = array();
+  while(($line = fgets($connection)) !== false)
+  { $frames[] = array_map('floatval', explode(' ', trim($line)));
+  }
+  fclose($connection);
+  return $frames;
+}
+
+#function for asking the SIFT server for the settings that decide its results,
+#returns them as a single line or false on error
+function querySIFTParameters($socket='/tmp/siftd.sock')
+{ $connection = @stream_socket_client("unix://$socket", $errno, $errstr, 5);
+  if(!$connection) return false;
+
+  fwrite($connection, "params\0");
+  $status = fgets($connection);
+  $parameters = fgets($connection);
+  fclose($connection);
+  if($status === false || trim($status) != 'ok 1' || $parameters === false) return false;
+  return trim($parameters);
+}
+
 #**********************************************************
 #Main script
 #**********************************************************
 
+include './resultCache.php';
+
 #<1>set target path for storing photo uploads on the server
 $photo_upload_path = "./upload/";
 $photo_upload_path = $photo_upload_path. basename( $_FILES['uploadedfile']['name']); 
@@ -50,15 +121,55 @@ ini_set('post_max_size', '10M');
 ini_set('max_input_time', 300);  
 ini_set('max_execution_time', 300);  
 
-#<4>Get and stored uploaded photos on the server
-if(copy($_FILES['uploadedfile']['tmp_name'], $photo_upload_path)) {
+#<4>look the photo up in the result cache, keyed also by the settings the
+#   running siftd reports and by the processing done here
+$max_width = 640;
+$sift_parameters = querySIFTParameters();
+$cached_result_path = false;
+if($sift_parameters !== false) {
+	$cache_key = cacheKey($_FILES['uploadedfile']['tmp_name'], "siftd $sift_parameters; width $max_width");
+	$cached_result_path = cacheLookup($cache_key, 'jpg');
+}
+
+if($sift_parameters === false) {
+	echo "There was an error contacting the SIFT server !";
+
+} else if($cached_result_path !== false) {
+	streamFile($cached_result_path, $downloadFileName,"application/octet-stream");
+
+#<5>Get and stored uploaded photos on the server
+} else if(copy($_FILES['uploadedfile']['tmp_name'], $photo_upload_path)) {
 	
-	#<5> execute matlab image processing algorithm
-	#example: Compute and display SIFT features using VLFeat and Matlab
-	$command = "matlab -nodesktop -nodisplay -r \"computeSIFT('$photo_upload_path','$processed_photo_output_path');exit\"";
-	exec($command);
-	#<6>stream processed photo to the client
-	streamFile($processed_photo_output_path, $downloadFileName,"application/octet-stream");
+	#<6> compute SIFT features with the SIFT server, started once from this
+	#    directory as the web server user (its socket is private to the user
+	#    and group that start it) with
+	#    vlfeat-0.9.14/bin/glnxa64/siftd --output-dir output &
+	#example: Compute and display SIFT features using VLFeat
+	#the server resolves paths on its own, so they are absolute
+	$job = uniqid('sift_');
+	$bmp_input_path = getcwd()."/upload/$job.bmp";
+	$bmp_output_path = getcwd()."/output/$job.bmp";
+	$frames_output_path = getcwd()."/output/$job.frame";
+	$frames = false;
+	if(writeBMP($photo_upload_path, $bmp_input_path, $max_width)) {
+		$frames = querySIFTServer(array('sift', $bmp_input_path, $bmp_output_path));
+	}
+	if($frames === false || !writeJPEG($bmp_output_path, $processed_photo_output_path)) {
+		echo "There was an error computing SIFT features of $photo_upload_path !";
+	} else {
+		#<7>keep the result and its frames for the next upload of the same photo
+		$lines = '';
+		foreach($frames as $frame) $lines .= implode(' ', $frame)."\n";
+		file_put_contents($frames_output_path, $lines);
+		cacheStore($cache_key, 'jpg', $processed_photo_output_path);
+		cacheStore($cache_key, 'frame', $frames_output_path);
+
+		#<8>stream processed photo to the client
+		streamFile($processed_photo_output_path, $downloadFileName,"application/octet-stream");
+	}
+	@unlink($bmp_input_path);
+	@unlink($bmp_output_path);
+	@unlink($frames_output_path);
 } else{
     echo "There was an error uploading the file to $photo_upload_path !";
 }
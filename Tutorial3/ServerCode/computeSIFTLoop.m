@@ -3,6 +3,12 @@
 % EE368 Digital Image Processing
 % Android Tutorial #3: Server-Client Communication
 % Run a persistent Matlab session that waits on incoming image query from phone.
+%
+% computeSIFTLoop.php queues every upload as upload/queue/<job>.job and waits
+% for one line on the named pipe output/<job>.fifo. Several sessions can run
+% this loop side by side, each one takes a job by renaming its file, which
+% only one of them can do. Idle sessions sleep on the named pipe
+% upload/queue/wakeup, which gets one byte per queued job.
 
 % Make sure folders exist
 if ~exist('output', 'dir')
@@ -11,38 +17,72 @@ end
 if ~exist('upload', 'dir')
     mkdir('upload');
 end
+queueDir = 'upload/queue';
+if ~exist(queueDir, 'dir')
+    mkdir(queueDir);
+end
+wakeupFile = [queueDir '/wakeup'];
+if ~exist(wakeupFile, 'file')
+    system(['mkfifo ' wakeupFile]);
+end
+
+% Open for reading and writing, so that opening does not wait for a writer
+wakeup = fopen(wakeupFile, 'r+');
+workerId = sprintf('%d', feature('getpid'));
 
 while 1
-    
-    % Wait until image is ready
-    imageReadyFile = 'upload/image_ready';
-    if ~exist(imageReadyFile, 'file')
-        pause(0.5);
-        disp('Waiting for image-is-ready signal');
+
+    % Take the oldest job nobody else has taken
+    jobs = dir([queueDir '/*.job']);
+    [dates, order] = sort([jobs.datenum]);
+    job = '';
+    for k = order
+        name = jobs(k).name(1:end-4);
+        runFile = [queueDir '/' name '.' workerId];
+        if java.io.File([queueDir '/' jobs(k).name]).renameTo(java.io.File(runFile))
+            job = name;
+            break;
+        end
+    end
+
+    % Wait until a job is queued
+    if isempty(job)
+        disp('Waiting for a job');
+        fread(wakeup, 1);
         continue;
     end
-    
-    % Read input image file
-    fid = fopen(imageReadyFile, 'r');
-    imageFile = fscanf(fid, '%s', 1);
-    [pathStr, name, ext] = fileparts(imageFile);
-    disp(['Processing image: ' imageFile]);
-    
-    % Remove image-is-ready file
-    delete(imageReadyFile);
-    
-    % Call SIFT keypoint extractor
-    if ext(1) ~= '.'
-        ext = ['.' ext];
+
+    % Pass the wakeup on if more jobs are waiting
+    if numel(jobs) > 1
+        fid = fopen(wakeupFile, 'w');
+        fwrite(fid, 'j');
+        fclose(fid);
     end
-    inputImageFile = ['upload/' name ext];
-    outputImageFile = ['output/processed_' name ext];
-    computeSIFT(inputImageFile, outputImageFile);
-    
-    % Signal that result is ready
-    resultReadyFile = 'output/result_ready';
-    fid = fopen(resultReadyFile, 'w');
-    fprintf(fid, '1');
+
+    % Read input and output image files
+    fid = fopen(runFile, 'r');
+    inputImageFile = fgetl(fid);
+    outputImageFile = fgetl(fid);
     fclose(fid);
-    
+    disp(['Processing image: ' inputImageFile]);
+
+    % Call SIFT keypoint extractor
+    try
+        computeSIFT(inputImageFile, outputImageFile);
+        status = 'ok';
+    catch err
+        status = ['error ' err.message];
+    end
+    delete(runFile);
+
+    % Signal that result is ready, unless the request has gone away
+    resultFile = ['output/' job '.fifo'];
+    if exist(resultFile, 'file')
+        fid = fopen(resultFile, 'w');
+        if fid >= 0
+            fprintf(fid, '%s\n', status);
+            fclose(fid);
+        end
+    end
+
 end % while
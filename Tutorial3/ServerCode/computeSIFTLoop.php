@@ -36,16 +36,20 @@ function streamFile($location, $filename, $mimeType='application/octet-stream')
 #Main script
 #**********************************************************
 
-#<1>set target path for storing photo uploads on the server
-$photo_upload_path = "./upload/";
-$photo_upload_path = $photo_upload_path.basename( $_FILES['uploadedfile']['name']); 
-$photo_upload_indicator_path = "./upload/image_ready";
+include './resultCache.php';
+
+#<1>set target path for storing photo uploads on the server, under a job id
+#   unique to this request so that concurrent uploads do not clobber each other
+$job = str_replace('.', '_', uniqid('job_', true));
+$extension = pathinfo($_FILES['uploadedfile']['name'], PATHINFO_EXTENSION);
+$photo_upload_path = "./upload/$job.$extension";
+$photo_upload_queue_path = "./upload/queue/";
+$photo_upload_wakeup_path = "./upload/queue/wakeup";
 
 #<2>set target path for storing result on the server
 $downloadFileName = 'processed_';
-$processed_photo_output_path = "./output/processed_";
-$processed_photo_output_path = $processed_photo_output_path.basename( $_FILES['uploadedfile']['name']); 
-$processed_photo_output_indicator_path = "./output/result_ready";
+$processed_photo_output_path = "./output/processed_$job.$extension";
+$processed_photo_output_fifo_path = "./output/$job.fifo";
 $downloadFileName = $downloadFileName.basename( $_FILES['uploadedfile']['name']); 
 
 #<3>modify maximum allowable file size to 10MB and timeout to 300s
@@ -54,24 +58,57 @@ ini_set('post_max_size', '10M');
 ini_set('max_input_time', 300);  
 ini_set('max_execution_time', 300);  
 
-#<4>Get and stored uploaded photos on the server
-if(copy($_FILES['uploadedfile']['tmp_name'], $photo_upload_path)) {
-	
-	#<5>signal that the image is ready
-	$handle = fopen($photo_upload_indicator_path, 'w');
-	fprintf($handle, '%s', $photo_upload_path);
-	fclose($handle);
+#<4>look the photo up in the result cache, keyed also by the code that
+#   processes it so that editing computeSIFT.m invalidates older results
+$cache_key = cacheKey($_FILES['uploadedfile']['tmp_name'], 'computeSIFT.m '.sha1_file('./computeSIFT.m'));
+$cache_extension = 'processed.'.strtolower($extension);
+$cached_result_path = cacheLookup($cache_key, $cache_extension);
+
+if($cached_result_path !== false) {
+	streamFile($cached_result_path, $downloadFileName,"application/octet-stream");
+
+#<5>Get and stored uploaded photos on the server
+} else if(copy($_FILES['uploadedfile']['tmp_name'], $photo_upload_path)) {
 	
-	#<6>wait until the result is ready
-	while (!file_exists($processed_photo_output_indicator_path))
+	#<6>create the pipe the result is signalled on, opened for reading and
+	#   writing so that opening does not wait for computeSIFTLoop.m
+	posix_mkfifo($processed_photo_output_fifo_path, 0666);
+	$result = fopen($processed_photo_output_fifo_path, 'r+');
+
+	#<7>queue the job, the rename makes it appear complete
+	if(!file_exists($photo_upload_wakeup_path))
 	{
-		usleep(1000000);
+		@mkdir($photo_upload_queue_path);
+		posix_mkfifo($photo_upload_wakeup_path, 0666);
+	}
+	file_put_contents($photo_upload_queue_path."$job.tmp",
+		"$photo_upload_path\n$processed_photo_output_path\n");
+	rename($photo_upload_queue_path."$job.tmp", $photo_upload_queue_path."$job.job");
+
+	#<8>wake up one waiting computeSIFTLoop.m
+	$wakeup = fopen($photo_upload_wakeup_path, 'r+');
+	fwrite($wakeup, 'j');
+	fclose($wakeup);
+
+	#<9>wait until the result is ready
+	$read = array($result);
+	$write = NULL;
+	$except = NULL;
+	$status = false;
+	if(stream_select($read, $write, $except, 300) > 0)
+	{
+		$status = fgets($result);
+	}
+	unlink($processed_photo_output_fifo_path);
+	fclose($result);
+
+	#<10>stream processed photo to the client
+	if($status !== false && strncmp($status, 'ok', 2) == 0) {
+		cacheStore($cache_key, $cache_extension, $processed_photo_output_path);
+		streamFile($processed_photo_output_path, $downloadFileName,"application/octet-stream");
+	} else {
+		echo "There was an error processing $photo_upload_path !";
 	}
-	usleep(1000000);
-	unlink($processed_photo_output_indicator_path);
-	
-	#<7>stream processed photo to the client
-	streamFile($processed_photo_output_path, $downloadFileName,"application/octet-stream");
 } else{
     echo "There was an error uploading the file to $photo_upload_path !";
 }
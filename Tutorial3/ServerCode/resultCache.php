@@ -0,0 +1,60 @@
+<?php
+#-------------------------------------------------------------------------------
+# EE368 Digital Image Processing
+# Android Tutorial #3: Server-Client Interaction Example for Image Processing
+# Result cache shared by computeSIFT.php and computeSIFTLoop.php
+#------------------------------------------------------------------------------
+# Results are stored under ./output/cache/ by a key made of the hash of the
+# uploaded file and of the processing parameters, so that a client sending
+# the same photo again, e.g. when retrying on a poor connection, gets the
+# stored result without any processing. A file's modification time is its
+# last use, and the least recently used results are removed once the cache
+# grows beyond $cache_max_bytes.
+
+$cache_path = "./output/cache/";
+$cache_max_bytes = 64 * 1024 * 1024;
+
+#function for computing the cache key of an uploaded file
+function cacheKey($location, $parameters)
+{ return sha1(sha1_file($location).'|'.$parameters);
+}
+
+#function for finding a result in the cache, returns its path or false
+function cacheLookup($key, $extension)
+{ global $cache_path;
+  $location = $cache_path.$key.'.'.$extension;
+  if(!file_exists($location)) return false;
+  touch($location);
+  return $location;
+}
+
+#function for adding a result to the cache, evicting the least recently
+#used results over the size limit
+function cacheStore($key, $extension, $location)
+{ global $cache_path, $cache_max_bytes;
+  if(!is_dir($cache_path)) @mkdir($cache_path, 0777, true);
+
+  #copy under a unique name first, so that a result appears complete
+  $temp = $cache_path.str_replace('.', '_', uniqid('tmp_', true));
+  if(!@copy($location, $temp)) return;
+  rename($temp, $cache_path.$key.'.'.$extension);
+
+  $entries = array();
+  $total = 0;
+  foreach(glob($cache_path.'*.*') as $entry)
+  { $stat = @stat($entry);
+    if($stat === false) continue;
+    $entries[$entry] = $stat['mtime'];
+    $total += $stat['size'];
+  }
+  if($total <= $cache_max_bytes) return;
+
+  asort($entries);
+  foreach($entries as $entry => $mtime)
+  { $size = @filesize($entry);
+    if(@unlink($entry)) $total -= $size;
+    if($total <= $cache_max_bytes) break;
+  }
+}
+
+?>
@@ -167,11 +167,13 @@ libsrc = \
   vl\ikmeans.c \
   vl\imopv.c \
   vl\imopv_sse2.c \
+  vl\imopv_avx2.c \
   vl\kdtree.c \
   vl\kmeans.c \
   vl\lbp.c \
   vl\mathop.c \
   vl\mathop_sse2.c \
+  vl\mathop_avx2.c \
   vl\mser.c \
   vl\pegasos.c \
   vl\pgm.c \
@@ -179,8 +181,11 @@ libsrc = \
   vl\random.c \
   vl\rodrigues.c \
   vl\sift.c \
+  vl\sift_sse2.c \
+  vl\sift_avx2.c \
   vl\slic.c \
-  vl\stringop.c
+  vl\stringop.c \
+  vl\threads.c
 
 cmdsrc = \
   src\aib.c \
@@ -195,6 +200,7 @@ cmdsrc = \
   src\test_nan.c \
   src\test_qsort-def.c \
   src\test_rand.c \
+  src\test_sift_tiled.c \
   src\test_stringop.c \
   src\test_threads.c \
   src\test_vec_comp.c
@@ -376,6 +382,23 @@ $(objdir)\imopv_sse2.obj : vl\imopv_sse2.c
 	@echo .... CC [+SSE2] $(@)
 	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:SSE2 /D"__SSE2__" /c /Fo"$(@)" "vl\$(@B).c"
 
+$(objdir)\sift_sse2.obj : vl\sift_sse2.c
+	@echo .... CC [+SSE2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:SSE2 /D"__SSE2__" /c /Fo"$(@)" "vl\$(@B).c"
+
+# special sources with AVX2 support
+$(objdir)\mathop_avx2.obj : vl\mathop_avx2.c
+	@echo .... CC [+AVX2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX2 /D"__AVX2__" /D"__FMA__" /c /Fo"$(@)" "vl\$(@B).c"
+
+$(objdir)\imopv_avx2.obj : vl\imopv_avx2.c
+	@echo .... CC [+AVX2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX2 /D"__AVX2__" /c /Fo"$(@)" "vl\$(@B).c"
+
+$(objdir)\sift_avx2.obj : vl\sift_avx2.c
+	@echo .... CC [+AVX2] $(@)
+	@$(CC) $(CFLAGS) $(DLL_CFLAGS) /arch:AVX2 /D"__AVX2__" /c /Fo"$(@)" "vl\$(@B).c"
+
 # vl\*.c -> $objdir\*.obj
 {vl}.c{$(objdir)}.obj:
 	@echo .... CC $(@)
@@ -19,7 +19,7 @@ info: bin-info
 # --------------------------------------------------------------------
 
 BIN_CFLAGS = $(STD_CFLAGS) -I$(VLDIR)
-BIN_LDFLAGS = $(STD_LDFLAGS) -L$(BINDIR) -lvl
+BIN_LDFLAGS = $(STD_LDFLAGS) -L$(BINDIR) -lvl -lm
 
 # Mac OS X Intel 32
 ifeq ($(ARCH),maci)
@@ -72,6 +72,9 @@ bin-all: $(bin_tgt)
 $(BINDIR)/% : $(VLDIR)/src/%.c $(dll-dir) $(dll_tgt)
 	$(call C,CC) $(BIN_CFLAGS) "$<" $(BIN_LDFLAGS) -o "$@"
 
+# siftd runs one thread per worker
+$(BINDIR)/siftd : BIN_LDFLAGS += -pthread
+
 $(BINDIR)/%.d : $(VLDIR)/src/%.c $(dll-dir)
 	$(call C,CC) $(BIN_CFLAGS) -M -MT  \
 	       '$(BINDIR)/$* $(BINDIR)/$*.d' \
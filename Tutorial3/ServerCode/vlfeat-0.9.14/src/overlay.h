@@ -0,0 +1,332 @@
+/** @brief    Drawing SIFT frames over an image - Definition.
+ ** @internal
+ **
+ ** This file contains the rasterizer shared by the command line
+ ** drivers to render SIFT frames the way @c vl_plotframe plots them:
+ ** a circle of radius equal to the frame scale and a radius along the
+ ** frame orientation, drawn a first time thick and black and a second
+ ** time thin and yellow on top, so that they read on any background.
+ **
+ ** The image is converted to RGB once and the frames are drawn in
+ ** place, without any intermediate figure.
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_OVERLAY_DRIVER
+#define VL_OVERLAY_DRIVER
+
+#include <vl/generic.h>
+#include <vl/mathop.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+/** @brief Default number of frames drawn, largest scale first */
+#define VL_OVERLAY_DEFAULT_TOP 300
+
+/** @brief Image with SIFT frames drawn over it
+ **/
+struct _VlOverlay
+{
+  vl_uint8  *rgb ;         /**< pixels, three bytes each */
+  int        width ;       /**< image width */
+  int        height ;      /**< image height */
+  vl_size    rgb_size ;    /**< capacity of rgb in pixels */
+  double    *scales ;      /**< frame selection buffer */
+  vl_size    scales_size ; /**< capacity of scales in frames */
+} ;
+
+/** @brief Image with SIFT frames drawn over it type
+ ** @see ::_VlOverlay
+ **/
+typedef struct _VlOverlay VlOverlay ;
+
+/* ----------------------------------------------------------------- */
+/** @brief Free the buffers of an overlay
+ **
+ ** @param self overlay.
+ **
+ ** The buffers are kept by ::vl_overlay_set_image from one image to
+ ** the next, this releases them.
+ **/
+static void
+vl_overlay_free (VlOverlay * self)
+{
+  if (self->rgb)    free (self->rgb) ;
+  if (self->scales) free (self->scales) ;
+  self->rgb         = 0 ;
+  self->rgb_size    = 0 ;
+  self->scales      = 0 ;
+  self->scales_size = 0 ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Set the image of an overlay
+ **
+ ** @param self   overlay (zero-initialized the first time).
+ ** @param image  grayscale image.
+ ** @param width  image width.
+ ** @param height image height.
+ **
+ ** @return error code. The function fails with ::VL_ERR_ALLOC if the
+ ** RGB buffer cannot be allocated.
+ **/
+static int
+vl_overlay_set_image (VlOverlay * self, vl_uint8 const * image,
+                      int width, int height)
+{
+  vl_size npixels = (vl_size) width * height ;
+  vl_size q ;
+
+  if (self->rgb_size < npixels) {
+    vl_uint8 * rgb = realloc (self->rgb, 3 * npixels) ;
+    if (! rgb) return VL_ERR_ALLOC ;
+    self->rgb      = rgb ;
+    self->rgb_size = npixels ;
+  }
+  self->width  = width ;
+  self->height = height ;
+
+  for (q = 0 ; q < npixels ; ++q) {
+    self->rgb [3 * q + 0] = image [q] ;
+    self->rgb [3 * q + 1] = image [q] ;
+    self->rgb [3 * q + 2] = image [q] ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** @internal @brief Set a pixel if it is inside the image */
+VL_INLINE void
+_vl_overlay_put (VlOverlay * self, int u, int v, vl_uint8 const * color)
+{
+  if (u >= 0 && v >= 0 && u < self->width && v < self->height) {
+    vl_uint8 * pt = self->rgb + 3 * ((vl_size) v * self->width + u) ;
+    pt [0] = color [0] ;
+    pt [1] = color [1] ;
+    pt [2] = color [2] ;
+  }
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Draw a SIFT frame
+ **
+ ** @param self       overlay.
+ ** @param x          frame center x coordinate.
+ ** @param y          frame center y coordinate.
+ ** @param r          frame scale (circle radius).
+ ** @param angle      frame orientation.
+ ** @param color      RGB color.
+ ** @param linewidth  line width in pixels.
+ **
+ ** Pixel centers have integer coordinates, as the SIFT frames. A
+ ** pixel is set if its center is closer than half the line width to
+ ** the circle or to the radius.
+ **/
+static void
+vl_overlay_draw_frame (VlOverlay * self,
+                       double x, double y, double r, double angle,
+                       vl_uint8 const * color, double linewidth)
+{
+  double hw = 0.5 * linewidth ;
+  double ro = r + hw ;
+  double ri = r - hw > 0 ? r - hw : 0 ;
+  double c  = cos (angle) ;
+  double s  = sin (angle) ;
+  int u, v, umin, umax, vmin, vmax ;
+
+  /* circle: per row, the pixels between the two radii */
+  vmin = (int) ceil  (y - ro) ;
+  vmax = (int) floor (y + ro) ;
+  if (vmin < 0) vmin = 0 ;
+  if (vmax > self->height - 1) vmax = self->height - 1 ;
+
+  for (v = vmin ; v <= vmax ; ++v) {
+    double dy  = v - y ;
+    double ox  = sqrt (VL_MAX (ro * ro - dy * dy, 0.0)) ;
+    double ix  = ri * ri - dy * dy > 0 ? sqrt (ri * ri - dy * dy) : -1 ;
+    umin = (int) ceil  (x - ox) ;
+    umax = (int) floor (x + ox) ;
+    for (u = umin ; u <= umax ; ++u) {
+      double dx = u - x ;
+      if (dx > - ix && dx < ix) {
+        u = (int) ceil (x + ix) - 1 ;
+        continue ;
+      }
+      _vl_overlay_put (self, u, v, color) ;
+    }
+  }
+
+  /* radius: the pixels close to the segment from the center */
+  umin = (int) ceil  (VL_MIN (x, x + r * c) - hw) ;
+  umax = (int) floor (VL_MAX (x, x + r * c) + hw) ;
+  vmin = (int) ceil  (VL_MIN (y, y + r * s) - hw) ;
+  vmax = (int) floor (VL_MAX (y, y + r * s) + hw) ;
+
+  for (v = vmin ; v <= vmax ; ++v) {
+    for (u = umin ; u <= umax ; ++u) {
+      double dx = u - x ;
+      double dy = v - y ;
+      double t  = dx * c + dy * s ;
+      double ex, ey ;
+      t  = VL_MAX (0.0, VL_MIN (r, t)) ;
+      ex = dx - t * c ;
+      ey = dy - t * s ;
+      if (ex * ex + ey * ey <= hw * hw) {
+        _vl_overlay_put (self, u, v, color) ;
+      }
+    }
+  }
+}
+
+/** @internal @brief Order scales decreasingly */
+static int
+_vl_overlay_cmp_scale (void const * a, void const * b)
+{
+  double x = * (double const *) a ;
+  double y = * (double const *) b ;
+  return (x < y) - (x > y) ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Draw the SIFT frames with the largest scale
+ **
+ ** @param self     overlay.
+ ** @param frames   frames (x, y, scale, angle), one after the other.
+ ** @param nframes  number of frames.
+ ** @param top      maximum number of frames to draw.
+ **
+ ** The frames with the @a top largest scales are drawn, as in @c
+ ** computeSIFT.m.  Each one is outlined in black first (line width
+ ** 1.75 pt, as @c vl_plotframe at 96 dpi) and then drawn in yellow
+ ** (1 pt).
+ **
+ ** @return error code. The function fails with ::VL_ERR_ALLOC if the
+ ** selection buffer cannot be allocated.
+ **/
+static int
+vl_overlay_draw_frames (VlOverlay * self, double const * frames,
+                        vl_size nframes, vl_size top)
+{
+  static vl_uint8 const black  [3] = {  0,   0, 0} ;
+  static vl_uint8 const yellow [3] = {255, 255, 0} ;
+  double threshold = - VL_INFINITY_D ;
+  vl_size i ;
+  int pass ;
+
+  if (nframes == 0 || top == 0) return VL_ERR_OK ;
+
+  /* the scale of the top-th frame */
+  if (top < nframes) {
+    if (self->scales_size < nframes) {
+      double * scales = realloc (self->scales, sizeof(double) * nframes) ;
+      if (! scales) return VL_ERR_ALLOC ;
+      self->scales      = scales ;
+      self->scales_size = nframes ;
+    }
+    for (i = 0 ; i < nframes ; ++i) self->scales [i] = frames [4 * i + 2] ;
+    qsort (self->scales, nframes, sizeof(double), _vl_overlay_cmp_scale) ;
+    threshold = self->scales [top - 1] ;
+  }
+
+  /* frames above the threshold first, then ties until top are drawn */
+  for (pass = 0 ; pass < 2 ; ++pass) {
+    vl_uint8 const * color = pass ? yellow : black ;
+    double linewidth = (pass ? 1.0 : 1.75) * 96 / 72 ;
+    vl_size drawn = 0 ;
+    int ties ;
+    for (ties = 0 ; ties < 2 ; ++ties) {
+      for (i = 0 ; i < nframes && drawn < top ; ++i) {
+        double const * fr = frames + 4 * i ;
+        if (ties ? fr [2] == threshold : fr [2] > threshold) {
+          vl_overlay_draw_frame (self, fr [0], fr [1], fr [2], fr [3],
+                                 color, linewidth) ;
+          ++ drawn ;
+        }
+      }
+    }
+  }
+  return VL_ERR_OK ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Write an overlay to a file in PPM format
+ **
+ ** @param self  overlay.
+ ** @param f     file (opened for binary writing).
+ **
+ ** @return error code. The function fails with ::VL_ERR_IO if the
+ ** image cannot be written.
+ **/
+static int
+vl_overlay_insert_ppm (VlOverlay const * self, FILE * f)
+{
+  vl_size npixels = (vl_size) self->width * self->height ;
+
+  fprintf (f, "P6\n%d\n%d\n255\n", self->width, self->height) ;
+  if (fwrite (self->rgb, 3, npixels, f) < npixels) {
+    return VL_ERR_IO ;
+  }
+  return VL_ERR_OK ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Write an overlay to a file in BMP format
+ **
+ ** @param self  overlay.
+ ** @param f     file (opened for binary writing).
+ **
+ ** The image is stored bottom-up with 24 bits per pixel and no
+ ** compression, which every BMP reader supports (e.g. PHP
+ ** @c imagecreatefrombmp).
+ **
+ ** @return error code. The function fails with ::VL_ERR_IO if the
+ ** image cannot be written.
+ **/
+static int
+vl_overlay_insert_bmp (VlOverlay const * self, FILE * f)
+{
+  vl_size stride = ((vl_size) 3 * self->width + 3) & ~ (vl_size) 3 ;
+  vl_size image_size = stride * self->height ;
+  vl_uint8 head [54] = {'B', 'M'} ;
+  vl_uint8 * row ;
+  int x, y, k ;
+  /* file size, pixel offset, header size, width, height, planes and
+     bits per pixel, image size, 72 dpi resolution */
+  vl_uint32 const fields [][2] = {
+    { 2, 54 + image_size}, {10, 54}, {14, 40},
+    {18, self->width}, {22, self->height}, {26, 1 | (24 << 16)},
+    {34, image_size}, {38, 2835}, {42, 2835}} ;
+
+  for (k = 0 ; k < (signed) (sizeof(fields) / sizeof(fields[0])) ; ++k) {
+    int b ;
+    for (b = 0 ; b < 4 ; ++b) {
+      head [fields [k][0] + b] = (vl_uint8) (fields [k][1] >> (8 * b)) ;
+    }
+  }
+  if (fwrite (head, 1, sizeof(head), f) < sizeof(head)) return VL_ERR_IO ;
+
+  row = calloc (stride, 1) ;
+  if (! row) return VL_ERR_ALLOC ;
+  for (y = self->height - 1 ; y >= 0 ; -- y) {
+    vl_uint8 const * pt = self->rgb + 3 * (vl_size) y * self->width ;
+    for (x = 0 ; x < self->width ; ++x) {
+      row [3 * x + 0] = pt [3 * x + 2] ;
+      row [3 * x + 1] = pt [3 * x + 1] ;
+      row [3 * x + 2] = pt [3 * x + 0] ;
+    }
+    if (fwrite (row, 1, stride, f) < stride) break ;
+  }
+  free (row) ;
+  return y < 0 ? VL_ERR_OK : VL_ERR_IO ;
+}
+
+/* VL_OVERLAY_DRIVER */
+#endif
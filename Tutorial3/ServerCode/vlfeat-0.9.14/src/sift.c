@@ -15,6 +15,7 @@ the terms of the BSD license (see the COPYING file).
 #define VL_SIFT_DRIVER_VERSION 0.1
 
 #include "generic-driver.h"
+#include "overlay.h"
 
 #include <vl/generic.h>
 #include <vl/stringop.h>
@@ -41,12 +42,18 @@ char const help_message [] =
   " --gss           Specify Gaussian scale space files\n"
   " --octaves -O    Number of octaves\n"
   " --levels -S     Number of levels per octave\n"
+  " --threads -j    Number of threads\n"
   " --first-octave  Index of the first octave\n"
   " --edge-thresh   Specify the edge threshold\n"
   " --peak-thresh   Specift the peak threshold\n"
   " --magnif        Specify the magnification factor\n"
   " --read-frames   Specify a file from which to read frames\n"
   " --orientations  Force the computation of the orientations\n"
+  " --render        Specify file of the frames drawn over the image\n"
+  " --render-top    Number of frames drawn, largest first\n"
+  " --max-memory    Memory limit of the scale space in MB\n"
+  " --approximate   Approximate the scale space by box filters\n"
+  " --compact       Store the scale space in 16 bits\n"
   "\n" ;
 
 /* ----------------------------------------------------------------- */
@@ -61,11 +68,16 @@ enum {
   opt_peak_thresh,
   opt_magnif,
   opt_read_frames,
-  opt_orientations
+  opt_orientations,
+  opt_render,
+  opt_render_top,
+  opt_max_memory,
+  opt_approximate,
+  opt_compact
 } ;
 
 /* short options */
-char const opts [] = "vhO:S:o:" ;
+char const opts [] = "vhO:S:o:j:" ;
 
 /* long options */
 struct option const longopts [] = {
@@ -73,6 +85,7 @@ struct option const longopts [] = {
   { "help",            no_argument,            0,          'h'              },
   { "octaves",         required_argument,      0,          'O'              },
   { "levels",          required_argument,      0,          'S'              },
+  { "threads",         required_argument,      0,          'j'              },
   { "output",          optional_argument,      0,          'o'              },
   { "meta",            optional_argument,      0,          opt_meta         },
   { "frames",          optional_argument,      0,          opt_frames       },
@@ -84,6 +97,11 @@ struct option const longopts [] = {
   { "magnif",          required_argument,      0,          opt_magnif       },
   { "read-frames",     required_argument,      0,          opt_read_frames  },
   { "orientations",    no_argument,            0,          opt_orientations },
+  { "render",          optional_argument,      0,          opt_render       },
+  { "render-top",      required_argument,      0,          opt_render_top   },
+  { "max-memory",      required_argument,      0,          opt_max_memory   },
+  { "approximate",     no_argument,            0,          opt_approximate  },
+  { "compact",         no_argument,            0,          opt_compact      },
   { 0,                 0,                      0,          0                }
 } ;
 
@@ -159,6 +177,27 @@ save_gss (VlSiftFilt * filt, VlFileMeta * fm, const char * basename,
   return err ;
 }
 
+/* ----------------------------------------------------------------- */
+/** @brief Make room in a buffer
+ ** @internal
+ **
+ ** The buffer @a buffer of @a size elements of @a elem_size bytes is
+ ** enlarged, if needed, to hold @a n elements.
+ **
+ ** @return error code.
+ **/
+static int
+reserve (void ** buffer, int * size, int n, size_t elem_size)
+{
+  if (*size < n) {
+    void * tmp = realloc (*buffer, elem_size * n) ;
+    if (! tmp) return VL_ERR_ALLOC ;
+    *buffer = tmp ;
+    *size   = n ;
+  }
+  return VL_ERR_OK ;
+}
+
 /* ----------------------------------------------------------------- */
 /** @brief Keypoint ordering
  ** @internal
@@ -171,6 +210,93 @@ korder (void const* a, void const* b) {
   return 0 ;
 }
 
+/* ----------------------------------------------------------------- */
+/** @brief Destination of the frames of an image
+ ** @internal
+ **/
+typedef struct _FrameWriter
+{
+  VlFileMeta *out ;
+  VlFileMeta *frm ;
+  VlFileMeta *dsc ;
+  vl_bool     render ;      /**< keep the frames to draw them */
+  double     *rkeys ;
+  int         nrkeys ;
+  int         rkeys_size ;
+} FrameWriter ;
+
+/** @brief Write frames and their descriptors
+ ** @internal
+ **
+ ** The function has the signature of ::VlSiftFramesFunction. @a
+ ** descrs can be @c NULL if neither the aggregate file nor the
+ ** descriptors file are written.
+ **
+ ** @return error code.
+ **/
+static int
+write_frames (void * data, VlSiftKeypoint const * keys,
+              double const * angles, vl_sift_pix const * descrs,
+              int nframes)
+{
+  FrameWriter * w = data ;
+  int j ;
+
+  for (j = 0 ; j < nframes ; ++j) {
+    VlSiftKeypoint const *k      = keys + j ;
+    double                angle  = angles [j] ;
+    vl_sift_pix const    *descr  = descrs ? descrs + 128 * j : 0 ;
+
+    if (w->out->active) {
+      int l ;
+      vl_file_meta_put_double (w->out, k -> x     ) ;
+      vl_file_meta_put_double (w->out, k -> y     ) ;
+      vl_file_meta_put_double (w->out, k -> sigma ) ;
+      vl_file_meta_put_double (w->out, angle      ) ;
+      for (l = 0 ; l < 128 ; ++l) {
+        vl_file_meta_put_uint8 (w->out, (vl_uint8) (512.0 * descr [l])) ;
+      }
+      if (w->out->protocol == VL_PROT_ASCII) fprintf(w->out->file, "\n") ;
+    }
+
+    if (w->frm->active) {
+      vl_file_meta_put_double (w->frm, k -> x     ) ;
+      vl_file_meta_put_double (w->frm, k -> y     ) ;
+      vl_file_meta_put_double (w->frm, k -> sigma ) ;
+      vl_file_meta_put_double (w->frm, angle      ) ;
+      if (w->frm->protocol == VL_PROT_ASCII) fprintf(w->frm->file, "\n") ;
+    }
+
+    if (w->dsc->active) {
+      int l ;
+      for (l = 0 ; l < 128 ; ++l) {
+        double x = 512.0 * descr[l] ;
+        x = (x < 255.0) ? x : 255.0 ;
+        vl_file_meta_put_uint8 (w->dsc, (vl_uint8) (x)) ;
+      }
+      if (w->dsc->protocol == VL_PROT_ASCII) fprintf(w->dsc->file, "\n") ;
+    }
+
+    if (w->render) {
+      /* make enough space */
+      if (w->rkeys_size < w->nrkeys + 1) {
+        double * tmp ;
+        w->rkeys_size += 10000 ;
+        tmp = realloc (w->rkeys, 4 * sizeof(double) * w->rkeys_size) ;
+        if (! tmp) return VL_ERR_ALLOC ;
+        w->rkeys = tmp ;
+      }
+
+      w->rkeys [4 * w->nrkeys + 0] = k -> x ;
+      w->rkeys [4 * w->nrkeys + 1] = k -> y ;
+      w->rkeys [4 * w->nrkeys + 2] = k -> sigma ;
+      w->rkeys [4 * w->nrkeys + 3] = angle ;
+      ++ w->nrkeys ;
+    }
+  }
+  return VL_ERR_OK ;
+}
+
 /* ---------------------------------------------------------------- */
 /** @brief SIFT driver entry point
  **/
@@ -181,15 +307,23 @@ main(int argc, char **argv)
   double   edge_thresh  = -1 ;
   double   peak_thresh  = -1 ;
   double   magnif       = -1 ;
+  vl_bool  approximate  = 0 ;
+  vl_bool  compact      = 0 ;
   int      O = -1, S = 3, omin = -1 ;
+  int      num_threads  = 1 ;
+  double   max_memory   = 0 ;
 
   vl_bool  err    = VL_ERR_OK ;
-  char     err_msg [1024] ;
+  /* room for a whole file name (VlFileMeta::name) and the text */
+  char     err_msg [1024 + 128] ;
   int      n ;
   int      exit_code          = 0 ;
   int      verbose            = 0 ;
   vl_bool  force_output       = 0 ;
   vl_bool  force_orientations = 0 ;
+  int      render_top         = VL_OVERLAY_DEFAULT_TOP ;
+  VlOverlay overlay           = {0, 0, 0, 0, 0, 0} ;
+  VlSiftBatch *batch          = 0 ;
 
   VlFileMeta out  = {1, "%.sift",  VL_PROT_ASCII, "", 0} ;
   VlFileMeta frm  = {0, "%.frame", VL_PROT_ASCII, "", 0} ;
@@ -197,6 +331,7 @@ main(int argc, char **argv)
   VlFileMeta met  = {0, "%.meta",  VL_PROT_ASCII, "", 0} ;
   VlFileMeta gss  = {0, "%.pgm",   VL_PROT_ASCII, "", 0} ;
   VlFileMeta ifr  = {0, "%.frame", VL_PROT_ASCII, "", 0} ;
+  VlFileMeta rnd  = {0, "%.ppm",   VL_PROT_ASCII, "", 0} ;
 
 #define ERRF(msg, arg) {                                        \
     err = VL_ERR_BAD_ARG ;                                      \
@@ -246,6 +381,7 @@ main(int argc, char **argv)
       printf ("Meta         filespec: `%s'\n", met.pattern) ;
       printf ("GSS          filespec: '%s'\n", gss.pattern) ;
       printf ("Read frames  filespec: '%s'\n", ifr.pattern) ;
+      printf ("Render       filespec: '%s'\n", rnd.pattern) ;
       printf ("Version: driver %s; libvl %s\n",
               VL_XSTRINGIFY(VL_SIFT_DRIVER_VERSION),
               vl_get_version_string()) ;
@@ -321,6 +457,14 @@ main(int argc, char **argv)
             argv [optind - 1]) ;
       break ;
 
+    case 'j' :
+      /* --threads ............................................... */
+      n = sscanf (optarg, "%d", &num_threads) ;
+      if (n == 0 || num_threads < 1)
+        ERRF("The argument of '%s' must be a positive integer.",
+            argv [optind - 1]) ;
+      break ;
+
     case opt_first_octave :
       /* --first-octave ......................................... */
       n = sscanf (optarg, "%d", &omin) ;
@@ -361,6 +505,39 @@ main(int argc, char **argv)
       force_orientations = 1 ;
       break ;
 
+    case opt_render :
+      /* --render ............................................... */
+      err = vl_file_meta_parse (&rnd, optarg) ;
+      if (err)
+        ERRF("The arguments of '%s' is invalid.", argv [optind - 1]) ;
+      break ;
+
+    case opt_render_top :
+      /* --render-top ........................................... */
+      n = sscanf (optarg, "%d", &render_top) ;
+      if (n == 0 || render_top < 0)
+        ERRF("The argument of '%s' must be a non-negative integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_max_memory :
+      /* --max-memory ........................................... */
+      n = sscanf (optarg, "%lf", &max_memory) ;
+      if (n == 0 || max_memory < 0)
+        ERRF("The argument of '%s' must be a non-negative float.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_approximate :
+      /* --approximate .......................................... */
+      approximate = 1 ;
+      break ;
+
+    case opt_compact :
+      /* --compact .............................................. */
+      compact = 1 ;
+      break ;
+
     case 0 :
     default :
       /* should not get here ...................................... */
@@ -368,6 +545,20 @@ main(int argc, char **argv)
     }
   }
 
+  /* the tiles do not support sourcing frames or saving the GSS */
+  if (! err && max_memory > 0 && (ifr.active || gss.active)) {
+    err = VL_ERR_BAD_ARG ;
+    snprintf(err_msg, sizeof(err_msg),
+             "--max-memory cannot be used with --read-frames or --gss.") ;
+  }
+
+  /* the compact scale space is not stored in single precision */
+  if (! err && compact && gss.active) {
+    err = VL_ERR_BAD_ARG ;
+    snprintf(err_msg, sizeof(err_msg),
+             "--compact cannot be used with --gss.") ;
+  }
+
   /* check for parsing errors */
   if (err) {
     fprintf(stderr, "%s: error: %s (%d)\n",
@@ -384,7 +575,7 @@ main(int argc, char **argv)
      if --output is not specified, specifying --frames or --descriptors
      prevent the aggregate outout file to be produced.
   */
-  if (! force_output && (frm.active || dsc.active)) {
+  if (! force_output && (frm.active || dsc.active || rnd.active)) {
     out.active = 0 ;
   }
 
@@ -401,11 +592,33 @@ main(int argc, char **argv)
     PRNFO("write meta ...... ", met) ;
     PRNFO("write GSS ....... ", gss) ;
     PRNFO("read  frames .... ", ifr) ;
+    PRNFO("write render .... ", rnd) ;
 
     if (force_orientations)
       printf("sift: will compute orientations\n") ;
   }
 
+  /* ------------------------------------------------------------------
+   *                                                       Make filters
+   * --------------------------------------------------------------- */
+
+  /* the batch keeps the filters of the last image sizes and the
+     frame buffers from one image to the next */
+  batch = vl_sift_batch_new (O, S, omin) ;
+  if (! batch) {
+    fprintf (stderr, "sift: err: Could not create SIFT filter.\n") ;
+    exit (1) ;
+  }
+  if (edge_thresh >= 0) vl_sift_batch_set_edge_thresh (batch, edge_thresh) ;
+  if (peak_thresh >= 0) vl_sift_batch_set_peak_thresh (batch, peak_thresh) ;
+  if (magnif      >= 0) vl_sift_batch_set_magnif      (batch, magnif) ;
+  vl_sift_batch_set_num_threads (batch, num_threads) ;
+  vl_sift_batch_set_descriptors (batch, out.active || dsc.active) ;
+  vl_sift_batch_set_max_memory  (batch,
+                                 (vl_size) (max_memory * 1024 * 1024)) ;
+  vl_sift_batch_set_approximate (batch, approximate) ;
+  vl_sift_batch_set_compact     (batch, compact) ;
+
   /* ------------------------------------------------------------------
    *                                         Process one image per time
    * --------------------------------------------------------------- */
@@ -422,12 +635,24 @@ main(int argc, char **argv)
 
     VlSiftFilt      *filt = 0 ;
     vl_size          q ;
-    int              i ;
+    int              i, j, nframes ;
     vl_bool          first ;
 
     double           *ikeys = 0 ;
     int              nikeys = 0, ikeys_size = 0 ;
 
+    FrameWriter      writer = {0, 0, 0, 0, 0, 0, 0} ;
+
+    VlSiftKeypoint   *okeys = 0 ;
+    double           *oangles = 0 ;
+    int              *onangles = 0 ;
+    int              okeys_size = 0, oangles_size = 0, onangles_size = 0 ;
+
+    VlSiftKeypoint   *dkeys = 0 ;
+    double           *dangles = 0 ;
+    vl_sift_pix      *descrs = 0 ;
+    int              dkeys_size = 0, dangles_size = 0, descrs_size = 0 ;
+
     /* ...............................................................
      *                                                 Determine files
      * ............................................................ */
@@ -592,23 +817,21 @@ main(int argc, char **argv)
     err = vl_file_meta_open (&dsc, basename, "wb") ; WERR(dsc.name, writing) ;
     err = vl_file_meta_open (&frm, basename, "wb") ; WERR(frm.name, writing) ;
     err = vl_file_meta_open (&met, basename, "wb") ; WERR(met.name, writing) ;
+    err = vl_file_meta_open (&rnd, basename, "wb") ; WERR(rnd.name, writing) ;
 
     if (verbose > 1) {
       if (out.active) printf("sift: writing all ....... to . '%s'\n", out.name);
       if (frm.active) printf("sift: writing frames .... to . '%s'\n", frm.name);
       if (dsc.active) printf("sift: writing descriptors to . '%s'\n", dsc.name);
       if (met.active) printf("sift: writign meta ...... to . '%s'\n", met.name);
+      if (rnd.active) printf("sift: writing render .... to . '%s'\n", rnd.name);
     }
 
     /* ...............................................................
-     *                                                     Make filter
+     *                                                      Get filter
      * ............................................................ */
 
-    filt = vl_sift_new (pim.width, pim.height, O, S, omin) ;
-
-    if (edge_thresh >= 0) vl_sift_set_edge_thresh (filt, edge_thresh) ;
-    if (peak_thresh >= 0) vl_sift_set_peak_thresh (filt, peak_thresh) ;
-    if (magnif      >= 0) vl_sift_set_magnif      (filt, magnif) ;
+    filt = vl_sift_batch_get_filter (batch, pim.width, pim.height) ;
 
     if (!filt) {
       snprintf (err_msg, sizeof(err_msg),
@@ -631,18 +854,61 @@ main(int argc, char **argv)
               vl_sift_get_peak_thresh  (filt)) ;
       printf ("sift:   magnif                = %g\n",
               vl_sift_get_magnif       (filt)) ;
+      printf ("sift:   threads               = %d\n",
+              vl_sift_get_num_threads  (filt)) ;
+      if (max_memory > 0) {
+        printf ("sift:   max memory            = %g MB\n", max_memory) ;
+      }
+      printf ("sift:   approximate           = %s\n",
+              vl_sift_get_approximate  (filt) ? "yes" : "no") ;
+      printf ("sift:   compact               = %s\n",
+              vl_sift_get_compact      (filt) ? "yes" : "no") ;
       printf ("sift: will source frames? %s\n",
               ikeys ? "yes" : "no") ;
       printf ("sift: will force orientations? %s\n",
               force_orientations ? "yes" : "no") ;
     }
 
+    writer.out    = &out ;
+    writer.frm    = &frm ;
+    writer.dsc    = &dsc ;
+    writer.render = rnd.active ;
+
     /* ...............................................................
-     *                                             Process each octave
+     *                                         Process the whole image
+     * ............................................................ */
+
+    if (! ifr.active && ! gss.active) {
+      vl_sift_batch_clear (batch) ;
+      err = vl_sift_batch_process (batch, fdata, pim.width, pim.height) ;
+      if (err) {
+        if (max_memory > 0) {
+          snprintf (err_msg, sizeof(err_msg),
+                    "Could not process the image within %g MB.", max_memory) ;
+        } else {
+          snprintf (err_msg, sizeof(err_msg),
+                    "Could not allocate enough memory.") ;
+        }
+        goto done ;
+      }
+      err = write_frames (&writer,
+                          vl_sift_batch_get_keypoints (batch),
+                          vl_sift_batch_get_angles (batch),
+                          vl_sift_batch_get_descriptors (batch),
+                          (int) vl_sift_batch_get_num_frames (batch)) ;
+      if (err) {
+        snprintf (err_msg, sizeof(err_msg),
+                  "Could not allocate enough memory.") ;
+        goto done ;
+      }
+    }
+
+    /* ...............................................................
+     *         Process each octave (sourcing frames or saving the GSS)
      * ............................................................ */
     i     = 0 ;
     first = 1 ;
-    while (1) {
+    while (ifr.active || gss.active) {
       VlSiftKeypoint const *keys = 0 ;
       int                   nkeys ;
 
@@ -654,10 +920,15 @@ main(int argc, char **argv)
         err = vl_sift_process_next_octave  (filt) ;
       }
 
-      if (err) {
+      if (err == VL_ERR_EOF) {
         err = VL_ERR_OK ;
         break ;
       }
+      if (err) {
+        snprintf (err_msg, sizeof(err_msg),
+                  "Could not allocate enough memory.") ;
+        goto done ;
+      }
 
       if (verbose > 1) {
         printf("sift: GSS octave %d computed\n",
@@ -676,28 +947,23 @@ main(int argc, char **argv)
 
       /* run detector ............................................. */
       if (ikeys == 0) {
-        vl_sift_detect (filt) ;
+        err = vl_sift_detect (filt) ;
+        if (err) {
+          snprintf (err_msg, sizeof(err_msg),
+                    "Could not allocate enough memory.") ;
+          goto done ;
+        }
 
         keys  = vl_sift_get_keypoints     (filt) ;
         nkeys = vl_sift_get_nkeypoints (filt) ;
-        i     = 0 ;
 
         if (verbose > 1) {
           printf ("sift: detected %d (unoriented) keypoints\n", nkeys) ;
         }
       } else {
-        nkeys = nikeys ;
-      }
-
-      /* for each keypoint ........................................ */
-      for (; i < nkeys ; ++i) {
-        double                angles [4] ;
-        int                   nangles ;
-        VlSiftKeypoint        ik ;
-        VlSiftKeypoint const *k ;
-
-        /* obtain keypoint orientations ........................... */
-        if (ikeys) {
+        /* the source keypoints of this octave, sorted by scale */
+        for (nkeys = 0 ; i < nikeys ; ++i, ++nkeys) {
+          VlSiftKeypoint ik ;
           vl_sift_keypoint_init (filt, &ik,
                                  ikeys [4 * i + 0],
                                  ikeys [4 * i + 1],
@@ -707,62 +973,105 @@ main(int argc, char **argv)
             break ;
           }
 
-          k          = &ik ;
-
-          /* optionally compute orientations too */
-          if (force_orientations) {
-            nangles = vl_sift_calc_keypoint_orientations
-              (filt, angles, k) ;
-          } else {
-            angles [0] = ikeys [4 * i + 3] ;
-            nangles    = 1 ;
+          err = reserve ((void**) &okeys, &okeys_size, nkeys + 1,
+                         sizeof(VlSiftKeypoint)) ;
+          if (! err) err = reserve ((void**) &oangles, &oangles_size,
+                                    4 * (nkeys + 1), sizeof(double)) ;
+          if (! err) err = reserve ((void**) &onangles, &onangles_size,
+                                    nkeys + 1, sizeof(int)) ;
+          if (err) {
+            snprintf (err_msg, sizeof(err_msg),
+                      "Could not allocate enough memory.") ;
+            goto done ;
           }
-        } else {
-          k = keys + i ;
-          nangles = vl_sift_calc_keypoint_orientations
-            (filt, angles, k) ;
+
+          okeys    [nkeys]     = ik ;
+          oangles  [4 * nkeys] = ikeys [4 * i + 3] ;
+          onangles [nkeys]     = 1 ;
         }
+        keys = okeys ;
+      }
 
-        /* for each orientation ................................... */
-        for (q = 0 ; q < (unsigned) nangles ; ++q) {
-          vl_sift_pix descr [128] ;
+      /* obtain keypoint orientations ............................. */
+      if (ikeys == 0 || force_orientations) {
+        err = reserve ((void**) &oangles, &oangles_size,
+                       4 * nkeys, sizeof(double)) ;
+        if (! err) err = reserve ((void**) &onangles, &onangles_size,
+                                  nkeys, sizeof(int)) ;
+        if (err) {
+          snprintf (err_msg, sizeof(err_msg),
+                    "Could not allocate enough memory.") ;
+          goto done ;
+        }
+        vl_sift_calc_keypoints_orientations (filt, oangles, onangles,
+                                             keys, nkeys) ;
+      }
 
-          /* compute descriptor (if necessary) */
-          if (out.active || dsc.active) {
-            vl_sift_calc_keypoint_descriptor
-              (filt, descr, k, angles [q]) ;
+      /* one frame for each orientation of each keypoint .......... */
+      for (nframes = 0, j = 0 ; j < nkeys ; ++j) {
+        for (q = 0 ; q < (unsigned) onangles [j] ; ++q, ++nframes) {
+          err = reserve ((void**) &dkeys, &dkeys_size, nframes + 1,
+                         sizeof(VlSiftKeypoint)) ;
+          if (! err) err = reserve ((void**) &dangles, &dangles_size,
+                                    nframes + 1, sizeof(double)) ;
+          if (err) {
+            snprintf (err_msg, sizeof(err_msg),
+                      "Could not allocate enough memory.") ;
+            goto done ;
           }
+          dkeys   [nframes] = keys [j] ;
+          dangles [nframes] = oangles [4 * j + q] ;
+        }
+      }
 
-          if (out.active) {
-            int l ;
-            vl_file_meta_put_double (&out, k -> x     ) ;
-            vl_file_meta_put_double (&out, k -> y     ) ;
-            vl_file_meta_put_double (&out, k -> sigma ) ;
-            vl_file_meta_put_double (&out, angles [q] ) ;
-            for (l = 0 ; l < 128 ; ++l) {
-              vl_file_meta_put_uint8 (&out, (vl_uint8) (512.0 * descr [l])) ;
-            }
-            if (out.protocol == VL_PROT_ASCII) fprintf(out.file, "\n") ;
-          }
+      /* compute descriptors (if necessary) ....................... */
+      if (out.active || dsc.active) {
+        err = reserve ((void**) &descrs, &descrs_size,
+                       128 * nframes, sizeof(vl_sift_pix)) ;
+        if (err) {
+          snprintf (err_msg, sizeof(err_msg),
+                    "Could not allocate enough memory.") ;
+          goto done ;
+        }
+        vl_sift_calc_keypoints_descriptors (filt, descrs, dkeys, dangles,
+                                            nframes) ;
+      }
 
-          if (frm.active) {
-            vl_file_meta_put_double (&frm, k -> x     ) ;
-            vl_file_meta_put_double (&frm, k -> y     ) ;
-            vl_file_meta_put_double (&frm, k -> sigma ) ;
-            vl_file_meta_put_double (&frm, angles [q] ) ;
-            if (frm.protocol == VL_PROT_ASCII) fprintf(frm.file, "\n") ;
-          }
+      /* write frames ............................................. */
+      err = write_frames (&writer, dkeys, dangles, descrs, nframes) ;
+      if (err) {
+        snprintf (err_msg, sizeof(err_msg),
+                  "Could not allocate enough memory.") ;
+        goto done ;
+      }
+    }
 
-          if (dsc.active) {
-            int l ;
-            for (l = 0 ; l < 128 ; ++l) {
-              double x = 512.0 * descr[l] ;
-              x = (x < 255.0) ? x : 255.0 ;
-              vl_file_meta_put_uint8 (&dsc, (vl_uint8) (x)) ;
-            }
-            if (dsc.protocol == VL_PROT_ASCII) fprintf(dsc.file, "\n") ;
-          }
-        }
+    /* ...............................................................
+     *                                          Draw frames over image
+     * ............................................................ */
+
+    if (rnd.active) {
+      err = vl_overlay_set_image (&overlay, data, pim.width, pim.height) ;
+      if (! err) {
+        err = vl_overlay_draw_frames (&overlay, writer.rkeys, writer.nrkeys,
+                                      render_top) ;
+      }
+      if (err) {
+        snprintf (err_msg, sizeof(err_msg),
+                  "Could not allocate enough memory.") ;
+        goto done ;
+      }
+
+      err = vl_overlay_insert_ppm (&overlay, rnd.file) ;
+      if (err) {
+        snprintf (err_msg, sizeof(err_msg),
+                  "Could not write '%s'.", rnd.name) ;
+        goto done ;
+      }
+
+      if (verbose) {
+        printf ("sift: drew %d of %d frames to '%s'\n",
+                VL_MIN (writer.nrkeys, render_top), writer.nrkeys, rnd.name) ;
       }
     }
 
@@ -779,6 +1088,9 @@ main(int argc, char **argv)
       if (frm.active) {
         fprintf(met.file,"  frames      = '%s'\n", frm.name) ;
       }
+      if (rnd.active) {
+        fprintf(met.file,"  render      = '%s'\n", rnd.name) ;
+      }
       fprintf(met.file, ">\n") ;
     }
 
@@ -790,12 +1102,21 @@ main(int argc, char **argv)
       ikeys = 0 ;
     }
 
-    /* release filter */
-    if (filt) {
-      vl_sift_delete (filt) ;
-      filt = 0 ;
+    /* release rendered keys buffer */
+    if (writer.rkeys) {
+      free (writer.rkeys) ;
+      writer.rkeys_size = writer.nrkeys = 0 ;
+      writer.rkeys = 0 ;
     }
 
+    /* release octave keys buffers */
+    if (okeys)    free (okeys) ;
+    if (oangles)  free (oangles) ;
+    if (onangles) free (onangles) ;
+    if (dkeys)    free (dkeys) ;
+    if (dangles)  free (dangles) ;
+    if (descrs)   free (descrs) ;
+
     /* release image data */
     if (fdata) {
       free (fdata) ;
@@ -820,6 +1141,7 @@ main(int argc, char **argv)
     vl_file_meta_close (&met) ;
     vl_file_meta_close (&gss) ;
     vl_file_meta_close (&ifr) ;
+    vl_file_meta_close (&rnd) ;
 
     /* if bad print error message */
     if (err) {
@@ -832,6 +1154,9 @@ main(int argc, char **argv)
     }
   }
 
+  vl_overlay_free (&overlay) ;
+  vl_sift_batch_delete (batch) ;
+
   /* quit */
   return exit_code ;
 }
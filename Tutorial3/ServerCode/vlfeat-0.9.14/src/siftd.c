@@ -0,0 +1,933 @@
+/** @internal
+ ** @file     siftd.c
+ ** @brief    Scale Invariant Feature Transform (SIFT) - Server
+ **
+ ** A long running process that computes SIFT keypoints for jobs
+ ** received over a local (Unix domain) socket. Each job is a single
+ ** request made of the fields
+ **
+ ** @verbatim
+ ** sift INPUT OUTPUT
+ ** @endverbatim
+ **
+ ** each followed by a NUL byte (so that paths may contain spaces and
+ ** newlines), to which the server answers with a line <code>ok
+ ** N</code> followed by N lines <code>x y sigma angle</code>, or with
+ ** a line <code>error MESSAGE</code>. INPUT is a grayscale PGM or a
+ ** BMP, which is converted to gray. The image with the keypoints
+ ** drawn on it (see overlay.h) is written to OUTPUT, as a BMP if its
+ ** name ends in <code>.bmp</code> and as a PPM otherwise, unless
+ ** OUTPUT is <code>-</code>. BMP lets a client such as PHP GD convert
+ ** from and to other formats in a single call. OUTPUT must be an
+ ** absolute path in the output directory of the server or below it,
+ ** and is not written through a symbolic link.
+ **
+ ** The request <code>params</code> is answered by <code>ok
+ ** 1</code> and a line with every setting that affects the results,
+ ** as <code>name=value</code> pairs, so that clients can tell whether
+ ** results they stored are still valid (e.g. as a cache key).
+ **
+ ** The socket is accessible by the user and the group of the server
+ ** only, and a client that does not send its request in time is
+ ** dropped.
+ **
+ ** Jobs are served by a pool of worker threads. Each worker keeps a
+ ** SIFT batch (see ::vl_sift_batch_new) between jobs, with a filter for
+ ** each of the last few image sizes, so that images of these sizes do
+ ** not allocate anything.
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#define VL_SIFTD_DRIVER_VERSION 0.3
+
+/* realpath and O_NOFOLLOW are not in C99 */
+#define _XOPEN_SOURCE 700
+
+#include "overlay.h"
+
+#include <vl/generic.h>
+#include <vl/mathop.h>
+#include <vl/pgm.h>
+#include <vl/sift.h>
+#include <vl/getopt_long.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+#if defined(VL_THREADS_POSIX) && ! defined(VL_DISABLE_THREADS)
+#define SIFTD_SUPPORTED
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
+/* ----------------------------------------------------------------- */
+/* help message */
+char const help_message [] =
+  "Usage: %s [options]\n"
+  "\n"
+  "Options include:\n"
+  " --verbose -v    Be verbose\n"
+  " --help -h       Print this help message\n"
+  " --socket -s     Path of the socket to listen on\n"
+  " --output-dir -o Directory the outputs are written to\n"
+  " --timeout       Seconds a client has to send its request\n"
+  " --workers -j    Number of worker threads\n"
+  " --threads       Number of threads of each job\n"
+  " --octaves -O    Number of octaves\n"
+  " --levels -S     Number of levels per octave\n"
+  " --first-octave  Index of the first octave\n"
+  " --edge-thresh   Specify the edge threshold\n"
+  " --peak-thresh   Specify the peak threshold\n"
+  " --magnif        Specify the magnification factor\n"
+  " --render-top    Number of frames drawn on the output image\n"
+  " --max-memory    Memory limit of the scale space of a job in MB\n"
+  " --approximate   Approximate the scale space by box filters\n"
+  " --compact       Store the scale space in 16 bits\n"
+  "\n" ;
+
+/* ----------------------------------------------------------------- */
+/* long options codes */
+enum {
+  opt_first_octave = 1000,
+  opt_edge_thresh,
+  opt_peak_thresh,
+  opt_magnif,
+  opt_render_top,
+  opt_threads,
+  opt_max_memory,
+  opt_approximate,
+  opt_compact,
+  opt_timeout
+} ;
+
+/* short options */
+char const opts [] = "vhs:o:j:O:S:" ;
+
+/* long options */
+struct option const longopts [] = {
+  { "verbose",         no_argument,            0,          'v'              },
+  { "help",            no_argument,            0,          'h'              },
+  { "socket",          required_argument,      0,          's'              },
+  { "output-dir",      required_argument,      0,          'o'              },
+  { "timeout",         required_argument,      0,          opt_timeout      },
+  { "workers",         required_argument,      0,          'j'              },
+  { "octaves",         required_argument,      0,          'O'              },
+  { "levels",          required_argument,      0,          'S'              },
+  { "first-octave",    required_argument,      0,          opt_first_octave },
+  { "edge-thresh",     required_argument,      0,          opt_edge_thresh  },
+  { "peak-thresh",     required_argument,      0,          opt_peak_thresh  },
+  { "magnif",          required_argument,      0,          opt_magnif       },
+  { "render-top",      required_argument,      0,          opt_render_top   },
+  { "threads",         required_argument,      0,          opt_threads      },
+  { "max-memory",      required_argument,      0,          opt_max_memory   },
+  { "approximate",     no_argument,            0,          opt_approximate  },
+  { "compact",         no_argument,            0,          opt_compact      },
+  { 0,                 0,                      0,          0                }
+} ;
+
+/* ----------------------------------------------------------------- */
+/** @brief SIFT parameters, shared by all workers
+ ** @internal
+ **/
+typedef struct _SiftParams
+{
+  int    O ;
+  int    S ;
+  int    omin ;
+  double edge_thresh ;
+  double peak_thresh ;
+  double magnif ;
+  int    render_top ;
+  int    threads ;
+  double max_memory ;   /**< in MB, 0 for no limit */
+  int    approximate ;  /**< smooth by box filters */
+  int    compact ;      /**< store the scale space in 16 bits */
+  int    verbose ;
+  char  *output_dir ;   /**< absolute, without a trailing slash */
+  double timeout ;      /**< in seconds, to receive a request */
+} SiftParams ;
+
+#ifdef SIFTD_SUPPORTED
+
+/** @brief Pending connections
+ ** @internal
+ **/
+#define QUEUE_SIZE 64
+
+typedef struct _JobQueue
+{
+  int             fds [QUEUE_SIZE] ;
+  int             first ;
+  int             size ;
+  pthread_mutex_t mutex ;
+  pthread_cond_t  not_empty ;
+  pthread_cond_t  not_full ;
+} JobQueue ;
+
+/** @brief Worker state, kept between jobs
+ ** @internal
+ **/
+typedef struct _Worker
+{
+  pthread_t         thread ;
+  int               id ;
+  SiftParams const *params ;
+  JobQueue         *queue ;
+
+  VlSiftBatch      *batch ;        /**< filters of the last image sizes */
+  vl_uint8         *data ;
+  vl_sift_pix      *fdata ;
+  vl_size           npixels ;      /**< capacity of the buffers */
+  vl_uint8         *row ;          /**< BMP row */
+  vl_size           row_size ;     /**< capacity of row */
+  double           *frames ;       /**< x, y, sigma, angle */
+  vl_size           nframes ;
+  vl_size           frames_size ;  /**< capacity of frames */
+  VlOverlay         overlay ;      /**< output image */
+  char             *reply ;        /**< reply to the current job */
+  vl_size           reply_length ;
+  vl_size           reply_size ;   /**< capacity of reply */
+} Worker ;
+
+/* ----------------------------------------------------------------- */
+/** @brief Add a connection to the queue, waiting if it is full
+ ** @internal
+ **/
+static void
+queue_push (JobQueue * q, int fd)
+{
+  pthread_mutex_lock (&q->mutex) ;
+  while (q->size == QUEUE_SIZE) {
+    pthread_cond_wait (&q->not_full, &q->mutex) ;
+  }
+  q->fds [(q->first + q->size) % QUEUE_SIZE] = fd ;
+  ++ q->size ;
+  pthread_cond_signal (&q->not_empty) ;
+  pthread_mutex_unlock (&q->mutex) ;
+}
+
+/** @brief Take the oldest connection from the queue
+ ** @internal
+ **/
+static int
+queue_pop (JobQueue * q)
+{
+  int fd ;
+  pthread_mutex_lock (&q->mutex) ;
+  while (q->size == 0) {
+    pthread_cond_wait (&q->not_empty, &q->mutex) ;
+  }
+  fd = q->fds [q->first] ;
+  q->first = (q->first + 1) % QUEUE_SIZE ;
+  -- q->size ;
+  pthread_cond_signal (&q->not_full) ;
+  pthread_mutex_unlock (&q->mutex) ;
+  return fd ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Make room for an image of @a npixels pixels
+ ** @internal
+ **/
+static int
+reserve_image (Worker * w, vl_size npixels)
+{
+  if (npixels <= w->npixels) return VL_ERR_OK ;
+
+  free (w->data) ;
+  free (w->fdata) ;
+  w->data  = malloc (npixels * sizeof(vl_uint8)) ;
+  w->fdata = malloc (npixels * sizeof(vl_sift_pix)) ;
+  w->npixels = 0 ;
+
+  if (! w->data || ! w->fdata) return VL_ERR_ALLOC ;
+  w->npixels = npixels ;
+  return VL_ERR_OK ;
+}
+
+/** @internal @brief Little endian integer of @a n bytes */
+static vl_uint32
+get_le (vl_uint8 const * pt, int n)
+{
+  vl_uint32 x = 0 ;
+  while (n --) x = (x << 8) | pt [n] ;
+  return x ;
+}
+
+/** @brief Read a BMP image as gray into the worker buffers
+ ** @internal
+ **
+ ** Uncompressed 8 bit (palette), 24 and 32 bit images are supported,
+ ** stored either bottom-up or top-down. Colors are converted to gray
+ ** with the weights of MATLAB @c rgb2gray.
+ **/
+static int
+read_bmp (Worker * w, FILE * f, int * width, int * height)
+{
+  vl_uint8 head [54] ;
+  vl_uint8 gray [256] ;
+  vl_uint32 offset, head_size, compression, ncolors ;
+  int bpp, top_down, x, y, err ;
+  vl_size stride ;
+
+  if (fread (head, 1, sizeof(head), f) < sizeof(head) ||
+      head [0] != 'B' || head [1] != 'M') return VL_ERR_BAD_ARG ;
+
+  offset      = get_le (head + 10, 4) ;
+  head_size   = get_le (head + 14, 4) ;
+  *width      = (vl_int32) get_le (head + 18, 4) ;
+  *height     = (vl_int32) get_le (head + 22, 4) ;
+  bpp         = get_le (head + 28, 2) ;
+  compression = get_le (head + 30, 4) ;
+  ncolors     = get_le (head + 46, 4) ;
+
+  top_down = *height < 0 ;
+  if (top_down) *height = - *height ;
+
+  if (head_size < 40 || compression != 0 ||
+      (bpp != 8 && bpp != 24 && bpp != 32) ||
+      *width <= 0 || *width > 0x8000 ||
+      *height <= 0 || *height > 0x8000) return VL_ERR_BAD_ARG ;
+
+  /* gray level of each palette entry, stored as BGR0 */
+  if (bpp == 8) {
+    vl_uint8 color [4] ;
+    int k ;
+    if (ncolors == 0 || ncolors > 256) ncolors = 256 ;
+    memset (gray, 0, sizeof(gray)) ;
+    if (fseek (f, 14 + head_size, SEEK_SET)) return VL_ERR_IO ;
+    for (k = 0 ; k < (signed) ncolors ; ++k) {
+      if (fread (color, 1, 4, f) < 4) return VL_ERR_IO ;
+      gray [k] = (vl_uint8)
+        ((2989 * color [2] + 5870 * color [1] + 1140 * color [0] + 5000)
+         / 10000) ;
+    }
+  }
+
+  stride = (((vl_size) *width * bpp + 31) / 32) * 4 ;
+  if (w->row_size < stride) {
+    vl_uint8 * row = realloc (w->row, stride) ;
+    if (! row) return VL_ERR_ALLOC ;
+    w->row      = row ;
+    w->row_size = stride ;
+  }
+  err = reserve_image (w, (vl_size) *width * *height) ;
+  if (err) return err ;
+  if (fseek (f, offset, SEEK_SET)) return VL_ERR_IO ;
+
+  for (y = 0 ; y < *height ; ++y) {
+    vl_uint8 * dst = w->data + (vl_size) (top_down ? y : *height - 1 - y) * *width ;
+    vl_uint8 const * pt = w->row ;
+    if (fread (w->row, 1, stride, f) < stride) return VL_ERR_IO ;
+    if (bpp == 8) {
+      for (x = 0 ; x < *width ; ++x) dst [x] = gray [pt [x]] ;
+    } else {
+      int step = bpp / 8 ;
+      for (x = 0 ; x < *width ; ++x, pt += step) {
+        dst [x] = (vl_uint8)
+          ((2989 * pt [2] + 5870 * pt [1] + 1140 * pt [0] + 5000) / 10000) ;
+      }
+    }
+  }
+  return VL_ERR_OK ;
+}
+
+/** @brief Read a PGM or BMP image into the worker buffers
+ ** @internal
+ **/
+static int
+read_image (Worker * w, FILE * f, int * width, int * height)
+{
+  VlPgmImage pim ;
+  int err, c = getc (f) ;
+
+  ungetc (c, f) ;
+  if (c == 'B') return read_bmp (w, f, width, height) ;
+
+  err = vl_pgm_extract_head (f, &pim) ;
+  if (! err && vl_pgm_get_bpp (&pim) != 1) err = VL_ERR_BAD_ARG ;
+  if (! err) err = reserve_image (w, vl_pgm_get_npixels (&pim)) ;
+  if (! err) err = vl_pgm_extract_data (f, &pim, w->data) ;
+  if (! err) {
+    *width  = pim.width ;
+    *height = pim.height ;
+  }
+  return err ;
+}
+
+/** @brief Append a frame to the results of the current job
+ ** @internal
+ **/
+static int
+add_frame (Worker * w, double x, double y, double sigma, double angle)
+{
+  if (w->nframes == w->frames_size) {
+    vl_size size = w->frames_size ? 2 * w->frames_size : 1024 ;
+    double * frames = realloc (w->frames, 4 * sizeof(double) * size) ;
+    if (! frames) return VL_ERR_ALLOC ;
+    w->frames      = frames ;
+    w->frames_size = size ;
+  }
+  w->frames [4 * w->nframes + 0] = x ;
+  w->frames [4 * w->nframes + 1] = y ;
+  w->frames [4 * w->nframes + 2] = sigma ;
+  w->frames [4 * w->nframes + 3] = angle ;
+  ++ w->nframes ;
+  return VL_ERR_OK ;
+}
+
+/** @brief Append formatted text to the reply of the current job
+ ** @internal
+ **/
+static void
+reply (Worker * w, char const * format, ...)
+{
+  va_list args ;
+  int n ;
+
+  while (1) {
+    vl_size room = w->reply_size - w->reply_length ;
+    va_start (args, format) ;
+    n = vsnprintf (w->reply + w->reply_length, room, format, args) ;
+    va_end (args) ;
+    if (n < 0) return ;
+    if ((vl_size) n < room) break ;
+
+    {
+      vl_size size = 2 * w->reply_size + n + 1 ;
+      char * buffer = realloc (w->reply, size) ;
+      if (! buffer) return ;
+      w->reply      = buffer ;
+      w->reply_size = size ;
+    }
+  }
+  w->reply_length += n ;
+}
+
+/** @brief Read a NUL terminated field of a request
+ ** @internal
+ **
+ ** Fails if the field does not fit @a size bytes, or if the client
+ ** hangs up or does not send it in time (see ::SiftParams::timeout).
+ **/
+static vl_bool
+read_field (int fd, char * field, vl_size size)
+{
+  vl_size length = 0 ;
+  while (length < size) {
+    ssize_t n = read (fd, field + length, 1) ;
+    if (n <= 0) return VL_FALSE ;
+    if (field [length] == 0) return VL_TRUE ;
+    ++ length ;
+  }
+  return VL_FALSE ;
+}
+
+/** @brief Open an output file in the output directory
+ ** @internal
+ **
+ ** The directory of @a path, with the symbolic links resolved, must
+ ** be the output directory or one of its subdirectories, and the
+ ** file itself must not be a symbolic link.
+ **/
+static FILE *
+open_output (SiftParams const * p, char const * path)
+{
+  char dir [PATH_MAX] ;
+  char real [PATH_MAX] ;
+  char const * name = strrchr (path, '/') ;
+  vl_size length = strlen (p->output_dir) ;
+  int fd ;
+
+  if (! name || name - path >= PATH_MAX) return 0 ;
+  memcpy (dir, path, name - path) ;
+  dir [name - path] = 0 ;
+  ++ name ;
+  if (! *name || ! strcmp (name, ".") || ! strcmp (name, "..")) return 0 ;
+
+  if (! realpath (*dir ? dir : "/", real)) return 0 ;
+  if (strncmp (real, p->output_dir, length) ||
+      (real [length] != 0 && real [length] != '/')) return 0 ;
+
+  fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644) ;
+  if (fd < 0) return 0 ;
+  return fdopen (fd, "wb") ;
+}
+
+/** @brief Send the whole reply
+ ** @internal
+ **/
+static void
+send_reply (Worker * w, int fd)
+{
+  vl_size sent = 0 ;
+  while (sent < w->reply_length) {
+    ssize_t n = write (fd, w->reply + sent, w->reply_length - sent) ;
+    if (n <= 0) break ;
+    sent += n ;
+  }
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Compute the SIFT frames of the image in the worker buffers
+ ** @internal
+ **
+ ** With a memory limit, large images are processed by tiles (see
+ ** ::vl_sift_process_tiled).
+ **/
+static int
+compute_sift (Worker * w, int width, int height)
+{
+  SiftParams const * p = w->params ;
+  VlSiftKeypoint const * keys ;
+  double const * angles ;
+  vl_size q, i ;
+  int err ;
+
+  for (q = 0 ; q < (unsigned) (width * height) ; ++q) {
+    w->fdata [q] = w->data [q] ;
+  }
+
+  if (! w->batch) {
+    w->batch = vl_sift_batch_new (p->O, p->S, p->omin) ;
+    if (! w->batch) return VL_ERR_ALLOC ;
+    if (p->edge_thresh >= 0) vl_sift_batch_set_edge_thresh (w->batch, p->edge_thresh) ;
+    if (p->peak_thresh >= 0) vl_sift_batch_set_peak_thresh (w->batch, p->peak_thresh) ;
+    if (p->magnif      >= 0) vl_sift_batch_set_magnif      (w->batch, p->magnif) ;
+    vl_sift_batch_set_num_threads (w->batch, p->threads) ;
+    vl_sift_batch_set_descriptors (w->batch, 0) ;
+    vl_sift_batch_set_max_memory  (w->batch,
+                                   (vl_size) (p->max_memory * 1024 * 1024)) ;
+    vl_sift_batch_set_approximate (w->batch, p->approximate) ;
+    vl_sift_batch_set_compact     (w->batch, p->compact) ;
+  }
+
+  w->nframes = 0 ;
+  vl_sift_batch_clear (w->batch) ;
+  err = vl_sift_batch_process (w->batch, w->fdata, width, height) ;
+  if (err) return err ;
+
+  keys   = vl_sift_batch_get_keypoints (w->batch) ;
+  angles = vl_sift_batch_get_angles (w->batch) ;
+  for (i = 0 ; i < vl_sift_batch_get_num_frames (w->batch) ; ++i) {
+    if (add_frame (w, keys [i].x, keys [i].y, keys [i].sigma, angles [i])) {
+      return VL_ERR_ALLOC ;
+    }
+  }
+  return VL_ERR_OK ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Reply with the settings that affect the results
+ ** @internal
+ **
+ ** The number of workers and threads is left out, as the frames do
+ ** not depend on it. Negative values stand for the library defaults,
+ ** which are fixed by the library version.
+ **/
+static void
+serve_params (Worker * w)
+{
+  SiftParams const * p = w->params ;
+  reply (w, "ok 1\n") ;
+  reply (w, "octaves=%d levels=%d first-octave=%d "
+         "edge-thresh=%.17g peak-thresh=%.17g magnif=%.17g "
+         "render-top=%d max-memory=%.17g approximate=%d compact=%d "
+         "driver=%s libvl=%s\n",
+         p->O, p->S, p->omin,
+         p->edge_thresh, p->peak_thresh, p->magnif,
+         p->render_top, p->max_memory, p->approximate, p->compact,
+         VL_XSTRINGIFY(VL_SIFTD_DRIVER_VERSION),
+         vl_get_version_string ()) ;
+}
+
+/* ----------------------------------------------------------------- */
+/** @brief Run one job and prepare its reply
+ ** @internal
+ **/
+static void
+serve (Worker * w, int fd)
+{
+  char        command [16] ;
+  char        input [1024] ;
+  char        output [1024] ;
+  FILE       *f = 0 ;
+  int         width = 0, height = 0 ;
+  int         err ;
+  vl_size     i, length ;
+
+  vl_tic () ;
+
+  if (! read_field (fd, command, sizeof(command))) {
+    reply (w, "error bad request\n") ;
+    return ;
+  }
+  if (! strcmp (command, "params")) {
+    serve_params (w) ;
+    return ;
+  }
+  if (strcmp (command, "sift") ||
+      ! read_field (fd, input, sizeof(input)) ||
+      ! read_field (fd, output, sizeof(output))) {
+    reply (w, "error bad request\n") ;
+    return ;
+  }
+
+  /* read image */
+  f = fopen (input, "rb") ;
+  if (! f) {
+    reply (w, "error cannot open '%s'\n", input) ;
+    return ;
+  }
+  err = read_image (w, f, &width, &height) ;
+  fclose (f) ;
+  if (err) {
+    reply (w, "error cannot read '%s'\n", input) ;
+    return ;
+  }
+
+  err = compute_sift (w, width, height) ;
+  if (err) {
+    reply (w, "error out of memory\n") ;
+    return ;
+  }
+
+  /* draw the frames over the image */
+  if (strcmp (output, "-")) {
+    err = vl_overlay_set_image (&w->overlay, w->data, width, height) ;
+    if (! err) err = vl_overlay_draw_frames (&w->overlay, w->frames,
+                                             w->nframes, w->params->render_top) ;
+    if (err) {
+      reply (w, "error out of memory\n") ;
+      return ;
+    }
+    length = strlen (output) ;
+    f = open_output (w->params, output) ;
+    if (f) {
+      if (length > 4 && ! strcmp (output + length - 4, ".bmp")) {
+        err = vl_overlay_insert_bmp (&w->overlay, f) ;
+      } else {
+        err = vl_overlay_insert_ppm (&w->overlay, f) ;
+      }
+      if (fclose (f)) err = VL_ERR_IO ;
+    }
+    if (! f || err) {
+      reply (w, "error cannot write '%s'\n", output) ;
+      return ;
+    }
+  }
+
+  reply (w, "ok %d\n", (int) w->nframes) ;
+  for (i = 0 ; i < w->nframes ; ++i) {
+    double const * fr = w->frames + 4 * i ;
+    reply (w, "%g %g %g %g\n", fr [0], fr [1], fr [2], fr [3]) ;
+  }
+
+  if (w->params->verbose) {
+    printf ("siftd: worker %d: '%s' %d x %d, %d frames, %.3f s\n",
+            w->id, input, width, height, (int) w->nframes,
+            vl_toc ()) ;
+    fflush (stdout) ;
+  }
+}
+
+/** @brief Worker thread
+ ** @internal
+ **/
+static void *
+worker_main (void * arg)
+{
+  Worker * w = arg ;
+  while (1) {
+    int fd = queue_pop (w->queue) ;
+    w->reply_length = 0 ;
+    serve (w, fd) ;
+    send_reply (w, fd) ;
+    close (fd) ;
+  }
+  return 0 ;
+}
+
+#endif /* SIFTD_SUPPORTED */
+
+/* ---------------------------------------------------------------- */
+/** @brief SIFT server entry point
+ **/
+int
+main(int argc, char **argv)
+{
+  char const *socket_path = "/tmp/siftd.sock" ;
+  int         nworkers    = 0 ;
+  int         n ;
+  vl_bool     err         = VL_ERR_OK ;
+  char        err_msg [1024] ;
+
+  char const *output_dir  = "." ;
+  SiftParams  params = {-1, 3, 0, -1, -1, -1, VL_OVERLAY_DEFAULT_TOP, 1, 0, 0, 0, 0, 0, 10} ;
+
+#define ERRF(msg, arg) {                                        \
+    err = VL_ERR_BAD_ARG ;                                      \
+    snprintf(err_msg, sizeof(err_msg), msg, arg) ;              \
+    break ;                                                     \
+  }
+
+  /* -----------------------------------------------------------------
+   *                                                     Parse options
+   * -------------------------------------------------------------- */
+
+  while (!err) {
+    int ch = getopt_long(argc, argv, opts, longopts, 0) ;
+
+    /* end of option list? */
+    if (ch == -1) break;
+
+    switch (ch) {
+
+    case '?' :
+      /* unkown option ............................................ */
+      ERRF("Invalid option '%s'.", argv [optind - 1]) ;
+      break ;
+
+    case ':' :
+      /* missing argument ......................................... */
+      ERRF("Missing mandatory argument for option '%s'.",
+          argv [optind - 1]) ;
+      break ;
+
+    case 'h' :
+      /* --help ................................................... */
+      printf (help_message, argv [0]) ;
+      printf ("Socket: `%s'\n", socket_path) ;
+      printf ("Version: driver %s; libvl %s\n",
+              VL_XSTRINGIFY(VL_SIFTD_DRIVER_VERSION),
+              vl_get_version_string()) ;
+      exit (0) ;
+      break ;
+
+    case 'v' :
+      /* --verbose ................................................ */
+      ++ params.verbose ;
+      break ;
+
+    case 's' :
+      /* --socket ................................................. */
+      socket_path = optarg ;
+      break ;
+
+    case 'o' :
+      /* --output-dir ............................................. */
+      output_dir = optarg ;
+      break ;
+
+    case opt_timeout :
+      /* --timeout ................................................ */
+      n = sscanf (optarg, "%lf", &params.timeout) ;
+      if (n == 0 || params.timeout <= 0)
+        ERRF("The argument of '%s' must be a positive float.",
+            argv [optind - 1]) ;
+      break ;
+
+    case 'j' :
+      /* --workers ................................................ */
+      n = sscanf (optarg, "%d", &nworkers) ;
+      if (n == 0 || nworkers < 1)
+        ERRF("The argument of '%s' must be a positive integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case 'O' :
+      /* --octaves ............................................... */
+      n = sscanf (optarg, "%d", &params.O) ;
+      if (n == 0 || params.O < 0)
+        ERRF("The argument of '%s' must be a non-negative integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case 'S' :
+      /* --levels ............................................... */
+      n = sscanf (optarg, "%d", &params.S) ;
+      if (n == 0 || params.S < 0)
+        ERRF("The argument of '%s' must be a non-negative integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_first_octave :
+      /* --first-octave ......................................... */
+      n = sscanf (optarg, "%d", &params.omin) ;
+      if (n == 0)
+        ERRF("The argument of '%s' must be an integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_edge_thresh :
+      /* --edge-thresh ........................................... */
+      n = sscanf (optarg, "%lf", &params.edge_thresh) ;
+      if (n == 0 || params.edge_thresh < 1)
+        ERRF("The argument of '%s' must be not smaller than 1.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_peak_thresh :
+      /* --peak-thresh ........................................... */
+      n = sscanf (optarg, "%lf", &params.peak_thresh) ;
+      if (n == 0 || params.peak_thresh < 0)
+        ERRF("The argument of '%s' must be a non-negative float.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_magnif :
+      /* --magnif  .............................................. */
+      n = sscanf (optarg, "%lf", &params.magnif) ;
+      if (n == 0 || params.magnif < 1)
+        ERRF("The argument of '%s' must be a non-negative float.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_render_top :
+      /* --render-top ............................................ */
+      n = sscanf (optarg, "%d", &params.render_top) ;
+      if (n == 0 || params.render_top < 0)
+        ERRF("The argument of '%s' must be a non-negative integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_threads :
+      /* --threads ............................................... */
+      n = sscanf (optarg, "%d", &params.threads) ;
+      if (n == 0 || params.threads < 1)
+        ERRF("The argument of '%s' must be a positive integer.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_max_memory :
+      /* --max-memory ............................................ */
+      n = sscanf (optarg, "%lf", &params.max_memory) ;
+      if (n == 0 || params.max_memory < 0)
+        ERRF("The argument of '%s' must be a non-negative float.",
+            argv [optind - 1]) ;
+      break ;
+
+    case opt_approximate :
+      /* --approximate ........................................... */
+      params.approximate = 1 ;
+      break ;
+
+    case opt_compact :
+      /* --compact ............................................... */
+      params.compact = 1 ;
+      break ;
+
+    case 0 :
+    default :
+      /* should not get here ...................................... */
+      abort() ;
+    }
+  }
+
+  if (err) {
+    fprintf(stderr, "%s: error: %s (%d)\n",
+            argv [0],
+            err_msg, err) ;
+    exit (1) ;
+  }
+
+#ifdef SIFTD_SUPPORTED
+  {
+    struct sockaddr_un addr ;
+    struct timeval timeout ;
+    JobQueue queue ;
+    Worker * workers ;
+    mode_t mask ;
+    int listener, i ;
+
+    if (nworkers == 0) nworkers = vl_get_num_cpus () ;
+
+    params.output_dir = realpath (output_dir, NULL) ;
+    if (! params.output_dir) {
+      fprintf (stderr, "%s: error: cannot resolve the output directory '%s'\n",
+               argv [0], output_dir) ;
+      exit (1) ;
+    }
+    /* the root is the only directory that ends with a slash */
+    if (! strcmp (params.output_dir, "/")) params.output_dir [0] = 0 ;
+
+    timeout.tv_sec  = (time_t) params.timeout ;
+    timeout.tv_usec = (suseconds_t) ((params.timeout - timeout.tv_sec) * 1e6) ;
+
+    /* a client hanging up must not kill the server */
+    signal (SIGPIPE, SIG_IGN) ;
+
+    memset (&addr, 0, sizeof(addr)) ;
+    addr.sun_family = AF_UNIX ;
+    if (strlen (socket_path) >= sizeof(addr.sun_path)) {
+      fprintf (stderr, "%s: error: socket path too long\n", argv [0]) ;
+      exit (1) ;
+    }
+    strcpy (addr.sun_path, socket_path) ;
+
+    /* the socket is created for the user and the group only */
+    listener = socket (AF_UNIX, SOCK_STREAM, 0) ;
+    unlink (socket_path) ;
+    mask = umask (S_IXUSR | S_IXGRP | S_IRWXO) ;
+    err = (listener < 0 ||
+           bind (listener, (struct sockaddr *) &addr, sizeof(addr)) ||
+           chmod (socket_path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) ||
+           listen (listener, QUEUE_SIZE)) ;
+    umask (mask) ;
+    if (err) {
+      fprintf (stderr, "%s: error: cannot listen on '%s'\n",
+               argv [0], socket_path) ;
+      exit (1) ;
+    }
+
+    queue.first = 0 ;
+    queue.size  = 0 ;
+    pthread_mutex_init (&queue.mutex, NULL) ;
+    pthread_cond_init  (&queue.not_empty, NULL) ;
+    pthread_cond_init  (&queue.not_full, NULL) ;
+
+    workers = calloc (nworkers, sizeof(Worker)) ;
+    for (i = 0 ; i < nworkers ; ++i) {
+      workers [i].id     = i ;
+      workers [i].params = &params ;
+      workers [i].queue  = &queue ;
+      pthread_create (&workers [i].thread, NULL, worker_main, workers + i) ;
+    }
+
+    if (params.verbose) {
+      printf ("siftd: listening on '%s' with %d workers, writing to '%s/'\n",
+              socket_path, nworkers, params.output_dir) ;
+      fflush (stdout) ;
+    }
+
+    while (1) {
+      int fd = accept (listener, NULL, NULL) ;
+      if (fd < 0) continue ;
+      /* a client that stalls holds a worker until the timeout */
+      setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ;
+      setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) ;
+      queue_push (&queue, fd) ;
+    }
+  }
+#else
+  fprintf (stderr, "%s: error: this build has no POSIX threads\n", argv [0]) ;
+  return 1 ;
+#endif
+}
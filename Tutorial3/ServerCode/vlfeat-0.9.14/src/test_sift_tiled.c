@@ -0,0 +1,118 @@
+/** @file   test_sift_tiled.c
+ ** @brief  Test SIFT with bounded memory against the whole image
+ **
+ ** Usage: test_sift_tiled [IMAGE.pgm], from the VLFeat root by
+ ** default on data/box.pgm.
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "check.h"
+#include <vl/sift.h>
+#include <vl/pgm.h>
+#include <string.h>
+#include <math.h>
+
+/* frames as x, y, sigma, angle */
+typedef struct _Frames
+{
+  int n ;
+  int res ;
+  double *f ;
+} Frames ;
+
+static int
+push_frames (void *data, VlSiftKeypoint const *keys,
+             double const *angles, vl_sift_pix const *descrs VL_UNUSED,
+             int nframes)
+{
+  Frames *frames = data ;
+  int i ;
+  if (frames->n + nframes > frames->res) {
+    frames->res = 2 * (frames->n + nframes) ;
+    frames->f = realloc (frames->f, sizeof(double) * 4 * frames->res) ;
+    check (frames->f != NULL, "out of memory") ;
+  }
+  for (i = 0 ; i < nframes ; ++i) {
+    double *f = frames->f + 4 * (frames->n ++) ;
+    f [0] = keys [i].x ;
+    f [1] = keys [i].y ;
+    f [2] = keys [i].sigma ;
+    f [3] = angles [i] ;
+  }
+  return VL_ERR_OK ;
+}
+
+static int
+compare_frames (void const *a, void const *b)
+{
+  double const *x = a ;
+  double const *y = b ;
+  int i ;
+  for (i = 0 ; i < 4 ; ++i) {
+    if (x [i] < y [i]) return -1 ;
+    if (x [i] > y [i]) return +1 ;
+  }
+  return 0 ;
+}
+
+/* the frames of the image, sorted as the tiles report them in a
+   different order */
+static Frames
+run (vl_sift_pix const *im, int width, int height,
+     vl_bool compact, vl_size max_memory)
+{
+  Frames frames = {0, 0, NULL} ;
+  VlSiftFilt *f = vl_sift_new (width, height, -1, 3, -1) ;
+  int err ;
+  vl_sift_set_compact (f, compact) ;
+  err = vl_sift_process_tiled (f, im, max_memory, VL_FALSE,
+                               push_frames, &frames) ;
+  check (err == VL_ERR_OK, "vl_sift_process_tiled failed (%d)", err) ;
+  vl_sift_delete (f) ;
+  qsort (frames.f, frames.n, sizeof(double) * 4, compare_frames) ;
+  return frames ;
+}
+
+int
+main (int argc, char *argv[])
+{
+  char const *name = (argc > 1) ? argv [1] : "data/box.pgm" ;
+  VlPgmImage pim ;
+  vl_uint8 *data ;
+  vl_sift_pix *im ;
+  int i, compact ;
+
+  check (vl_pgm_read_new (name, &pim, &data) == VL_ERR_OK,
+         "cannot read %s", name) ;
+  im = malloc (sizeof(vl_sift_pix) * pim.width * pim.height) ;
+  for (i = 0 ; i < (int) (pim.width * pim.height) ; ++i) im [i] = data [i] ;
+
+  /* 8 MB splits the 324 x 223 box image in tiles, and the coarser
+     octaves are computed from the base composed by the tiles, with
+     and without compact storage */
+  for (compact = 0 ; compact < 2 ; ++compact) {
+    Frames whole = run (im, pim.width, pim.height, compact, 0) ;
+    Frames tiled = run (im, pim.width, pim.height, compact, 8 << 20) ;
+    check (whole.n > 0, "no frames") ;
+    check (whole.n == tiled.n, "compact %d: %d frames, %d with tiles",
+           compact, whole.n, tiled.n) ;
+    for (i = 0 ; i < 4 * whole.n ; ++i) {
+      check (fabs (whole.f [i] - tiled.f [i]) < 1e-2,
+             "compact %d: frame %d differs with tiles", compact, i / 4) ;
+    }
+    free (whole.f) ;
+    free (tiled.f) ;
+  }
+
+  free (im) ;
+  vl_free (data) ;
+  check_signoff() ;
+  return 0 ;
+}
@@ -21,6 +21,13 @@ enum {
   opt_distance,
   opt_initialization,
   opt_num_repetitions,
+  opt_num_trees,
+  opt_max_num_comparisons,
+  opt_num_threads,
+  opt_batch_size,
+  opt_energy_check_period,
+  opt_dimension,
+  opt_file_type,
   opt_verbose
 } ;
 
@@ -37,6 +44,13 @@ vlmxOption  options [] = {
   {"NumRepetitions",    1,   opt_num_repetitions,    },
   {"Initialization",    1,   opt_initialization      },
   {"Initialisation",    1,   opt_initialization      }, /* UK spelling */
+  {"NumTrees",          1,   opt_num_trees           },
+  {"MaxNumComparisons", 1,   opt_max_num_comparisons },
+  {"NumThreads",        1,   opt_num_threads         },
+  {"BatchSize",         1,   opt_batch_size          },
+  {"EnergyCheckPeriod", 1,   opt_energy_check_period },
+  {"Dimension",         1,   opt_dimension           },
+  {"FileType",          1,   opt_file_type           },
   {0,                   0,   0                       }
 } ;
 
@@ -61,6 +75,14 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   VlVectorComparisonType distance = VlDistanceL2 ;
   vl_size maxNumIterations = 100 ;
   vl_size numRepetitions = 1 ;
+  vl_size numTrees = 3 ;
+  vl_size maxNumComparisons = 100 ;
+  int numThreads = 1 ;
+  vl_size batchSize = 10000 ;
+  vl_size energyCheckPeriod = 0 ;
+  vl_type fileDataType = VL_TYPE_UINT8 ;
+  char fileName [1024] ;
+  vl_bool fromFile ;
   double energy ;
   int verbosity = 0 ;
   int initialization = INIT_PLUSPLUS ;
@@ -85,26 +107,40 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
               "Too many output arguments.");
   }
 
-  classID = mxGetClassID (IN(DATA)) ;
-  switch (classID) {
-    case mxSINGLE_CLASS: dataType = VL_TYPE_FLOAT ; break ;
-    case mxDOUBLE_CLASS: dataType = VL_TYPE_DOUBLE ; break ;
-    default:
+  /* DATA can be the name of a file, which is clustered by mini-batches */
+  fromFile = vlmxIsString (IN(DATA), -1) ;
+
+  if (fromFile) {
+    if (mxGetString (IN(DATA), fileName, sizeof(fileName))) {
       vlmxError (vlmxErrInvalidArgument,
-                "DATA must be of class SINGLE or DOUBLE") ;
-      abort() ;
-  }
+                "FILE name too long.") ;
+    }
+    classID = mxSINGLE_CLASS ;
+    dataType = VL_TYPE_FLOAT ;
+    dimension = 128 ;
+    numData = 0 ;
+  } else {
+    classID = mxGetClassID (IN(DATA)) ;
+    switch (classID) {
+      case mxSINGLE_CLASS: dataType = VL_TYPE_FLOAT ; break ;
+      case mxDOUBLE_CLASS: dataType = VL_TYPE_DOUBLE ; break ;
+      default:
+        vlmxError (vlmxErrInvalidArgument,
+                  "DATA must be of class SINGLE or DOUBLE") ;
+        abort() ;
+    }
 
-  dimension = mxGetM (IN(DATA)) ;
-  numData = mxGetN (IN(DATA)) ;
+    dimension = mxGetM (IN(DATA)) ;
+    numData = mxGetN (IN(DATA)) ;
 
-  if (dimension == 0) {
-    vlmxError (vlmxErrInvalidArgument, "SIZE(DATA,1) is zero") ;
+    if (dimension == 0) {
+      vlmxError (vlmxErrInvalidArgument, "SIZE(DATA,1) is zero") ;
+    }
   }
 
   if (!vlmxIsPlainScalar(IN(NUMCENTERS)) ||
       (numCenters = (vl_size) mxGetScalar(IN(NUMCENTERS))) < 1  ||
-      numCenters > numData) {
+      (! fromFile && numCenters > numData)) {
     vlmxError (vlmxErrInvalidArgument,
               "NUMCENTERS must be a positive integer not greater "
               "than the number of data.") ;
@@ -201,6 +237,77 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
         numRepetitions = (vl_size) mxGetScalar (optarg) ;
         break ;
 
+      case opt_num_trees :
+        if (!vlmxIsPlainScalar (optarg) || mxGetScalar (optarg) < 1) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "NUMTREES must be an integer scalar larger than or equal to 1.") ;
+        }
+        numTrees = (vl_size) mxGetScalar (optarg) ;
+        break ;
+
+      case opt_max_num_comparisons :
+        if (!vlmxIsPlainScalar (optarg) || mxGetScalar (optarg) < 0) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "MAXNUMCOMPARISONS must be a non-negative integer scalar.") ;
+        }
+        maxNumComparisons = (vl_size) mxGetScalar (optarg) ;
+        break ;
+
+      case opt_num_threads :
+        if (!vlmxIsPlainScalar (optarg) || mxGetScalar (optarg) < 1) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "NUMTHREADS must be a positive integer.") ;
+        }
+        numThreads = (int) mxGetScalar (optarg) ;
+        break ;
+
+      case opt_batch_size :
+        if (!vlmxIsPlainScalar (optarg) || mxGetScalar (optarg) < 1) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "BATCHSIZE must be a positive integer.") ;
+        }
+        batchSize = (vl_size) mxGetScalar (optarg) ;
+        break ;
+
+      case opt_energy_check_period :
+        if (!vlmxIsPlainScalar (optarg) || mxGetScalar (optarg) < 0) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "ENERGYCHECKPERIOD must be a non-negative integer.") ;
+        }
+        energyCheckPeriod = (vl_size) mxGetScalar (optarg) ;
+        break ;
+
+      case opt_dimension :
+        if (!fromFile) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "DIMENSION can be used only if DATA is a file.") ;
+        }
+        if (!vlmxIsPlainScalar (optarg) || mxGetScalar (optarg) < 1) {
+          vlmxError (vlmxErrInvalidArgument,
+                     "DIMENSION must be a positive integer.") ;
+        }
+        dimension = (vl_size) mxGetScalar (optarg) ;
+        break ;
+
+      case opt_file_type :
+        if (!vlmxIsString (optarg, -1)) {
+          vlmxError (vlmxErrInvalidArgument,
+                    "FILETYPE must be a string.") ;
+        }
+        if (mxGetString (optarg, buf, sizeof(buf))) {
+          vlmxError (vlmxErrInvalidArgument,
+                    "FILETYPE argument too long.") ;
+        }
+        if (uStrICmp("uint8", buf) == 0) {
+          fileDataType = VL_TYPE_UINT8 ;
+        } else if (uStrICmp("single", buf) == 0) {
+          fileDataType = VL_TYPE_FLOAT ;
+        } else {
+          vlmxError (vlmxErrInvalidArgument,
+                    "Invalid value %s for FILETYPE", buf) ;
+        }
+        break ;
+
       default :
         abort() ;
         break ;
@@ -211,7 +318,7 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
    *                                                        Do the job
    * -------------------------------------------------------------- */
 
-  data = mxGetPr(IN(DATA)) ;
+  if (! fromFile) data = mxGetPr(IN(DATA)) ;
 
   kmeans = vl_kmeans_new (dataType, distance) ;
 
@@ -220,6 +327,11 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   vl_kmeans_set_algorithm (kmeans, algorithm) ;
   vl_kmeans_set_initialization (kmeans, initialization) ;
   vl_kmeans_set_max_num_iterations (kmeans, maxNumIterations) ;
+  vl_kmeans_set_num_trees (kmeans, numTrees) ;
+  vl_kmeans_set_max_num_comparisons (kmeans, maxNumComparisons) ;
+  vl_kmeans_set_num_threads (kmeans, numThreads) ;
+  vl_kmeans_set_batch_size (kmeans, batchSize) ;
+  vl_kmeans_set_energy_check_period (kmeans, energyCheckPeriod) ;
 
   if (verbosity) {
     char const * algorithmName = 0 ;
@@ -240,10 +352,23 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
     mexPrintf("kmeans: Algorithm = %s\n", algorithmName) ;
     mexPrintf("kmeans: MaxNumIterations = %d\n", vl_kmeans_get_max_num_iterations(kmeans)) ;
     mexPrintf("kmeans: NumRepetitions = %d\n", vl_kmeans_get_num_repetitions(kmeans)) ;
+    mexPrintf("kmeans: NumThreads = %d\n", vl_kmeans_get_num_threads(kmeans)) ;
+    if (vl_kmeans_get_algorithm(kmeans) == VlKMeansANN) {
+      mexPrintf("kmeans: NumTrees = %d\n", vl_kmeans_get_num_trees(kmeans)) ;
+      mexPrintf("kmeans: MaxNumComparisons = %d\n", vl_kmeans_get_max_num_comparisons(kmeans)) ;
+    }
+    if (fromFile) {
+      mexPrintf("kmeans: BatchSize = %d\n", vl_kmeans_get_batch_size(kmeans)) ;
+      mexPrintf("kmeans: EnergyCheckPeriod = %d\n", vl_kmeans_get_energy_check_period(kmeans)) ;
+      mexPrintf("kmeans: file = %s\n", fileName) ;
+      mexPrintf("kmeans: file data type = %s\n", vl_get_type_name(fileDataType)) ;
+    }
     mexPrintf("kmeans: data type = %s\n", vl_get_type_name(vl_kmeans_get_data_type(kmeans))) ;
     mexPrintf("kmeans: distance = %s\n", vl_get_vector_comparison_type_name(vl_kmeans_get_distance(kmeans))) ;
     mexPrintf("kmeans: data dimension = %d\n", dimension) ;
-    mexPrintf("kmeans: num. data points = %d\n", numData) ;
+    if (! fromFile) {
+      mexPrintf("kmeans: num. data points = %d\n", numData) ;
+    }
     mexPrintf("kmeans: num. centers = %d\n", numCenters) ;
     mexPrintf("\n") ;
   }
@@ -252,7 +377,16 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
   /*                                    Clustering and quantization */
   /* -------------------------------------------------------------- */
 
-  energy = vl_kmeans_cluster(kmeans, data, dimension, numData, numCenters) ;
+  if (fromFile) {
+    if (vl_kmeans_cluster_file (kmeans, fileName, fileDataType,
+                                dimension, numCenters)) {
+      vl_kmeans_delete (kmeans) ;
+      vlmxError (vlmxErrInvalidArgument, "%s", vl_get_last_error_message()) ;
+    }
+    energy = vl_kmeans_get_energy (kmeans) ;
+  } else {
+    energy = vl_kmeans_cluster(kmeans, data, dimension, numData, numCenters) ;
+  }
 
   /* copy centers */
   OUT(CENTERS) = mxCreateNumericMatrix (dimension, numCenters, classID, mxREAL) ;
@@ -260,8 +394,10 @@ mexFunction (int nout, mxArray * out[], int nin, const mxArray * in[])
           vl_kmeans_get_centers (kmeans),
           vl_get_type_size (dataType) * dimension * vl_kmeans_get_num_centers(kmeans)) ;
 
-  /* optionally qunatize */
-  if (nout > 1) {
+  /* optionally qunatize; a file is not loaded to do so */
+  if (nout > 1 && fromFile) {
+    OUT(ASSIGNMENTS) = mxCreateNumericMatrix (1, 0, mxUINT32_CLASS, mxREAL) ;
+  } else if (nout > 1) {
     vl_uindex j ;
     vl_uint32 * assignments  ;
     OUT(ASSIGNMENTS) = mxCreateNumericMatrix (1, numData, mxUINT32_CLASS, mxREAL) ;
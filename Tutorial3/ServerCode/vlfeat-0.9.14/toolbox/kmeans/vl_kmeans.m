@@ -9,6 +9,16 @@
 %   [C, A, ENERGY] = VL_KMEANS(...) returns the energy of the solution
 %   (or an upper bound for the ELKAN algorithm) as well.
 %
+%   C = VL_KMEANS(FILE, NUMCENTERS) clusters the data stored in the
+%   binary file FILE, which may be larger than the memory, by
+%   mini-batch k-means. The file contains the data points one after
+%   the other with no header, for instance the descriptors written by
+%   the SIFT command line program with --descriptors=bin://. C is
+%   SINGLE. A is empty, and ENERGY is estimated from the last
+%   mini-batch unless ENERGYCHECKPERIOD is used. MAXNUMITERATIONS is
+%   the number of mini-batches. Only the L2 distance is supported, and
+%   ALGORITHM and NUMREPETITIONS are ignored.
+%
 %   KMEANS() supports different initialization and optimization
 %   methods and different clustering distances. Specifically, the
 %   following options are supported:
@@ -24,13 +34,42 @@
 %     to initialize the centers.
 %
 %   Algorithm:: [LLOYD]
-%     Use either the standard LLOYD or the accelerated
-%     ELKAN algorithm for optimization.
+%     Use either the standard LLOYD, the accelerated ELKAN, or the
+%     approximated ANN algorithm for optimization. ANN assigns the data
+%     to the centers by searching a randomized kd-forest and is the
+%     fastest for a large number of centers.
+%
+%   NumTrees:: [3]
+%     Number of trees of the kd-forest used by the ANN algorithm.
+%
+%   MaxNumComparisons:: [100]
+%     Maximum number of comparisons made by the ANN algorithm to
+%     assign a data point. Set it to 0 for an exact search.
 %
 %   NumRepetitions:: [1]
 %     Number of time to restart k-means. The solution with minimal
 %     energy is returned.
 %
+%   NumThreads:: [1]
+%     Number of threads used to initialize the centers and to assign
+%     the data and update the centers at each iteration. The result
+%     does not depend on it.
+%
+%   Dimension:: [128]
+%     Dimension of the data points in FILE.
+%
+%   FileType:: [UINT8]
+%     Type of the data in FILE, either UINT8 or SINGLE.
+%
+%   BatchSize:: [10000]
+%     Number of data points of a mini-batch. It should be several times
+%     NUMCENTERS.
+%
+%   EnergyCheckPeriod:: [0]
+%     Compute the energy on all the data in FILE every so many
+%     mini-batches, and stop when it does not decrease, returning the
+%     centers of the lowest energy found. 0 disables the checks.
+%
 %   Example::
 %     VL_KMEANS(X, 10, 'verbose', 'distance', 'l1', 'algorithm',
 %     'elkan') clusters the data point X using 10 centers, l1
@@ -28,6 +28,8 @@ enum {
   opt_norm,
   opt_window_size,
   opt_float_descriptors,
+  opt_magnif,
+  opt_num_threads,
   opt_verbose
 } ;
 
@@ -40,6 +42,8 @@ vlmxOption  options [] = {
 {"Norm",             0,   opt_norm             },
 {"WindowSize",       1,   opt_window_size      },
 {"FloatDescriptors", 0,   opt_float_descriptors},
+{"Magnif",           1,   opt_magnif           },
+{"NumThreads",       1,   opt_num_threads      },
 {"Verbose",          0,   opt_verbose          },
 {0,                  0,   0                    }
 } ;
@@ -64,7 +68,10 @@ mexFunction(int nout, mxArray *out[],
   int                M, N ;
 
   int                step = 1 ;
-  int                size = 3 ;
+  int                sizes [VL_DSIFT_MAX_BIN_SIZES] = {3} ;
+  int                numSizes = 1 ;
+  double             magnif = 0 ;
+  int                numThreads = 1 ;
   vl_bool            norm = 0 ;
 
   vl_bool floatDescriptors = VL_FALSE ;
@@ -123,10 +130,21 @@ mexFunction(int nout, mxArray *out[],
         break ;
 
       case opt_size :
-        if (!vlmxIsPlainScalar(optarg) || (size = (int) *mxGetPr(optarg)) <= 0) {
-          vlmxError(vlmxErrInvalidArgument,"SIZE is not a scalar or it is negative.") ;
+      {
+        int k ;
+        if (!vlmxIsPlainVector(optarg, -1) ||
+            (numSizes = mxGetNumberOfElements(optarg)) < 1 ||
+            numSizes > VL_DSIFT_MAX_BIN_SIZES) {
+          vlmxError(vlmxErrInvalidArgument,"SIZE is not a vector of 1 to %d elements.",
+                    VL_DSIFT_MAX_BIN_SIZES) ;
+        }
+        for (k = 0 ; k < numSizes ; ++k) {
+          if ((sizes[k] = (int) mxGetPr(optarg)[k]) <= 0) {
+            vlmxError(vlmxErrInvalidArgument,"SIZE is negative.") ;
+          }
         }
         break ;
+      }
 
       case opt_step :
         if (!vlmxIsPlainScalar(optarg) || (step = (int) *mxGetPr(optarg)) <= 0) {
@@ -144,6 +162,18 @@ mexFunction(int nout, mxArray *out[],
         floatDescriptors = VL_TRUE ;
         break ;
 
+      case opt_magnif :
+        if (!vlmxIsPlainScalar(optarg) || (magnif = *mxGetPr(optarg)) < 0) {
+          vlmxError(vlmxErrInvalidArgument,"MAGNIF is not a scalar or it is negative.") ;
+        }
+        break ;
+
+      case opt_num_threads :
+        if (!vlmxIsPlainScalar(optarg) || (numThreads = (int) *mxGetPr(optarg)) < 1) {
+          vlmxError(vlmxErrInvalidArgument,"NUMTHREADS must be a positive integer.") ;
+        }
+        break ;
+
       default :
         abort() ;
     }
@@ -163,7 +193,7 @@ mexFunction(int nout, mxArray *out[],
     VlDsiftFilter *dsift ;
 
     /* note that the image received from MATLAB is transposed */
-    dsift = vl_dsift_new_basic (M, N, step, size) ;
+    dsift = vl_dsift_new_basic (M, N, step, sizes[0]) ;
     if (bounds) {
       vl_dsift_set_bounds(dsift,
                           VL_MAX(bounds[1], 0),
@@ -176,8 +206,8 @@ mexFunction(int nout, mxArray *out[],
     if (windowSize >= 0) {
       vl_dsift_set_window_size(dsift, windowSize) ;
     }
+    vl_dsift_set_num_threads(dsift, numThreads) ;
 
-    numFrames = vl_dsift_get_keypoint_num (dsift) ;
     descrSize = vl_dsift_get_descriptor_size (dsift) ;
     geom = vl_dsift_get_geometry (dsift) ;
 
@@ -203,15 +233,26 @@ mexFunction(int nout, mxArray *out[],
                 geom->numBinX,
                 geom->numBinY) ;
       mexPrintf("vl_dsift: descriptor size:   %d\n", descrSize) ;
-      mexPrintf("vl_dsift: bin sizes:         [binSizeX, binSizeY] = [%d, %d]\n",
-                geom->binSizeX,
-                geom->binSizeY) ;
+      mexPrintf("vl_dsift: bin sizes:        ") ;
+      for (k = 0 ; k < numSizes ; ++k) mexPrintf(" %d", sizes[k]) ;
+      mexPrintf("\n") ;
+      mexPrintf("vl_dsift: magnif:            %g\n", magnif) ;
       mexPrintf("vl_dsift: flat window:       %s\n", VL_YESNO(useFlatWindow)) ;
       mexPrintf("vl_dsift: window size:       %g\n", vl_dsift_get_window_size(dsift)) ;
-      mexPrintf("vl_dsift: num of features:   %d\n", numFrames) ;
+      mexPrintf("vl_dsift: threads:           %d\n", vl_dsift_get_num_threads(dsift)) ;
     }
 
-    vl_dsift_process (dsift, data) ;
+    if (numSizes == 1 && magnif == 0) {
+      vl_dsift_process (dsift, data) ;
+    } else {
+      vl_dsift_process_multi (dsift, data, sizes, numSizes, magnif) ;
+    }
+
+    numFrames = vl_dsift_get_keypoint_num (dsift) ;
+
+    if (verbose) {
+      mexPrintf("vl_dsift: num of features:   %d\n", numFrames) ;
+    }
 
     frames = vl_dsift_get_keypoints (dsift) ;
     descrs = vl_dsift_get_descriptors (dsift) ;
@@ -233,7 +274,7 @@ mexFunction(int nout, mxArray *out[],
         (2, dims, mxUINT8_CLASS, mxREAL) ;
       }
 
-      dims [0] = norm ? 3 : 2 ;
+      dims [0] = 2 + (norm ? 1 : 0) + (numSizes > 1 ? 1 : 0) ;
 
       out[OUT_FRAMES] = mxCreateNumericArray
       (2, dims, mxDOUBLE_CLASS, mxREAL) ;
@@ -255,6 +296,9 @@ mexFunction(int nout, mxArray *out[],
         if (norm)
           *outFrameIter++ = frames [k].norm ;
 
+        if (numSizes > 1)
+          *outFrameIter++ = frames [k].s ;
+
         vl_dsift_transpose_descriptor (tmpDescr,
                                        descrs + descrSize * k,
                                        geom->numBinT,
@@ -37,7 +37,24 @@
 %     Extracts a SIFT descriptor each STEP pixels.
 %
 %   Size:: [3]
-%     A spatial bin covers SIZE pixels.
+%     A spatial bin covers SIZE pixels. SIZE can be a vector of up
+%     to 16 bin sizes, in which case the descriptors of all the sizes
+%     are computed in one pass and returned one size after the
+%     other. FRAMES then gets a last row with the bin size of each
+%     frame. As in VL_PHOW(), the frames of the different sizes have
+%     the same centers: the lower bounds of SIZE(I) are moved by
+%     FLOOR(3/2 (MAX(SIZE) - SIZE(I))) pixels.
+%
+%   Magnif:: [0]
+%     If positive, the image is smoothed for each bin size SIZE(I) by
+%     a Gaussian of standard deviation SIZE(I) / MAGNIF, as by
+%     VL_IMSMOOTH(), before computing its gradient. Otherwise the
+%     gradient is computed once for all the bin sizes.
+%
+%   NumThreads:: [1]
+%     Number of threads computing the gradient and convolving the
+%     orientation planes of the bin sizes. The output does not depend
+%     on it.
 %
 %   Bounds:: [whole image]
 %     Specifies a rectangular area where descriptors should be
@@ -1,8 +1,9 @@
 function [frames, descrs] = vl_phow(im, varargin)
 % VL_PHOW  Extract PHOW features
 %   [FRAMES, DESCRS] = VL_PHOW(IM) extracts PHOW features from the
-%   image IM. This function is a wrapper around VL_DSIFT() and
-%   VL_IMSMOOTH().
+%   image IM. This function is a wrapper around VL_DSIFT(), which
+%   smooths the image and extracts the descriptors of all the SIZES in
+%   one pass.
 %
 %   The PHOW descriptors where introduced in [1]. By default,
 %   VL_PHOW() computes the gray-scale variant of the descriptor.  The
@@ -44,6 +45,10 @@ function [frames, descrs] = vl_phow(im, varargin)
 %     If set to TRUE, the descriptors are returned in floating point
 %     format.
 %
+%   NumThreads:: [1]
+%     Number of threads used by VL_DSIFT(). The output does not
+%     depend on it.
+%
 %   See also: VL_DSIFT(), VL_HELP().
 
 % Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
@@ -65,9 +70,11 @@ function [frames, descrs] = vl_phow(im, varargin)
   opts.magnif = 6 ;
   opts.windowsize = 1.5 ;
   opts.contrastthreshold = 0.005 ;
+  opts.numthreads = 1 ;
   opts = vl_argparse(opts,varargin) ;
 
-  dsiftOpts = {'norm', 'windowsize', opts.windowsize} ;
+  dsiftOpts = {'norm', 'windowsize', opts.windowsize, ...
+               'magnif', opts.magnif, 'numthreads', opts.numthreads} ;
   if opts.verbose, dsiftOpts{end+1} = 'verbose' ; end
   if opts.fast, dsiftOpts{end+1} = 'fast' ; end
   if opts.floatdescriptors, dsiftOpts{end+1} = 'floatdescriptors' ; end
@@ -115,54 +122,48 @@ function [frames, descrs] = vl_phow(im, varargin)
     fprintf('%s: sizes: [%s]\n', mfilename, sprintf(' %d', opts.sizes)) ;
   end
 
-  for si = 1:length(opts.sizes)
-
-    % Recall from VL_DSIFT() that the first descriptor for scale SIZE has
-    % center located at XC = XMIN + 3/2 SIZE (the Y coordinate is
-    % similar). It is convenient to align the descriptors at different
-    % scales so that they have the same geometric centers. For the
-    % maximum size we pick XMIN = 1 and we get centers starting from
-    % XC = 1 + 3/2 MAX(OPTS.SIZES). For any other scale we pick XMIN so
-    % that XMIN + 3/2 SIZE = 1 + 3/2 MAX(OPTS.SIZES).
-    %
-    % In pracrice, the offset must be integer ('bounds'), so the
-    % alignment works properly only if all OPTS.SZES are even or odd.
-
-    off = floor(1 + 3/2 * (max(opts.sizes) - opts.sizes(si))) ;
+  % Recall from VL_DSIFT() that the first descriptor for scale SIZE has
+  % center located at XC = XMIN + 3/2 SIZE (the Y coordinate is
+  % similar). It is convenient to align the descriptors at different
+  % scales so that they have the same geometric centers. For the
+  % maximum size we pick XMIN = 1 and we get centers starting from
+  % XC = 1 + 3/2 MAX(OPTS.SIZES). For any other scale we pick XMIN so
+  % that XMIN + 3/2 SIZE = 1 + 3/2 MAX(OPTS.SIZES). VL_DSIFT() does
+  % this when given all the sizes at once, and it also smooths the
+  % image to the appropriate scale based on the size of the SIFT bins
+  % (MAGNIF option).
+  %
+  % In pracrice, the offset must be integer, so the
+  % alignment works properly only if all OPTS.SZES are even or odd.
 
-    % smooth the image to the appropriate scale based on the size
-    % of the SIFT bins
-    sigma = opts.sizes(si) / opts.magnif ;
-    ims = vl_imsmooth(im, sigma) ;
-
-    % extract dense SIFT features from all channels
-    for k = 1:numChannels
-      [f{k}, d{k}] = vl_dsift(...
-        ims(:,:,k), ...
-        dsiftOpts{:},  ...
-        'size', opts.sizes(si), ...
-        'bounds', [off off +inf +inf]) ;
-    end
+  % extract dense SIFT features from all channels
+  for k = 1:numChannels
+    [f{k}, d{k}] = vl_dsift(...
+      im(:,:,k), ...
+      dsiftOpts{:},  ...
+      'size', opts.sizes) ;
+  end
 
-    % remove low contrast descriptors
-    % note that for color descriptors the V component is
-    % thresholded
-    switch opts.color
-      case {'gray', 'opponent'}
-        contrast = f{1}(3,:) ;
-      case 'rgb'
-        contrast = mean([f{1}(3,:) ; f{2}(3,:) ; f{3}(3,:)],1) ;
-      otherwise % hsv
-        contrast = f{3}(3,:) ;
-    end
-    for k = 1:numChannels
-      d{k}(:, contrast < opts.contrastthreshold) = 0 ;
-    end
+  % remove low contrast descriptors
+  % note that for color descriptors the V component is
+  % thresholded
+  switch opts.color
+    case {'gray', 'opponent'}
+      contrast = f{1}(3,:) ;
+    case 'rgb'
+      contrast = mean([f{1}(3,:) ; f{2}(3,:) ; f{3}(3,:)],1) ;
+    otherwise % hsv
+      contrast = f{3}(3,:) ;
+  end
+  for k = 1:numChannels
+    d{k}(:, contrast < opts.contrastthreshold) = 0 ;
+  end
 
-    % save only x,y, and the scale
-    frames{si} = [f{1}(1:3, :) ; opts.sizes(si) * ones(1,size(f{1},2))] ;
-    descrs{si} = cat(1, d{:}) ;
+  % save only x,y, and the scale
+  if length(opts.sizes) == 1
+    frames = [f{1}(1:3, :) ; opts.sizes * ones(1,size(f{1},2))] ;
+  else
+    frames = f{1}(1:4, :) ;
   end
-  descrs = cell2mat(descrs) ;
-  frames = cell2mat(frames) ;
+  descrs = cat(1, d{:}) ;
 end
@@ -32,9 +32,15 @@ enum {
   opt_window_size,
   opt_orientations,
   opt_float_descriptors,
+  opt_num_threads,
+  opt_approximate,
+  opt_compact,
   opt_verbose
 } ;
 
+/* outputs */
+enum {OUT_FRAMES=0, OUT_DESCRIPTORS} ;
+
 /* options */
 vlmxOption  options [] = {
   {"Octaves",          1,   opt_octaves           },
@@ -48,6 +54,9 @@ vlmxOption  options [] = {
   {"WindowSize",       1,   opt_window_size       },
   {"Orientations",     0,   opt_orientations      },
   {"FloatDescriptors", 0,   opt_float_descriptors },
+  {"NumThreads",       1,   opt_num_threads       },
+  {"Approximate",      0,   opt_approximate       },
+  {"Compact",          0,   opt_compact           },
   {"Verbose",          0,   opt_verbose           },
   {0,                  0,   0                     }
 } ;
@@ -125,6 +134,118 @@ check_sorted (double const * keys, vl_size nkeys)
   return VL_TRUE ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Save a descriptor with MATLAB conventions
+ **
+ ** @param descr  descriptors buffer (@c UINT8 or @c SINGLE).
+ ** @param index  index of the descriptor in @a descr.
+ ** @param src    descriptor (transposed).
+ ** @param floatDescriptors whether @a descr is @c SINGLE.
+ **/
+
+static void
+save_descriptor (void *descr, vl_size index, vl_sift_pix const *src,
+                 vl_bool floatDescriptors)
+{
+  int j ;
+  if (! floatDescriptors) {
+    for (j = 0 ; j < 128 ; ++j) {
+      float x = 512.0F * src [j] ;
+      x = (x < 255.0F) ? x : 255.0F ;
+      ((vl_uint8*)descr) [128 * index + j] = (vl_uint8) x ;
+    }
+  } else {
+    for (j = 0 ; j < 128 ; ++j) {
+      float x = 512.0F * src [j] ;
+      ((float*)descr) [128 * index + j] = x ;
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Process a cell array of images
+ **
+ ** @param out    frames and descriptors (output).
+ ** @param nout   number of outputs.
+ ** @param images cell array of images.
+ ** @param batch  SIFT batch.
+ ** @param floatDescriptors whether to return @c SINGLE descriptors.
+ **
+ ** The function computes the frames of all images with the same
+ ** batch, which reuses the filters of the images of the same size,
+ ** and returns them in cell arrays of the same size as @a images.
+ **/
+
+static void
+process_images (mxArray *out[], int nout, mxArray const *images,
+                VlSiftBatch *batch, vl_bool floatDescriptors)
+{
+  vl_size numImages = mxGetNumberOfElements (images) ;
+  vl_size const *offsets ;
+  VlSiftKeypoint const *keys ;
+  double const *angles ;
+  vl_sift_pix const *descrs ;
+  vl_uindex i, q ;
+
+  vl_sift_batch_set_descriptors (batch, nout > 1) ;
+  if (vl_sift_batch_reserve (batch, numImages, 0)) {
+    vl_sift_batch_delete (batch) ;
+    mexErrMsgTxt("Could not allocate enough memory.") ;
+  }
+
+  for (i = 0 ; i < numImages ; ++i) {
+    mxArray const *im = mxGetCell (images, i) ;
+    if (vl_sift_batch_process (batch, (vl_sift_pix const*) mxGetData (im),
+                               mxGetM (im), mxGetN (im))) {
+      vl_sift_batch_delete (batch) ;
+      mexErrMsgTxt("Could not allocate enough memory.") ;
+    }
+  }
+
+  offsets = vl_sift_batch_get_offsets     (batch) ;
+  keys    = vl_sift_batch_get_keypoints   (batch) ;
+  angles  = vl_sift_batch_get_angles      (batch) ;
+  descrs  = vl_sift_batch_get_descriptors (batch) ;
+
+  out[OUT_FRAMES] = mxCreateCellArray (mxGetNumberOfDimensions (images),
+                                       mxGetDimensions (images)) ;
+  if (nout > 1) {
+    out[OUT_DESCRIPTORS] = mxCreateCellArray (mxGetNumberOfDimensions (images),
+                                              mxGetDimensions (images)) ;
+  }
+
+  for (i = 0 ; i < numImages ; ++i) {
+    vl_size nframes = offsets [i + 1] - offsets [i] ;
+    mxArray *frames = mxCreateDoubleMatrix (4, nframes, mxREAL) ;
+    double *pt = mxGetPr (frames) ;
+
+    /* the input image was the transpose of the actual image */
+    for (q = 0 ; q < nframes ; ++q) {
+      VlSiftKeypoint const *k = keys + offsets [i] + q ;
+      pt [4 * q + 0] = k -> y + 1 ;
+      pt [4 * q + 1] = k -> x + 1 ;
+      pt [4 * q + 2] = k -> sigma ;
+      pt [4 * q + 3] = VL_PI / 2 - angles [offsets [i] + q] ;
+    }
+    mxSetCell (out[OUT_FRAMES], i, frames) ;
+
+    if (nout > 1) {
+      mxArray *descr = mxCreateNumericMatrix
+        (128, nframes, floatDescriptors ? mxSINGLE_CLASS : mxUINT8_CLASS,
+         mxREAL) ;
+      for (q = 0 ; q < nframes ; ++q) {
+        vl_sift_pix rbuf [128] ;
+        transpose_descriptor (rbuf, (vl_sift_pix*)
+                              descrs + 128 * (offsets [i] + q)) ;
+        save_descriptor (mxGetData (descr), q, rbuf, floatDescriptors) ;
+      }
+      mxSetCell (out[OUT_DESCRIPTORS], i, descr) ;
+    }
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @brief MEX entry point
  **/
@@ -134,15 +255,15 @@ mexFunction(int nout, mxArray *out[],
             int nin, const mxArray *in[])
 {
   enum {IN_I=0,IN_END} ;
-  enum {OUT_FRAMES=0, OUT_DESCRIPTORS} ;
 
   int                verbose = 0 ;
   int                opt ;
   int                next = IN_END ;
   mxArray const     *optarg ;
 
-  vl_sift_pix const *data ;
-  int                M, N ;
+  vl_sift_pix const *data = 0 ;
+  int                M = 0, N = 0 ;
+  vl_bool            multipleImages = 0 ;
 
   int                O     = - 1 ;
   int                S     =   3 ;
@@ -159,6 +280,9 @@ mexFunction(int nout, mxArray *out[],
   int                nikeys = -1 ;
   vl_bool            force_orientations = 0 ;
   vl_bool            floatDescriptors = 0 ;
+  int                numThreads = 1 ;
+  vl_bool            approximate = 0 ;
+  vl_bool            compact = 0 ;
 
   VL_USE_MATLAB_ENV ;
 
@@ -172,14 +296,27 @@ mexFunction(int nout, mxArray *out[],
     mexErrMsgTxt("Too many output arguments.");
   }
 
-  if (mxGetNumberOfDimensions (in[IN_I]) != 2              ||
-      mxGetClassID            (in[IN_I]) != mxSINGLE_CLASS  ) {
-    mexErrMsgTxt("I must be a matrix of class SINGLE") ;
-  }
+  if (mxIsCell (in[IN_I])) {
+    vl_uindex i ;
+    for (i = 0 ; i < mxGetNumberOfElements (in[IN_I]) ; ++i) {
+      mxArray const *im = mxGetCell (in[IN_I], i) ;
+      if (! im ||
+          mxGetNumberOfDimensions (im) != 2              ||
+          mxGetClassID            (im) != mxSINGLE_CLASS  ) {
+        mexErrMsgTxt("The elements of I must be matrices of class SINGLE") ;
+      }
+    }
+    multipleImages = 1 ;
+  } else {
+    if (mxGetNumberOfDimensions (in[IN_I]) != 2              ||
+        mxGetClassID            (in[IN_I]) != mxSINGLE_CLASS  ) {
+      mexErrMsgTxt("I must be a matrix of class SINGLE") ;
+    }
 
-  data = (vl_sift_pix*) mxGetData (in[IN_I]) ;
-  M    = mxGetM (in[IN_I]) ;
-  N    = mxGetN (in[IN_I]) ;
+    data = (vl_sift_pix*) mxGetData (in[IN_I]) ;
+    M    = mxGetM (in[IN_I]) ;
+    N    = mxGetN (in[IN_I]) ;
+  }
 
   while ((opt = vlmxNextOption (in, nin, options, &next, &optarg)) >= 0) {
     switch (opt) {
@@ -257,11 +394,59 @@ mexFunction(int nout, mxArray *out[],
       floatDescriptors = 1 ;
       break ;
 
+    case opt_num_threads :
+      if (!vlmxIsPlainScalar(optarg) || (numThreads = (int) *mxGetPr(optarg)) < 1) {
+        mexErrMsgTxt("'NumThreads' must be a positive integer.") ;
+      }
+      break ;
+
+    case opt_approximate :
+      approximate = 1 ;
+      break ;
+
+    case opt_compact :
+      compact = 1 ;
+      break ;
+
     default :
       abort() ;
     }
   }
 
+  /* -----------------------------------------------------------------
+   *                                       Do job for a cell of images
+   * -------------------------------------------------------------- */
+  if (multipleImages) {
+    VlSiftBatch *batch ;
+
+    if (nikeys >= 0 || force_orientations) {
+      mexErrMsgTxt("'Frames' and 'Orientations' require a single image.") ;
+    }
+
+    batch = vl_sift_batch_new (O, S, o_min) ;
+    if (! batch) {
+      mexErrMsgTxt("Could not allocate enough memory.") ;
+    }
+    if (peak_thresh >= 0) vl_sift_batch_set_peak_thresh (batch, peak_thresh) ;
+    if (edge_thresh >= 0) vl_sift_batch_set_edge_thresh (batch, edge_thresh) ;
+    if (norm_thresh >= 0) vl_sift_batch_set_norm_thresh (batch, norm_thresh) ;
+    if (magnif      >= 0) vl_sift_batch_set_magnif      (batch, magnif) ;
+    if (window_size >= 0) vl_sift_batch_set_window_size (batch, window_size) ;
+    vl_sift_batch_set_num_threads (batch, numThreads) ;
+    vl_sift_batch_set_approximate (batch, approximate) ;
+    vl_sift_batch_set_compact     (batch, compact) ;
+
+    process_images (out, nout, in[IN_I], batch, floatDescriptors) ;
+
+    if (verbose) {
+      mexPrintf ("vl_sift: found %d keypoints in %d images\n",
+                 (int) vl_sift_batch_get_num_frames (batch),
+                 (int) vl_sift_batch_get_num_images (batch)) ;
+    }
+    vl_sift_batch_delete (batch) ;
+    return ;
+  }
+
   /* -----------------------------------------------------------------
    *                                                            Do job
    * -------------------------------------------------------------- */
@@ -270,7 +455,15 @@ mexFunction(int nout, mxArray *out[],
     vl_bool            first ;
     double            *frames = 0 ;
     void              *descr  = 0 ;
-    int                nframes = 0, reserved = 0, i,j,q ;
+    int                nframes = 0, reserved = 0, i,j,q,p ;
+
+    /* keypoints, orientations and descriptors of the current octave */
+    VlSiftKeypoint    *okeys    = 0 ;
+    double            *oangles  = 0 ;
+    int               *onangles = 0 ;
+    VlSiftKeypoint    *dkeys    = 0 ;
+    double            *dangles  = 0 ;
+    vl_sift_pix       *dbuf     = 0 ;
 
     /* create a filter to process the image */
     filt = vl_sift_new (M, N, O, S, o_min) ;
@@ -280,6 +473,9 @@ mexFunction(int nout, mxArray *out[],
     if (norm_thresh >= 0) vl_sift_set_norm_thresh (filt, norm_thresh) ;
     if (magnif      >= 0) vl_sift_set_magnif      (filt, magnif) ;
     if (window_size >= 0) vl_sift_set_window_size (filt, window_size) ;
+    vl_sift_set_num_threads (filt, numThreads) ;
+    vl_sift_set_approximate (filt, approximate) ;
+    vl_sift_set_compact     (filt, compact) ;
 
     if (verbose) {
       mexPrintf("vl_sift: filter settings:\n") ;
@@ -299,6 +495,12 @@ mexFunction(int nout, mxArray *out[],
                 vl_sift_get_window_size   (filt)) ;
       mexPrintf("vl_sift:   float descriptor      = %d\n",
                 floatDescriptors) ;
+      mexPrintf("vl_sift:   threads               = %d\n",
+                vl_sift_get_num_threads   (filt)) ;
+      mexPrintf("vl_sift:   approximate           = %d\n",
+                vl_sift_get_approximate   (filt)) ;
+      mexPrintf("vl_sift:   compact               = %d\n",
+                vl_sift_get_compact       (filt)) ;
 
       mexPrintf((nikeys >= 0) ?
                 "vl_sift: will source frames? yes (%d read)\n" :
@@ -339,28 +541,21 @@ mexFunction(int nout, mxArray *out[],
 
       /* Run detector ............................................. */
       if (nikeys < 0) {
-        vl_sift_detect (filt) ;
+        if (vl_sift_detect (filt)) {
+          vl_sift_delete (filt) ;
+          mexErrMsgTxt("Could not allocate enough memory.") ;
+        }
 
         keys  = vl_sift_get_keypoints  (filt) ;
         nkeys = vl_sift_get_nkeypoints (filt) ;
-        i     = 0 ;
 
         if (verbose > 1) {
           printf ("vl_sift: detected %d (unoriented) keypoints\n", nkeys) ;
         }
       } else {
-        nkeys = nikeys ;
-      }
-
-      /* For each keypoint ........................................ */
-      for (; i < nkeys ; ++i) {
-        double                angles [4] ;
-        int                   nangles ;
-        VlSiftKeypoint        ik ;
-        VlSiftKeypoint const *k ;
-
-        /* Obtain keypoint orientations ........................... */
-        if (nikeys >= 0) {
+        /* Source keypoints of this octave (sorted by scale) ........ */
+        for (nkeys = 0 ; i < nikeys ; ++i, ++nkeys) {
+          VlSiftKeypoint ik ;
           vl_sift_keypoint_init (filt, &ik,
                                  ikeys [4 * i + 1] - 1,
                                  ikeys [4 * i + 0] - 1,
@@ -370,73 +565,85 @@ mexFunction(int nout, mxArray *out[],
             break ;
           }
 
-          k = &ik ;
-
-          /* optionally compute orientations too */
-          if (force_orientations) {
-            nangles = vl_sift_calc_keypoint_orientations
-              (filt, angles, k) ;
-          } else {
-            angles [0] = VL_PI / 2 - ikeys [4 * i + 3] ;
-            nangles    = 1 ;
-          }
-        } else {
-          k = keys + i ;
-          nangles = vl_sift_calc_keypoint_orientations
-            (filt, angles, k) ;
+          okeys    = mxRealloc (okeys,    sizeof(VlSiftKeypoint) * (nkeys + 1)) ;
+          oangles  = mxRealloc (oangles,  4 * sizeof(double)     * (nkeys + 1)) ;
+          onangles = mxRealloc (onangles, sizeof(int)            * (nkeys + 1)) ;
+          okeys    [nkeys]     = ik ;
+          oangles  [4 * nkeys] = VL_PI / 2 - ikeys [4 * i + 3] ;
+          onangles [nkeys]     = 1 ;
         }
+        keys = okeys ;
+      }
 
-        /* For each orientation ................................... */
-        for (q = 0 ; q < nangles ; ++q) {
-          vl_sift_pix  buf [128] ;
-          vl_sift_pix rbuf [128] ;
+      /* Obtain keypoint orientations ............................. */
+      if (nikeys < 0 || force_orientations) {
+        oangles  = mxRealloc (oangles,  4 * sizeof(double) * (nkeys + 1)) ;
+        onangles = mxRealloc (onangles, sizeof(int)        * (nkeys + 1)) ;
+        vl_sift_calc_keypoints_orientations (filt, oangles, onangles,
+                                             keys, nkeys) ;
+      }
 
-          /* compute descriptor (if necessary) */
-          if (nout > 1) {
-            vl_sift_calc_keypoint_descriptor (filt, buf, k, angles [q]) ;
-            transpose_descriptor (rbuf, buf) ;
-          }
+      /* One frame for each orientation of each keypoint .......... */
+      for (p = 0, j = 0 ; j < nkeys ; ++j) p += onangles [j] ;
+      dkeys   = mxRealloc (dkeys,   sizeof(VlSiftKeypoint) * (p + 1)) ;
+      dangles = mxRealloc (dangles, sizeof(double)         * (p + 1)) ;
+      for (p = 0, j = 0 ; j < nkeys ; ++j) {
+        for (q = 0 ; q < onangles [j] ; ++q, ++p) {
+          dkeys   [p] = keys [j] ;
+          dangles [p] = oangles [4 * j + q] ;
+        }
+      }
 
-          /* make enough room for all these keypoints and more */
-          if (reserved < nframes + 1) {
-            reserved += 2 * nkeys ;
-            frames = mxRealloc (frames, 4 * sizeof(double) * reserved) ;
-            if (nout > 1) {
-              if (! floatDescriptors) {
-                descr  = mxRealloc (descr,  128 * sizeof(vl_uint8) * reserved) ;
-              } else {
-                descr  = mxRealloc (descr,  128 * sizeof(float) * reserved) ;
-              }
-            }
-          }
+      /* Compute descriptors (if necessary) ....................... */
+      if (nout > 1) {
+        dbuf = mxRealloc (dbuf, 128 * sizeof(vl_sift_pix) * (p + 1)) ;
+        vl_sift_calc_keypoints_descriptors (filt, dbuf, dkeys, dangles, p) ;
+      }
 
-          /* Save back with MATLAB conventions. Notice tha the input
-           * image was the transpose of the actual image. */
-          frames [4 * nframes + 0] = k -> y + 1 ;
-          frames [4 * nframes + 1] = k -> x + 1 ;
-          frames [4 * nframes + 2] = k -> sigma ;
-          frames [4 * nframes + 3] = VL_PI / 2 - angles [q] ;
+      /* For each frame ........................................... */
+      for (q = 0 ; q < p ; ++q) {
+        VlSiftKeypoint const *k = dkeys + q ;
+        vl_sift_pix rbuf [128] ;
+
+        if (nout > 1) {
+          transpose_descriptor (rbuf, dbuf + 128 * q) ;
+        }
 
+        /* make enough room for all these keypoints and more */
+        if (reserved < nframes + 1) {
+          reserved += 2 * p ;
+          frames = mxRealloc (frames, 4 * sizeof(double) * reserved) ;
           if (nout > 1) {
             if (! floatDescriptors) {
-              for (j = 0 ; j < 128 ; ++j) {
-                float x = 512.0F * rbuf [j] ;
-                x = (x < 255.0F) ? x : 255.0F ;
-                ((vl_uint8*)descr) [128 * nframes + j] = (vl_uint8) x ;
-              }
+              descr  = mxRealloc (descr,  128 * sizeof(vl_uint8) * reserved) ;
             } else {
-              for (j = 0 ; j < 128 ; ++j) {
-                float x = 512.0F * rbuf [j] ;
-                ((float*)descr) [128 * nframes + j] = x ;
-              }
+              descr  = mxRealloc (descr,  128 * sizeof(float) * reserved) ;
             }
           }
+        }
+
+        /* Save back with MATLAB conventions. Notice tha the input
+         * image was the transpose of the actual image. */
+        frames [4 * nframes + 0] = k -> y + 1 ;
+        frames [4 * nframes + 1] = k -> x + 1 ;
+        frames [4 * nframes + 2] = k -> sigma ;
+        frames [4 * nframes + 3] = VL_PI / 2 - dangles [q] ;
 
-          ++ nframes ;
-        } /* next orientation */
-      } /* next keypoint */
+        if (nout > 1) {
+          save_descriptor (descr, nframes, rbuf, floatDescriptors) ;
+        }
+
+        ++ nframes ;
+      } /* next frame */
     } /* next octave */
 
+    if (okeys)    mxFree (okeys) ;
+    if (oangles)  mxFree (oangles) ;
+    if (onangles) mxFree (onangles) ;
+    if (dkeys)    mxFree (dkeys) ;
+    if (dangles)  mxFree (dangles) ;
+    if (dbuf)     mxFree (dbuf) ;
+
     if (verbose) {
       mexPrintf ("vl_sift: found %d keypoints\n", nframes) ;
     }
@@ -9,6 +9,13 @@
 %   column of D is the descriptor of the corresponding frame in F. A
 %   descriptor is a 128-dimensional vector of class UINT8.
 %
+%   [F,D] = VL_SIFT(IMAGES) processes a cell array IMAGES of images
+%   and returns cell arrays F and D of the same size, with the frames
+%   and the descriptors of each image. The images share the SIFT
+%   filters, so that the scale space of images of the same size is
+%   allocated only once. The 'Frames' and 'Orientations' options
+%   require a single image.
+%
 %   VL_SIFT() accepts the following options:
 %
 %   Octaves:: [maximum possible]
@@ -51,6 +58,17 @@
 %     If specified, compute the orietantions of the frames overriding
 %     the orientation specified by the 'Frames' option.
 %
+%   Approximate::
+%     If specified, approximate the Gaussian filters of the scale
+%     space by box filters. This is faster, especially for the
+%     coarser scales, but the frames are less repeatable.
+%
+%   Compact::
+%     If specified, store the scale space in 16 bits. This takes
+%     less than half the memory, but a few frames change because of
+%     the rounding. On flat or synthetic images the rounding may
+%     remove most frames.
+%
 %   Verbose::
 %     If specfified, be verbose (may be repeated to increase the
 %     verbosity level).
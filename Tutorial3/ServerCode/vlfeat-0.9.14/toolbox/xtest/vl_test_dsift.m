@@ -60,3 +60,50 @@ for wi = 1:length(windowSizeRange)
   error = std(d_(:) - d(:)) / std(d(:)) ;
   assert(error < 0.1,  'dsift and sift equivalence') ;
 end
+
+function test_multi_size(s)
+% several sizes in one pass equal one call per size, with the lower
+% bounds moved so that all the sizes have the same centers
+sizes = [4 6 8] ;
+[f, d] = vl_dsift(s.I, 'size', sizes, 'step', 3, 'floatdescriptors') ;
+for i = 1:length(sizes)
+  off = floor(3/2 * (max(sizes) - sizes(i))) ;
+  [f_, d_] = vl_dsift(s.I, 'size', sizes(i), 'step', 3, ...
+                      'bounds', [1+off, 1+off, +inf, +inf], ...
+                      'floatdescriptors') ;
+  sel = f(end,:) == sizes(i) ;
+  vl_assert_equal(f(1:2,sel), f_) ;
+  vl_assert_equal(d(:,sel), d_) ;
+end
+
+function test_multi_size_magnif(s)
+% with MAGNIF each size sees the image smoothed as by VL_IMSMOOTH()
+sizes = [4 6 8] ;
+magnif = 6 ;
+[f, d] = vl_dsift(s.I, 'size', sizes, 'step', 3, 'magnif', magnif, ...
+                  'floatdescriptors') ;
+for i = 1:length(sizes)
+  off = floor(3/2 * (max(sizes) - sizes(i))) ;
+  [f_, d_] = vl_dsift(vl_imsmooth(s.I, sizes(i) / magnif), ...
+                      'size', sizes(i), 'step', 3, ...
+                      'bounds', [1+off, 1+off, +inf, +inf], ...
+                      'floatdescriptors') ;
+  sel = f(end,:) == sizes(i) ;
+  vl_assert_equal(f(1:2,sel), f_) ;
+  vl_assert_almost_equal(d(:,sel), d_, 1e-4 * max(d_(:))) ;
+end
+
+function test_num_threads(s)
+% the output does not depend on the number of threads
+opts = {{'size', 4}, ...
+        {'size', [4 6 8 10]}, ...
+        {'size', [4 6 8 10], 'magnif', 6, 'fast'}} ;
+for i = 1:length(opts)
+  [f, d] = vl_dsift(s.I, opts{i}{:}, 'step', 3, 'norm') ;
+  for numThreads = [2 3 8]
+    [f_, d_] = vl_dsift(s.I, opts{i}{:}, 'step', 3, 'norm', ...
+                        'numthreads', numThreads) ;
+    vl_assert_equal(f_, f) ;
+    vl_assert_equal(d_, d) ;
+  end
+end
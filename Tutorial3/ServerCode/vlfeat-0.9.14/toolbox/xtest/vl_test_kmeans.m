@@ -42,6 +42,82 @@ for dataType = dataTypes
     vl_assert_almost_equal(centers, centers_, 1e-5) ;
     vl_assert_almost_equal(assignments, assignments_, 1e-5) ;
     vl_assert_almost_equal(en, en_, 1e-5) ;
+
+    % the kd-forest compares the points by the l2 distance; with no
+    % limit on the comparisons it finds the same centers as Lloyd in
+    % double precision. In single precision Lloyd assigns the points
+    % by a blocked matrix product, whose round-off can break near ties
+    % differently, so that only the energies are close
+    if strcmp(distance, 'l2')
+      vl_twister('state',0) ;
+      [centers_, assignments_, en_] = vl_kmeans(X, 10, ...
+                                                'NumRepetitions', 1, ...
+                                                'MaxNumIterations', 10, ...
+                                                'Algorithm', 'ANN', ...
+                                                'MaxNumComparisons', 0, ...
+                                                'Distance', distance) ;
+      if isa(X, 'double')
+        vl_assert_almost_equal(centers, centers_, 1e-5) ;
+        vl_assert_almost_equal(assignments, assignments_, 1e-5) ;
+        vl_assert_almost_equal(en, en_, 1e-5) ;
+      else
+        vl_assert_almost_equal(en, en_, 1e-2 * en) ;
+      end
+    end
+  end
+end
+
+function test_num_threads(s)
+% the result does not depend on the number of threads
+algorithms = {'lloyd', 'elkan', 'ann'} ;
+distances = {'l1', 'l2'} ;
+dataTypes = {'single','double'} ;
+for dataType = dataTypes
+  for distance = distances
+    for algorithm = algorithms
+      conversion = str2func(char(dataType)) ;
+      X = conversion(s.X) ;
+      opts = {'NumRepetitions', 2, ...
+              'MaxNumIterations', 10, ...
+              'Initialization', 'plusplus', ...
+              'Algorithm', char(algorithm), ...
+              'Distance', char(distance)} ;
+      vl_twister('state',0) ;
+      [centers, assignments, en] = vl_kmeans(X, 10, opts{:}, ...
+                                             'NumThreads', 1) ;
+      for numThreads = [2 3 8]
+        vl_twister('state',0) ;
+        [centers_, assignments_, en_] = vl_kmeans(X, 10, opts{:}, ...
+                                                  'NumThreads', numThreads) ;
+        vl_assert_equal(centers, centers_) ;
+        vl_assert_equal(assignments, assignments_) ;
+        vl_assert_equal(en, en_) ;
+      end
+    end
+  end
+end
+
+function test_l2_assignments(s)
+% the l2 assignments come from a blocked matrix product; they must pick
+% the closest centers up to round-off, also when the centers span
+% several blocks and the data is not a multiple of the tile size
+dataTypes = {'single','double'} ;
+for dataType = dataTypes
+  conversion = str2func(char(dataType)) ;
+  for numCenters = [3 301]
+    randn('state',0) ;
+    X = conversion(randn(128, 1003)) ;
+    vl_twister('state',0) ;
+    [centers, assignments] = vl_kmeans(X, numCenters, ...
+                                       'MaxNumIterations', 1, ...
+                                       'Initialization', 'randsel', ...
+                                       'Distance', 'l2') ;
+    D = vl_alldist(double(centers), double(X)) ;
+    [dists, assignments_] = min(D, [], 1) ;
+    dists_ = D(sub2ind(size(D), double(assignments), 1:size(X,2))) ;
+    vl_assert_almost_equal(dists_, dists, 1e-4 * max(dists)) ;
+    assert(mean(double(assignments) == assignments_) > 0.99, ...
+           'l2 assignments differ from VL_ALLDIST() too often') ;
   end
 end
 
@@ -62,6 +138,23 @@ for dataType = dataTypes
   end
 end
 
+function test_file(s)
+fileName = [tempname '.bin'] ;
+f = fopen(fileName, 'w') ;
+fwrite(f, single(s.X), 'single') ;
+fclose(f) ;
+[centers, assignments, en] = vl_kmeans(fileName, 10, ...
+                                       'FileType', 'single', ...
+                                       'Dimension', size(s.X,1), ...
+                                       'BatchSize', 50, ...
+                                       'MaxNumIterations', 20, ...
+                                       'EnergyCheckPeriod', 5) ;
+delete(fileName) ;
+assert(isa(centers, 'single') && isequal(size(centers), [size(s.X,1) 10])) ;
+assert(isempty(assignments)) ;
+en_ = sum(min(vl_alldist(double(centers), s.X))) ;
+vl_assert_almost_equal(en, en_, 1e-4 * en_) ;
+
 function [centers, assignments, en] = simpleKMeans(X, numCenters)
 [dimension, numData] = size(X) ;
 centers = randn(dimension, numCenters) ;
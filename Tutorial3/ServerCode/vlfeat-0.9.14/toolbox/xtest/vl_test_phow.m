@@ -21,3 +21,32 @@ assert(size(d,1) == 128*3) ;
 function test_opponent(s)
 [f,d] = vl_phow(s.I, 'color', 'opponent') ;
 assert(size(d,1) == 128*3) ;
+
+function test_sizes(s)
+% one VL_DSIFT() pass over all the sizes gives what smoothing and
+% extracting each size separately gives
+sizes = [4 6 8 10] ;
+magnif = 6 ;
+[f, d] = vl_phow(s.I, 'color', 'gray', 'sizes', sizes, 'magnif', magnif, ...
+                 'floatdescriptors', true) ;
+im = rgb2gray(s.I) ;
+for i = 1:length(sizes)
+  off = floor(1 + 3/2 * (max(sizes) - sizes(i))) ;
+  [f_, d_] = vl_dsift(vl_imsmooth(im, sizes(i) / magnif), ...
+                      'size', sizes(i), 'step', 2, 'fast', 'norm', ...
+                      'windowsize', 1.5, 'floatdescriptors', ...
+                      'bounds', [off off +inf +inf]) ;
+  d_(:, f_(3,:) < 0.005) = 0 ;
+  sel = f(4,:) == sizes(i) ;
+  vl_assert_equal(f(1:2,sel), f_(1:2,:)) ;
+  vl_assert_almost_equal(d(:,sel), d_, 1e-4 * max(d_(:))) ;
+end
+
+function test_num_threads(s)
+% the output does not depend on the number of threads
+[f,d] = vl_phow(s.I, 'color', 'rgb') ;
+for numThreads = [2 4]
+  [f_,d_] = vl_phow(s.I, 'color', 'rgb', 'numthreads', numThreads) ;
+  vl_assert_equal(f_, f) ;
+  vl_assert_equal(d_, d) ;
+end
@@ -16,6 +16,7 @@ the terms of the BSD license (see the COPYING file).
 #include "pgm.h"
 #include "mathop.h"
 #include "imopv.h"
+#include "threads.h"
 #include <math.h>
 #include <string.h>
 
@@ -86,7 +87,9 @@ To use the <b>DSIFT filter</b>:
 - Initialize a new DSIFT filter object by ::vl_dsift_new (or the simplified
 ::vl_dsift_new_basic). Customize the descriptor parameters by
 ::vl_dsift_set_steps, ::vl_dsift_set_geometry, etc.
-- Process an image by ::vl_dsift_process.
+- Process an image by ::vl_dsift_process, or at several bin sizes at
+  once by ::vl_dsift_process_multi. Optionally split the work among
+  threads by ::vl_dsift_set_num_threads.
 - Retrieve the number of keypoints (::vl_dsift_get_keypoint_num), the
   keypoints (::vl_dsift_get_keypoints), and their descriptors
   (::vl_dsift_get_descriptors).
@@ -370,39 +373,44 @@ _vl_dsift_update_buffers (VlDsiftFilter * self)
 /** ------------------------------------------------------------------
  ** @internal @brief Allocate internal buffers
  ** @param self DSIFT filter.
+ ** @param numFrameAlloc number of keypoints.
+ ** @param numGradAlloc number of gradient planes.
  **
  ** The function (re)allocates the internal buffers in accordance with
- ** the current image and descriptor geometry.
+ ** the current descriptor geometry.
  **/
 
 static void
-_vl_dsift_alloc_buffers (VlDsiftFilter* self)
+_vl_dsift_alloc_buffers (VlDsiftFilter* self,
+                         int numFrameAlloc, int numGradAlloc)
 {
-  _vl_dsift_update_buffers (self) ;
-  {
-    int numFrameAlloc = vl_dsift_get_keypoint_num (self) ;
-    int numBinAlloc   = vl_dsift_get_descriptor_size (self) ;
-    int numGradAlloc  = self->geom.numBinT ;
-
-    /* see if we need to update the buffers */
-    if (numBinAlloc != self->numBinAlloc ||
-        numGradAlloc != self->numGradAlloc ||
-        numFrameAlloc != self->numFrameAlloc) {
-
-      int t ;
-
-      _vl_dsift_free_buffers(self) ;
-
-      self->frames = vl_malloc(sizeof(VlDsiftKeypoint) * numFrameAlloc) ;
-      self->descrs = vl_malloc(sizeof(float) * numBinAlloc * numFrameAlloc) ;
-      self->grads  = vl_malloc(sizeof(float*) * numGradAlloc) ;
-      for (t = 0 ; t < numGradAlloc ; ++t) {
-        self->grads[t] =
-          vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
-      }
-      self->numBinAlloc = numBinAlloc ;
-      self->numGradAlloc = numGradAlloc ;
-      self->numFrameAlloc = numFrameAlloc ;
+  int numBinAlloc = vl_dsift_get_descriptor_size (self) ;
+  int t ;
+
+  /* see if we need to update the buffers */
+  if (numBinAlloc != self->numBinAlloc ||
+      numGradAlloc != self->numGradAlloc ||
+      numFrameAlloc != self->numFrameAlloc) {
+
+    _vl_dsift_free_buffers(self) ;
+
+    self->frames = vl_malloc(sizeof(VlDsiftKeypoint) * numFrameAlloc) ;
+    self->descrs = vl_malloc(sizeof(float) * numBinAlloc * numFrameAlloc) ;
+    self->grads  = vl_malloc(sizeof(float*) * numGradAlloc) ;
+    for (t = 0 ; t < numGradAlloc ; ++t) {
+      self->grads[t] =
+        vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
+    }
+    self->numBinAlloc = numBinAlloc ;
+    self->numGradAlloc = numGradAlloc ;
+    self->numFrameAlloc = numFrameAlloc ;
+  }
+
+  /* the temporary buffers of the other threads */
+  for (t = 1 ; t < self->numThreads ; ++t) {
+    if (! self->threadConvTmp[t]) {
+      self->threadConvTmp[t] =
+        vl_malloc(sizeof(float) * 2 * self->imWidth * self->imHeight) ;
     }
   }
 }
@@ -420,6 +428,7 @@ VL_EXPORT VlDsiftFilter *
 vl_dsift_new (int imWidth, int imHeight)
 {
   VlDsiftFilter * self = vl_malloc (sizeof(VlDsiftFilter)) ;
+  int t ;
   self->imWidth  = imWidth ;
   self->imHeight = imHeight ;
 
@@ -443,6 +452,11 @@ vl_dsift_new (int imWidth, int imHeight)
   self->convTmp1 = vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
   self->convTmp2 = vl_malloc(sizeof(float) * self->imWidth * self->imHeight) ;
 
+  self->numThreads = 1 ;
+  for (t = 0 ; t < VL_DSIFT_MAX_THREADS ; ++t) {
+    self->threadConvTmp[t] = NULL ;
+  }
+
   self->numBinAlloc = 0 ;
   self->numFrameAlloc = 0 ;
   self->numGradAlloc = 0 ;
@@ -488,202 +502,344 @@ vl_dsift_new_basic (int imWidth, int imHeight, int step, int binSize)
 VL_EXPORT void
 vl_dsift_delete (VlDsiftFilter * self)
 {
+  int t ;
   _vl_dsift_free_buffers (self) ;
+  for (t = 0 ; t < VL_DSIFT_MAX_THREADS ; ++t) {
+    if (self->threadConvTmp[t]) vl_free (self->threadConvTmp[t]) ;
+  }
   if (self->convTmp2) vl_free (self->convTmp2) ;
   if (self->convTmp1) vl_free (self->convTmp1) ;
   vl_free (self) ;
 }
 
+/** ------------------------------------------------------------------
+ ** @internal @brief Scale of a DSIFT job
+ **
+ ** The keypoints of a scale are the ones of the filter for a given
+ ** bin size. They are stored from the keypoint @c frameOffset on.
+ **/
+
+typedef struct _VlDsiftScale
+{
+  VlDsiftDescriptorGeometry geom ; /**< descriptor geometry. */
+  int boundMinX ;       /**< first keypoint bin X. */
+  int boundMinY ;       /**< first keypoint bin Y. */
+  int numFramesX ;      /**< number of keypoints along X. */
+  int numFramesY ;      /**< number of keypoints along Y. */
+  int frameOffset ;     /**< index of the first keypoint. */
+  float **grads ;       /**< orientation planes. */
+} _VlDsiftScale ;
 
 /** ------------------------------------------------------------------
- ** @internal @brief Process with Gaussian window
+ ** @internal @brief Initialize a scale
  ** @param self DSIFT filter.
+ ** @param sc scale (out).
+ ** @param geom descriptor geometry.
+ ** @param boundMinX first keypoint bin X.
+ ** @param boundMinY first keypoint bin Y.
+ ** @param frameOffset index of the first keypoint.
+ **
+ ** The keypoints span the filter bounds from the given first bin on.
  **/
 
-VL_INLINE void
-_vl_dsift_with_gaussian_window (VlDsiftFilter * self)
+static void
+_vl_dsift_init_scale (VlDsiftFilter const *self, _VlDsiftScale *sc,
+                      VlDsiftDescriptorGeometry const *geom,
+                      int boundMinX, int boundMinY, int frameOffset)
 {
-  int binx, biny, bint ;
-  int framex, framey ;
-  float *xker, *yker ;
+  int rangeX = self->boundMaxX - boundMinX - (geom->numBinX - 1) * geom->binSizeX ;
+  int rangeY = self->boundMaxY - boundMinY - (geom->numBinY - 1) * geom->binSizeY ;
+
+  sc->geom = *geom ;
+  sc->boundMinX = boundMinX ;
+  sc->boundMinY = boundMinY ;
+  sc->numFramesX = (rangeX >= 0) ? rangeX / self->stepX + 1 : 0 ;
+  sc->numFramesY = (rangeY >= 0) ? rangeY / self->stepY + 1 : 0 ;
+  sc->frameOffset = frameOffset ;
+  sc->grads = NULL ;
+}
 
-  int Wx = self->geom.binSizeX - 1 ;
-  int Wy = self->geom.binSizeY - 1 ;
+/** @internal @brief DSIFT job */
+typedef struct _VlDsiftJob
+{
+  float const *im ;        /**< image. */
+  _VlDsiftScale *scales ;  /**< scales. */
+  int numScales ;          /**< number of scales. */
+} _VlDsiftJob ;
 
-  for (biny = 0 ; biny < self->geom.numBinY ; ++biny) {
+/** @internal @brief Data of ::_vl_dsift_smooth_band */
+typedef struct _VlDsiftSmoothJob
+{
+  float       *dst ;
+  float const *src ;
+  int          width ;
+  int          height ;
+  float const *filter ;
+  int          filterWidth ;
+} _VlDsiftSmoothJob ;
 
-    yker = _vl_dsift_new_kernel (self->geom.binSizeY,
-                                 self->geom.numBinY,
-                                 biny,
-                                 self->windowSize) ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Task run by ::_vl_dsift_parallel_for
+ **
+ ** A task processes the items @a begin to @a end - 1 of a job on
+ ** the thread @a tid, using the temporary buffers of that thread.
+ **/
 
-    for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
+typedef void (*_VlDsiftTask) (VlDsiftFilter *self, void *data,
+                              int tid, int begin, int end) ;
 
-      xker = _vl_dsift_new_kernel(self->geom.binSizeX,
-                                  self->geom.numBinX,
-                                  binx,
-                                  self->windowSize) ;
+/** @internal @brief Task of a filter, run by ::_vl_parallel_for */
+typedef struct _VlDsiftParallelJob
+{
+  VlDsiftFilter *self ;
+  _VlDsiftTask task ;
+  void *data ;
+} _VlDsiftParallelJob ;
 
-      for (bint = 0 ; bint < self->geom.numBinT ; ++bint) {
-
-        vl_imconvcol_vf (self->convTmp1, self->imHeight,
-                         self->grads[bint], self->imWidth, self->imHeight,
-                         self->imWidth,
-                         yker, -Wy, +Wy, 1,
-                         VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
-
-        vl_imconvcol_vf (self->convTmp2, self->imWidth,
-                         self->convTmp1, self->imHeight, self->imWidth,
-                         self->imHeight,
-                         xker, -Wx, +Wx, 1,
-                         VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
-
-        {
-          float *dst = self->descrs
-            + bint
-            + binx * self->geom.numBinT
-            + biny * (self->geom.numBinX * self->geom.numBinT)  ;
-
-          float *src = self->convTmp2 ;
-
-          int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
-          int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
-          int descrSize = vl_dsift_get_descriptor_size (self) ;
-
-          for (framey  = self->boundMinY ;
-               framey <= self->boundMaxY - frameSizeY + 1 ;
-               framey += self->stepY) {
-            for (framex  = self->boundMinX ;
-                 framex <= self->boundMaxX - frameSizeX + 1 ;
-                 framex += self->stepX) {
-              *dst = src [(framex + binx * self->geom.binSizeX) * 1 +
-                          (framey + biny * self->geom.binSizeY) * self->imWidth]  ;
-              dst += descrSize ;
-            } /* framex */
-          } /* framey */
-        }
-
-      } /* for bint */
-      vl_free (xker) ;
-    } /* for binx */
-    vl_free (yker) ;
-  } /* for biny */
+static void
+_vl_dsift_parallel_task (void *data, int tid, vl_uindex begin, vl_uindex end)
+{
+  _VlDsiftParallelJob *job = data ;
+  job->task (job->self, job->data, tid, (int) begin, (int) end) ;
 }
 
 /** ------------------------------------------------------------------
- ** @internal @brief Process with flat window.
- ** @param self DSIFT filter object.
+ ** @internal
+ ** @brief Run a task on the items of a job in parallel
+ **
+ ** @param self   DSIFT filter.
+ ** @param task   task.
+ ** @param data   task data.
+ ** @param n      number of items.
+ ** @param grain  minimum number of items of a thread.
+ ** @param align  slices start at multiples of @a align items.
+ **
+ ** The items are split among the threads of the filter by
+ ** ::_vl_parallel_for.
+ **/
+
+static void
+_vl_dsift_parallel_for (VlDsiftFilter *self, _VlDsiftTask task,
+                        void *data, int n, int grain, int align)
+{
+  _VlDsiftParallelJob job ;
+  job.self = self ;
+  job.task = task ;
+  job.data = data ;
+  _vl_parallel_for (self->numThreads, _vl_dsift_parallel_task, &job,
+                    VL_MAX(n, 0), grain, align) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Get the temporary buffers of a thread
+ ** @param self DSIFT filter.
+ ** @param tid thread.
+ ** @param tmp1 first buffer (out).
+ ** @param tmp2 second buffer (out).
  **/
 
 VL_INLINE void
-_vl_dsift_with_flat_window (VlDsiftFilter* self)
+_vl_dsift_get_thread_buffers (VlDsiftFilter *self, int tid,
+                              float **tmp1, float **tmp2)
 {
-  int binx, biny, bint ;
+  if (tid == 0) {
+    *tmp1 = self->convTmp1 ;
+    *tmp2 = self->convTmp2 ;
+  } else {
+    *tmp1 = self->threadConvTmp[tid] ;
+    *tmp2 = self->threadConvTmp[tid] + self->imWidth * self->imHeight ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Process one orientation plane with Gaussian window
+ ** @param self DSIFT filter.
+ ** @param sc scale.
+ ** @param bint orientation bin.
+ ** @param convTmp1 temporary buffer.
+ ** @param convTmp2 temporary buffer.
+ **/
+
+VL_INLINE void
+_vl_dsift_with_gaussian_window (VlDsiftFilter * self,
+                                _VlDsiftScale const * sc, int bint,
+                                float * convTmp1, float * convTmp2)
+{
+  int binx, biny ;
   int framex, framey ;
+  float *xker, *yker ;
+
+  int Wx = sc->geom.binSizeX - 1 ;
+  int Wy = sc->geom.binSizeY - 1 ;
+
+  for (biny = 0 ; biny < sc->geom.numBinY ; ++biny) {
+
+    yker = _vl_dsift_new_kernel (sc->geom.binSizeY,
+                                 sc->geom.numBinY,
+                                 biny,
+                                 self->windowSize) ;
 
-  /* for each orientation bin */
-  for (bint = 0 ; bint < self->geom.numBinT ; ++bint) {
+    for (binx = 0 ; binx < sc->geom.numBinX ; ++binx) {
 
-    vl_imconvcoltri_f (self->convTmp1, self->imHeight,
-                       self->grads [bint], self->imWidth, self->imHeight,
+      xker = _vl_dsift_new_kernel(sc->geom.binSizeX,
+                                  sc->geom.numBinX,
+                                  binx,
+                                  self->windowSize) ;
+
+      vl_imconvcol_vf (convTmp1, self->imHeight,
+                       sc->grads[bint], self->imWidth, self->imHeight,
                        self->imWidth,
-                       self->geom.binSizeY, /* filt size */
-                       1, /* subsampling step */
+                       yker, -Wy, +Wy, 1,
                        VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
 
-    vl_imconvcoltri_f (self->convTmp2, self->imWidth,
-                       self->convTmp1, self->imHeight, self->imWidth,
+      vl_imconvcol_vf (convTmp2, self->imWidth,
+                       convTmp1, self->imHeight, self->imWidth,
                        self->imHeight,
-                       self->geom.binSizeX,
-                       1,
+                       xker, -Wx, +Wx, 1,
                        VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
 
-    for (biny = 0 ; biny < self->geom.numBinY ; ++biny) {
-
-      /*
-      This fast version of DSIFT does not use a proper Gaussian
-      weighting scheme for the gradiens that are accumulated on the
-      spatial bins. Instead each spatial bins is accumulated based on
-      the triangular kernel only, equivalent to bilinear interpolation
-      plus a flat, rather than Gaussian, window. Eventually, however,
-      the magnitude of the spatial bins in the SIFT descriptor is
-      reweighted by the average of the Gaussian window on each bin.
-      */
-
-      float wy = _vl_dsift_get_bin_window_mean
-        (self->geom.binSizeY, self->geom.numBinY, biny,
-         self->windowSize) ;
-
-      /* The convolution functions vl_imconvcoltri_* convolve by a
-       * triangular kernel with unit integral. Instead for SIFT the
-       * triangular kernel should have unit height. This is
-       * compensated for by multiplying by the bin size:
-       */
-
-      wy *= self->geom.binSizeY ;
-
-      for (binx = 0 ; binx < self->geom.numBinX ; ++binx) {
-        float w ;
-        float wx = _vl_dsift_get_bin_window_mean (self->geom.binSizeX,
-                                                  self->geom.numBinX,
-                                                  binx,
-                                                  self->windowSize) ;
+      {
+        int descrSize = vl_dsift_get_descriptor_size (self) ;
 
         float *dst = self->descrs
+          + sc->frameOffset * descrSize
           + bint
-          + binx * self->geom.numBinT
-          + biny * (self->geom.numBinX * self->geom.numBinT)  ;
-
-        float *src = self->convTmp2 ;
+          + binx * sc->geom.numBinT
+          + biny * (sc->geom.numBinX * sc->geom.numBinT)  ;
 
-        int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
-        int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
-        int descrSize = vl_dsift_get_descriptor_size (self) ;
+        float const *src = convTmp2
+          + sc->boundMinX + binx * sc->geom.binSizeX
+          + (sc->boundMinY + biny * sc->geom.binSizeY) * self->imWidth ;
 
-        wx *= self->geom.binSizeX ;
-        w = wx * wy ;
-
-        for (framey  = self->boundMinY ;
-             framey <= self->boundMaxY - frameSizeY + 1 ;
-             framey += self->stepY) {
-          for (framex  = self->boundMinX ;
-               framex <= self->boundMaxX - frameSizeX + 1 ;
-               framex += self->stepX) {
-            *dst = w * src [(framex + binx * self->geom.binSizeX) * 1 +
-                            (framey + biny * self->geom.binSizeY) * self->imWidth]  ;
+        for (framey = 0 ; framey < sc->numFramesY ; ++framey) {
+          for (framex = 0 ; framex < sc->numFramesX ; ++framex) {
+            *dst = src [framex * self->stepX +
+                        framey * self->stepY * self->imWidth] ;
             dst += descrSize ;
           } /* framex */
         } /* framey */
-      } /* binx */
-    } /* biny */
-  } /* bint */
+      }
+
+      vl_free (xker) ;
+    } /* for binx */
+    vl_free (yker) ;
+  } /* for biny */
 }
 
 /** ------------------------------------------------------------------
- ** @brief Compute keypoints and descriptors
- **
+ ** @internal @brief Process one orientation plane with flat window.
+ ** @param self DSIFT filter object.
+ ** @param sc scale.
+ ** @param bint orientation bin.
+ ** @param convTmp1 temporary buffer.
+ ** @param convTmp2 temporary buffer.
+ **/
+
+VL_INLINE void
+_vl_dsift_with_flat_window (VlDsiftFilter* self,
+                            _VlDsiftScale const * sc, int bint,
+                            float * convTmp1, float * convTmp2)
+{
+  int binx, biny ;
+  int framex, framey ;
+
+  vl_imconvcoltri_f (convTmp1, self->imHeight,
+                     sc->grads [bint], self->imWidth, self->imHeight,
+                     self->imWidth,
+                     sc->geom.binSizeY, /* filt size */
+                     1, /* subsampling step */
+                     VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
+
+  vl_imconvcoltri_f (convTmp2, self->imWidth,
+                     convTmp1, self->imHeight, self->imWidth,
+                     self->imHeight,
+                     sc->geom.binSizeX,
+                     1,
+                     VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
+
+  for (biny = 0 ; biny < sc->geom.numBinY ; ++biny) {
+
+    /*
+    This fast version of DSIFT does not use a proper Gaussian
+    weighting scheme for the gradiens that are accumulated on the
+    spatial bins. Instead each spatial bins is accumulated based on
+    the triangular kernel only, equivalent to bilinear interpolation
+    plus a flat, rather than Gaussian, window. Eventually, however,
+    the magnitude of the spatial bins in the SIFT descriptor is
+    reweighted by the average of the Gaussian window on each bin.
+    */
+
+    float wy = _vl_dsift_get_bin_window_mean
+      (sc->geom.binSizeY, sc->geom.numBinY, biny,
+       self->windowSize) ;
+
+    /* The convolution functions vl_imconvcoltri_* convolve by a
+     * triangular kernel with unit integral. Instead for SIFT the
+     * triangular kernel should have unit height. This is
+     * compensated for by multiplying by the bin size:
+     */
+
+    wy *= sc->geom.binSizeY ;
+
+    for (binx = 0 ; binx < sc->geom.numBinX ; ++binx) {
+      float w ;
+      float wx = _vl_dsift_get_bin_window_mean (sc->geom.binSizeX,
+                                                sc->geom.numBinX,
+                                                binx,
+                                                self->windowSize) ;
+      int descrSize = vl_dsift_get_descriptor_size (self) ;
+
+      float *dst = self->descrs
+        + sc->frameOffset * descrSize
+        + bint
+        + binx * sc->geom.numBinT
+        + biny * (sc->geom.numBinX * sc->geom.numBinT)  ;
+
+      float const *src = convTmp2
+        + sc->boundMinX + binx * sc->geom.binSizeX
+        + (sc->boundMinY + biny * sc->geom.binSizeY) * self->imWidth ;
+
+      wx *= sc->geom.binSizeX ;
+      w = wx * wy ;
+
+      for (framey = 0 ; framey < sc->numFramesY ; ++framey) {
+        for (framex = 0 ; framex < sc->numFramesX ; ++framex) {
+          *dst = w * src [framex * self->stepX +
+                          framey * self->stepY * self->imWidth] ;
+          dst += descrSize ;
+        } /* framex */
+      } /* framey */
+    } /* binx */
+  } /* biny */
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Compute the orientation planes of some rows
  ** @param self DSIFT filter.
- ** @param im   image data.
+ ** @param im image.
+ ** @param grads orientation planes.
+ ** @param begin first row.
+ ** @param end last row plus one.
  **/
 
-void vl_dsift_process (VlDsiftFilter* self, float const* im)
+static void
+_vl_dsift_gradient_rows (VlDsiftFilter *self, float const *im,
+                         float **grads, int begin, int end)
 {
   int t, x, y ;
 
-  /* update buffers */
-  _vl_dsift_alloc_buffers (self) ;
-
   /* clear integral images */
   for (t = 0 ; t < self->geom.numBinT ; ++t)
-    memset (self->grads[t], 0,
-            sizeof(float) * self->imWidth * self->imHeight) ;
+    memset (grads[t] + begin * self->imWidth, 0,
+            sizeof(float) * self->imWidth * (end - begin)) ;
 
 #undef at
 #define at(x,y) (im[(y)*self->imWidth+(x)])
 
   /* Compute gradients, their norm, and their angle */
 
-  for (y = 0 ; y < self->imHeight ; ++ y) {
+  for (y = begin ; y < end ; ++ y) {
     for (x = 0 ; x < self->imWidth ; ++ x) {
       float gx, gy ;
       float angle, mod, nt, rbint ;
@@ -717,64 +873,319 @@ void vl_dsift_process (VlDsiftFilter* self, float const* im)
       rbint = nt - bint ;
 
       /* write it back */
-      self->grads [(bint    ) % self->geom.numBinT][x + y * self->imWidth] = (1 - rbint) * mod ;
-      self->grads [(bint + 1) % self->geom.numBinT][x + y * self->imWidth] = (    rbint) * mod ;
+      grads [(bint    ) % self->geom.numBinT][x + y * self->imWidth] = (1 - rbint) * mod ;
+      grads [(bint + 1) % self->geom.numBinT][x + y * self->imWidth] = (    rbint) * mod ;
     }
   }
+}
 
-  if (self->useFlatWindow) {
-    _vl_dsift_with_flat_window(self) ;
-  } else {
-    _vl_dsift_with_gaussian_window(self) ;
+/** ------------------------------------------------------------------
+ ** @internal @brief Task computing the orientation planes by rows
+ **/
+
+static void
+_vl_dsift_gradient_task (VlDsiftFilter *self, void *data,
+                         int tid VL_UNUSED, int begin, int end)
+{
+  _VlDsiftJob const *job = data ;
+  _vl_dsift_gradient_rows (self, job->im, job->scales[0].grads, begin, end) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Filter and transpose a band of columns of an image
+ **
+ ** Columns are filtered independently, so that the bands of an image
+ ** can be processed by different threads with the same result.
+ **/
+
+static void
+_vl_dsift_smooth_band (VlDsiftFilter *self VL_UNUSED, void *data,
+                       int tid VL_UNUSED, int begin, int end)
+{
+  _VlDsiftSmoothJob const *job = data ;
+  vl_imconvcol_vf (job->dst + begin * job->height, job->height,
+                   job->src + begin, end - begin, job->height, job->width,
+                   job->filter, - job->filterWidth, job->filterWidth,
+                   1, VL_PAD_BY_CONTINUITY|VL_TRANSPOSE) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Smooth an image as @c vl_imsmooth
+ ** @param self DSIFT filter.
+ ** @param im image.
+ ** @param sigma standard deviation of the Gaussian.
+ ** @return the smoothed image (in DSIFT::convTmp2) or @a im.
+ **/
+
+static float const *
+_vl_dsift_smooth (VlDsiftFilter *self, float const *im, double sigma)
+{
+  _VlDsiftSmoothJob job ;
+  int W = (int) ceil (4.0 * sigma) ;
+  float *filter ;
+  float acc = 0 ;
+  int j ;
+
+  if (sigma < 0.01) return im ;
+
+  filter = vl_malloc (sizeof(float) * (2 * W + 1)) ;
+  for (j = 0 ; j < 2 * W + 1 ; ++j) {
+    float z = ((float) j - W) / (sigma + VL_EPSILON_F) ;
+    filter[j] = (float) exp (- 0.5 * (z*z)) ;
+    acc += filter[j] ;
+  }
+  for (j = 0 ; j < 2 * W + 1 ; ++j) {
+    filter[j] /= acc ;
+  }
+
+  /* bands start at multiples of four columns to keep SIMD alignment */
+  job.filter = filter ;
+  job.filterWidth = W ;
+  job.dst = self->convTmp1 ;
+  job.src = im ;
+  job.width = self->imWidth ;
+  job.height = self->imHeight ;
+  _vl_dsift_parallel_for (self, _vl_dsift_smooth_band, &job,
+                          self->imWidth, 16, 4) ;
+
+  job.dst = self->convTmp2 ;
+  job.src = self->convTmp1 ;
+  job.width = self->imHeight ;
+  job.height = self->imWidth ;
+  _vl_dsift_parallel_for (self, _vl_dsift_smooth_band, &job,
+                          self->imHeight, 16, 4) ;
+
+  vl_free (filter) ;
+  return self->convTmp2 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal @brief Task binning the orientation planes of the scales
+ **
+ ** Item @c k is the orientation plane <code>k % numBinT</code> of the
+ ** scale <code>k / numBinT</code>.
+ **/
+
+static void
+_vl_dsift_planes_task (VlDsiftFilter *self, void *data,
+                       int tid, int begin, int end)
+{
+  _VlDsiftJob const *job = data ;
+  float *convTmp1, *convTmp2 ;
+  int k ;
+
+  _vl_dsift_get_thread_buffers (self, tid, &convTmp1, &convTmp2) ;
+
+  for (k = begin ; k < end ; ++k) {
+    _VlDsiftScale const *sc = job->scales + k / self->geom.numBinT ;
+    int bint = k % self->geom.numBinT ;
+    if (sc->numFramesX * sc->numFramesY == 0) {
+      continue ;
+    } else if (self->useFlatWindow) {
+      _vl_dsift_with_flat_window (self, sc, bint, convTmp1, convTmp2) ;
+    } else {
+      _vl_dsift_with_gaussian_window (self, sc, bint, convTmp1, convTmp2) ;
+    }
   }
+}
 
-  {
-    VlDsiftKeypoint* frameIter = self->frames ;
-    float * descrIter = self->descrs ;
-    int framex, framey, bint ;
+/** ------------------------------------------------------------------
+ ** @internal @brief Task filling and normalizing the keypoints
+ **/
 
-    int frameSizeX = self->geom.binSizeX * (self->geom.numBinX - 1) + 1 ;
-    int frameSizeY = self->geom.binSizeY * (self->geom.numBinY - 1) + 1 ;
-    int descrSize = vl_dsift_get_descriptor_size (self) ;
+static void
+_vl_dsift_frames_task (VlDsiftFilter *self, void *data,
+                       int tid VL_UNUSED, int begin, int end)
+{
+  _VlDsiftJob const *job = data ;
+  int descrSize = vl_dsift_get_descriptor_size (self) ;
+  int s = 0 ;
+  int k, bint ;
+
+  for (k = begin ; k < end ; ++k) {
+    VlDsiftKeypoint* frameIter = self->frames + k ;
+    float * descrIter = self->descrs + k * descrSize ;
+    _VlDsiftScale const *sc ;
+    int framex, framey ;
+
+    while (s + 1 < job->numScales && k >= job->scales[s + 1].frameOffset) ++ s ;
+    sc = job->scales + s ;
+
+    framex = sc->boundMinX + ((k - sc->frameOffset) % sc->numFramesX) * self->stepX ;
+    framey = sc->boundMinY + ((k - sc->frameOffset) / sc->numFramesX) * self->stepY ;
+
+    {
+      int frameSizeX = sc->geom.binSizeX * (sc->geom.numBinX - 1) + 1 ;
+      int frameSizeY = sc->geom.binSizeY * (sc->geom.numBinY - 1) + 1 ;
+
+      float deltaCenterX = 0.5F * sc->geom.binSizeX * (sc->geom.numBinX - 1) ;
+      float deltaCenterY = 0.5F * sc->geom.binSizeY * (sc->geom.numBinY - 1) ;
+
+      float normConstant = frameSizeX * frameSizeY ;
+
+      frameIter->x    = framex + deltaCenterX ;
+      frameIter->y    = framey + deltaCenterY ;
+      frameIter->s    = sc->geom.binSizeX ;
+
+      /* mass */
+      {
+        float mass = 0 ;
+        for (bint = 0 ; bint < descrSize ; ++ bint)
+          mass += descrIter[bint] ;
+        mass /= normConstant ;
+        frameIter->norm = mass ;
+      }
+    }
 
-    float deltaCenterX = 0.5F * self->geom.binSizeX * (self->geom.numBinX - 1) ;
-    float deltaCenterY = 0.5F * self->geom.binSizeY * (self->geom.numBinY - 1) ;
+    /* L2 normalize */
+    _vl_dsift_normalize_histogram (descrIter, descrIter + descrSize) ;
 
-    float normConstant = frameSizeX * frameSizeY ;
+    /* clamp */
+    for(bint = 0 ; bint < descrSize ; ++ bint)
+      if (descrIter[bint] > 0.2F) descrIter[bint] = 0.2F ;
 
-    for (framey  = self->boundMinY ;
-         framey <= self->boundMaxY - frameSizeY + 1 ;
-         framey += self->stepY) {
+    /* L2 normalize */
+    _vl_dsift_normalize_histogram (descrIter, descrIter + descrSize) ;
+  }
+}
 
-      for (framex  = self->boundMinX ;
-           framex <= self->boundMaxX - frameSizeX + 1 ;
-           framex += self->stepX) {
+/** ------------------------------------------------------------------
+ ** @brief Compute keypoints and descriptors
+ **
+ ** @param self DSIFT filter.
+ ** @param im   image data.
+ **/
 
-        frameIter->x    = framex + deltaCenterX ;
-        frameIter->y    = framey + deltaCenterY ;
+void vl_dsift_process (VlDsiftFilter* self, float const* im)
+{
+  _VlDsiftScale scale ;
+  _VlDsiftJob job ;
 
-        /* mass */
-        {
-          float mass = 0 ;
-          for (bint = 0 ; bint < descrSize ; ++ bint)
-            mass += descrIter[bint] ;
-          mass /= normConstant ;
-          frameIter->norm = mass ;
-        }
+  /* update buffers */
+  _vl_dsift_update_buffers (self) ;
+  _vl_dsift_alloc_buffers (self, self->numFrames, self->geom.numBinT) ;
+
+  _vl_dsift_init_scale (self, &scale, &self->geom,
+                        self->boundMinX, self->boundMinY, 0) ;
+  scale.grads = self->grads ;
+
+  job.im = im ;
+  job.scales = &scale ;
+  job.numScales = 1 ;
+
+  _vl_dsift_parallel_for (self, _vl_dsift_gradient_task, &job,
+                          self->imHeight, 16, 1) ;
+  _vl_dsift_parallel_for (self, _vl_dsift_planes_task, &job,
+                          self->geom.numBinT, 1, 1) ;
+  _vl_dsift_parallel_for (self, _vl_dsift_frames_task, &job,
+                          self->numFrames, 64, 1) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute keypoints and descriptors at several bin sizes
+ **
+ ** @param self        DSIFT filter.
+ ** @param im          image data.
+ ** @param binSizes    bin sizes.
+ ** @param numBinSizes number of bin sizes.
+ ** @param magnif      smoothing factor (or zero).
+ **
+ ** The function computes in one pass the keypoints and descriptors
+ ** of ::vl_dsift_process for each of the @a numBinSizes (at most
+ ** ::VL_DSIFT_MAX_BIN_SIZES) bin sizes @a binSizes, which replace the
+ ** bin sizes of the filter geometry. The keypoints are stored one
+ ** bin size after the other, and VlDsiftKeypoint::s is set to their
+ ** bin size.
+ **
+ ** As in @c vl_phow, the keypoints of the different bin sizes have
+ ** the same centers: the bounds of a bin size @c b are moved right
+ ** and down by <code>floor((numBinX - 1) / 2 (maxb - b))</code>
+ ** pixels, where @c maxb is the largest bin size (and similarly along
+ ** Y).
+ **
+ ** If @a magnif is positive, the image of a bin size @c b is smoothed
+ ** by a Gaussian of standard deviation <code>b / magnif</code>, as by
+ ** @c vl_imsmooth, before computing its gradient. Otherwise the
+ ** gradient is computed once and shared by all bin sizes. The
+ ** descriptors are the same as the ones of ::vl_dsift_process run on
+ ** each smoothed image with the bounds above.
+ **
+ ** The orientation planes of the bin sizes are convolved in parallel
+ ** (see ::vl_dsift_set_num_threads). With smoothing, the bin sizes
+ ** are processed in groups just large enough to give each thread a
+ ** plane, so that only the planes of a group are stored.
+ **/
+
+void
+vl_dsift_process_multi (VlDsiftFilter* self, float const* im,
+                        int const* binSizes, int numBinSizes,
+                        double magnif)
+{
+  _VlDsiftScale scales [VL_DSIFT_MAX_BIN_SIZES] ;
+  _VlDsiftJob job ;
+  int maxBinSize = 0 ;
+  int numFrames = 0 ;
+  int groupSize = 1 ;
+  int s, first ;
 
-        /* L2 normalize */
-        _vl_dsift_normalize_histogram (descrIter, descrIter + descrSize) ;
+  assert (numBinSizes >= 1 && numBinSizes <= VL_DSIFT_MAX_BIN_SIZES) ;
 
-        /* clamp */
-        for(bint = 0 ; bint < descrSize ; ++ bint)
-          if (descrIter[bint] > 0.2F) descrIter[bint] = 0.2F ;
+  for (s = 0 ; s < numBinSizes ; ++s) {
+    maxBinSize = VL_MAX(maxBinSize, binSizes[s]) ;
+  }
 
-        /* L2 normalize */
-        _vl_dsift_normalize_histogram (descrIter, descrIter + descrSize) ;
+  for (s = 0 ; s < numBinSizes ; ++s) {
+    VlDsiftDescriptorGeometry geom = self->geom ;
+    int offX = (int) floor (0.5 * (geom.numBinX - 1) * (maxBinSize - binSizes[s])) ;
+    int offY = (int) floor (0.5 * (geom.numBinY - 1) * (maxBinSize - binSizes[s])) ;
+    geom.binSizeX = binSizes[s] ;
+    geom.binSizeY = binSizes[s] ;
+    _vl_dsift_init_scale (self, scales + s, &geom,
+                          self->boundMinX + offX, self->boundMinY + offY,
+                          numFrames) ;
+    numFrames += scales[s].numFramesX * scales[s].numFramesY ;
+  }
+
+  /* enough bin sizes for each thread to convolve a plane */
+  if (magnif > 0) {
+    groupSize = (self->numThreads + self->geom.numBinT - 1) / self->geom.numBinT ;
+    groupSize = VL_MIN(groupSize, numBinSizes) ;
+  }
 
-        frameIter ++ ;
-        descrIter += descrSize ;
-      } /* for framex */
-    } /* for framey */
+  _vl_dsift_update_buffers (self) ;
+  self->numFrames = numFrames ;
+  _vl_dsift_alloc_buffers (self, numFrames, self->geom.numBinT * groupSize) ;
+
+  job.im = im ;
+
+  if (magnif > 0) {
+    for (first = 0 ; first < numBinSizes ; first += groupSize) {
+      job.scales = scales + first ;
+      job.numScales = VL_MIN(groupSize, numBinSizes - first) ;
+      for (s = 0 ; s < job.numScales ; ++s) {
+        _VlDsiftJob gradJob ;
+        gradJob.scales = job.scales + s ;
+        gradJob.scales->grads = self->grads + s * self->geom.numBinT ;
+        gradJob.im = _vl_dsift_smooth (self, im, binSizes[first + s] / magnif) ;
+        _vl_dsift_parallel_for (self, _vl_dsift_gradient_task, &gradJob,
+                                self->imHeight, 16, 1) ;
+      }
+      _vl_dsift_parallel_for (self, _vl_dsift_planes_task, &job,
+                              job.numScales * self->geom.numBinT, 1, 1) ;
+    }
+  } else {
+    for (s = 0 ; s < numBinSizes ; ++s) scales[s].grads = self->grads ;
+    job.scales = scales ;
+    job.numScales = numBinSizes ;
+    _vl_dsift_parallel_for (self, _vl_dsift_gradient_task, &job,
+                            self->imHeight, 16, 1) ;
+    _vl_dsift_parallel_for (self, _vl_dsift_planes_task, &job,
+                            numBinSizes * self->geom.numBinT, 1, 1) ;
   }
+
+  job.scales = scales ;
+  job.numScales = numBinSizes ;
+  _vl_dsift_parallel_for (self, _vl_dsift_frames_task, &job,
+                          numFrames, 64, 1) ;
 }
@@ -36,6 +36,12 @@ typedef struct VlDsiftDescriptorGeometry_
   int binSizeY ; /**< size of bins along Y */
 } VlDsiftDescriptorGeometry ;
 
+/** @brief Maximum number of threads of a DSIFT filter */
+#define VL_DSIFT_MAX_THREADS 64
+
+/** @brief Maximum number of bin sizes of ::vl_dsift_process_multi */
+#define VL_DSIFT_MAX_BIN_SIZES 16
+
 /** @brief Dense SIFT filter */
 typedef struct VlDsiftFilter_
 {
@@ -68,12 +74,18 @@ typedef struct VlDsiftFilter_
   float **grads ;          /**< gradient buffer */
   float *convTmp1 ;        /**< temporary buffer */
   float *convTmp2 ;        /**< temporary buffer */
+
+  int numThreads ;         /**< number of threads */
+  float *threadConvTmp [VL_DSIFT_MAX_THREADS] ; /**< temporary buffers of the other threads */
 }  VlDsiftFilter ;
 
 VL_EXPORT VlDsiftFilter *vl_dsift_new (int width, int height) ;
 VL_EXPORT VlDsiftFilter *vl_dsift_new_basic (int width, int height, int step, int binSize) ;
 VL_EXPORT void vl_dsift_delete (VlDsiftFilter *self) ;
 VL_EXPORT void vl_dsift_process (VlDsiftFilter *self, float const* im) ;
+VL_EXPORT void vl_dsift_process_multi (VlDsiftFilter *self, float const* im,
+                                       int const* binSizes, int numBinSizes,
+                                       double magnif) ;
 VL_INLINE void vl_dsift_transpose_descriptor (float* dst,
                                              float const* src,
                                              int numBinT,
@@ -95,6 +107,7 @@ VL_INLINE void vl_dsift_set_geometry (VlDsiftFilter *self,
                                       VlDsiftDescriptorGeometry const* geom) ;
 VL_INLINE void vl_dsift_set_flat_window (VlDsiftFilter *self, vl_bool useFlatWindow) ;
 VL_INLINE void vl_dsift_set_window_size (VlDsiftFilter *self, double windowSize) ;
+VL_INLINE void vl_dsift_set_num_threads (VlDsiftFilter *self, int numThreads) ;
 /** @} */
 
 /** @name Retrieving data and parameters
@@ -115,6 +128,7 @@ VL_INLINE void            vl_dsift_get_steps           (VlDsiftFilter const* sel
 VL_INLINE VlDsiftDescriptorGeometry const* vl_dsift_get_geometry (VlDsiftFilter const *self) ;
 VL_INLINE vl_bool         vl_dsift_get_flat_window     (VlDsiftFilter const *self) ;
 VL_INLINE double          vl_dsift_get_window_size     (VlDsiftFilter const *self) ;
+VL_INLINE int             vl_dsift_get_num_threads     (VlDsiftFilter const *self) ;
 /** @} */
 
 VL_EXPORT
@@ -350,5 +364,34 @@ vl_dsift_get_window_size(VlDsiftFilter const * self)
   return self->windowSize ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set the number of threads
+ ** @param self DSIFT filter object.
+ ** @param numThreads number of threads.
+ **
+ ** ::vl_dsift_process and ::vl_dsift_process_multi split the
+ ** orientation planes and the keypoints among @a numThreads threads
+ ** (clamped to the range 1 to ::VL_DSIFT_MAX_THREADS). The results do
+ ** not depend on @a numThreads.
+ **/
+
+VL_INLINE void
+vl_dsift_set_num_threads (VlDsiftFilter *self, int numThreads)
+{
+  self->numThreads = VL_MAX(1, VL_MIN(numThreads, VL_DSIFT_MAX_THREADS)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of threads
+ ** @param self DSIFT filter object.
+ ** @return number of threads.
+ **/
+
+VL_INLINE int
+vl_dsift_get_num_threads (VlDsiftFilter const *self)
+{
+  return self->numThreads ;
+}
+
 /*  VL_DSIFT_H */
 #endif
@@ -608,6 +608,21 @@ vl_unlock_state ()
  ** @return @c true if SSE2 is present.
  **/
 
+/** @fn ::vl_cpu_has_avx()
+ ** @brief Check for AVX instruction set
+ ** @return @c true if AVX is present and enabled by the OS.
+ **/
+
+/** @fn ::vl_cpu_has_avx2()
+ ** @brief Check for AVX2 instruction set
+ ** @return @c true if AVX2 is present and enabled by the OS.
+ **/
+
+/** @fn ::vl_cpu_has_fma()
+ ** @brief Check for FMA (fused multiply-add) instruction set
+ ** @return @c true if FMA is present and enabled by the OS.
+ **/
+
 /** ------------------------------------------------------------------
  ** @internal @brief Set last VLFeat error
  **
@@ -180,6 +180,9 @@ VL_INLINE void vl_set_simd_enabled (vl_bool x) ;
 VL_INLINE vl_bool vl_get_simd_enabled () ;
 VL_INLINE vl_bool vl_cpu_has_sse3 () ;
 VL_INLINE vl_bool vl_cpu_has_sse2 () ;
+VL_INLINE vl_bool vl_cpu_has_avx () ;
+VL_INLINE vl_bool vl_cpu_has_avx2 () ;
+VL_INLINE vl_bool vl_cpu_has_fma () ;
 VL_INLINE int vl_get_num_cpus () ;
 VL_EXPORT VlRand * vl_get_rand () ;
 
@@ -361,6 +364,36 @@ vl_cpu_has_sse2 ()
 #endif
 }
 
+VL_INLINE vl_bool
+vl_cpu_has_avx ()
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasAVX ;
+#else
+  return 0 ;
+#endif
+}
+
+VL_INLINE vl_bool
+vl_cpu_has_avx2 ()
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasAVX2 ;
+#else
+  return 0 ;
+#endif
+}
+
+VL_INLINE vl_bool
+vl_cpu_has_fma ()
+{
+#if defined(VL_ARCH_IX86) || defined(VL_ARCH_X64) || defined(VL_ARCH_IA64)
+  return vl_get_state()->cpuInfo.hasFMA ;
+#else
+  return 0 ;
+#endif
+}
+
 VL_INLINE int
 vl_get_num_cpus ()
 {
@@ -325,6 +325,12 @@ it supports POSIX threads.
  ** Define this symbol to disable SSE2 support.
  **/
 
+/** @def VL_DISABLE_AVX2
+ ** @brief Defined if AVX2 support if disabled
+ **
+ ** Define this symbol to disable AVX2 and FMA support.
+ **/
+
 /** @def VL_DISABLE_THREADS
  ** @brief Defined if multi-threading support is disabled
  **
@@ -356,7 +362,13 @@ it supports POSIX threads.
 VL_INLINE void
 _vl_cpuid (vl_int32* info, int function)
 {
-  __cpuid(info, function) ;
+  __cpuidex(info, function, 0) ;
+}
+
+VL_INLINE vl_uint64
+_vl_xgetbv ()
+{
+  return _xgetbv(0) ;
 }
 #endif
 
@@ -376,17 +388,31 @@ _vl_cpuid (vl_int32* info, int function)
    "movl %%ebx, %1   \n" /* save what cpuid just put in %ebx */
    "popl %%ebx       \n" /* restore the old %ebx */
    : "=a"(info[0]), "=r"(info[1]), "=c"(info[2]), "=d"(info[3])
-   : "a"(function)
+   : "a"(function), "c"(0)
    : "cc") ; /* clobbered (cc=condition codes) */
 #else /* no -fPIC or -fPIC with a 64-bit target */
   __asm__ __volatile__
   ("cpuid"
    : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3])
-   : "a"(function)
+   : "a"(function), "c"(0)
    : "cc") ;
 #endif
 }
 
+/* Read the XCR0 register, that tells which register states the OS
+ * saves. This is the xgetbv instruction, spelled out for assemblers
+ * that do not know it. */
+VL_INLINE vl_uint64
+_vl_xgetbv ()
+{
+  vl_uint32 eax, edx ;
+  __asm__ __volatile__
+  (".byte 0x0f, 0x01, 0xd0"
+   : "=a"(eax), "=d"(edx)
+   : "c"(0)) ;
+  return ((vl_uint64) edx << 32) | eax ;
+}
+
 #endif
 
 void
@@ -408,6 +434,23 @@ _vl_x86cpu_info_init (VlX86CpuInfo *self)
     self->hasSSE3  = info[2] & (1 <<  0) ;
     self->hasSSE41 = info[2] & (1 << 19) ;
     self->hasSSE42 = info[2] & (1 << 20) ;
+
+    self->hasAVX     = 0 ;
+    self->hasFMA     = 0 ;
+    self->hasAVX2    = 0 ;
+    self->hasAVX512F = 0 ;
+
+    /* AVX registers are usable only if the OS saves them (OSXSAVE) */
+    if ((info[2] & (1 << 27)) && (_vl_xgetbv() & 0x6) == 0x6) {
+      self->hasAVX = info[2] & (1 << 28) ;
+      self->hasFMA = info[2] & (1 << 12) ;
+      if (max_func >= 7) {
+        vl_uint64 xcr0 = _vl_xgetbv() ;
+        _vl_cpuid(info, 7) ;
+        self->hasAVX2 = info[1] & (1 << 5) ;
+        self->hasAVX512F = (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6 ;
+      }
+    }
   }
 }
 
@@ -421,14 +464,18 @@ _vl_x86cpu_info_to_string_copy (VlX86CpuInfo const *self)
       string = vl_malloc(sizeof(char) * length) ;
       if (string == NULL) break ;
     }
-    length = snprintf(string, length, "%s%s%s%s%s%s%s",
+    length = snprintf(string, length, "%s%s%s%s%s%s%s%s%s%s%s",
                       self->vendor.string,
                       self->hasMMX   ? " MMX" : "",
                       self->hasSSE   ? " SSE" : "",
                       self->hasSSE2  ? " SSE2" : "",
                       self->hasSSE3  ? " SSE3" : "",
                       self->hasSSE41 ? " SSE41" : "",
-                      self->hasSSE42 ? " SSE42" : "") ;
+                      self->hasSSE42 ? " SSE42" : "",
+                      self->hasAVX   ? " AVX" : "",
+                      self->hasFMA   ? " FMA" : "",
+                      self->hasAVX2  ? " AVX2" : "",
+                      self->hasAVX512F ? " AVX512F" : "") ;
     length += 1 ;
   }
   return string ;
@@ -482,6 +529,9 @@ vl_static_configuration_to_string_copy ()
 #endif
 #ifndef VL_DISABLE_SSE2
   ", SSE2"
+#endif
+#ifndef VL_DISABLE_AVX2
+  ", AVX2"
 #endif
   ;
 
@@ -36,6 +36,7 @@ the terms of the BSD license (see the COPYING file).
 
 #include "imopv.h"
 #include "imopv_sse2.h"
+#include "imopv_avx2.h"
 #include "mathop.h"
 
 #define FLT VL_TYPE_FLOAT
@@ -130,9 +131,21 @@ void VL_XCAT(vl_imconvcol_v, SFX)
   vl_bool transp = flags & VL_TRANSPOSE ;
   vl_bool zeropad = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
 
-  /* dispatch to accelerated version */
+  /* dispatch to accelerated version; the AVX2 one leaves the last
+     columns, if any, to the code below, the SSE2 one processes all of
+     them if the AVX2 one did not */
+#ifndef VL_DISABLE_AVX2
+  if (vl_cpu_has_avx2() && vl_get_simd_enabled()) {
+    x = VL_XCAT3(_vl_imconvcol_v,SFX,_avx2)
+    (dst,dst_stride,
+     src,src_width,src_height,src_stride,
+     filt,filt_begin,filt_end,
+     step,flags) ;
+    dst += transp ? x * dst_stride : x ;
+  }
+#endif
 #ifndef VL_DISABLE_SSE2
-  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+  if (x == 0 && vl_cpu_has_sse2() && vl_get_simd_enabled()) {
     VL_XCAT3(_vl_imconvcol_v,SFX,_sse2)
     (dst,dst_stride,
      src,src_width,src_height,src_stride,
@@ -513,8 +526,7 @@ VL_XCAT(vl_imconvcoltri_, SFX)
   vl_bool transp = flags & VL_TRANSPOSE ;
   vl_bool zeropad = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
   T scale = (T) (1.0 / ((double)filterSize * (double)filterSize)) ;
-  T * buffer = vl_malloc (sizeof(T) * (imageHeight + filterSize)) ;
-  buffer += filterSize ;
+  T * buffer ;
 
   if (imageHeight == 0) {
     return  ;
@@ -523,6 +535,21 @@ VL_XCAT(vl_imconvcoltri_, SFX)
   x = 0 ;
   dheight = (imageHeight - 1) / step + 1 ;
 
+  /* dispatch to accelerated version, which leaves the last columns,
+     if any, to the code below */
+#ifndef VL_DISABLE_AVX2
+  if (vl_cpu_has_avx2() && vl_get_simd_enabled()) {
+    x = VL_XCAT3(_vl_imconvcoltri_,SFX,_avx2)
+    (dest, destStride, image, imageWidth, imageHeight, imageStride,
+     filterSize, step, flags) ;
+    if (x == (signed)imageWidth) return ;
+    dest += transp ? x * destStride : (vl_size) x ;
+  }
+#endif
+
+  buffer = vl_malloc (sizeof(T) * (imageHeight + filterSize)) ;
+  buffer += filterSize ;
+
   while (x < (signed)imageWidth) {
     T const * imagei ;
     imagei = image + x + imageStride * (imageHeight - 1) ;
@@ -0,0 +1,217 @@
+/** @file imopv_avx2.c
+ ** @brief Vectorized image operations - AVX2 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_AVX2) & ! defined(__AVX2__)
+#error "Compiling with AVX2 enabled, but no __AVX2__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_AVX2)
+
+#ifndef VL_IMOPV_AVX2_INSTANTIATING
+
+#include <immintrin.h>
+#include "imopv.h"
+#include "imopv_avx2.h"
+
+#define FLT VL_TYPE_FLOAT
+#define VL_IMOPV_AVX2_INSTANTIATING
+#include "imopv_avx2.c"
+
+#define FLT VL_TYPE_DOUBLE
+#define VL_IMOPV_AVX2_INSTANTIATING
+#include "imopv_avx2.c"
+
+/* ---------------------------------------------------------------- */
+/* VL_IMOPV_AVX2_INSTANTIATING */
+#else
+
+#include "float.th"
+
+/* Products and sums are not fused, so that each column is computed
+ * with the same operations, in the same order, as by the SSE2 and C
+ * versions, and results do not depend on the CPU. Loads are
+ * unaligned: on AVX2 processors they cost the same as aligned loads
+ * of aligned data, and image buffers are seldom aligned to 32 bytes. */
+
+/* ---------------------------------------------------------------- */
+int
+VL_XCAT3(_vl_imconvcol_v, SFX, _avx2)
+(T* dst, int dst_stride,
+ T const* src,
+ int src_width, int src_height, int src_stride,
+ T const* filt, int filt_begin, int filt_end,
+ int step, unsigned int flags)
+{
+  int x = 0 ;
+  int y ;
+  vl_bool transp    = flags & VL_TRANSPOSE ;
+  vl_bool zeropad   = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
+
+  /* let filt point to the last sample of the filter */
+  filt += filt_end - filt_begin ;
+
+  for (x = 0 ; x + VSIZE <= src_width ; x += VSIZE) {
+    /* see vl_imconvcol_vf for the three chunks of the sum */
+    T * dsti = transp ? dst + x * dst_stride : dst + x ;
+
+    for (y = 0 ; y < src_height ; y += step)  {
+      union {VTYPE v ; T x [VSIZE] ; } acc ;
+      VTYPE v, c ;
+      T const *filti = filt ;
+      T const *srci ;
+      int stop ;
+
+      acc.v = VSTZ () ;
+      v = VSTZ () ;
+
+      stop = filt_end - y ;
+      srci = src + x - stop * src_stride ;
+
+      if (stop > 0) {
+        if (zeropad) {
+          v = VSTZ () ;
+        } else {
+          v = VLDU (src + x) ;
+        }
+        while (filti > filt - stop) {
+          c = VLD1 (filti--) ;
+          acc.v = VADD (acc.v, VMUL (v, c)) ;
+          srci += src_stride ;
+        }
+      }
+
+      stop = filt_end - VL_MAX(filt_begin, y - src_height + 1) + 1 ;
+      while (filti > filt - stop) {
+        v = VLDU (srci) ;
+        c = VLD1 (filti--) ;
+        acc.v = VADD (acc.v, VMUL (v, c)) ;
+        srci += src_stride ;
+      }
+
+      if (zeropad) v = VSTZ () ;
+
+      stop = filt_end - filt_begin + 1 ;
+      while (filti > filt - stop) {
+        c = VLD1 (filti--) ;
+        acc.v = VADD (acc.v, VMUL (v, c)) ;
+      }
+
+      if (transp) {
+        int i ;
+        for (i = 0 ; i < VSIZE ; ++i) dsti [i * dst_stride] = acc.x [i] ;
+        dsti += 1 ;
+      } else {
+        VSTU (dsti, acc.v) ;
+        dsti += dst_stride ;
+      }
+    } /* next y */
+  } /* next x */
+  return x ;
+}
+
+/* ---------------------------------------------------------------- */
+vl_size
+VL_XCAT3(_vl_imconvcoltri_, SFX, _avx2)
+(T * dest, vl_size destStride,
+ T const * image,
+ vl_size imageWidth, vl_size imageHeight, vl_size imageStride,
+ vl_size filterSize,
+ vl_size step, unsigned int flags)
+{
+  vl_index x, y ;
+  vl_index h = imageHeight ;
+  vl_index fs = filterSize ;
+  vl_index dheight = (h - 1) / (vl_index) step + 1 ;
+  vl_bool transp = flags & VL_TRANSPOSE ;
+  vl_bool zeropad = (flags & VL_PAD_MASK) == VL_PAD_BY_ZERO ;
+  VTYPE scale = VSETA ((T) (1.0 / ((double)filterSize * (double)filterSize))) ;
+  T * buffer ;
+
+  if (h == 0 || imageWidth < VSIZE) return 0 ;
+
+  /* one row of VSIZE columns per buffer element of vl_imconvcoltri_f */
+  buffer = vl_malloc (sizeof(T) * VSIZE * (h + fs)) ;
+  buffer += VSIZE * fs ;
+
+#define B(y) (buffer + VSIZE * (y))
+
+  for (x = 0 ; x + VSIZE <= (signed)imageWidth ; x += VSIZE) {
+    T const * imagei = image + x + imageStride * (h - 1) ;
+    VTYPE acc ;
+
+    /* integrate backward the columns */
+    acc = VLDU (imagei) ;
+    VSTU (B(h - 1), acc) ;
+    for (y = h - 2 ; y >= 0 ; --y) {
+      imagei -= imageStride ;
+      acc = VADD (acc, VLDU (imagei)) ;
+      VSTU (B(y), acc) ;
+    }
+    if (zeropad) {
+      for ( ; y >= - fs ; --y) {
+        VSTU (B(y), acc) ;
+      }
+    } else {
+      VTYPE first = VLDU (imagei) ;
+      for ( ; y >= - fs ; --y) {
+        acc = VADD (acc, first) ;
+        VSTU (B(y), acc) ;
+      }
+    }
+
+    /* compute the filter forward */
+    for (y = - fs ; y < h - fs ; ++y) {
+      VSTU (B(y), VSUB (VLDU (B(y)), VLDU (B(y + fs)))) ;
+    }
+    if (! zeropad) {
+      VTYPE last = VLDU (B(h - 1)) ;
+      for (y = h - fs ; y < h ; ++y) {
+        VSTU (B(y), VSUB (VLDU (B(y)), VMUL (last, VSETA ((T) (h - fs - y))))) ;
+      }
+    }
+
+    /* integrate forward the columns */
+    acc = VLDU (B(- fs)) ;
+    for (y = - fs + 1 ; y < h ; ++y) {
+      acc = VADD (VLDU (B(y)), acc) ;
+      VSTU (B(y), acc) ;
+    }
+
+    /* compute the filter backward */
+    for (y = (vl_index) step * (dheight - 1) ; y >= 0 ; y -= step) {
+      union {VTYPE v ; T x [VSIZE] ; } r ;
+      vl_index k = y / (vl_index) step ;
+      r.v = VMUL (scale, VSUB (VLDU (B(y)), VLDU (B(y - fs)))) ;
+      if (transp) {
+        int i ;
+        for (i = 0 ; i < VSIZE ; ++i) {
+          dest [(x + i) * destStride + k] = r.x [i] ;
+        }
+      } else {
+        VSTU (dest + k * destStride + x, r.v) ;
+      }
+    }
+  } /* next x */
+
+#undef B
+
+  vl_free (buffer - VSIZE * fs) ;
+  return x ;
+}
+
+#undef FLT
+#undef VL_IMOPV_AVX2_INSTANTIATING
+#endif
+
+/* ! VL_DISABLE_AVX2 */
+#endif
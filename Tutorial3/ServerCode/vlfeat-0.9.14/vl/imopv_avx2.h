@@ -0,0 +1,58 @@
+/** @file imopv_avx2.h
+ ** @brief Vectorized image operations - AVX2
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_IMOPV_AVX2_H
+#define VL_IMOPV_AVX2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX2
+
+/* These functions process the columns of the image in groups of
+ * eight (float) or four (double) and return the number of columns
+ * processed. The caller completes the remaining columns. */
+
+VL_EXPORT
+int _vl_imconvcol_vf_avx2 (float* dst, int dst_stride,
+                           float const* src,
+                           int src_width, int src_height, int src_stride,
+                           float const* filt, int filt_begin, int filt_end,
+                           int step, unsigned int flags) ;
+
+VL_EXPORT
+int _vl_imconvcol_vd_avx2 (double* dst, int dst_stride,
+                           double const* src,
+                           int src_width, int src_height, int src_stride,
+                           double const* filt, int filt_begin, int filt_end,
+                           int step, unsigned int flags) ;
+
+VL_EXPORT
+vl_size _vl_imconvcoltri_f_avx2 (float * dest, vl_size destStride,
+                                 float const * image,
+                                 vl_size imageWidth, vl_size imageHeight,
+                                 vl_size imageStride,
+                                 vl_size filterSize,
+                                 vl_size step, unsigned int flags) ;
+
+VL_EXPORT
+vl_size _vl_imconvcoltri_d_avx2 (double * dest, vl_size destStride,
+                                 double const * image,
+                                 vl_size imageWidth, vl_size imageHeight,
+                                 vl_size imageStride,
+                                 vl_size filterSize,
+                                 vl_size step, unsigned int flags) ;
+
+#endif
+
+/* VL_IMOPV_AVX2_H */
+#endif
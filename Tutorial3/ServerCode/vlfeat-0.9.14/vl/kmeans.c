@@ -24,8 +24,12 @@ It supports
 - @e l1 and @e l2 distances;
 - random selection and <code>k-means++</code> @cite{arthur07k-means}
   initialization methods;
-- the basic Lloyd @cite{lloyd82least} and the accelerated Elkan
-  @cite{elkan03using} optimization methods.
+- the basic Lloyd @cite{lloyd82least}, the accelerated Elkan
+  @cite{elkan03using}, and the approximate nearest neighbors (ANN)
+  optimization methods;
+- multiple threads (::vl_kmeans_set_num_threads);
+- mini-batch k-means on data files larger than the memory
+  (::vl_kmeans_cluster_file).
 
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section kmeans-usage Usage
@@ -54,6 +58,33 @@ bound for the Elkan algorithm) and ::vl_kmeans_get_centers to obtain
 the @c numCluster cluster centers. Use ::vl_kmeans_quantize to
 quantize new data points.
 
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@subsection kmeans-usage-files Clustering data files
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+Large training sets, such as the SIFT descriptors of many images,
+may not fit in memory. ::vl_kmeans_cluster_file clusters the data
+stored in a binary file of @c float or @c vl_uint8 values (for
+instance the output of the @c sift program with
+<code>--descriptors=bin://</code>). The file is mapped in memory and
+read by mini-batches of ::vl_kmeans_set_batch_size points, so that
+the memory used depends only on the size of the mini-batches and on
+the number of centers:
+
+@code
+VlKMeans * kmeans = vl_kmeans_new (VL_TYPE_FLOAT, VlDistanceL2) ;
+vl_kmeans_set_batch_size (kmeans, 20000) ;
+vl_kmeans_set_max_num_iterations (kmeans, 1000) ;
+vl_kmeans_set_energy_check_period (kmeans, 200) ;
+if (vl_kmeans_cluster_file (kmeans, "descriptors.bin", VL_TYPE_UINT8, 128, numCenters)) {
+  printf ("%s\n", vl_get_last_error_message ()) ;
+}
+@endcode
+
+Here each iteration processes one mini-batch, and the energy of all
+the data is computed every 200 mini-batches (see
+@ref kmeans-tech-minibatch).
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @subsection kmeans-usage-init Initialization algorithms
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -88,6 +119,16 @@ quantize new data points.
   square of the number of clusters, which makes it unpractical for a
   very large number of clusters.
 
+- <b>ANN</b> (::VlKMeansANN). This is a variation of
+  @cite{lloyd82least} that assigns the points to the clusters by
+  means of an approximate nearest neighbor search in a randomized
+  kd-forest built on the centers (@ref kdtree.h). The number of trees
+  and the maximum number of comparisons per point can be set by
+  ::vl_kmeans_set_num_trees and ::vl_kmeans_set_max_num_comparisons.
+  Each assignment costs a fixed number of distance calculations rather
+  than one per cluster, which makes it possible to use tens of
+  thousands of clusters.
+
 @section kmeans-tech Technical details
 
 Given data points @f$ x_1, \dots, x_n \in \mathbb{R}^d @f$, k-means
@@ -123,7 +164,12 @@ can be optimized independently for the membership @f$ \pi(i) @f$ of
 each point @f$ x_i @f$ by minimizing @f$ d^2(x_i, c_{\pi(i)}) @f$
 over @f$ \pi(i) \in \{1, \dots, k\} @f$. Assuming that computing
 a distance is @f$ O(d) @f$, this step requires @f$ O(ndk) @f$ operations
-and dominates the other.
+and dominates the other. For the @f$ l^2 @f$ distance, it is carried
+out by ::vl_eval_l2_argmin_on_all_pairs_f, which computes the scalar
+products @f$ \langle x_i, c_k \rangle @f$ as a blocked matrix
+multiplication and finds the closest centers on the fly. This is
+several times faster, but may break ties between two almost equally
+close centers differently than the exact comparison.
 
 The algorithm usually starts by initializing the centers from a
 random selection of the data point.
@@ -169,13 +215,70 @@ to the distance to the currently assigned center and a lower bound to the
 distance to all the other centers. Unless such bounds do not intersect,
 then a point need not to be reassigned. See [3] for details.
 
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@subsection kmeans-tech-ann Speeding up by approximate nearest neighbors
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+At each iteration, ::VlKMeansANN builds a randomized kd-forest on the
+current centers and queries it with each point, stopping the search
+after a given number of comparisons. The center found in this manner
+is not necessarily the closest one. Hence it replaces the current
+center of the point only if it is closer, which is checked by
+computing the exact distance to the latter. In this way the energy
+does not increase from one iteration to the next.
+
+When no point changes its assignment, the algorithm could be stuck
+because of the approximate search rather than because it has
+converged. Thus the assignments are recomputed exhaustively as in
+@cite{lloyd82least}; the algorithm stops only if this does not
+improve any of them, and continues from the exact assignments
+otherwise. The kd-forest uses the Euclidean distance. For the
+@f$ l^1 @f$ distance it just proposes the candidate centers, which
+are still compared by the @f$ l^1 @f$ distance.
+
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+@subsection kmeans-tech-minibatch Mini-batch k-means
+<!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
+
+::vl_kmeans_cluster_file implements the mini-batch k-means of
+@cite{sculley10web-scale}. The centers are seeded as usual from
+::vl_kmeans_set_batch_size points sampled evenly from the file (or
+more if there are more centers). Then each iteration assigns the
+points of a mini-batch to the closest centers, and moves each
+center @f$ c_k @f$ towards each of its points @f$ x @f$ in turn:
+
+@f[
+  n_k \leftarrow n_k + 1, \qquad
+  c_k \leftarrow c_k + \frac{1}{n_k} (x - c_k),
+@f]
+
+where @f$ n_k @f$ is the number of points assigned to @f$ c_k @f$ so
+far. Hence the learning rate of each center decreases as it
+stabilizes, and @f$ c_k @f$ is the mean of all the points assigned to
+it over time. The mini-batches are contiguous blocks of the file,
+visited in random order, so that reading them is sequential. While
+a mini-batch is processed, the next one is read from the disk on a
+separate thread. Since the energy of all the data cannot be computed
+at each iteration, it is either estimated from the last mini-batch
+or, if requested, computed periodically by a pass on the whole file.
+
 */
 
 #include "kmeans.h"
 #include "generic.h"
 #include "mathop.h"
+#include "kdtree.h"
+#include "threads.h"
 #include <string.h>
 
+#if defined(VL_OS_LINUX) || defined(VL_OS_MACOSX)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 /* ================================================================ */
 #ifndef VL_KMEANS_INSTANTIATING
 
@@ -221,6 +324,11 @@ vl_kmeans_new (vl_type dataType,
   self->verbosity = 0 ;
   self->maxNumIterations = 100 ;
   self->numRepetitions = 1 ;
+  self->numTrees = 3 ;
+  self->maxNumComparisons = 100 ;
+  self->batchSize = 10000 ;
+  self->energyCheckPeriod = 0 ;
+  self->numThreads = 1 ;
 
   self->centers = NULL ;
   self->centerDistances = NULL ;
@@ -248,6 +356,11 @@ vl_kmeans_new_copy (VlKMeans const * kmeans)
   self->verbosity = kmeans->verbosity ;
   self->maxNumIterations = kmeans->maxNumIterations ;
   self->numRepetitions = kmeans->numRepetitions ;
+  self->numTrees = kmeans->numTrees ;
+  self->maxNumComparisons = kmeans->maxNumComparisons ;
+  self->batchSize = kmeans->batchSize ;
+  self->energyCheckPeriod = kmeans->energyCheckPeriod ;
+  self->numThreads = kmeans->numThreads ;
 
   self->dimension = kmeans->dimension ;
   self->numCenters = kmeans->numCenters ;
@@ -299,12 +412,341 @@ typedef struct _VlKMeansSortWrapper
 #define VL_SHUFFLE_prefix _vl_kmeans
 #include "shuffle-def.h"
 
+/* ---------------------------------------------------------------- */
+/*                                                          Threads */
+/* ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Task run by ::_vl_kmeans_parallel_for
+ **
+ ** A task processes the items @a begin to @a end - 1 of a job on
+ ** the thread @a tid.
+ **/
+
+typedef void (*_VlKMeansTask) (VlKMeans * self, void * data,
+                               int tid, vl_uindex begin, vl_uindex end) ;
+
+/** @internal @brief Task of a KMeans object, run by ::_vl_parallel_for */
+typedef struct _VlKMeansParallelJob
+{
+  VlKMeans * self ;
+  _VlKMeansTask task ;
+  void * data ;
+} _VlKMeansParallelJob ;
+
+static void
+_vl_kmeans_parallel_task (void * data, int tid, vl_uindex begin, vl_uindex end)
+{
+  _VlKMeansParallelJob * job = data ;
+  job->task (job->self, job->data, tid, begin, end) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run a task on the items of a job in parallel
+ **
+ ** @param self   KMeans object.
+ ** @param task   task.
+ ** @param data   task data.
+ ** @param n      number of items.
+ ** @param grain  minimum number of items of a thread.
+ **
+ ** The items are split among the threads of the object by
+ ** ::_vl_parallel_for. Tasks must not use the random number
+ ** generator, which is thread specific.
+ **/
+
+static void
+_vl_kmeans_parallel_for (VlKMeans * self, _VlKMeansTask task,
+                         void * data, vl_size n, vl_size grain)
+{
+  _VlKMeansParallelJob job ;
+  job.self = self ;
+  job.task = task ;
+  job.data = data ;
+  _vl_parallel_for (self->numThreads, _vl_kmeans_parallel_task, &job,
+                    n, grain, 1) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                       Data files */
+/* ---------------------------------------------------------------- */
+
+/** @internal @brief Memory mapped data file */
+typedef struct _VlKMeansFile
+{
+  vl_type dataType ;     /**< type of the data in the file */
+  vl_size dimension ;    /**< data dimension */
+  vl_size numData ;      /**< number of data points */
+  void * map ;           /**< mapped file */
+  vl_size mapSize ;      /**< size of the mapped file */
+#if defined(VL_OS_WIN)
+  HANDLE handle ;
+  HANDLE mapping ;
+#endif
+} _VlKMeansFile ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Close a data file
+ ** @param self data file.
+ **/
+
+static void
+_vl_kmeans_file_close (_VlKMeansFile * self)
+{
+#if defined(VL_OS_LINUX) || defined(VL_OS_MACOSX)
+  if (self->map) munmap (self->map, self->mapSize) ;
+#elif defined(VL_OS_WIN)
+  if (self->map) UnmapViewOfFile (self->map) ;
+  if (self->mapping) CloseHandle (self->mapping) ;
+  if (self->handle) CloseHandle (self->handle) ;
+#endif
+  memset (self, 0, sizeof(_VlKMeansFile)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Open a data file
+ ** @param self data file (output).
+ ** @param fileName name of the file.
+ ** @param dataType type of the data in the file.
+ ** @param dimension data dimension.
+ ** @return error code.
+ **
+ ** The file stores the data points one after the other, with no
+ ** header, in the native byte order. It is mapped in memory read
+ ** only, so that reading it does not take memory other than the
+ ** system file cache.
+ **/
+
+static int
+_vl_kmeans_file_open (_VlKMeansFile * self, char const * fileName,
+                      vl_type dataType, vl_size dimension)
+{
+  vl_size pointSize = dimension * vl_get_type_size (dataType) ;
+  vl_size size = 0 ;
+
+  memset (self, 0, sizeof(_VlKMeansFile)) ;
+  self->dataType = dataType ;
+  self->dimension = dimension ;
+
+#if defined(VL_OS_LINUX) || defined(VL_OS_MACOSX)
+  {
+    struct stat info ;
+    int fd = open (fileName, O_RDONLY) ;
+    if (fd < 0) {
+      return vl_set_last_error (VL_ERR_IO, "Could not open `%s'", fileName) ;
+    }
+    if (fstat (fd, &info)) {
+      close (fd) ;
+      return vl_set_last_error (VL_ERR_IO, "Could not get the size of `%s'", fileName) ;
+    }
+    size = (vl_size) info.st_size ;
+    if (size > 0) {
+      self->map = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0) ;
+      if (self->map == MAP_FAILED) {
+        self->map = NULL ;
+        close (fd) ;
+        return vl_set_last_error (VL_ERR_IO, "Could not map `%s' in memory", fileName) ;
+      }
+    }
+    /* the mapping keeps the file open */
+    close (fd) ;
+  }
+#elif defined(VL_OS_WIN)
+  {
+    LARGE_INTEGER fileSize ;
+    self->handle = CreateFileA (fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) ;
+    if (self->handle == INVALID_HANDLE_VALUE) {
+      self->handle = NULL ;
+      return vl_set_last_error (VL_ERR_IO, "Could not open `%s'", fileName) ;
+    }
+    if (! GetFileSizeEx (self->handle, &fileSize)) {
+      _vl_kmeans_file_close (self) ;
+      return vl_set_last_error (VL_ERR_IO, "Could not get the size of `%s'", fileName) ;
+    }
+    size = (vl_size) fileSize.QuadPart ;
+    if (size > 0) {
+      self->mapping = CreateFileMappingA (self->handle, NULL, PAGE_READONLY, 0, 0, NULL) ;
+      if (self->mapping) {
+        self->map = MapViewOfFile (self->mapping, FILE_MAP_READ, 0, 0, 0) ;
+      }
+      if (! self->map) {
+        _vl_kmeans_file_close (self) ;
+        return vl_set_last_error (VL_ERR_IO, "Could not map `%s' in memory", fileName) ;
+      }
+    }
+  }
+#else
+  return vl_set_last_error (VL_ERR_IO, "Mapping files in memory is not supported on this platform") ;
+#endif
+
+  self->mapSize = size ;
+  self->numData = size / pointSize ;
+
+  if (size % pointSize) {
+    _vl_kmeans_file_close (self) ;
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "The size of `%s' is not a multiple of the size of a data point",
+                              fileName) ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Read data points from a data file
+ ** @param self data file.
+ ** @param buffer buffer (output).
+ ** @param bufferType type of the buffer (::VL_TYPE_FLOAT or ::VL_TYPE_DOUBLE).
+ ** @param begin index of the first data point.
+ ** @param numData number of data points.
+ **
+ ** Reading the mapped file may block until the data is loaded
+ ** from the disk.
+ **/
+
+static void
+_vl_kmeans_file_read (_VlKMeansFile const * self, void * buffer, vl_type bufferType,
+                      vl_uindex begin, vl_size numData)
+{
+  vl_size n = numData * self->dimension ;
+  void const * src = (char const *) self->map +
+    begin * self->dimension * vl_get_type_size (self->dataType) ;
+  vl_uindex i ;
+
+  switch (self->dataType) {
+    case VL_TYPE_FLOAT :
+      if (bufferType == VL_TYPE_FLOAT) {
+        memcpy (buffer, src, sizeof(float) * n) ;
+      } else {
+        for (i = 0 ; i < n ; ++i) ((double*)buffer)[i] = ((float const*)src)[i] ;
+      }
+      break ;
+    case VL_TYPE_UINT8 :
+      if (bufferType == VL_TYPE_FLOAT) {
+        for (i = 0 ; i < n ; ++i) ((float*)buffer)[i] = ((vl_uint8 const*)src)[i] ;
+      } else {
+        for (i = 0 ; i < n ; ++i) ((double*)buffer)[i] = ((vl_uint8 const*)src)[i] ;
+      }
+      break ;
+    default:
+      abort() ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Read of a mini-batch in the background
+ **
+ ** A mini-batch is read by ::_vl_kmeans_fetch_start and
+ ** ::_vl_kmeans_fetch_finish, on a separate thread if possible, so
+ ** that the next mini-batch is loaded from the disk while the
+ ** current one is processed.
+ **/
+
+#if defined(VL_THREADS_POSIX) && ! defined(VL_DISABLE_THREADS)
+#define VL_KMEANS_THREADS
+#endif
+
+typedef struct _VlKMeansFetch
+{
+  _VlKMeansFile const * file ;
+  void * buffer ;
+  vl_type bufferType ;
+  vl_uindex begin ;
+  vl_size numData ;
+#if defined(VL_KMEANS_THREADS)
+  pthread_t thread ;
+  vl_bool started ;
+#endif
+} _VlKMeansFetch ;
+
+static void *
+_vl_kmeans_fetch_main (void * arg)
+{
+  _VlKMeansFetch * fetch = arg ;
+  _vl_kmeans_file_read (fetch->file, fetch->buffer, fetch->bufferType,
+                        fetch->begin, fetch->numData) ;
+  return NULL ;
+}
+
+static void
+_vl_kmeans_fetch_start (_VlKMeansFetch * fetch, vl_uindex begin, vl_size numData)
+{
+  fetch->begin = begin ;
+  fetch->numData = numData ;
+#if defined(VL_KMEANS_THREADS)
+  fetch->started = ! pthread_create (&fetch->thread, NULL,
+                                     _vl_kmeans_fetch_main, fetch) ;
+#endif
+}
+
+/* a read that could not be started is done on the calling thread */
+static void
+_vl_kmeans_fetch_finish (_VlKMeansFetch * fetch)
+{
+#if defined(VL_KMEANS_THREADS)
+  if (fetch->started) {
+    pthread_join (fetch->thread, NULL) ;
+    fetch->started = VL_FALSE ;
+    return ;
+  }
+#endif
+  _vl_kmeans_fetch_main (fetch) ;
+}
+
 /* #ifdef VL_KMEANS_INSTANTITATING */
 #endif
 
 /* ================================================================ */
 #ifdef VL_KMEANS_INSTANTIATING
 
+/* ---------------------------------------------------------------- */
+/*                                                             Jobs */
+/* ---------------------------------------------------------------- */
+
+/* The data shared by the tasks run by _vl_kmeans_parallel_for. Each
+ * task uses only some of the fields. The per-thread counters and
+ * flags are combined by the calling thread, in order. */
+
+typedef struct VL_XCAT(_VlKMeansJob_, SFX)
+{
+  TYPE const * data ;
+  vl_size numData ;
+  vl_uint32 * assignments ;
+  TYPE * distances ;
+
+  /* seeding */
+  TYPE const * center ;
+  TYPE * minDistances ;
+
+  /* center update */
+  TYPE * centers ;
+  vl_size const * clusterMasses ;
+  vl_uindex const * clusterBegins ;
+  vl_uint32 const * clusterMembers ;
+  vl_uint32 const * permutations ;
+  vl_size * numSeenSoFar ;
+
+  /* mini-batch */
+  vl_size * centerCounts ;
+
+  /* Elkan */
+  TYPE * pointToClosestCenterUB ;
+  vl_bool * pointToClosestCenterUBIsStrict ;
+  TYPE * pointToCenterLB ;
+  TYPE * nextCenterDistances ;
+  TYPE const * centerToNewCenterDistances ;
+  vl_size numDistanceComputationsToInit [VL_KMEANS_MAX_THREADS] ;
+  vl_size numDistanceComputationsToRefreshUB [VL_KMEANS_MAX_THREADS] ;
+  vl_size numDistanceComputationsToRefreshLB [VL_KMEANS_MAX_THREADS] ;
+  vl_bool allDone [VL_KMEANS_MAX_THREADS] ;
+} VL_XCAT(_VlKMeansJob_, SFX) ;
+
 /* ---------------------------------------------------------------- */
 /*                                                      Set centers */
 /* ---------------------------------------------------------------- */
@@ -386,6 +828,31 @@ VL_XCAT(_vl_kmeans_seed_centers_with_rand_data_, SFX)
 /*                                                 kmeans++ seeding */
 /* ---------------------------------------------------------------- */
 
+static void
+VL_XCAT(_vl_kmeans_seed_centers_plus_plus_task_, SFX)
+(VlKMeans * self, void * data, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uindex x ;
+#if (FLT == VL_TYPE_FLOAT)
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
+#else
+  VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
+#endif
+
+  VL_XCAT(vl_eval_vector_comparison_on_all_pairs_, SFX)
+  (job->distances + begin,
+   self->dimension,
+   job->center, 1,
+   job->data + begin * self->dimension, end - begin,
+   distFn) ;
+
+  for (x = begin ; x < end ; ++x) {
+    job->minDistances[x] = VL_MIN(job->minDistances[x], job->distances[x]) ;
+  }
+}
+
 static void
 VL_XCAT(_vl_kmeans_seed_centers_plus_plus_, SFX)
 (VlKMeans * self,
@@ -398,11 +865,7 @@ VL_XCAT(_vl_kmeans_seed_centers_plus_plus_, SFX)
   VlRand * rand = vl_get_rand () ;
   TYPE * distances = vl_malloc (sizeof(TYPE) * numData) ;
   TYPE * minDistances = vl_malloc (sizeof(TYPE) * numData) ;
-#if (FLT == VL_TYPE_FLOAT)
-  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
-#else
-  VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
-#endif
+  VL_XCAT(_VlKMeansJob_, SFX) job ;
 
   self->dimension = dimension ;
   self->numCenters = numCenters ;
@@ -412,6 +875,11 @@ VL_XCAT(_vl_kmeans_seed_centers_plus_plus_, SFX)
     minDistances[x] = (TYPE) VL_INFINITY_D ;
   }
 
+  memset (&job, 0, sizeof(job)) ;
+  job.data = data ;
+  job.distances = distances ;
+  job.minDistances = minDistances ;
+
   /* select the first point at random */
   x = vl_rand_uindex (rand, numData) ;
   c = 0 ;
@@ -427,15 +895,13 @@ VL_XCAT(_vl_kmeans_seed_centers_plus_plus_, SFX)
     c ++ ;
     if (c == numCenters) break ;
 
-    VL_XCAT(vl_eval_vector_comparison_on_all_pairs_, SFX)
-    (distances,
-     dimension,
-     (TYPE*)self->centers + (c - 1) * dimension, 1,
-     data, numData,
-     distFn) ;
+    /* update the distances to the closest center */
+    job.center = (TYPE*)self->centers + (c - 1) * dimension ;
+    _vl_kmeans_parallel_for (self,
+                             VL_XCAT(_vl_kmeans_seed_centers_plus_plus_task_, SFX),
+                             &job, numData, 1024) ;
 
     for (x = 0 ; x < numData ; ++x) {
-      minDistances[x] = VL_MIN(minDistances[x], distances[x]) ;
       energy += minDistances[x] ;
     }
 
@@ -454,27 +920,48 @@ VL_XCAT(_vl_kmeans_seed_centers_plus_plus_, SFX)
 /* ---------------------------------------------------------------- */
 
 static void
-VL_XCAT(_vl_kmeans_quantize_, SFX)
-(VlKMeans * self,
- vl_uint32 * assignments,
- TYPE * distances,
- TYPE const * data,
- vl_size numData)
+VL_XCAT(_vl_kmeans_quantize_task_, SFX)
+(VlKMeans * self, void * data, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
 {
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uint32 * assignments = job->assignments ;
+  TYPE * distances = job->distances ;
   vl_uindex i ;
 #if (FLT == VL_TYPE_FLOAT)
   VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
 #else
   VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
 #endif
-  TYPE * distanceToCenters = vl_malloc (sizeof(TYPE) * self->numCenters) ;
+  TYPE * distanceToCenters ;
+
+  /* For the l2 distance, the closest centers are found as in a matrix
+     multiplication. The distances to them are then recomputed exactly,
+     so that the energy does not suffer from cancellations. */
+  if (self->distance == VlDistanceL2) {
+    VL_XCAT(vl_eval_l2_argmin_on_all_pairs_, SFX)(assignments + begin, NULL,
+                                                  self->dimension,
+                                                  job->data + self->dimension * begin,
+                                                  end - begin,
+                                                  (TYPE*)self->centers, self->numCenters) ;
+    if (distances) {
+      for (i = begin ; i < end ; ++i) {
+        distances[i] = distFn (self->dimension,
+                               job->data + self->dimension * i,
+                               (TYPE*)self->centers + self->dimension * assignments[i]) ;
+      }
+    }
+    return ;
+  }
+
+  distanceToCenters = vl_malloc (sizeof(TYPE) * self->numCenters) ;
 
-  for (i = 0 ; i < numData ; ++i) {
+  for (i = begin ; i < end ; ++i) {
     vl_size k ;
     TYPE bestDistance = (TYPE) VL_INFINITY_D ;
     VL_XCAT(vl_eval_vector_comparison_on_all_pairs_, SFX)(distanceToCenters,
                                                           self->dimension,
-                                                          data + self->dimension * i, 1,
+                                                          job->data + self->dimension * i, 1,
                                                           (TYPE*)self->centers, self->numCenters,
                                                           distFn) ;
     for (k = 0 ; k < self->numCenters ; ++k) {
@@ -489,6 +976,24 @@ VL_XCAT(_vl_kmeans_quantize_, SFX)
   vl_free(distanceToCenters) ;
 }
 
+static void
+VL_XCAT(_vl_kmeans_quantize_, SFX)
+(VlKMeans * self,
+ vl_uint32 * assignments,
+ TYPE * distances,
+ TYPE const * data,
+ vl_size numData)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) job ;
+  memset (&job, 0, sizeof(job)) ;
+  job.data = data ;
+  job.numData = numData ;
+  job.assignments = assignments ;
+  job.distances = distances ;
+  _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_quantize_task_, SFX),
+                           &job, numData, 16) ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                 Helper functions */
 /* ---------------------------------------------------------------- */
@@ -538,6 +1043,139 @@ VL_XCAT(_vl_kmeans_sort_data_helper_, SFX)
   }
 }
 
+/* ---------------------------------------------------------------- */
+/*                                                    Center update */
+/* ---------------------------------------------------------------- */
+
+/* Each thread sums the points of a range of centers, visiting them in
+ * their order in the data, so that the result does not depend on the
+ * number of threads. */
+
+static void
+VL_XCAT(_vl_kmeans_update_centers_l2_task_, SFX)
+(VlKMeans * self, void * data, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uindex c, d, i ;
+
+  for (c = begin ; c < end ; ++c) {
+    TYPE * cpt = job->centers + c * self->dimension ;
+    memset(cpt, 0, sizeof(TYPE) * self->dimension) ;
+    for (i = job->clusterBegins[c] ; i < job->clusterBegins[c + 1] ; ++i) {
+      TYPE const * xpt = job->data + job->clusterMembers[i] * self->dimension ;
+      for (d = 0 ; d < self->dimension ; ++d) { cpt[d] += xpt[d] ; }
+    }
+    if (job->clusterMasses[c] > 0) {
+      TYPE mass = job->clusterMasses[c] ;
+      for (d = 0 ; d < self->dimension ; ++d) { cpt[d] /= mass ; }
+    }
+  }
+}
+
+/* Each thread computes the medians of a range of dimensions. */
+
+static void
+VL_XCAT(_vl_kmeans_update_centers_l1_task_, SFX)
+(VlKMeans * self, void * data, int tid,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_size * numSeenSoFar = job->numSeenSoFar + tid * self->numCenters ;
+  vl_uindex c, d, x ;
+
+  for (d = begin ; d < end ; ++d) {
+    vl_uint32 const * perm = job->permutations + d * job->numData ;
+    memset(numSeenSoFar, 0, sizeof(vl_size) * self->numCenters) ;
+    for (x = 0; x < job->numData ; ++x) {
+      c = job->assignments[perm[x]] ;
+      if (2 * numSeenSoFar[c] < job->clusterMasses[c]) {
+        job->centers [d + c * self->dimension] =
+        job->data [d + perm[x] * self->dimension] ;
+      }
+      numSeenSoFar[c] ++ ;
+    }
+  }
+}
+
+/* Recompute the centers @a centers from the assignments. The function
+ * returns the number of empty clusters, whose centers are restarted
+ * from random data points. */
+
+static vl_size
+VL_XCAT(_vl_kmeans_update_centers_, SFX)
+(VlKMeans * self,
+ TYPE * centers,
+ TYPE const * data,
+ vl_size numData,
+ vl_uint32 * assignments,
+ vl_size * clusterMasses,
+ vl_uint32 const * permutations)
+{
+  vl_size c, d, x ;
+  vl_size numRestartedCenters = 0 ;
+  VlRand * rand = vl_get_rand () ;
+  VL_XCAT(_VlKMeansJob_, SFX) job ;
+
+  memset(clusterMasses, 0, sizeof(vl_size) * self->numCenters) ;
+  for (x = 0 ; x < numData ; ++x) {
+    clusterMasses[assignments[x]] ++ ;
+  }
+
+  memset (&job, 0, sizeof(job)) ;
+  job.data = data ;
+  job.numData = numData ;
+  job.assignments = assignments ;
+  job.centers = centers ;
+  job.clusterMasses = clusterMasses ;
+  job.permutations = permutations ;
+
+  switch (self->distance) {
+    case VlDistanceL2:
+    {
+      /* list the points of each cluster */
+      vl_uindex * clusterBegins = vl_malloc (sizeof(vl_uindex) * (self->numCenters + 1)) ;
+      vl_uint32 * clusterMembers = vl_malloc (sizeof(vl_uint32) * numData) ;
+      clusterBegins[0] = 0 ;
+      clusterBegins[1] = 0 ;
+      for (c = 1 ; c < self->numCenters ; ++c) {
+        clusterBegins[c + 1] = clusterBegins[c] + clusterMasses[c - 1] ;
+      }
+      for (x = 0 ; x < numData ; ++x) {
+        clusterMembers[clusterBegins[assignments[x] + 1] ++] = (vl_uint32) x ;
+      }
+      job.clusterBegins = clusterBegins ;
+      job.clusterMembers = clusterMembers ;
+      _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_update_centers_l2_task_, SFX),
+                               &job, self->numCenters, 8) ;
+      vl_free (clusterBegins) ;
+      vl_free (clusterMembers) ;
+      break ;
+    }
+    case VlDistanceL1:
+      job.numSeenSoFar = vl_malloc (sizeof(vl_size) * self->numCenters * self->numThreads) ;
+      _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_update_centers_l1_task_, SFX),
+                               &job, self->dimension, 1) ;
+      vl_free (job.numSeenSoFar) ;
+      break ;
+    default:
+      abort();
+  }
+
+  /* restart the centers as required  */
+  for (c = 0 ; c < self->numCenters ; ++c) {
+    if (clusterMasses[c] == 0) {
+      TYPE * cpt = centers + c * self->dimension ;
+      vl_uindex x = vl_rand_uindex(rand, numData) ;
+      numRestartedCenters ++ ;
+      for (d = 0 ; d < self->dimension ; ++d) {
+        cpt[d] = data[x * self->dimension + d] ;
+      }
+    }
+  }
+  return numRestartedCenters ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                 Lloyd refinement */
 /* ---------------------------------------------------------------- */
@@ -548,7 +1186,7 @@ VL_XCAT(_vl_kmeans_refine_centers_lloyd_, SFX)
  TYPE const * data,
  vl_size numData)
 {
-  vl_size c, d, x, iteration ;
+  vl_size x, iteration ;
   vl_bool allDone ;
   double previousEnergy = VL_INFINITY_D ;
   double energy ;
@@ -556,14 +1194,11 @@ VL_XCAT(_vl_kmeans_refine_centers_lloyd_, SFX)
   vl_uint32 * assignments = vl_malloc (sizeof(vl_uint32) * numData) ;
   vl_size * clusterMasses = vl_malloc (sizeof(vl_size) * numData) ;
   vl_uint32 * permutations = NULL ;
-  vl_size * numSeenSoFar = NULL ;
-  VlRand * rand = vl_get_rand () ;
   vl_size totNumRestartedCenters = 0 ;
   vl_size numRestartedCenters = 0 ;
 
   if (self->distance == VlDistanceL1) {
     permutations = vl_malloc(sizeof(vl_uint32) * numData * self->dimension) ;
-    numSeenSoFar = vl_malloc(sizeof(vl_size) * self->numCenters) ;
     VL_XCAT(_vl_kmeans_sort_data_helper_, SFX)(self, permutations, data, numData) ;
   }
 
@@ -602,62 +1237,10 @@ VL_XCAT(_vl_kmeans_refine_centers_lloyd_, SFX)
     previousEnergy = energy ;
 
     /* update clusters */
-    memset(clusterMasses, 0, sizeof(vl_size) * numData) ;
-    for (x = 0 ; x < numData ; ++x) {
-      clusterMasses[assignments[x]] ++ ;
-    }
-
-    numRestartedCenters = 0 ;
-    switch (self->distance) {
-      case VlDistanceL2:
-        memset(self->centers, 0, sizeof(TYPE) * self->dimension * self->numCenters) ;
-        for (x = 0 ; x < numData ; ++x) {
-          TYPE * cpt = (TYPE*)self->centers + assignments[x] * self->dimension ;
-          TYPE const * xpt = data + x * self->dimension ;
-          for (d = 0 ; d < self->dimension ; ++d) { cpt[d] += xpt[d] ; }
-        }
-        for (c = 0 ; c < self->numCenters ; ++c) {
-          TYPE * cpt = (TYPE*)self->centers + c * self->dimension ;
-          if (clusterMasses[c] > 0) {
-            TYPE mass = clusterMasses[c] ;
-            for (d = 0 ; d < self->dimension ; ++d) { cpt[d] /= mass ; }
-          } else {
-            vl_uindex x = vl_rand_uindex(rand, numData) ;
-            numRestartedCenters ++ ;
-            for (d = 0 ; d < self->dimension ; ++d) {
-              cpt[d] = data[x * self->dimension + d] ;
-            }
-          }
-        }
-        break ;
-      case VlDistanceL1:
-        for (d = 0 ; d < self->dimension ; ++d) {
-          vl_uint32 * perm = permutations + d * numData ;
-          memset(numSeenSoFar, 0, sizeof(vl_size) * self->numCenters) ;
-          for (x = 0; x < numData ; ++x) {
-            c = assignments[perm[x]] ;
-            if (2 * numSeenSoFar[c] < clusterMasses[c]) {
-              ((TYPE*)self->centers) [d + c * self->dimension] =
-              data [d + perm[x] * self->dimension] ;
-            }
-            numSeenSoFar[c] ++ ;
-          }
-          /* restart the centers as required  */
-          for (c = 0 ; c < self->numCenters ; ++c) {
-            if (clusterMasses[c] == 0) {
-              TYPE * cpt = (TYPE*)self->centers + c * self->dimension ;
-              vl_uindex x = vl_rand_uindex(rand, numData) ;
-              numRestartedCenters ++ ;
-              for (d = 0 ; d < self->dimension ; ++d) {
-                cpt[d] = data[x * self->dimension + d] ;
-              }
-            }
-          }
-        }
-        break ;
-      default:
-        abort();
-    } /* done compute centers */
+    numRestartedCenters =
+    VL_XCAT(_vl_kmeans_update_centers_, SFX)(self, self->centers, data, numData,
+                                             assignments, clusterMasses,
+                                             permutations) ;
 
     totNumRestartedCenters += numRestartedCenters ;
     if (self->verbosity && numRestartedCenters) {
@@ -667,7 +1250,6 @@ VL_XCAT(_vl_kmeans_refine_centers_lloyd_, SFX)
   } /* next Lloyd iteration */
 
   if (permutations) { vl_free(permutations) ; }
-  if (numSeenSoFar) { vl_free(numSeenSoFar) ; }
   vl_free(distances) ;
   vl_free(assignments) ;
   vl_free(clusterMasses) ;
@@ -678,6 +1260,27 @@ VL_XCAT(_vl_kmeans_refine_centers_lloyd_, SFX)
 /*                                                 Elkan refinement */
 /* ---------------------------------------------------------------- */
 
+static void
+VL_XCAT(_vl_kmeans_update_center_distances_task_, SFX)
+(VlKMeans * self, void * data VL_UNUSED, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
+{
+#if (FLT == VL_TYPE_FLOAT)
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
+#else
+  VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
+#endif
+
+  VL_XCAT(vl_eval_vector_comparison_on_all_pairs_, SFX)((TYPE*)self->centerDistances
+                                                        + begin * self->numCenters,
+                                                        self->dimension,
+                                                        self->centers, self->numCenters,
+                                                        (TYPE*)self->centers
+                                                        + begin * self->dimension,
+                                                        end - begin,
+                                                        distFn) ;
+}
+
 static double
 VL_XCAT(_vl_kmeans_update_center_distances_, SFX)
 (VlKMeans * self)
@@ -693,15 +1296,273 @@ VL_XCAT(_vl_kmeans_update_center_distances_, SFX)
                                        self->numCenters *
                                        self->numCenters) ;
   }
-  VL_XCAT(vl_eval_vector_comparison_on_all_pairs_, SFX)(self->centerDistances,
-                                                        self->dimension,
-                                                        self->centers, self->numCenters,
-                                                        NULL, 0,
-                                                        distFn) ;
-  return self->numCenters * (self->numCenters - 1) / 2 ;
+  if (self->numThreads > 1) {
+    /* the threads compute whole columns, i.e. twice as many distances */
+    _vl_kmeans_parallel_for (self,
+                             VL_XCAT(_vl_kmeans_update_center_distances_task_, SFX),
+                             NULL, self->numCenters, 16) ;
+  } else {
+    VL_XCAT(vl_eval_vector_comparison_on_all_pairs_, SFX)(self->centerDistances,
+                                                          self->dimension,
+                                                          self->centers, self->numCenters,
+                                                          NULL, 0,
+                                                          distFn) ;
+  }
+  return self->numCenters * (self->numCenters - 1) / 2 ;
+}
+
+static void
+VL_XCAT(_vl_kmeans_update_next_center_distances_task_, SFX)
+(VlKMeans * self, void * data, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uindex c, j ;
+
+  for (c = begin ; c < end ; ++c) {
+    job->nextCenterDistances[c] = (TYPE) VL_INFINITY_D ;
+    for (j = 0 ; j < self->numCenters ; ++j) {
+      if (j == c) continue ;
+      job->nextCenterDistances[c] = VL_MIN(job->nextCenterDistances[c],
+                                           ((TYPE*)self->centerDistances)
+                                           [j + c * self->numCenters]) ;
+    }
+  }
+}
+
+/* Assign points to the initial centers and initialize the bounds. */
+
+static void
+VL_XCAT(_vl_kmeans_elkan_init_task_, SFX)
+(VlKMeans * self, void * data, int tid,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uint32 * assignments = job->assignments ;
+  TYPE * pointToClosestCenterUB = job->pointToClosestCenterUB ;
+  vl_bool * pointToClosestCenterUBIsStrict = job->pointToClosestCenterUBIsStrict ;
+  TYPE * pointToCenterLB = job->pointToCenterLB ;
+  vl_size numDistanceComputations = 0 ;
+  vl_uindex x ;
+  vl_uint32 c ;
+#if (FLT == VL_TYPE_FLOAT)
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
+#else
+  VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
+#endif
+
+  memset(pointToCenterLB + begin * self->numCenters, 0,
+         sizeof(TYPE) * self->numCenters * (end - begin)) ;
+  for (x = begin ; x < end ; ++x) {
+    TYPE distance ;
+
+    /* do the first center */
+    assignments[x] = 0 ;
+    distance = distFn(self->dimension,
+                      job->data + x * self->dimension,
+                      (TYPE*)self->centers + 0) ;
+    pointToClosestCenterUB[x] = distance ;
+    pointToClosestCenterUBIsStrict[x] = VL_TRUE ;
+    pointToCenterLB[0 + x * self->numCenters] = distance ;
+    numDistanceComputations += 1 ;
+
+    /* do other centers */
+    for (c = 1 ; c < self->numCenters ; ++c) {
+
+      /* Can skip if the center assigned so far is twice as close
+         as its distance to the center under consideration */
+
+      if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
+          pointToClosestCenterUB[x] <=
+          ((TYPE*)self->centerDistances)
+          [c + assignments[x] * self->numCenters]) {
+        continue ;
+      }
+
+      distance = distFn(self->dimension,
+                        job->data + x * self->dimension,
+                        (TYPE*)self->centers + c * self->dimension) ;
+      pointToCenterLB[c + x * self->numCenters] = distance ;
+      numDistanceComputations += 1 ;
+      if (distance < pointToClosestCenterUB[x]) {
+        pointToClosestCenterUB[x] = distance ;
+        assignments[x] = c ;
+      }
+    }
+  }
+  job->numDistanceComputationsToInit[tid] += numDistanceComputations ;
 }
 
+/* Update the bounds on the point-to-center distances based on the
+   center variation. */
+
+static void
+VL_XCAT(_vl_kmeans_elkan_update_bounds_task_, SFX)
+(VlKMeans * self, void * data, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  TYPE * pointToClosestCenterUB = job->pointToClosestCenterUB ;
+  TYPE * pointToCenterLB = job->pointToCenterLB ;
+  TYPE const * centerToNewCenterDistances = job->centerToNewCenterDistances ;
+  vl_uindex x ;
+  vl_uint32 c ;
+
+  for (x = begin ; x < end ; ++x) {
+    /*
+     Update upper bounds on point-to-closest-center distances
+     based on the center variation.
+     */
+    TYPE a = pointToClosestCenterUB[x] ;
+    TYPE b = centerToNewCenterDistances[job->assignments[x]] ;
+    if (self->distance == VlDistanceL1) {
+      pointToClosestCenterUB[x] = a + b ;
+    } else {
+#if (FLT == VL_TYPE_FLOAT)
+      TYPE sqrtab =  sqrtf (a * b) ;
+#else
+      TYPE sqrtab =  sqrt (a * b) ;
+#endif
+      pointToClosestCenterUB[x] = a + b + 2.0 * sqrtab ;
+    }
+    job->pointToClosestCenterUBIsStrict[x] = VL_FALSE ;
+
+    /*
+     Update lower bounds on point-to-center distances
+     based on the center variation.
+     */
+    for (c = 0 ; c < self->numCenters ; ++c) {
+      TYPE a = pointToCenterLB[c + x * self->numCenters] ;
+      TYPE b = centerToNewCenterDistances[c] ;
+      if (a < b) {
+        pointToCenterLB[c + x * self->numCenters] = 0 ;
+      } else {
+        if (self->distance == VlDistanceL1) {
+           pointToCenterLB[c + x * self->numCenters]  = a - b ;
+        } else {
+#if (FLT == VL_TYPE_FLOAT)
+          TYPE sqrtab =  sqrtf (a * b) ;
+#else
+          TYPE sqrtab =  sqrt (a * b) ;
+#endif
+           pointToCenterLB[c + x * self->numCenters]  = a + b - 2.0 * sqrtab ;
+        }
+      }
+    }
+  }
+}
+
+/*
+ Scan the data and to the reassignments. Use the bounds to
+ skip as many point-to-center distance calculations as possible.
+ */
+
+static void
+VL_XCAT(_vl_kmeans_elkan_reassign_task_, SFX)
+(VlKMeans * self, void * data, int tid,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uint32 * assignments = job->assignments ;
+  TYPE * pointToClosestCenterUB = job->pointToClosestCenterUB ;
+  vl_bool * pointToClosestCenterUBIsStrict = job->pointToClosestCenterUBIsStrict ;
+  TYPE * pointToCenterLB = job->pointToCenterLB ;
+  TYPE const * nextCenterDistances = job->nextCenterDistances ;
+  vl_size numDistanceComputationsToRefreshUB = 0 ;
+  vl_size numDistanceComputationsToRefreshLB = 0 ;
+  vl_bool allDone = VL_TRUE ;
+  vl_uindex x ;
+  vl_uint32 c ;
+#if (FLT == VL_TYPE_FLOAT)
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
+#else
+  VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
+#endif
+
+  for (x = begin ; x < end ; ++x) {
+    /*
+     A point x sticks with its current center assignmets[x]
+     the UB to d(x, c[assigmnets[x]]) is not larger than half
+     the distance of c[assigments[x]] to any other center c.
+     */
+    if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
+        pointToClosestCenterUB[x] <= nextCenterDistances[assignments[x]]) {
+      continue ;
+    }
+
+    for (c = 0 ; c < self->numCenters ; ++c) {
+      vl_uint32 cx = assignments[x] ;
+      TYPE distance ;
+
+      /* The point is not reassigned to a given center c
+       if either:
+
+       0 - c is already the assigned center
+       1 - The UB of d(x, c[assignments[x]]) is smaller than half
+           the distance of c[assigments[x]] to c, OR
+       2 - The UB of d(x, c[assignmets[x]]) is smaller than the
+           LB of the distance of x to c.
+       */
+      if (cx == c) {
+        continue ;
+      }
+      if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
+          pointToClosestCenterUB[x] <= ((TYPE*)self->centerDistances)
+          [c + cx * self->numCenters]) {
+        continue ;
+      }
+      if (pointToClosestCenterUB[x] <= pointToCenterLB
+          [c + x * self->numCenters]) {
+        continue ;
+      }
+
+      /* If the UB is loose, try recomputing it and test again */
+      if (! pointToClosestCenterUBIsStrict[x]) {
+        distance = distFn(self->dimension,
+                          job->data + self->dimension * x,
+                          (TYPE*)self->centers + self->dimension * cx) ;
+        pointToClosestCenterUB[x] = distance ;
+        pointToClosestCenterUBIsStrict[x] = VL_TRUE ;
+        pointToCenterLB[cx + x * self->numCenters] = distance ;
+        numDistanceComputationsToRefreshUB += 1 ;
 
+        if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
+            pointToClosestCenterUB[x] <= ((TYPE*)self->centerDistances)
+            [c + cx * self->numCenters]) {
+          continue ;
+        }
+        if (pointToClosestCenterUB[x] <= pointToCenterLB
+            [c + x * self->numCenters]) {
+          continue ;
+        }
+      }
+
+      /*
+       Now the UB is strict (equal to d(x, assignments[x])), but
+       we still could not exclude that x should be reassigned to
+       c. We therefore compute the distance, update the LB,
+       and check if a reassigmnet must be made
+       */
+      distance = distFn(self->dimension,
+                        job->data + x * self->dimension,
+                        (TYPE*)self->centers + c *  self->dimension) ;
+      numDistanceComputationsToRefreshLB += 1 ;
+      pointToCenterLB[c + x * self->numCenters] = distance ;
+
+      if (distance < pointToClosestCenterUB[x]) {
+        assignments[x] = c ;
+        pointToClosestCenterUB[x] = distance ;
+        allDone = VL_FALSE ;
+        /* the UB strict flag is already set here */
+      }
+
+    } /* assign center */
+  } /* next data point */
+
+  job->numDistanceComputationsToRefreshUB[tid] += numDistanceComputationsToRefreshUB ;
+  job->numDistanceComputationsToRefreshLB[tid] += numDistanceComputationsToRefreshLB ;
+  job->allDone[tid] &= allDone ;
+}
 
 static double
 VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
@@ -709,13 +1570,14 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
  TYPE const * data,
  vl_size numData)
 {
-  vl_size d, iteration, x ;
-  vl_uint32 c, j ;
+  vl_size iteration, x ;
+  vl_uint32 c ;
+  int t ;
   vl_bool allDone ;
   TYPE * distances = vl_malloc (sizeof(TYPE) * numData) ;
   vl_uint32 * assignments = vl_malloc (sizeof(vl_uint32) * numData) ;
   vl_size * clusterMasses = vl_malloc (sizeof(vl_size) * numData) ;
-  VlRand * rand = vl_get_rand () ;
+  VL_XCAT(_VlKMeansJob_, SFX) job ;
 
 #if (FLT == VL_TYPE_FLOAT)
     VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
@@ -731,7 +1593,6 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
   TYPE * centerToNewCenterDistances = vl_malloc (sizeof(TYPE) * self->numCenters) ;
 
   vl_uint32 * permutations = NULL ;
-  vl_size * numSeenSoFar = NULL ;
 
   double energy ;
 
@@ -745,10 +1606,19 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
 
   if (self->distance == VlDistanceL1) {
     permutations = vl_malloc(sizeof(vl_uint32) * numData * self->dimension) ;
-    numSeenSoFar = vl_malloc(sizeof(vl_size) * self->numCenters) ;
     VL_XCAT(_vl_kmeans_sort_data_helper_, SFX)(self, permutations, data, numData) ;
   }
 
+  memset (&job, 0, sizeof(job)) ;
+  job.data = data ;
+  job.numData = numData ;
+  job.assignments = assignments ;
+  job.pointToClosestCenterUB = pointToClosestCenterUB ;
+  job.pointToClosestCenterUBIsStrict = pointToClosestCenterUBIsStrict ;
+  job.pointToCenterLB = pointToCenterLB ;
+  job.nextCenterDistances = nextCenterDistances ;
+  job.centerToNewCenterDistances = centerToNewCenterDistances ;
+
   /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
   /*                          Initialization                        */
   /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -763,43 +1633,10 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
   VL_XCAT(_vl_kmeans_update_center_distances_, SFX)(self) ;
 
   /* assigmen points to the initial centers and initialize bounds */
-  memset(pointToCenterLB, 0, sizeof(TYPE) * self->numCenters *  numData) ;
-  for (x = 0 ; x < numData ; ++x) {
-    TYPE distance ;
-
-    /* do the first center */
-    assignments[x] = 0 ;
-    distance = distFn(self->dimension,
-                      data + x * self->dimension,
-                      (TYPE*)self->centers + 0) ;
-    pointToClosestCenterUB[x] = distance ;
-    pointToClosestCenterUBIsStrict[x] = VL_TRUE ;
-    pointToCenterLB[0 + x * self->numCenters] = distance ;
-    totDistanceComputationsToInit += 1 ;
-
-    /* do other centers */
-    for (c = 1 ; c < self->numCenters ; ++c) {
-
-      /* Can skip if the center assigned so far is twice as close
-         as its distance to the center under consideration */
-
-      if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
-          pointToClosestCenterUB[x] <=
-          ((TYPE*)self->centerDistances)
-          [c + assignments[x] * self->numCenters]) {
-        continue ;
-      }
-
-      distance = distFn(self->dimension,
-                        data + x * self->dimension,
-                        (TYPE*)self->centers + c * self->dimension) ;
-      pointToCenterLB[c + x * self->numCenters] = distance ;
-      totDistanceComputationsToInit += 1 ;
-      if (distance < pointToClosestCenterUB[x]) {
-        pointToClosestCenterUB[x] = distance ;
-        assignments[x] = c ;
-      }
-    }
+  _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_elkan_init_task_, SFX),
+                           &job, numData, 16) ;
+  for (t = 0 ; t < VL_KMEANS_MAX_THREADS ; ++t) {
+    totDistanceComputationsToInit += job.numDistanceComputationsToInit[t] ;
   }
 
   /* compute UB on energy */
@@ -853,62 +1690,10 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
     /*                         Compute new centers                  */
     /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    memset(clusterMasses, 0, sizeof(vl_size) * numData) ;
-    for (x = 0 ; x < numData ; ++x) {
-      clusterMasses[assignments[x]] ++ ;
-    }
-
-    switch (self->distance) {
-      case VlDistanceL2:
-        memset(newCenters, 0, sizeof(TYPE) * self->dimension * self->numCenters) ;
-        for (x = 0 ; x < numData ; ++x) {
-          TYPE * cpt = newCenters + assignments[x] * self->dimension ;
-          TYPE const * xpt = data + x * self->dimension ;
-          for (d = 0 ; d < self->dimension ; ++d) { cpt[d] += xpt[d] ; }
-        }
-        for (c = 0 ; c < self->numCenters ; ++c) {
-          TYPE * cpt = newCenters + c * self->dimension ;
-          if (clusterMasses[c] > 0) {
-            TYPE mass = clusterMasses[c] ;
-            for (d = 0 ; d < self->dimension ; ++d) { cpt[d] /= mass ; }
-          } else {
-            /* restart the center */
-            vl_uindex x = vl_rand_uindex(rand, numData) ;
-			numRestartedCenters ++ ;
-            for (d = 0 ; d < self->dimension ; ++d) {
-              cpt[d] = data[x * self->dimension + d] ;
-            }
-          }
-        }
-        break ;
-      case VlDistanceL1:
-        for (d = 0 ; d < self->dimension ; ++d) {
-          vl_uint32 * perm = permutations + d * numData ;
-          memset(numSeenSoFar, 0, sizeof(vl_size) * self->numCenters) ;
-          for (x = 0; x < numData ; ++x) {
-            c = assignments[perm[x]] ;
-            if (2 * numSeenSoFar[c] < clusterMasses[c]) {
-              newCenters [d + c * self->dimension] =
-              data [d + perm[x] * self->dimension] ;
-            }
-            numSeenSoFar[c] ++ ;
-          }
-        }
-        /* restart the centers as required  */
-        for (c = 0 ; c < self->numCenters ; ++c) {
-          if (clusterMasses[c] == 0) {
-            TYPE * cpt = newCenters + c * self->dimension ;
-            vl_uindex x = vl_rand_uindex(rand, numData) ;
-			numRestartedCenters ++ ;
-            for (d = 0 ; d < self->dimension ; ++d) {
-              cpt[d] = data[x * self->dimension + d] ;
-            }
-          }
-        }
-        break ;
-      default:
-        abort();
-    } /* done compute centers */
+    numRestartedCenters =
+    VL_XCAT(_vl_kmeans_update_centers_, SFX)(self, newCenters, data, numData,
+                                             assignments, clusterMasses,
+                                             permutations) ;
 
     /* compute the distance from the old centers to the new centers */
     for (c = 0 ; c < self->numCenters ; ++c) {
@@ -936,60 +1721,17 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
     numDistanceComputationsToRefreshCenterDistances
     += VL_XCAT(_vl_kmeans_update_center_distances_, SFX)(self) ;
 
-    for (c = 0 ; c < self->numCenters ; ++c) {
-      nextCenterDistances[c] = (TYPE) VL_INFINITY_D ;
-      for (j = 0 ; j < self->numCenters ; ++j) {
-        if (j == c) continue ;
-        nextCenterDistances[c] = VL_MIN(nextCenterDistances[c],
-                                        ((TYPE*)self->centerDistances)
-                                        [j + c * self->numCenters]) ;
-      }
-    }
+    _vl_kmeans_parallel_for (self,
+                             VL_XCAT(_vl_kmeans_update_next_center_distances_task_, SFX),
+                             &job, self->numCenters, 16) ;
 
     /*
-     Update upper bounds on point-to-closest-center distances
+     Update the upper bounds on point-to-closest-center distances
+     and the lower bounds on point-to-center distances
      based on the center variation.
      */
-    for (x = 0 ; x < numData ; ++x) {
-      TYPE a = pointToClosestCenterUB[x] ;
-      TYPE b = centerToNewCenterDistances[assignments[x]] ;
-      if (self->distance == VlDistanceL1) {
-        pointToClosestCenterUB[x] = a + b ;
-      } else {
-#if (FLT == VL_TYPE_FLOAT)
-        TYPE sqrtab =  sqrtf (a * b) ;
-#else
-        TYPE sqrtab =  sqrt (a * b) ;
-#endif
-        pointToClosestCenterUB[x] = a + b + 2.0 * sqrtab ;
-      }
-      pointToClosestCenterUBIsStrict[x] = VL_FALSE ;
-    }
-
-    /*
-     Update lower bounds on point-to-center distances
-     based on the center variation.
-     */
-    for (x = 0 ; x < numData ; ++x) {
-      for (c = 0 ; c < self->numCenters ; ++c) {
-        TYPE a = pointToCenterLB[c + x * self->numCenters] ;
-        TYPE b = centerToNewCenterDistances[c] ;
-        if (a < b) {
-          pointToCenterLB[c + x * self->numCenters] = 0 ;
-        } else {
-          if (self->distance == VlDistanceL1) {
-             pointToCenterLB[c + x * self->numCenters]  = a - b ;
-          } else {
-#if (FLT == VL_TYPE_FLOAT)
-            TYPE sqrtab =  sqrtf (a * b) ;
-#else
-            TYPE sqrtab =  sqrt (a * b) ;
-#endif
-             pointToCenterLB[c + x * self->numCenters]  = a + b - 2.0 * sqrtab ;
-          }
-        }
-      }
-    }
+    _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_elkan_update_bounds_task_, SFX),
+                             &job, numData, 16) ;
 
    #ifdef SANITY
     {
@@ -1018,85 +1760,18 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
      Scan the data and to the reassignments. Use the bounds to
      skip as many point-to-center distance calculations as possible.
      */
-    for (allDone = VL_TRUE, x = 0 ; x < numData ; ++x) {
-      /*
-       A point x sticks with its current center assignmets[x]
-       the UB to d(x, c[assigmnets[x]]) is not larger than half
-       the distance of c[assigments[x]] to any other center c.
-       */
-      if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
-          pointToClosestCenterUB[x] <= nextCenterDistances[assignments[x]]) {
-        continue ;
-      }
-
-      for (c = 0 ; c < self->numCenters ; ++c) {
-        vl_uint32 cx = assignments[x] ;
-        TYPE distance ;
-
-        /* The point is not reassigned to a given center c
-         if either:
-
-         0 - c is already the assigned center
-         1 - The UB of d(x, c[assignments[x]]) is smaller than half
-             the distance of c[assigments[x]] to c, OR
-         2 - The UB of d(x, c[assignmets[x]]) is smaller than the
-             LB of the distance of x to c.
-         */
-        if (cx == c) {
-          continue ;
-        }
-        if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
-            pointToClosestCenterUB[x] <= ((TYPE*)self->centerDistances)
-            [c + cx * self->numCenters]) {
-          continue ;
-        }
-        if (pointToClosestCenterUB[x] <= pointToCenterLB
-            [c + x * self->numCenters]) {
-          continue ;
-        }
-
-        /* If the UB is loose, try recomputing it and test again */
-        if (! pointToClosestCenterUBIsStrict[x]) {
-          distance = distFn(self->dimension,
-                            data + self->dimension * x,
-                            (TYPE*)self->centers + self->dimension * cx) ;
-          pointToClosestCenterUB[x] = distance ;
-          pointToClosestCenterUBIsStrict[x] = VL_TRUE ;
-          pointToCenterLB[cx + x * self->numCenters] = distance ;
-          numDistanceComputationsToRefreshUB += 1 ;
-
-          if (((self->distance == VlDistanceL1) ? 2.0 : 4.0) *
-              pointToClosestCenterUB[x] <= ((TYPE*)self->centerDistances)
-              [c + cx * self->numCenters]) {
-            continue ;
-          }
-          if (pointToClosestCenterUB[x] <= pointToCenterLB
-              [c + x * self->numCenters]) {
-            continue ;
-          }
-        }
-
-        /*
-         Now the UB is strict (equal to d(x, assignments[x])), but
-         we still could not exclude that x should be reassigned to
-         c. We therefore compute the distance, update the LB,
-         and check if a reassigmnet must be made
-         */
-        distance = distFn(self->dimension,
-                          data + x * self->dimension,
-                          (TYPE*)self->centers + c *  self->dimension) ;
-        numDistanceComputationsToRefreshLB += 1 ;
-        pointToCenterLB[c + x * self->numCenters] = distance ;
-
-        if (distance < pointToClosestCenterUB[x]) {
-          assignments[x] = c ;
-          pointToClosestCenterUB[x] = distance ;
-          allDone = VL_FALSE ;
-          /* the UB strict flag is already set here */
-        }
-
-      } /* assign center */
-    } /* next data point */
+    for (t = 0 ; t < VL_KMEANS_MAX_THREADS ; ++t) {
+      job.numDistanceComputationsToRefreshUB[t] = 0 ;
+      job.numDistanceComputationsToRefreshLB[t] = 0 ;
+      job.allDone[t] = VL_TRUE ;
+    }
+    _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_elkan_reassign_task_, SFX),
+                             &job, numData, 16) ;
+    for (allDone = VL_TRUE, t = 0 ; t < VL_KMEANS_MAX_THREADS ; ++t) {
+      numDistanceComputationsToRefreshUB += job.numDistanceComputationsToRefreshUB[t] ;
+      numDistanceComputationsToRefreshLB += job.numDistanceComputationsToRefreshLB[t] ;
+      allDone &= job.allDone[t] ;
+    }
 
     totDistanceComputationsToRefreshUB
     += numDistanceComputationsToRefreshUB ;
@@ -1245,7 +1920,6 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
   }
 
   if (permutations) { vl_free(permutations) ; }
-  if (numSeenSoFar) { vl_free(numSeenSoFar) ; }
 
   vl_free(distances) ;
   vl_free(assignments) ;
@@ -1261,6 +1935,413 @@ VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)
   return energy ;
 }
 
+/* ---------------------------------------------------------------- */
+/*                                                   ANN refinement */
+/* ---------------------------------------------------------------- */
+
+static double
+VL_XCAT(_vl_kmeans_refine_centers_ann_, SFX)
+(VlKMeans * self,
+ TYPE const * data,
+ vl_size numData)
+{
+  vl_size x, iteration ;
+  double energy = VL_INFINITY_D ;
+  TYPE * distances = vl_malloc (sizeof(TYPE) * numData) ;
+  vl_uint32 * assignments = vl_malloc (sizeof(vl_uint32) * numData) ;
+  vl_size * clusterMasses = vl_malloc (sizeof(vl_size) * self->numCenters) ;
+  TYPE * exactDistances = NULL ;
+  vl_uint32 * exactAssignments = NULL ;
+  vl_uint32 * permutations = NULL ;
+  vl_size totNumComparisons = 0 ;
+  vl_size totNumRestartedCenters = 0 ;
+
+#if (FLT == VL_TYPE_FLOAT)
+  VlFloatVectorComparisonFunction distFn = vl_get_vector_comparison_function_f(self->distance) ;
+#else
+  VlDoubleVectorComparisonFunction distFn = vl_get_vector_comparison_function_d(self->distance) ;
+#endif
+
+  if (self->distance == VlDistanceL1) {
+    permutations = vl_malloc(sizeof(vl_uint32) * numData * self->dimension) ;
+    VL_XCAT(_vl_kmeans_sort_data_helper_, SFX)(self, permutations, data, numData) ;
+  }
+
+  for (iteration = 0 ; 1 ; ++ iteration) {
+    vl_size numComparisons = 0 ;
+    vl_size numReassigned = 0 ;
+    vl_size numRestartedCenters ;
+    VlKDForest * forest = vl_kdforest_new (FLT, self->dimension, self->numTrees) ;
+
+    /* assign data to clusters */
+    vl_kdforest_set_max_num_comparisons (forest, self->maxNumComparisons) ;
+    vl_kdforest_build (forest, self->numCenters, self->centers) ;
+
+    for (x = 0 ; x < numData ; ++x) {
+      VlKDForestNeighbor neighbor ;
+      TYPE const * xpt = data + x * self->dimension ;
+      TYPE distance ;
+
+      numComparisons += vl_kdforest_query (forest, &neighbor, 1, xpt) ;
+
+      /* the kd-forest compares points by the l2 distance */
+      if (self->distance == VlDistanceL2) {
+        distance = (TYPE) neighbor.distance ;
+      } else {
+        distance = distFn (self->dimension, xpt,
+                           (TYPE*)self->centers + neighbor.index * self->dimension) ;
+      }
+
+      if (iteration == 0) {
+        assignments[x] = (vl_uint32) neighbor.index ;
+        distances[x] = distance ;
+        continue ;
+      }
+
+      /* the search may miss the closest center; make sure that the
+         new assignment is not worse than the old one */
+      distances[x] = distFn (self->dimension, xpt,
+                             (TYPE*)self->centers + assignments[x] * self->dimension) ;
+      if (distance < distances[x]) {
+        assignments[x] = (vl_uint32) neighbor.index ;
+        distances[x] = distance ;
+        numReassigned ++ ;
+      }
+    }
+    vl_kdforest_delete (forest) ;
+    totNumComparisons += numComparisons ;
+
+    /* if the approximate search is stuck, check for convergence by
+       recomputing the assignments exactly */
+    if (iteration > 0 && numReassigned == 0 && self->maxNumComparisons > 0) {
+      if (exactAssignments == NULL) {
+        exactDistances = vl_malloc (sizeof(TYPE) * numData) ;
+        exactAssignments = vl_malloc (sizeof(vl_uint32) * numData) ;
+      }
+      VL_XCAT(_vl_kmeans_quantize_, SFX)(self, exactAssignments, exactDistances,
+                                         data, numData) ;
+      for (x = 0 ; x < numData ; ++x) {
+        if (exactDistances[x] < distances[x]) {
+          assignments[x] = exactAssignments[x] ;
+          distances[x] = exactDistances[x] ;
+          numReassigned ++ ;
+        }
+      }
+      if (self->verbosity) {
+        VL_PRINTF("kmeans: ANN iter %d: exact check reassigned %d points\n",
+                  iteration, numReassigned) ;
+      }
+    }
+
+    /* compute energy */
+    energy = 0 ;
+    for (x = 0 ; x < numData ; ++x) energy += distances[x] ;
+    if (self->verbosity) {
+      VL_PRINTF("kmeans: ANN iter %d: energy = %g, reassigned = %d, comparisons = %d\n",
+                iteration, energy, numReassigned, numComparisons) ;
+    }
+
+    /* check termination conditions */
+    if (iteration >= self->maxNumIterations) {
+      if (self->verbosity) {
+        VL_PRINTF("kmeans: ANN terminating because maximum number of iterations reached\n") ;
+      }
+      break ;
+    }
+    if (iteration > 0 && numReassigned == 0) {
+      if (self->verbosity) {
+        VL_PRINTF("kmeans: ANN terminating because the algorithm fully converged\n") ;
+      }
+      break ;
+    }
+
+    /* update clusters */
+    numRestartedCenters =
+    VL_XCAT(_vl_kmeans_update_centers_, SFX)(self, self->centers, data, numData,
+                                             assignments, clusterMasses,
+                                             permutations) ;
+    totNumRestartedCenters += numRestartedCenters ;
+    if (self->verbosity && numRestartedCenters) {
+      VL_PRINTF("kmeans: ANN iter %d: restarted %d centers\n", iteration,
+                numRestartedCenters) ;
+    }
+  } /* next ANN iteration */
+
+  if (self->verbosity) {
+    VL_PRINTF("kmeans: ANN: total comparisons: %d (%.2f %% of Lloyd)\n",
+              totNumComparisons,
+              100.0 * totNumComparisons / ((iteration + 1) * self->numCenters * numData)) ;
+    if (totNumRestartedCenters) {
+      VL_PRINTF("kmeans: ANN: there have been %d restarts\n",
+                totNumRestartedCenters) ;
+    }
+  }
+
+  if (permutations) { vl_free(permutations) ; }
+  if (exactDistances) { vl_free(exactDistances) ; }
+  if (exactAssignments) { vl_free(exactAssignments) ; }
+  vl_free(distances) ;
+  vl_free(assignments) ;
+  vl_free(clusterMasses) ;
+  return energy ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                    Mini-batch refinement on files */
+/* ---------------------------------------------------------------- */
+
+/* Each thread moves a range of centers towards their points, visiting
+ * them in their order in the mini-batch, so that the result does not
+ * depend on the number of threads. */
+
+static void
+VL_XCAT(_vl_kmeans_update_centers_mini_batch_task_, SFX)
+(VlKMeans * self, void * data, int tid VL_UNUSED,
+ vl_uindex begin, vl_uindex end)
+{
+  VL_XCAT(_VlKMeansJob_, SFX) * job = data ;
+  vl_uindex c, d, i ;
+
+  for (c = begin ; c < end ; ++c) {
+    TYPE * cpt = job->centers + c * self->dimension ;
+    for (i = job->clusterBegins[c] ; i < job->clusterBegins[c + 1] ; ++i) {
+      TYPE const * xpt = job->data + job->clusterMembers[i] * self->dimension ;
+      TYPE rate = (TYPE) 1 / (TYPE) (++ job->centerCounts[c]) ;
+      for (d = 0 ; d < self->dimension ; ++d) { cpt[d] += rate * (xpt[d] - cpt[d]) ; }
+    }
+  }
+}
+
+/* Move the centers towards the points of a mini-batch. The learning
+ * rate of a center is the inverse of the number of points assigned to
+ * it so far, which keeps it equal to the mean of these points. */
+
+static void
+VL_XCAT(_vl_kmeans_update_centers_mini_batch_, SFX)
+(VlKMeans * self,
+ TYPE const * data,
+ vl_size numData,
+ vl_uint32 const * assignments,
+ vl_size * centerCounts)
+{
+  vl_uindex c, x ;
+  vl_uindex * clusterBegins = vl_calloc (self->numCenters + 2, sizeof(vl_uindex)) ;
+  vl_uint32 * clusterMembers = vl_malloc (sizeof(vl_uint32) * numData) ;
+  VL_XCAT(_VlKMeansJob_, SFX) job ;
+
+  /* list the points of each cluster */
+  for (x = 0 ; x < numData ; ++x) {
+    clusterBegins[assignments[x] + 2] ++ ;
+  }
+  for (c = 2 ; c < self->numCenters + 2 ; ++c) {
+    clusterBegins[c] += clusterBegins[c - 1] ;
+  }
+  for (x = 0 ; x < numData ; ++x) {
+    clusterMembers[clusterBegins[assignments[x] + 1] ++] = (vl_uint32) x ;
+  }
+
+  memset (&job, 0, sizeof(job)) ;
+  job.data = data ;
+  job.numData = numData ;
+  job.centers = self->centers ;
+  job.clusterBegins = clusterBegins ;
+  job.clusterMembers = clusterMembers ;
+  job.centerCounts = centerCounts ;
+  _vl_kmeans_parallel_for (self, VL_XCAT(_vl_kmeans_update_centers_mini_batch_task_, SFX),
+                           &job, self->numCenters, 8) ;
+
+  vl_free (clusterBegins) ;
+  vl_free (clusterMembers) ;
+}
+
+/* Compute the energy of all the data of @a file, reading them by
+ * mini-batches in the two buffers @a buffers in turn. */
+
+static double
+VL_XCAT(_vl_kmeans_file_energy_, SFX)
+(VlKMeans * self,
+ _VlKMeansFile const * file,
+ TYPE ** buffers,
+ vl_size batchSize,
+ vl_uint32 * assignments,
+ TYPE * distances)
+{
+  _VlKMeansFetch fetches [2] ;
+  vl_uindex begin, t, x ;
+  double energy = 0 ;
+
+  memset (fetches, 0, sizeof(fetches)) ;
+  for (t = 0 ; t < 2 ; ++t) {
+    fetches[t].file = file ;
+    fetches[t].buffer = buffers[t] ;
+    fetches[t].bufferType = FLT ;
+  }
+
+  _vl_kmeans_fetch_start (fetches, 0, VL_MIN(batchSize, file->numData)) ;
+  for (begin = 0, t = 0 ; begin < file->numData ; begin += batchSize, t ^= 1) {
+    _VlKMeansFetch * fetch = fetches + t ;
+    _vl_kmeans_fetch_finish (fetch) ;
+    if (begin + batchSize < file->numData) {
+      _vl_kmeans_fetch_start (fetches + (t ^ 1), begin + batchSize,
+                              VL_MIN(batchSize, file->numData - begin - batchSize)) ;
+    }
+    VL_XCAT(_vl_kmeans_quantize_, SFX)(self, assignments, distances,
+                                       buffers[t], fetch->numData) ;
+    for (x = 0 ; x < fetch->numData ; ++x) energy += distances[x] ;
+  }
+  return energy ;
+}
+
+static double
+VL_XCAT(_vl_kmeans_cluster_file_, SFX)
+(VlKMeans * self,
+ _VlKMeansFile const * file,
+ vl_size numCenters)
+{
+  vl_size dimension = file->dimension ;
+  vl_size numData = file->numData ;
+  vl_size batchSize = VL_MIN(self->batchSize, numData) ;
+  vl_size numBatches = (numData + batchSize - 1) / batchSize ;
+  vl_size numSeeds = VL_MIN(numData, VL_MAX(batchSize, numCenters)) ;
+  VlRand * rand = vl_get_rand () ;
+  vl_uindex * order = vl_malloc (sizeof(vl_uindex) * numBatches) ;
+  vl_uint32 * assignments = vl_malloc (sizeof(vl_uint32) * batchSize) ;
+  TYPE * distances = vl_malloc (sizeof(TYPE) * batchSize) ;
+  vl_size * centerCounts = vl_calloc (numCenters, sizeof(vl_size)) ;
+  TYPE * bestCenters = NULL ;
+  TYPE * buffers [2] ;
+  _VlKMeansFetch fetches [2] ;
+  vl_uindex i, t, x, iteration, position ;
+  double energy = VL_INFINITY_D ;
+  double previousEnergy = VL_INFINITY_D ;
+  vl_bool checked = VL_FALSE ;
+
+  /* seed the centers from data points sampled evenly from the file */
+  {
+    TYPE * seeds = vl_malloc (sizeof(TYPE) * dimension * numSeeds) ;
+    for (i = 0 ; i < numSeeds ; ++i) {
+      vl_uindex first = (vl_uindex) ((vl_uint64) numData * i / numSeeds) ;
+      vl_uindex last = (vl_uindex) ((vl_uint64) numData * (i + 1) / numSeeds) ;
+      _vl_kmeans_file_read (file, seeds + dimension * i, FLT,
+                            first + vl_rand_uindex (rand, last - first), 1) ;
+    }
+    switch (self->initialization) {
+      case VlKMeansRandomSelection :
+        VL_XCAT(_vl_kmeans_seed_centers_with_rand_data_, SFX)
+        (self, seeds, dimension, numSeeds, numCenters) ;
+        break ;
+      case VlKMeansPlusPlus :
+        VL_XCAT(_vl_kmeans_seed_centers_plus_plus_, SFX)
+        (self, seeds, dimension, numSeeds, numCenters) ;
+        break ;
+      default:
+        abort() ;
+    }
+    vl_free (seeds) ;
+  }
+
+  buffers[0] = vl_malloc (sizeof(TYPE) * dimension * batchSize) ;
+  buffers[1] = vl_malloc (sizeof(TYPE) * dimension * batchSize) ;
+
+  /* the centers of the lowest energy evaluated so far, to which the
+     iterations return if the energy goes up */
+  if (self->energyCheckPeriod > 0) {
+    bestCenters = vl_malloc (sizeof(TYPE) * dimension * numCenters) ;
+  }
+  memset (fetches, 0, sizeof(fetches)) ;
+  for (t = 0 ; t < 2 ; ++t) {
+    fetches[t].file = file ;
+    fetches[t].buffer = buffers[t] ;
+    fetches[t].bufferType = FLT ;
+  }
+
+  /* The mini-batches are contiguous blocks of the file, visited in an
+     order that is shuffled at each pass on the data. The next one is
+     read while the current one is processed, except before an energy
+     evaluation, which needs both buffers. */
+  for (i = 0 ; i < numBatches ; ++i) order[i] = i ;
+  position = 0 ;
+
+#define NEXT_BATCH(fetch) \
+  { \
+    vl_uindex batch ; \
+    if (position == numBatches) position = 0 ; \
+    if (position == 0) _vl_kmeans_shuffle (order, numBatches, rand) ; \
+    batch = order [position ++] ; \
+    _vl_kmeans_fetch_start (fetch, batch * batchSize, \
+                            VL_MIN(batchSize, numData - batch * batchSize)) ; \
+  }
+
+  t = 0 ;
+  if (self->maxNumIterations > 0) NEXT_BATCH(fetches) ;
+
+  for (iteration = 0 ; iteration < self->maxNumIterations ; ++ iteration, t ^= 1) {
+    _VlKMeansFetch * fetch = fetches + t ;
+    vl_bool check = (self->energyCheckPeriod > 0 &&
+                     (iteration + 1) % self->energyCheckPeriod == 0) ;
+    vl_bool last = (iteration + 1 == self->maxNumIterations) ;
+    double batchEnergy = 0 ;
+
+    _vl_kmeans_fetch_finish (fetch) ;
+    if (! check && ! last) NEXT_BATCH(fetches + (t ^ 1)) ;
+
+    VL_XCAT(_vl_kmeans_quantize_, SFX)(self, assignments, distances,
+                                       buffers[t], fetch->numData) ;
+    for (x = 0 ; x < fetch->numData ; ++x) batchEnergy += distances[x] ;
+    VL_XCAT(_vl_kmeans_update_centers_mini_batch_, SFX)(self, buffers[t], fetch->numData,
+                                                        assignments, centerCounts) ;
+
+    /* until the next evaluation, the energy is estimated from the
+       mini-batch */
+    energy = batchEnergy * numData / fetch->numData ;
+    checked = VL_FALSE ;
+    if (self->verbosity) {
+      VL_PRINTF("kmeans: mini-batch iter %d: estimated energy = %g\n", iteration,
+                energy) ;
+    }
+
+    if (check) {
+      energy = VL_XCAT(_vl_kmeans_file_energy_, SFX)(self, file, buffers, batchSize,
+                                                     assignments, distances) ;
+      checked = VL_TRUE ;
+      if (self->verbosity) {
+        VL_PRINTF("kmeans: mini-batch iter %d: energy = %g\n", iteration,
+                  energy) ;
+      }
+      if (energy >= previousEnergy) {
+        if (self->verbosity) {
+          VL_PRINTF("kmeans: mini-batch terminating because the energy did not decrease\n") ;
+        }
+        memcpy (self->centers, bestCenters, sizeof(TYPE) * dimension * numCenters) ;
+        energy = previousEnergy ;
+        break ;
+      }
+      previousEnergy = energy ;
+      memcpy (bestCenters, self->centers, sizeof(TYPE) * dimension * numCenters) ;
+      if (! last) NEXT_BATCH(fetches + (t ^ 1)) ;
+    }
+  }
+#undef NEXT_BATCH
+
+  if (! checked && (self->energyCheckPeriod > 0 || self->maxNumIterations == 0)) {
+    energy = VL_XCAT(_vl_kmeans_file_energy_, SFX)(self, file, buffers, batchSize,
+                                                   assignments, distances) ;
+    if (energy > previousEnergy) {
+      memcpy (self->centers, bestCenters, sizeof(TYPE) * dimension * numCenters) ;
+      energy = previousEnergy ;
+    }
+  }
+
+  if (bestCenters) vl_free (bestCenters) ;
+  vl_free (buffers[0]) ;
+  vl_free (buffers[1]) ;
+  vl_free (order) ;
+  vl_free (assignments) ;
+  vl_free (distances) ;
+  vl_free (centerCounts) ;
+  return energy ;
+}
+
 /* ---------------------------------------------------------------- */
 static double
 VL_XCAT(_vl_kmeans_refine_centers_, SFX)
@@ -1277,6 +2358,10 @@ VL_XCAT(_vl_kmeans_refine_centers_, SFX)
       return
       VL_XCAT(_vl_kmeans_refine_centers_elkan_, SFX)(self, data, numData) ;
       break ;
+    case VlKMeansANN:
+      return
+      VL_XCAT(_vl_kmeans_refine_centers_ann_, SFX)(self, data, numData) ;
+      break ;
     default:
       abort() ;
   }
@@ -1562,6 +2647,94 @@ vl_kmeans_cluster (VlKMeans * self,
   return bestEnergy ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Cluster the data of a file by mini-batch k-means
+ ** @param self KMeans object.
+ ** @param fileName name of the data file.
+ ** @param fileDataType type of the data in the file (::VL_TYPE_FLOAT or ::VL_TYPE_UINT8).
+ ** @param dimension data dimension.
+ ** @param numCenters number of clusters.
+ ** @return error code.
+ **
+ ** The function clusters the data points stored in the file
+ ** @a fileName, which can be larger than the memory (see
+ ** @ref kmeans-usage-files). The file must contain the data points
+ ** one after the other, with no header. The function
+ ** initializes the centers by the algorithm set by
+ ** ::vl_kmeans_set_initialization and refines them by mini-batch
+ ** k-means, for at most ::vl_kmeans_get_max_num_iterations
+ ** mini-batches. The algorithm set by ::vl_kmeans_set_algorithm
+ ** and the number of repetitions are ignored. Only the
+ ** ::VlDistanceL2 distance is supported.
+ **
+ ** Use ::vl_kmeans_get_energy to obtain the energy at the end of
+ ** the optimization. This is computed on all the data if
+ ** ::vl_kmeans_set_energy_check_period was used, and estimated from
+ ** the last mini-batch otherwise.
+ **/
+
+VL_EXPORT int
+vl_kmeans_cluster_file (VlKMeans * self,
+                        char const * fileName,
+                        vl_type fileDataType,
+                        vl_size dimension,
+                        vl_size numCenters)
+{
+  _VlKMeansFile file ;
+  double timeRef ;
+  double energy ;
+  int err ;
+
+  if (self->distance != VlDistanceL2) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "Mini-batch k-means supports only the l2 distance") ;
+  }
+  if (fileDataType != VL_TYPE_FLOAT && fileDataType != VL_TYPE_UINT8) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "The data file must contain float or uint8 values") ;
+  }
+  if (dimension == 0 || numCenters == 0) {
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "The dimension and the number of centers must be positive") ;
+  }
+
+  err = _vl_kmeans_file_open (&file, fileName, fileDataType, dimension) ;
+  if (err) return err ;
+
+  if (file.numData < numCenters) {
+    _vl_kmeans_file_close (&file) ;
+    return vl_set_last_error (VL_ERR_BAD_ARG,
+                              "`%s' has fewer data points than centers", fileName) ;
+  }
+
+  if (self->verbosity) {
+    VL_PRINTF("kmeans: mini-batch k-means on %d data points of `%s'\n",
+              file.numData, fileName) ;
+  }
+
+  vl_kmeans_reset (self) ;
+  timeRef = vl_get_cpu_time () ;
+  switch (self->dataType) {
+    case VL_TYPE_FLOAT :
+      energy = _vl_kmeans_cluster_file_f (self, &file, numCenters) ;
+      break ;
+    case VL_TYPE_DOUBLE :
+      energy = _vl_kmeans_cluster_file_d (self, &file, numCenters) ;
+      break ;
+    default:
+      abort() ;
+  }
+  _vl_kmeans_file_close (&file) ;
+
+  if (self->verbosity) {
+    VL_PRINTF("kmeans: K-means terminated in %.2f s with energy %g\n",
+              vl_get_cpu_time() - timeRef, energy) ;
+  }
+
+  self->energy = energy ;
+  return VL_ERR_OK ;
+}
+
 /* VL_KMEANS_INSTANTIATING */
 #endif
 
@@ -20,6 +20,9 @@ the terms of the BSD license (see the COPYING file).
 
 /* ---------------------------------------------------------------- */
 
+/** @brief Maximum number of threads of a KMeans object */
+#define VL_KMEANS_MAX_THREADS 64
+
 /** @brief K-means algorithms */
 
 typedef enum _VlKMeansAlgorithm {
@@ -51,6 +54,11 @@ typedef struct _VlKMeans
   VlVectorComparisonType distance ;    /**< Distance */
   vl_size maxNumIterations ;           /**< Maximum number of refinement iterations */
   vl_size numRepetitions   ;           /**< Number of clustering repetitions */
+  vl_size numTrees ;                   /**< Number of trees for ANN */
+  vl_size maxNumComparisons ;          /**< Maximum number of comparisons for ANN */
+  vl_size batchSize ;                  /**< Number of data points of a mini-batch */
+  vl_size energyCheckPeriod ;          /**< Mini-batches between energy evaluations */
+  int numThreads ;                     /**< Number of threads */
   int verbosity ;                      /**< verbosity level */
 
   void * centers ;                     /**< centers */
@@ -85,6 +93,12 @@ VL_EXPORT void vl_kmeans_quantize (VlKMeans * self,
                                    void * distances,
                                    void const * data,
                                    vl_size numData) ;
+
+VL_EXPORT int vl_kmeans_cluster_file (VlKMeans * self,
+                                      char const * fileName,
+                                      vl_type fileDataType,
+                                      vl_size dimension,
+                                      vl_size numCenters) ;
 /** @} */
 
 /** @name Advanced data processing
@@ -124,6 +138,11 @@ VL_INLINE VlVectorComparisonType vl_kmeans_get_distance (VlKMeans const * self)
 VL_INLINE VlKMeansAlgorithm vl_kmeans_get_algorithm (VlKMeans const * self) ;
 VL_INLINE VlKMeansInitialization vl_kmeans_get_initialization (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_num_repetitions (VlKMeans const * self) ;
+VL_INLINE vl_size vl_kmeans_get_num_trees (VlKMeans const * self) ;
+VL_INLINE vl_size vl_kmeans_get_max_num_comparisons (VlKMeans const * self) ;
+VL_INLINE int vl_kmeans_get_num_threads (VlKMeans const * self) ;
+VL_INLINE vl_size vl_kmeans_get_batch_size (VlKMeans const * self) ;
+VL_INLINE vl_size vl_kmeans_get_energy_check_period (VlKMeans const * self) ;
 
 VL_INLINE vl_size vl_kmeans_get_dimension (VlKMeans const * self) ;
 VL_INLINE vl_size vl_kmeans_get_num_centers (VlKMeans const * self) ;
@@ -140,6 +159,11 @@ VL_INLINE void const * vl_kmeans_get_centers (VlKMeans const * self) ;
 VL_INLINE void vl_kmeans_set_algorithm (VlKMeans * self, VlKMeansAlgorithm algorithm) ;
 VL_INLINE void vl_kmeans_set_initialization (VlKMeans * self, VlKMeansInitialization initialization) ;
 VL_INLINE void vl_kmeans_set_num_repetitions (VlKMeans * self, vl_size numRepetitions) ;
+VL_INLINE void vl_kmeans_set_num_trees (VlKMeans * self, vl_size numTrees) ;
+VL_INLINE void vl_kmeans_set_max_num_comparisons (VlKMeans * self, vl_size maxNumComparisons) ;
+VL_INLINE void vl_kmeans_set_num_threads (VlKMeans * self, int numThreads) ;
+VL_INLINE void vl_kmeans_set_batch_size (VlKMeans * self, vl_size batchSize) ;
+VL_INLINE void vl_kmeans_set_energy_check_period (VlKMeans * self, vl_size energyCheckPeriod) ;
 VL_INLINE void vl_kmeans_set_max_num_iterations (VlKMeans * self, vl_size maxNumIterations) ;
 VL_INLINE void vl_kmeans_set_verbosity (VlKMeans * self, int verbosity) ;
 /** @} */
@@ -284,6 +308,145 @@ vl_kmeans_set_num_repetitions (VlKMeans * self,
   self->numRepetitions = numRepetitions ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get the number of trees used by the ANN algorithm
+ ** @param self KMeans object instance.
+ ** @return number of trees.
+ **/
+
+VL_INLINE vl_size
+vl_kmeans_get_num_trees (VlKMeans const * self)
+{
+  return self->numTrees ;
+}
+
+/** @brief Set the number of trees used by the ANN algorithm
+ ** @param self KMeans object instance.
+ ** @param numTrees number of trees.
+ ** The number of trees cannot be smaller than 1.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_num_trees (VlKMeans * self, vl_size numTrees)
+{
+  assert (numTrees >= 1) ;
+  self->numTrees = numTrees ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the maximum number of comparisons of the ANN algorithm
+ ** @param self KMeans object instance.
+ ** @return maximum number of comparisons.
+ **/
+
+VL_INLINE vl_size
+vl_kmeans_get_max_num_comparisons (VlKMeans const * self)
+{
+  return self->maxNumComparisons ;
+}
+
+/** @brief Set the maximum number of comparisons of the ANN algorithm
+ ** @param self KMeans object instance.
+ ** @param maxNumComparisons maximum number of comparisons.
+ **
+ ** This is the number of point-to-center comparisons that the
+ ** kd-forest search of ::VlKMeansANN may do to assign a point
+ ** (see ::vl_kdforest_set_max_num_comparisons). Setting it to 0
+ ** makes the search exact.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_max_num_comparisons (VlKMeans * self,
+                                   vl_size maxNumComparisons)
+{
+  self->maxNumComparisons = maxNumComparisons ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of threads
+ ** @param self KMeans object instance.
+ ** @return number of threads.
+ **/
+
+VL_INLINE int
+vl_kmeans_get_num_threads (VlKMeans const * self)
+{
+  return self->numThreads ;
+}
+
+/** @brief Set the number of threads
+ ** @param self KMeans object instance.
+ ** @param numThreads number of threads.
+ **
+ ** The seeding, the assignment and the update steps split the data
+ ** (or the centers) among @a numThreads threads (clamped to the
+ ** range 1 to ::VL_KMEANS_MAX_THREADS). The ANN kd-forest search is
+ ** not split. The results do not depend on @a numThreads.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_num_threads (VlKMeans * self, int numThreads)
+{
+  self->numThreads = VL_MAX(1, VL_MIN(numThreads, VL_KMEANS_MAX_THREADS)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the size of the mini-batches
+ ** @param self KMeans object instance.
+ ** @return number of data points of a mini-batch.
+ **/
+
+VL_INLINE vl_size
+vl_kmeans_get_batch_size (VlKMeans const * self)
+{
+  return self->batchSize ;
+}
+
+/** @brief Set the size of the mini-batches
+ ** @param self KMeans object instance.
+ ** @param batchSize number of data points of a mini-batch.
+ **
+ ** This is the number of data points that ::vl_kmeans_cluster_file
+ ** reads and assigns at each iteration. It should be several times
+ ** the number of centers. It cannot be smaller than 1.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_batch_size (VlKMeans * self, vl_size batchSize)
+{
+  assert (batchSize >= 1) ;
+  self->batchSize = batchSize ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the period of the energy evaluations
+ ** @param self KMeans object instance.
+ ** @return number of mini-batches between two energy evaluations.
+ **/
+
+VL_INLINE vl_size
+vl_kmeans_get_energy_check_period (VlKMeans const * self)
+{
+  return self->energyCheckPeriod ;
+}
+
+/** @brief Set the period of the energy evaluations
+ ** @param self KMeans object instance.
+ ** @param energyCheckPeriod number of mini-batches between two energy evaluations.
+ **
+ ** If @a energyCheckPeriod is not zero, ::vl_kmeans_cluster_file
+ ** evaluates the energy on all the data every @a energyCheckPeriod
+ ** mini-batches, and stops when it does not decrease. The centers
+ ** are then those of the lowest energy evaluated. Each evaluation
+ ** reads the whole file.
+ **/
+
+VL_INLINE void
+vl_kmeans_set_energy_check_period (VlKMeans * self, vl_size energyCheckPeriod)
+{
+  self->energyCheckPeriod = energyCheckPeriod ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Get K-means algorithm
  ** @param self KMeans object.
@@ -608,5 +608,17 @@ vl_eval_vector_comparison_on_all_pairs_d (double * result, vl_size dimension,
                                           double const * Y, vl_size numDataY,
                                           VlDoubleVectorComparisonFunction function) ;
 
+VL_EXPORT void
+vl_eval_l2_argmin_on_all_pairs_f (vl_uint32 * indexes, float * distances,
+                                  vl_size dimension,
+                                  float const * X, vl_size numDataX,
+                                  float const * Y, vl_size numDataY) ;
+
+VL_EXPORT void
+vl_eval_l2_argmin_on_all_pairs_d (vl_uint32 * indexes, double * distances,
+                                  vl_size dimension,
+                                  double const * X, vl_size numDataX,
+                                  double const * Y, vl_size numDataY) ;
+
 /* VL_MATHOP_H */
 #endif
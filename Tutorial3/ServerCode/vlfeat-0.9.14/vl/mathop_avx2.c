@@ -0,0 +1,289 @@
+/** @file mathop_avx2.c
+ ** @brief mathop for AVX2 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+/* ---------------------------------------------------------------- */
+#ifndef VL_MATHOP_AVX2_INSTANTIATING
+#define VL_MATHOP_AVX2_INSTANTIATING
+
+#ifndef VL_DISABLE_AVX2
+#if ! defined(__AVX2__) || ! defined(__FMA__)
+#  error "mathop_avx2.c must be compiled with AVX2 and FMA intrinsics enabled"
+#endif
+
+#include "generic.h"
+#include "mathop.h"
+#include "mathop_avx2.h"
+#include <immintrin.h>
+
+#undef FLT
+#define FLT VL_TYPE_DOUBLE
+#include "mathop_avx2.c"
+
+#undef FLT
+#define FLT VL_TYPE_FLOAT
+#include "mathop_avx2.c"
+
+/* VL_DISABLE_AVX2 */
+#endif
+
+/* ---------------------------------------------------------------- */
+/* VL_MATHOP_AVX2_INSTANTIATING */
+#else
+
+#include "float.th"
+
+/* Unaligned loads are used throughout: on AVX2 processors they are
+ * as fast as aligned ones when the data happens to be aligned. */
+
+VL_INLINE T
+VL_XCAT(_vl_vhsum_avx2_, SFX)(VTYPE x)
+{
+#if (FLT == VL_TYPE_FLOAT)
+  /* sum the two halves, then the four floats of the result */
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (x),
+                           _mm256_extractf128_ps (x, 1)) ;
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum)) ;
+  sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, _MM_SHUFFLE(1,1,1,1))) ;
+  return _mm_cvtss_f32 (sum) ;
+#else
+  __m128d sum = _mm_add_pd (_mm256_castpd256_pd128 (x),
+                            _mm256_extractf128_pd (x, 1)) ;
+  sum = _mm_add_sd (sum, _mm_unpackhi_pd (sum, sum)) ;
+  return _mm_cvtsd_f64 (sum) ;
+#endif
+}
+
+VL_EXPORT T
+VL_XCAT(_vl_distance_l2_avx2_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T acc ;
+  VTYPE vacc = VSTZ() ;
+
+  while (X + VSIZE <= X_end) {
+    VTYPE delta = VSUB(VLDU(X), VLDU(Y)) ;
+    vacc = VFMA(delta, delta, vacc) ;
+    X += VSIZE ;
+    Y += VSIZE ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx2_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    T delta = a - b ;
+    acc += delta * delta ;
+  }
+
+  return acc ;
+}
+
+VL_EXPORT T
+VL_XCAT(_vl_distance_l1_avx2_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T acc ;
+  VTYPE vacc = VSTZ() ;
+  VTYPE vminus = VSETA ((T) -0.0) ; /* sign bit */
+
+  while (X + VSIZE <= X_end) {
+    VTYPE delta = VSUB(VLDU(X), VLDU(Y)) ;
+    vacc = VADD(vacc, VANDN(vminus, delta)) ;
+    X += VSIZE ;
+    Y += VSIZE ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx2_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    T delta = a - b ;
+    acc += VL_MAX(delta, - delta) ;
+  }
+
+  return acc ;
+}
+
+VL_EXPORT T
+VL_XCAT(_vl_distance_chi2_avx2_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T acc ;
+  VTYPE vacc = VSTZ() ;
+
+  while (X + VSIZE <= X_end) {
+    VTYPE a = VLDU(X) ;
+    VTYPE b = VLDU(Y) ;
+    VTYPE delta = VSUB(a, b) ;
+    VTYPE denom = VADD(a, b) ;
+    VTYPE numer = VMUL(delta, delta) ;
+    VTYPE ratio = VDIV(numer, denom) ;
+    ratio = VAND(ratio, VNEQ(denom, VSTZ())) ;
+    vacc = VADD(vacc, ratio) ;
+    X += VSIZE ;
+    Y += VSIZE ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx2_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    T delta = a - b ;
+    T denom = a + b ;
+    T numer = delta * delta ;
+    if (denom) {
+      T ratio = numer / denom ;
+      acc += ratio ;
+    }
+  }
+  return acc ;
+}
+
+VL_EXPORT T
+VL_XCAT(_vl_kernel_l2_avx2_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T acc ;
+  VTYPE vacc = VSTZ() ;
+
+  while (X + VSIZE <= X_end) {
+    vacc = VFMA(VLDU(X), VLDU(Y), vacc) ;
+    X += VSIZE ;
+    Y += VSIZE ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx2_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    acc += a * b ;
+  }
+  return acc ;
+}
+
+VL_EXPORT T
+VL_XCAT(_vl_kernel_l1_avx2_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T acc ;
+  VTYPE vacc = VSTZ() ;
+  VTYPE vminus = VSETA ((T) -0.0) ;
+
+  while (X + VSIZE <= X_end) {
+    VTYPE a = VLDU(X) ;
+    VTYPE b = VLDU(Y) ;
+    VTYPE a_ = VANDN(vminus, a) ;
+    VTYPE b_ = VANDN(vminus, b) ;
+    VTYPE sum = VADD(a_,b_) ;
+    VTYPE diff = VSUB(a, b) ;
+    VTYPE diff_ = VANDN(vminus, diff) ;
+    vacc = VADD(vacc, VSUB(sum, diff_)) ;
+    X += VSIZE ;
+    Y += VSIZE ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx2_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    T a_ = VL_XCAT(vl_abs_, SFX) (a) ;
+    T b_ = VL_XCAT(vl_abs_, SFX) (b) ;
+    acc += a_ + b_ - VL_XCAT(vl_abs_, SFX) (a - b) ;
+  }
+
+  return acc / ((T)2) ;
+}
+
+VL_EXPORT T
+VL_XCAT(_vl_kernel_chi2_avx2_, SFX)
+(vl_size dimension, T const * X, T const * Y)
+{
+  T const * X_end = X + dimension ;
+  T acc ;
+  VTYPE vacc = VSTZ() ;
+
+  while (X + VSIZE <= X_end) {
+    VTYPE a = VLDU(X) ;
+    VTYPE b = VLDU(Y) ;
+    VTYPE denom = VADD(a, b) ;
+    VTYPE numer = VMUL(a,b) ;
+    VTYPE ratio = VDIV(numer, denom) ;
+    ratio = VAND(ratio, VNEQ(denom, VSTZ())) ;
+    vacc = VADD(vacc, ratio) ;
+    X += VSIZE ;
+    Y += VSIZE ;
+  }
+
+  acc = VL_XCAT(_vl_vhsum_avx2_, SFX)(vacc) ;
+
+  while (X < X_end) {
+    T a = *X++ ;
+    T b = *Y++ ;
+    T denom = a + b ;
+    if (denom) {
+      T ratio = a * b / denom ;
+      acc += ratio ;
+    }
+  }
+  return ((T)2) * acc ;
+}
+
+/* Dot products of four consecutive vectors X with the 2 VSIZE
+ * vectors of a panel, which stores them interleaved (component d of
+ * vector j is panel[2 VSIZE d + j]). This is the micro-kernel of
+ * vl_eval_l2_argmin_on_all_pairs. The 4 x 2 VSIZE results are kept
+ * in registers (8 out of 16) and stored in @a tile by rows. */
+
+VL_EXPORT void
+VL_XCAT(_vl_dot_tile_avx2_, SFX)
+(vl_size dimension, T const * X, T const * panel, T * tile)
+{
+  T const * X0 = X ;
+  T const * X1 = X0 + dimension ;
+  T const * X2 = X1 + dimension ;
+  T const * X3 = X2 + dimension ;
+  T const * X0_end = X0 + dimension ;
+  VTYPE acc00 = VSTZ(), acc01 = VSTZ() ;
+  VTYPE acc10 = VSTZ(), acc11 = VSTZ() ;
+  VTYPE acc20 = VSTZ(), acc21 = VSTZ() ;
+  VTYPE acc30 = VSTZ(), acc31 = VSTZ() ;
+
+  while (X0 < X0_end) {
+    VTYPE b0 = VLDU(panel) ;
+    VTYPE b1 = VLDU(panel + VSIZE) ;
+    VTYPE a ;
+    a = VLD1(X0++) ; acc00 = VFMA(a, b0, acc00) ; acc01 = VFMA(a, b1, acc01) ;
+    a = VLD1(X1++) ; acc10 = VFMA(a, b0, acc10) ; acc11 = VFMA(a, b1, acc11) ;
+    a = VLD1(X2++) ; acc20 = VFMA(a, b0, acc20) ; acc21 = VFMA(a, b1, acc21) ;
+    a = VLD1(X3++) ; acc30 = VFMA(a, b0, acc30) ; acc31 = VFMA(a, b1, acc31) ;
+    panel += 2 * VSIZE ;
+  }
+
+  VSTU(tile + 0 * VSIZE, acc00) ; VSTU(tile + 1 * VSIZE, acc01) ;
+  VSTU(tile + 2 * VSIZE, acc10) ; VSTU(tile + 3 * VSIZE, acc11) ;
+  VSTU(tile + 4 * VSIZE, acc20) ; VSTU(tile + 5 * VSIZE, acc21) ;
+  VSTU(tile + 6 * VSIZE, acc30) ; VSTU(tile + 7 * VSIZE, acc31) ;
+}
+
+/* VL_MATHOP_AVX2_INSTANTIATING */
+#endif
@@ -355,5 +355,42 @@ VL_XCAT(_vl_kernel_chi2_sse2_, SFX)
   return ((T)2) * acc ;
 }
 
+/* Dot products of four consecutive vectors X with the 2 VSIZE
+ * vectors of a panel, which stores them interleaved (component d of
+ * vector j is panel[2 VSIZE d + j]). This is the micro-kernel of
+ * vl_eval_l2_argmin_on_all_pairs. The 4 x 2 VSIZE results are kept
+ * in registers (8 out of 16) and stored in @a tile by rows. */
+
+VL_EXPORT void
+VL_XCAT(_vl_dot_tile_sse2_, SFX)
+(vl_size dimension, T const * X, T const * panel, T * tile)
+{
+  T const * X0 = X ;
+  T const * X1 = X0 + dimension ;
+  T const * X2 = X1 + dimension ;
+  T const * X3 = X2 + dimension ;
+  T const * X0_end = X0 + dimension ;
+  VTYPE acc00 = VSTZ(), acc01 = VSTZ() ;
+  VTYPE acc10 = VSTZ(), acc11 = VSTZ() ;
+  VTYPE acc20 = VSTZ(), acc21 = VSTZ() ;
+  VTYPE acc30 = VSTZ(), acc31 = VSTZ() ;
+
+  while (X0 < X0_end) {
+    VTYPE b0 = VLDU(panel) ;
+    VTYPE b1 = VLDU(panel + VSIZE) ;
+    VTYPE a ;
+    a = VLD1(X0++) ; acc00 = VADD(acc00, VMUL(a, b0)) ; acc01 = VADD(acc01, VMUL(a, b1)) ;
+    a = VLD1(X1++) ; acc10 = VADD(acc10, VMUL(a, b0)) ; acc11 = VADD(acc11, VMUL(a, b1)) ;
+    a = VLD1(X2++) ; acc20 = VADD(acc20, VMUL(a, b0)) ; acc21 = VADD(acc21, VMUL(a, b1)) ;
+    a = VLD1(X3++) ; acc30 = VADD(acc30, VMUL(a, b0)) ; acc31 = VADD(acc31, VMUL(a, b1)) ;
+    panel += 2 * VSIZE ;
+  }
+
+  VSTU(tile + 0 * VSIZE, acc00) ; VSTU(tile + 1 * VSIZE, acc01) ;
+  VSTU(tile + 2 * VSIZE, acc10) ; VSTU(tile + 3 * VSIZE, acc11) ;
+  VSTU(tile + 4 * VSIZE, acc20) ; VSTU(tile + 5 * VSIZE, acc21) ;
+  VSTU(tile + 6 * VSIZE, acc30) ; VSTU(tile + 7 * VSIZE, acc31) ;
+}
+
 /* VL_MATHOP_SSE2_INSTANTIATING */
 #endif
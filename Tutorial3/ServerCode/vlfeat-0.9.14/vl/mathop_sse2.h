@@ -62,6 +62,10 @@ VL_EXPORT T
 VL_XCAT(_vl_kernel_chi2_sse2_, SFX)
 (vl_size dimension, T const * X, T const * Y) ;
 
+VL_EXPORT void
+VL_XCAT(_vl_dot_tile_sse2_, SFX)
+(vl_size dimension, T const * X, T const * panel, T * tile) ;
+
 /* ! VL_DISABLE_SSE2 */
 #endif
 
@@ -246,6 +246,28 @@ no descriptor is zeroed. Normally this option is useful only with
 custom keypoints, as detected keypoints are implicitly selected at
 high contrast image regions.
 
+<b>Approximate scale space.</b> ::vl_sift_set_approximate() replaces
+the Gaussian filters of the scale space by compositions of three box
+filters of about the same variance. A box filter costs the same for
+any scale, while the cost of a Gaussian filter grows with its
+standard deviation. The rest of the algorithm is unchanged, so that
+the keypoints and descriptors have the usual format, but they are
+less repeatable. This is useful when throughput matters more than
+accuracy, for instance to preview the keypoints of an image.
+
+<b>Compact scale space.</b> ::vl_sift_set_compact() stores the levels
+and the DoG of the scale space in half precision, and the gradient as
+a half precision modulus and an eight bit angle. The filters still
+compute in single precision, so that only the stored values are
+rounded, and the scale space takes less than half the memory. This
+lets a server run more filters at once, and ::vl_sift_process_tiled()
+use larger tiles. A few keypoints close to the thresholds change and
+the descriptors differ by about one percent. Flat or synthetic images
+are an exception: in their flat areas the DoG values are tiny, and
+rounded to half precision they tie with their neighbours, so that
+they are no longer extrema. There compact storage can lose almost all
+the keypoints (6 instead of 3318 on a synthetic test image).
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section sift-usage Using the SIFT filter object
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -276,6 +298,29 @@ To use a <b>SIFT filter</b> object:
 To compute SIFT descriptors of custom keypoints, use
 ::vl_sift_calc_raw_descriptor().
 
+To bound the memory used by very large images, use instead
+::vl_sift_process_tiled(), which computes the first octaves on
+overlapping tiles and passes the frames (and optionally the
+descriptors) of the whole image to a function.
+
+To process a sequence of images, such as a collection of photos taken
+at a few resolutions, use a <b>SIFT batch</b>:
+
+- Create a batch with ::vl_sift_batch_new() and set its parameters
+  (e.g. ::vl_sift_batch_set_peak_thresh()).
+- Optionally reserve the frame buffers with ::vl_sift_batch_reserve().
+- Call ::vl_sift_batch_process() for each image. The frames of the
+  images are stored one after the other in the batch (see
+  ::vl_sift_batch_get_offsets(), ::vl_sift_batch_get_keypoints(),
+  ::vl_sift_batch_get_angles() and ::vl_sift_batch_get_descriptors()).
+- Use ::vl_sift_batch_clear() to drop the frames and start over
+  without releasing any memory, and ::vl_sift_batch_delete() to
+  release the batch.
+
+The batch keeps a filter for each of the last few image sizes, so an
+image of a size processed recently reuses the scale space buffers of
+the previous one instead of allocating them again.
+
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
 @section sift-tech Technical details
 <!-- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~  -->
@@ -672,6 +717,9 @@ Gaussian window size is set to have standard deviation
 #include "sift.h"
 #include "imopv.h"
 #include "mathop.h"
+#include "sift_sse2.h"
+#include "sift_avx2.h"
+#include "threads.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -689,6 +737,18 @@ double expn_tab [EXPN_SZ+1] ; /**< ::fast_expn table      @internal */
 #define NBO 8
 #define NBP 4
 
+/** @internal @brief Side of the tiles of the gradient cache */
+#define VL_SIFT_GRAD_TILE 32
+
+/** @internal @brief Rows between two recomputations of the box sums */
+#define VL_SIFT_BOX_REFRESH 8
+
+/** @internal @brief Rows transposed together when filtering by boxes */
+#define VL_SIFT_BOX_STRIP 32
+
+/** @internal @brief Pixels of a compact DoG row scanned together */
+#define VL_SIFT_SCAN_RUN 256
+
 #define log2(x) (log(x)/VL_LOG_OF_2)
 
 /** ------------------------------------------------------------------
@@ -733,6 +793,125 @@ fast_expn_init ()
   }
 }
 
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Task run by ::_vl_sift_parallel_for
+ **
+ ** A task processes the items @a begin to @a end - 1 of a job on
+ ** the thread @a tid. Tasks may use the per-thread buffers of the
+ ** filter for thread @a tid only.
+ **/
+
+typedef void (*_VlSiftTask) (VlSiftFilt *f, void *data,
+                             int tid, int begin, int end) ;
+
+/** @internal @brief Task of a filter, run by ::_vl_parallel_for */
+typedef struct _VlSiftParallelJob
+{
+  VlSiftFilt *f ;
+  _VlSiftTask task ;
+  void       *data ;
+} _VlSiftParallelJob ;
+
+static void
+_vl_sift_parallel_task (void *data, int tid, vl_uindex begin, vl_uindex end)
+{
+  _VlSiftParallelJob *job = data ;
+  job->task (job->f, job->data, tid, (int) begin, (int) end) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run a task on the items of a job in parallel
+ **
+ ** @param f      SIFT filter.
+ ** @param task   task.
+ ** @param data   task data.
+ ** @param n      number of items.
+ ** @param grain  minimum number of items of a thread.
+ ** @param align  slices start at multiples of @a align items.
+ **
+ ** The items are split among the threads of the filter by
+ ** ::_vl_parallel_for, in order. The function returns the number of
+ ** slices, at least one.
+ **/
+
+static int
+_vl_sift_parallel_for (VlSiftFilt *f, _VlSiftTask task, void *data,
+                       int n, int grain, int align)
+{
+  _VlSiftParallelJob job ;
+  job.f = f ;
+  job.task = task ;
+  job.data = data ;
+  return (int) _vl_parallel_for (f->numThreads, _vl_sift_parallel_task, &job,
+                                 VL_MAX(n, 0), grain, align) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Append a keypoint to the buffer of a thread
+ **
+ ** The function returns @c NULL and flags the thread in
+ ** VlSiftFilt::threadKeysFailed if the buffer cannot be enlarged.
+ **/
+
+VL_INLINE VlSiftKeypoint *
+_vl_sift_thread_push_key (VlSiftFilt *f, int tid)
+{
+  if (f->threadNumKeys[tid] >= f->threadKeysRes[tid]) {
+    VlSiftKeypoint *keys = vl_realloc (f->threadKeys[tid],
+                                       (f->threadKeysRes[tid] + 500) *
+                                       sizeof(VlSiftKeypoint)) ;
+    if (! keys) {
+      f->threadKeysFailed[tid] = VL_TRUE ;
+      return NULL ;
+    }
+    f->threadKeys[tid] = keys ;
+    f->threadKeysRes[tid] += 500 ;
+  }
+  return f->threadKeys[tid] + (f->threadNumKeys[tid] ++) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Concatenate the keypoint buffers of the threads
+ **
+ ** @param f           SIFT filter.
+ ** @param numThreads  number of threads whose buffers are used.
+ **
+ ** The keypoints replace the ones of the filter, in thread order.
+ ** If a thread could not store all its keypoints, or if they do not
+ ** fit the filter, the filter is left without keypoints and the
+ ** function returns ::VL_ERR_ALLOC.
+ **/
+
+static int
+_vl_sift_gather_keys (VlSiftFilt *f, int numThreads)
+{
+  int t, nkeys = 0 ;
+
+  f->nkeys = 0 ;
+  for (t = 0 ; t < numThreads ; ++t) {
+    if (f->threadKeysFailed[t]) return VL_ERR_ALLOC ;
+    nkeys += f->threadNumKeys[t] ;
+  }
+  if (nkeys > f->keys_res) {
+    VlSiftKeypoint *keys = vl_realloc (f->keys, (nkeys + 500) *
+                                       sizeof(VlSiftKeypoint)) ;
+    if (! keys) return VL_ERR_ALLOC ;
+    f->keys = keys ;
+    f->keys_res = nkeys + 500 ;
+  }
+
+  for (t = 0 ; t < numThreads ; ++t) {
+    memcpy (f->keys + f->nkeys, f->threadKeys[t],
+            f->threadNumKeys[t] * sizeof(VlSiftKeypoint)) ;
+    f->nkeys += f->threadNumKeys[t] ;
+  }
+  return VL_ERR_OK ;
+}
+
 /** ------------------------------------------------------------------
  ** @internal
  ** @brief Copy image, upsample rows and take transpose
@@ -771,6 +950,207 @@ copy_and_upsample_rows
   }
 }
 
+/** @internal @brief Data of ::_vl_sift_smooth_band */
+typedef struct _VlSiftSmoothJob
+{
+  vl_sift_pix       *dst ;
+  vl_sift_pix const *src ;
+  vl_size            width ;
+  vl_size            height ;
+} _VlSiftSmoothJob ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Filter and transpose a band of columns of an image
+ **
+ ** Columns are filtered independently, so that the bands of an image
+ ** can be processed by different threads with the same result.
+ **/
+
+static void
+_vl_sift_smooth_band (VlSiftFilt *f, void *data, int tid VL_UNUSED,
+                      int begin, int end)
+{
+  _VlSiftSmoothJob const *job = data ;
+  vl_imconvcol_vf (job->dst + begin * job->height, job->height,
+                   job->src + begin, end - begin, job->height, job->width,
+                   f->gaussFilter,
+                   - f->gaussFilterWidth, f->gaussFilterWidth,
+                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+}
+
+/** @internal @brief Data of ::_vl_sift_box_cols and ::_vl_sift_box_rows */
+typedef struct _VlSiftBoxJob
+{
+  vl_sift_pix       *dst ;
+  vl_sift_pix const *src ;
+  vl_size            width ;
+  vl_size            height ;
+  vl_sift_pix       *buffer ;     /**< buffers of the threads */
+  vl_size            bufferSize ; /**< size of the buffer of a thread */
+  int                radius ;     /**< radius of the boxes */
+  double             alpha ;      /**< weight of the ends of the boxes */
+  int                ringSize ;   /**< rows of the circular buffers */
+} _VlSiftBoxJob ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Boxes approximating a Gaussian
+ ** @param job   job receiving the boxes.
+ ** @param sigma standard deviation of the Gaussian.
+ **
+ ** The Gaussian is approximated by the composition of three
+ ** extended boxes. An extended box of radius @f$ r @f$ has weights
+ ** @f$ \alpha, 1, \dots, 1, \alpha @f$ (@f$ 2r + 1 @f$ ones), up to
+ ** normalization, where @f$ 0 \leq \alpha < 1 @f$ is chosen so that
+ ** its variance is @f$ \sigma^2 / 3 @f$. Unlike plain boxes, whose
+ ** widths are integer, this matches the variance of the Gaussian
+ ** exactly, which matters for the small standard deviations of the
+ ** SIFT scale space.
+ **/
+
+static void
+_vl_sift_box_init (_VlSiftBoxJob *job, double sigma)
+{
+  double t = sigma * sigma / 3 ;
+  int    r = (int) floor ((sqrt (1 + 12 * t) - 1) / 2) ;
+
+  /* the variance of a plain box of radius r is r (r + 1) / 3 <= t */
+  job->radius = r ;
+  job->alpha  = (2 * r + 1) * (3 * t - r * (r + 1))
+    / (6 * ((r + 1) * (r + 1) - t)) ;
+
+  /* at least 2r + 3 rows, a power of two to wrap around by masking */
+  job->ringSize = 1 ;
+  while (job->ringSize < 2 * r + 3) job->ringSize <<= 1 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Filter the columns of an image by the three boxes
+ ** @param dst       output image.
+ ** @param src       input image.
+ ** @param stride    distance between the rows of both images.
+ ** @param n         number of columns.
+ ** @param h         number of rows.
+ ** @param job       boxes.
+ ** @param work      @c (3 + 2 ringSize) n floats.
+ **
+ ** The image is padded by continuity and scanned by rows, keeping the
+ ** sums over the boxes of each column, so that memory is accessed
+ ** sequentially and the cost does not depend on the radius. The three
+ ** boxes are applied in the same scan: the rows filtered by the first
+ ** two are kept in circular buffers, just long enough for the next
+ ** box. The sums are updated in single precision, which vectorizes
+ ** well, and recomputed every ::VL_SIFT_BOX_REFRESH rows: a drifting
+ ** sum adds noise to flat regions, which the detector picks up as
+ ** spurious extrema.
+ **/
+
+static void
+_vl_sift_box_sweep (vl_sift_pix *dst, vl_sift_pix const *src, int stride,
+                    int n, int h, _VlSiftBoxJob const *job,
+                    vl_sift_pix *work)
+{
+  int         r     = job->radius ;
+  int         m     = job->ringSize ;
+  float       alpha = (float) job->alpha ;
+  float       norm  = (float) (1.0 / (2 * r + 1 + 2 * job->alpha)) ;
+  float      *ring  = work + 3 * n ;
+  int t, k, x, i ;
+
+  /* row i of the input of box k */
+#define IN(k,i) ((k) == 0 ?                                           \
+    src + VL_MAX(0, VL_MIN((i), h - 1)) * stride :                    \
+    ring + ((k) - 1) * m * n + (VL_MAX(0, VL_MIN((i), h - 1)) & (m - 1)) * n)
+
+  /* at step t, box k filters row t - k (r + 1), as box k - 1 has
+     just filtered the last row it needs */
+  for (t = 0 ; t < h + 2 * (r + 1) ; ++t) {
+    for (k = 0 ; k < 3 ; ++k) {
+      int y = t - k * (r + 1) ;
+      float const *above, *top, *below ;
+      float *out, *sum = work + k * n ;
+      if (y < 0 || y >= h) continue ;
+
+      out = (k == 2) ? dst + y * stride : ring + k * m * n + (y & (m - 1)) * n ;
+      above = IN(k, y - r - 1) ;
+      top   = IN(k, y - r) ;
+      below = IN(k, y + r + 1) ;
+
+      if (y % VL_SIFT_BOX_REFRESH == 0) {
+        for (x = 0 ; x < n ; ++x) sum [x] = 0 ;
+        for (i = y - r ; i <= y + r ; ++i) {
+          float const *pt = IN(k, i) ;
+          for (x = 0 ; x < n ; ++x) sum [x] += pt [x] ;
+        }
+      }
+      for (x = 0 ; x < n ; ++x) {
+        out [x] = (sum [x] + alpha * (above [x] + below [x])) * norm ;
+        sum [x] += below [x] - top [x] ;
+      }
+    }
+  }
+#undef IN
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Filter the columns @a begin to @a end - 1 by the boxes
+ **/
+
+static void
+_vl_sift_box_cols (VlSiftFilt *f VL_UNUSED, void *data, int tid,
+                   int begin, int end)
+{
+  _VlSiftBoxJob const *job = data ;
+  _vl_sift_box_sweep (job->dst + begin, job->src + begin, (int) job->width,
+                      end - begin, (int) job->height, job,
+                      job->buffer + job->bufferSize * tid) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Filter the rows @a begin to @a end - 1 by the boxes
+ **
+ ** The rows are transposed ::VL_SIFT_BOX_STRIP at a time to a buffer
+ ** small enough to stay in cache, filtered as columns and transposed
+ ** back.
+ **/
+
+static void
+_vl_sift_box_rows (VlSiftFilt *f VL_UNUSED, void *data, int tid,
+                   int begin, int end)
+{
+  _VlSiftBoxJob const *job = data ;
+  int                  w   = (int) job->width ;
+  vl_sift_pix         *a   = job->buffer + job->bufferSize * tid ;
+  vl_sift_pix         *b   = a + w * VL_SIFT_BOX_STRIP ;
+  vl_sift_pix         *work = b + w * VL_SIFT_BOX_STRIP ;
+  int y0, x0, x, j ;
+
+  for (y0 = begin ; y0 < end ; y0 += VL_SIFT_BOX_STRIP) {
+    int n = VL_MIN(VL_SIFT_BOX_STRIP, end - y0) ;
+    vl_sift_pix const *src = job->src + y0 * w ;
+    vl_sift_pix       *dst = job->dst + y0 * w ;
+
+    /* transpose by blocks of 16 columns, which stay in cache */
+    for (x0 = 0 ; x0 < w ; x0 += 16) {
+      int x1 = VL_MIN(x0 + 16, w) ;
+      for (j = 0 ; j < n ; ++j) {
+        for (x = x0 ; x < x1 ; ++x) a [x * n + j] = src [j * w + x] ;
+      }
+    }
+    _vl_sift_box_sweep (b, a, n, n, w, job, work) ;
+    for (x0 = 0 ; x0 < w ; x0 += 16) {
+      int x1 = VL_MIN(x0 + 16, w) ;
+      for (j = 0 ; j < n ; ++j) {
+        for (x = x0 ; x < x1 ; ++x) dst [j * w + x] = b [x * n + j] ;
+      }
+    }
+  }
+}
+
 /** ------------------------------------------------------------------
  ** @internal
  ** @brief Smooth an image
@@ -792,6 +1172,32 @@ _vl_sift_smooth (VlSiftFilt * self,
                  vl_size height,
                  double sigma)
 {
+  _VlSiftSmoothJob job ;
+
+  if (self->approximate) {
+    _VlSiftBoxJob box ;
+
+    /* the work area of ::_vl_sift_box_sweep and the strips of rows */
+    _vl_sift_box_init (&box, sigma) ;
+    box.bufferSize = (3 + 2 * box.ringSize) * VL_MAX(width, VL_SIFT_BOX_STRIP)
+      + 2 * width * VL_SIFT_BOX_STRIP ;
+    box.buffer = vl_malloc (sizeof(vl_sift_pix) * box.bufferSize
+                            * self->numThreads) ;
+
+    box.dst    = tempImage ;
+    box.src    = inputImage ;
+    box.width  = width ;
+    box.height = height ;
+    _vl_sift_parallel_for (self, _vl_sift_box_cols, &box, width, 64, 4) ;
+
+    box.dst    = outputImage ;
+    box.src    = tempImage ;
+    _vl_sift_parallel_for (self, _vl_sift_box_rows, &box, height, 16, 1) ;
+
+    vl_free (box.buffer) ;
+    return ;
+  }
+
   /* prepare Gaussian filter */
   if (self->gaussFilterSigma != sigma) {
     vl_uindex j ;
@@ -816,17 +1222,18 @@ _vl_sift_smooth (VlSiftFilt * self,
     return ;
   }
 
-  vl_imconvcol_vf (tempImage, height,
-                   inputImage, width, height, width,
-                   self->gaussFilter,
-                   - self->gaussFilterWidth, self->gaussFilterWidth,
-                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
-
-  vl_imconvcol_vf (outputImage, width,
-                   tempImage, height, width, height,
-                   self->gaussFilter,
-                   - self->gaussFilterWidth, self->gaussFilterWidth,
-                   1, VL_PAD_BY_CONTINUITY | VL_TRANSPOSE) ;
+  /* bands start at multiples of four columns to keep SIMD alignment */
+  job.dst    = tempImage ;
+  job.src    = inputImage ;
+  job.width  = width ;
+  job.height = height ;
+  _vl_sift_parallel_for (self, _vl_sift_smooth_band, &job, width, 16, 4) ;
+
+  job.dst    = outputImage ;
+  job.src    = tempImage ;
+  job.width  = height ;
+  job.height = width ;
+  _vl_sift_parallel_for (self, _vl_sift_smooth_band, &job, height, 16, 4) ;
 }
 
 /** ------------------------------------------------------------------
@@ -864,6 +1271,311 @@ copy_and_downsample
   }
 }
 
+/* ---------------------------------------------------------------- */
+/*                                             Compact scale space */
+/* ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Round a float to half precision
+ **
+ ** The value is rounded to the nearest IEEE 754 half precision
+ ** number (ties to even). Values too large become infinities.
+ **/
+
+VL_INLINE vl_uint16
+_vl_sift_half_from_float (float x)
+{
+  union { float f ; vl_uint32 i ; } u, magic ;
+  vl_uint32 sign, h ;
+
+  u.f  = x ;
+  sign = u.i & 0x80000000u ;
+  u.i ^= sign ;
+
+  if (u.i >= 0x47800000u) {
+    /* infinity or NaN */
+    h = (u.i > 0x7f800000u) ? 0x7e00u : 0x7c00u ;
+  } else if (u.i < 0x38800000u) {
+    /* subnormal or zero: the addition rounds the mantissa */
+    magic.i = 0x3f000000u ;
+    u.f += magic.f ;
+    h = u.i - magic.i ;
+  } else {
+    /* normal: rebias the exponent and round the mantissa */
+    h = (u.i + 0xc8000fffu + ((u.i >> 13) & 1)) >> 13 ;
+  }
+  return (vl_uint16) (h | (sign >> 16)) ;
+}
+
+/** @internal @brief Convert a half precision number to a float */
+VL_INLINE float
+_vl_sift_float_from_half (vl_uint16 h)
+{
+  union { float f ; vl_uint32 i ; } u, magic ;
+  vl_uint32 e ;
+
+  u.i = (vl_uint32) (h & 0x7fffu) << 13 ;
+  e   = u.i & 0x0f800000u ;
+  u.i += 0x38000000u ;
+  if (e == 0x0f800000u) {
+    /* infinity or NaN */
+    u.i += 0x38000000u ;
+  } else if (e == 0) {
+    /* subnormal or zero */
+    magic.i = 0x38800000u ;
+    u.i += 0x00800000u ;
+    u.f -= magic.f ;
+  }
+  u.i |= (vl_uint32) (h & 0x8000u) << 16 ;
+  return u.f ;
+}
+
+/** @internal @brief Round @a n floats to half precision */
+static void
+_vl_sift_pack_half (vl_uint16 *dst, vl_sift_pix const *src, vl_size n)
+{
+  vl_size i = 0 ;
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    i = _vl_sift_pack_half_sse2 (dst, src, n) ;
+  }
+#endif
+  for ( ; i < n ; ++i) dst [i] = _vl_sift_half_from_float (src [i]) ;
+}
+
+/** @internal @brief Convert @a n half precision numbers to floats */
+static void
+_vl_sift_unpack_half (vl_sift_pix *dst, vl_uint16 const *src, vl_size n)
+{
+  vl_size i = 0 ;
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    i = _vl_sift_unpack_half_sse2 (dst, src, n) ;
+  }
+#endif
+  for ( ; i < n ; ++i) dst [i] = _vl_sift_float_from_half (src [i]) ;
+}
+
+/** @internal @brief Pixel @a i of level @a s of the current octave */
+VL_INLINE vl_sift_pix
+_vl_sift_octave_at (VlSiftFilt const *f, int s, vl_size i)
+{
+  vl_size so = (vl_size) f->octave_width * f->octave_height ;
+  if (f->compact) {
+    return _vl_sift_float_from_half (f->octaveHalf [so * (s - f->s_min) + i]) ;
+  }
+  return f->octave [so * (s - f->s_min) + i] ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Pixel of the base of the next octave
+ **
+ ** @param f  SIFT filter.
+ ** @param x  column in the current octave (even).
+ ** @param y  row in the current octave (even).
+ **
+ ** The value is the one ::vl_sift_process_next_octave starts from:
+ ** a compact filter reads the single precision copy downsampled by
+ ** ::_vl_sift_fill_octave, not the level rounded to half precision.
+ **/
+
+VL_INLINE vl_sift_pix
+_vl_sift_next_base_at (VlSiftFilt const *f, int x, int y)
+{
+  vl_size w = f->octave_width ;
+  if (f->compact) {
+    return f->work [2 * w * f->octave_height + (y / 2) * (w / 2) + x / 2] ;
+  }
+  return f->octave [w * f->octave_height * VL_MIN(f->S, f->s_max - f->s_min)
+                    + w * y + x] ;
+}
+
+/** @internal @brief Gradient modulus of pixel @a i of the gradient cache */
+VL_INLINE vl_sift_pix
+_vl_sift_grad_mod (VlSiftFilt const *f, vl_size i)
+{
+  if (f->compact) return _vl_sift_float_from_half (f->gradModHalf [i]) ;
+  return f->grad [2 * i] ;
+}
+
+/** @internal @brief Gradient angle of pixel @a i of the gradient cache */
+VL_INLINE vl_sift_pix
+_vl_sift_grad_angle (VlSiftFilt const *f, vl_size i)
+{
+  if (f->compact) return f->gradAngle [i] * (vl_sift_pix) (2 * VL_PI / 256) ;
+  return f->grad [2 * i + 1] ;
+}
+
+/** @internal @brief Level of the compact scale space to store */
+typedef struct _VlSiftStoreJob
+{
+  int s ;                   /**< level index. */
+  vl_sift_pix const *cur ;  /**< level @c s. */
+  vl_sift_pix const *prev ; /**< level @c s - 1 (or NULL). */
+} _VlSiftStoreJob ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Store rows @a begin to @a end - 1 of a level in half precision
+ **
+ ** The DoG of the level and of the previous one is computed in
+ ** single precision, through the same rows of @c f->temp, and stored
+ ** in half precision too.
+ **/
+
+static void
+_vl_sift_store_rows (VlSiftFilt *f, void *data, int tid VL_UNUSED,
+                     int begin, int end)
+{
+  _VlSiftStoreJob const *job = data ;
+  vl_size w  = f->octave_width ;
+  vl_size so = w * f->octave_height ;
+  int y ;
+
+  for (y = begin ; y < end ; ++y) {
+    vl_size i = w * y, x ;
+    _vl_sift_pack_half (f->octaveHalf + so * (job->s - f->s_min) + i,
+                        job->cur + i, w) ;
+    if (job->prev) {
+      vl_sift_pix *dog = f->temp + i ;
+      for (x = 0 ; x < w ; ++x) {
+        dog [x] = job->cur [i + x] - job->prev [i + x] ;
+      }
+      _vl_sift_pack_half (f->dogHalf + so * (job->s - 1 - f->s_min) + i,
+                          dog, w) ;
+    }
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the levels of the current octave from its base
+ **
+ ** @param f SIFT filter.
+ **
+ ** The base of the octave (level @c s_min) must be already computed,
+ ** in @c f->work if the filter is compact. A compact filter computes
+ ** each level in single precision in one of the first two levels of
+ ** @c f->work from the previous level in the other one, and stores
+ ** it and the DoG in half precision. The level which is the base of
+ ** the next octave is also downsampled after them, so that the
+ ** levels in single precision are the same as without compact
+ ** storage.
+ **/
+
+static void
+_vl_sift_fill_octave (VlSiftFilt *f)
+{
+  int w = f->octave_width ;
+  int h = f->octave_height ;
+  _VlSiftStoreJob job ;
+  int s ;
+
+  if (! f->compact) {
+    for(s = f->s_min + 1 ; s <= f->s_max ; ++s) {
+      double sd = f->dsigma0 * pow (f->sigmak, s) ;
+      _vl_sift_smooth (f, vl_sift_get_octave(f, s), f->temp,
+                       vl_sift_get_octave(f, s - 1), w, h, sd) ;
+    }
+    return ;
+  }
+
+  job.s    = f->s_min ;
+  job.cur  = f->work ;
+  job.prev = NULL ;
+  _vl_sift_parallel_for (f, _vl_sift_store_rows, &job, h, 16, 1) ;
+
+  for(s = f->s_min + 1 ; s <= f->s_max ; ++s) {
+    double sd = f->dsigma0 * pow (f->sigmak, s) ;
+    vl_sift_pix *cur = f->work + (vl_size) w * h * ((s - f->s_min) % 2) ;
+    _vl_sift_smooth (f, cur, f->temp, job.cur, w, h, sd) ;
+    job.s    = s ;
+    job.prev = job.cur ;
+    job.cur  = cur ;
+    _vl_sift_parallel_for (f, _vl_sift_store_rows, &job, h, 16, 1) ;
+    if (s == VL_MIN(f->s_min + f->S, f->s_max)) {
+      copy_and_downsample (f->work + (vl_size) 2 * w * h, cur, w, h, 1) ;
+    }
+  }
+}
+
+/** @internal @brief Free the scale space buffers of a filter */
+static void
+_vl_sift_free_buffers (VlSiftFilt *f)
+{
+  if (f->temp)         vl_free (f->temp) ;
+  if (f->octave)       vl_free (f->octave) ;
+  if (f->dog)          vl_free (f->dog) ;
+  if (f->grad)         vl_free (f->grad) ;
+  if (f->work)         vl_free (f->work) ;
+  if (f->octaveHalf)   vl_free (f->octaveHalf) ;
+  if (f->dogHalf)      vl_free (f->dogHalf) ;
+  if (f->gradModHalf)  vl_free (f->gradModHalf) ;
+  if (f->gradAngle)    vl_free (f->gradAngle) ;
+  if (f->gradTiles)    vl_free (f->gradTiles) ;
+  if (f->gradTileList) vl_free (f->gradTileList) ;
+  f->temp = f->octave = f->dog = f->grad = f->work = 0 ;
+  f->octaveHalf = f->dogHalf = f->gradModHalf = 0 ;
+  f->gradAngle = f->gradTiles = 0 ;
+  f->gradTileList = 0 ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Allocate the scale space buffers of a filter
+ **
+ ** @param f SIFT filter.
+ **
+ ** The buffers are sized for the first octave. A compact filter
+ ** stores the levels, the DoG and the gradient modulus in half
+ ** precision and the gradient angle in eight bits, and keeps two
+ ** levels and the base of the next octave in single precision in @c
+ ** f->work (see ::_vl_sift_fill_octave). Its gradient cache holds
+ ** only the levels @c s_min + 1 to @c s_max - 2 which have keypoints.
+ **
+ ** @return error code.
+ **/
+
+static int
+_vl_sift_alloc_buffers (VlSiftFilt *f)
+{
+  int w = VL_SHIFT_LEFT(f->width,  - f->o_min) ;
+  int h = VL_SHIFT_LEFT(f->height, - f->o_min) ;
+  int nlevels = f->s_max - f->s_min ;
+  vl_size nel = (vl_size) w * h ;
+  int ntiles = ((w + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE) *
+               ((h + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE) *
+               (nlevels - 2) ;
+  vl_bool ok ;
+
+  _vl_sift_free_buffers (f) ;
+  f-> temp         = vl_malloc (sizeof(vl_sift_pix) * nel) ;
+  f-> gradTiles    = vl_malloc (sizeof(vl_uint8) * ntiles) ;
+  f-> gradTileList = vl_malloc (sizeof(int) * ntiles) ;
+  if (f->compact) {
+    f-> work        = vl_malloc (sizeof(vl_sift_pix)
+                                 * (nel * 2 + nel / 4 + w)) ;
+    f-> octaveHalf  = vl_malloc (sizeof(vl_uint16) * nel * (nlevels + 1)) ;
+    f-> dogHalf     = vl_malloc (sizeof(vl_uint16) * nel * nlevels) ;
+    f-> gradModHalf = vl_malloc (sizeof(vl_uint16) * nel * (nlevels - 2)) ;
+    f-> gradAngle   = vl_malloc (sizeof(vl_uint8)  * nel * (nlevels - 2)) ;
+    ok = f->work && f->octaveHalf && f->dogHalf &&
+      f->gradModHalf && f->gradAngle ;
+  } else {
+    f-> octave      = vl_malloc (sizeof(vl_sift_pix) * nel * (nlevels + 1)) ;
+    f-> dog         = vl_malloc (sizeof(vl_sift_pix) * nel * nlevels) ;
+    f-> grad        = vl_malloc (sizeof(vl_sift_pix) * nel * 2 * nlevels) ;
+    ok = f->octave && f->dog && f->grad ;
+  }
+  if (! ok || ! f->temp || ! f->gradTiles || ! f->gradTileList) {
+    _vl_sift_free_buffers (f) ;
+    return VL_ERR_ALLOC ;
+  }
+  return VL_ERR_OK ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Create a new SIFT filter
  **
@@ -874,7 +1586,10 @@ copy_and_downsample
  ** @param o_min    first octave index.
  **
  ** The function allocates and returns a new SIFT filter for the
- ** specified image and scale space geometry.
+ ** specified image and scale space geometry. The scale space buffers
+ ** are allocated when the filter processes its first image, so that
+ ** a filter can also be used just to hold the parameters of
+ ** ::vl_sift_process_tiled().
  **
  ** Setting @a O to a negative value sets the number of octaves to the
  ** maximum possible value depending on the size of the image.
@@ -891,10 +1606,6 @@ vl_sift_new (int width, int height,
 {
   VlSiftFilt *f = vl_malloc (sizeof(VlSiftFilt)) ;
 
-  int w   = VL_SHIFT_LEFT (width,  -o_min) ;
-  int h   = VL_SHIFT_LEFT (height, -o_min) ;
-  int nel = w * h ;
-
   /* negative value O => calculate max. value */
   if (noctaves < 0) {
     noctaves = VL_MAX (floor (log2 (VL_MIN(width, height))) - o_min - 3, 1) ;
@@ -909,13 +1620,19 @@ vl_sift_new (int width, int height,
   f-> s_max   = nlevels + 1 ;
   f-> o_cur   = o_min ;
 
-  f-> temp    = vl_malloc (sizeof(vl_sift_pix) * nel    ) ;
-  f-> octave  = vl_malloc (sizeof(vl_sift_pix) * nel
-                        * (f->s_max - f->s_min + 1)  ) ;
-  f-> dog     = vl_malloc (sizeof(vl_sift_pix) * nel
-                        * (f->s_max - f->s_min    )  ) ;
-  f-> grad    = vl_malloc (sizeof(vl_sift_pix) * nel * 2
-                        * (f->s_max - f->s_min    )  ) ;
+  /* allocated by vl_sift_process_first_octave() */
+  f-> temp    = 0 ;
+  f-> octave  = 0 ;
+  f-> dog     = 0 ;
+  f-> grad    = 0 ;
+  f-> work         = 0 ;
+  f-> octaveHalf   = 0 ;
+  f-> dogHalf      = 0 ;
+  f-> gradModHalf  = 0 ;
+  f-> gradAngle    = 0 ;
+  f-> gradTiles    = 0 ;
+  f-> gradTileList = 0 ;
+  f-> numGradTiles = 0 ;
 
   f-> sigman  = 0.5 ;
   f-> sigmak  = pow (2.0, 1.0 / nlevels) ;
@@ -925,6 +1642,8 @@ vl_sift_new (int width, int height,
   f-> gaussFilter = NULL ;
   f-> gaussFilterSigma = 0 ;
   f-> gaussFilterWidth = 0 ;
+  f-> approximate      = VL_FALSE ;
+  f-> compact          = VL_FALSE ;
 
   f-> octave_width  = 0 ;
   f-> octave_height = 0 ;
@@ -941,6 +1660,12 @@ vl_sift_new (int width, int height,
 
   f-> grad_o  = o_min - 1 ;
 
+  f-> numThreads    = 1 ;
+  f-> threadKeys    = vl_calloc (VL_SIFT_MAX_THREADS, sizeof(VlSiftKeypoint*)) ;
+  f-> threadNumKeys = vl_calloc (VL_SIFT_MAX_THREADS, sizeof(int)) ;
+  f-> threadKeysRes = vl_calloc (VL_SIFT_MAX_THREADS, sizeof(int)) ;
+  f-> threadKeysFailed = vl_calloc (VL_SIFT_MAX_THREADS, sizeof(vl_bool)) ;
+
   /* initialize fast_expn stuff */
   fast_expn_init () ;
 
@@ -961,11 +1686,18 @@ vl_sift_delete (VlSiftFilt* f)
 {
   if (f) {
     if (f->keys) vl_free (f->keys) ;
-    if (f->grad) vl_free (f->grad) ;
-    if (f->dog) vl_free (f->dog) ;
-    if (f->octave) vl_free (f->octave) ;
-    if (f->temp) vl_free (f->temp) ;
+    _vl_sift_free_buffers (f) ;
     if (f->gaussFilter) vl_free (f->gaussFilter) ;
+    if (f->threadKeys) {
+      int t ;
+      for (t = 0 ; t < VL_SIFT_MAX_THREADS ; ++t) {
+        if (f->threadKeys [t]) vl_free (f->threadKeys [t]) ;
+      }
+      vl_free (f->threadKeys) ;
+    }
+    if (f->threadNumKeys) vl_free (f->threadNumKeys) ;
+    if (f->threadKeysRes) vl_free (f->threadKeysRes) ;
+    if (f->threadKeysFailed) vl_free (f->threadKeysFailed) ;
     vl_free (f) ;
   }
 }
@@ -981,7 +1713,8 @@ vl_sift_delete (VlSiftFilt* f)
  ** internal keypoint buffer.
  **
  ** @return error code. The function returns ::VL_ERR_EOF if there are
- ** no more octaves to process.
+ ** no more octaves to process and ::VL_ERR_ALLOC if the scale space
+ ** buffers cannot be allocated.
  **
  ** @sa ::vl_sift_process_next_octave().
  **/
@@ -990,25 +1723,26 @@ VL_EXPORT
 int
 vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
 {
-  int o, s, h, w ;
+  int o, h, w ;
   double sa, sb ;
   vl_sift_pix *octave ;
 
   /* shortcuts */
-  vl_sift_pix *temp   = f-> temp ;
+  vl_sift_pix *temp ;
   int width           = f-> width ;
   int height          = f-> height ;
   int o_min           = f-> o_min ;
   int s_min           = f-> s_min ;
-  int s_max           = f-> s_max ;
   double sigma0       = f-> sigma0 ;
   double sigmak       = f-> sigmak ;
   double sigman       = f-> sigman ;
-  double dsigma0      = f-> dsigma0 ;
 
   /* restart from the first */
   f->o_cur = o_min ;
   f->nkeys = 0 ;
+
+  /* the gradient of a previous image is stale */
+  f->grad_o = o_min - 1 ;
   w = f-> octave_width  = VL_SHIFT_LEFT(f->width,  - f->o_cur) ;
   h = f-> octave_height = VL_SHIFT_LEFT(f->height, - f->o_cur) ;
 
@@ -1016,6 +1750,12 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
   if (f->O == 0)
     return VL_ERR_EOF ;
 
+  /* allocate the buffers on first use, or when the storage changes */
+  if (f->compact ? ! f->octaveHalf : ! f->octave) {
+    if (_vl_sift_alloc_buffers (f)) return VL_ERR_ALLOC ;
+  }
+  temp = f-> temp ;
+
   /* ------------------------------------------------------------------
    *                     Compute the first sublevel of the first octave
    * --------------------------------------------------------------- */
@@ -1026,7 +1766,7 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
    * the first octave has index zero, we just copy the image.
    */
 
-  octave = vl_sift_get_octave (f, s_min) ;
+  octave = f->compact ? f->work : vl_sift_get_octave (f, s_min) ;
 
   if (o_min < 0) {
     /* double once */
@@ -1068,11 +1808,7 @@ vl_sift_process_first_octave (VlSiftFilt *f, vl_sift_pix const *im)
    *                                          Compute the first octave
    * -------------------------------------------------------------- */
 
-  for(s = s_min + 1 ; s <= s_max ; ++s) {
-    double sd = dsigma0 * pow (sigmak, s) ;
-    _vl_sift_smooth (f, vl_sift_get_octave(f, s), temp,
-                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
-  }
+  _vl_sift_fill_octave (f) ;
 
   return VL_ERR_OK ;
 }
@@ -1097,7 +1833,7 @@ int
 vl_sift_process_next_octave (VlSiftFilt *f)
 {
 
-  int s, h, w, s_best ;
+  int h, w, s_best ;
   double sa, sb ;
   vl_sift_pix *octave, *pt ;
 
@@ -1110,7 +1846,6 @@ vl_sift_process_next_octave (VlSiftFilt *f)
   int s_max           = f-> s_max ;
   double sigma0       = f-> sigma0 ;
   double sigmak       = f-> sigmak ;
-  double dsigma0      = f-> dsigma0 ;
 
   /* is there another octave ? */
   if (f->o_cur == o_min + O - 1)
@@ -1123,8 +1858,14 @@ vl_sift_process_next_octave (VlSiftFilt *f)
   pt     = vl_sift_get_octave        (f, s_best) ;
   octave = vl_sift_get_octave        (f, s_min) ;
 
-  /* next octave */
-  copy_and_downsample (octave, pt, w, h, 1) ;
+  /* next octave, already downsampled by a compact filter */
+  if (f->compact) {
+    octave = f->work ;
+    memcpy (octave, octave + (vl_size) 2 * w * h,
+            sizeof(vl_sift_pix) * (w / 2) * (h / 2)) ;
+  } else {
+    copy_and_downsample (octave, pt, w, h, 1) ;
+  }
 
   f-> o_cur            += 1 ;
   f-> nkeys             = 0 ;
@@ -1143,146 +1884,261 @@ vl_sift_process_next_octave (VlSiftFilt *f)
    *                                                        Fill octave
    * --------------------------------------------------------------- */
 
-  for(s = s_min + 1 ; s <= s_max ; ++s) {
-    double sd = dsigma0 * pow (sigmak, s) ;
-    _vl_sift_smooth (f, vl_sift_get_octave(f, s), temp,
-                     vl_sift_get_octave(f, s - 1), w, h, sd) ;
-  }
+  _vl_sift_fill_octave (f) ;
 
   return VL_ERR_OK ;
 }
 
+/** @internal @brief Compute the DoG rows @a begin to @a end - 1 */
+static void
+_vl_sift_dog_rows (VlSiftFilt *f, void *data VL_UNUSED, int tid VL_UNUSED,
+                   int begin, int end)
+{
+  int                w     = f-> octave_width ;
+  int                so    = w * f-> octave_height ;
+  vl_sift_pix const *src_a = vl_sift_get_octave (f, f->s_min) + begin * w ;
+  vl_sift_pix const *end_a = vl_sift_get_octave (f, f->s_min) + end   * w ;
+  vl_sift_pix       *pt    = f-> dog + begin * w ;
+  vl_size            n     = 0 ;
+
+  /* the levels are contiguous, level s + 1 is so elements after s */
+#ifndef VL_DISABLE_AVX2
+  if (vl_cpu_has_avx2() && vl_get_simd_enabled()) {
+    n = _vl_sift_dog_avx2 (pt, src_a, end_a - src_a, so) ;
+  }
+#endif
+#ifndef VL_DISABLE_SSE2
+  if (n == 0 && vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    n = _vl_sift_dog_sse2 (pt, src_a, end_a - src_a, so) ;
+  }
+#endif
+  src_a += n ;
+  pt    += n ;
+
+  while (src_a != end_a) {
+    *pt++ = src_a [so] - *src_a ;
+    ++ src_a ;
+  }
+}
+
 /** ------------------------------------------------------------------
- ** @brief Detect keypoints
+ ** @internal
+ ** @brief Find the local extrema of a run of pixels of a DoG row
  **
- ** The function detect keypoints in the current octave filling the
- ** internal keypoint buffer. Keypoints can be retrieved by
- ** ::vl_sift_get_keypoints().
+ ** @param f       SIFT filter.
+ ** @param tid     thread.
+ ** @param extrema SIMD kernel (or NULL).
+ ** @param pt      DoG at pixel (@a x, @a y, @a s).
+ ** @param yo      y-stride of @a pt.
+ ** @param so      s-stride of @a pt.
+ ** @param x       first pixel.
+ ** @param x1      last pixel (excluded).
+ ** @param y       row.
+ ** @param s       level.
+ ** @param tpf     threshold of the SIMD kernel.
  **
- ** @param f SIFT filter.
+ ** With SIMD enabled, the pixels are tested in runs of 64 by @a
+ ** extrema and only the extrema are visited. The remaining pixels and
+ ** the ones on machines without SIMD are tested one at a time.
  **/
 
-VL_EXPORT
-void
-vl_sift_detect (VlSiftFilt * f)
+typedef vl_size (*VlSiftExtremaFunction)
+  (vl_uint64 *mask, float const *pt, vl_size n, int yo, int so, float tp) ;
+
+static void
+_vl_sift_scan_run (VlSiftFilt *f, int tid, VlSiftExtremaFunction extrema,
+                   vl_sift_pix const *pt, int yo, int so,
+                   int x, int x1, int y, int s, float tpf)
+{
+  double    tp = f-> peak_thresh ;
+  int const xo = 1 ;
+
+  while (extrema && x < x1) {
+    vl_uint64 mask ;
+    vl_size n = extrema (&mask, pt, x1 - x, yo, so, tpf) ;
+    int i ;
+    if (n == 0) break ;
+    for (i = 0 ; mask ; ++i, mask >>= 1) {
+      if (mask & 1) {
+        VlSiftKeypoint *k = _vl_sift_thread_push_key (f, tid) ;
+        if (! k) return ;
+        k-> ix = x + i ;
+        k-> iy = y ;
+        k-> is = s ;
+      }
+    }
+    pt += n ;
+    x  += n ;
+  }
+
+  for ( ; x < x1 ; ++x) {
+    vl_sift_pix v = *pt ;
+
+#define CHECK_NEIGHBORS(CMP,SGN)                    \
+    ( v CMP ## = SGN 0.8 * tp &&                \
+      v CMP *(pt + xo) &&                       \
+      v CMP *(pt - xo) &&                       \
+      v CMP *(pt + so) &&                       \
+      v CMP *(pt - so) &&                       \
+      v CMP *(pt + yo) &&                       \
+      v CMP *(pt - yo) &&                       \
+                                                \
+      v CMP *(pt + yo + xo) &&                  \
+      v CMP *(pt + yo - xo) &&                  \
+      v CMP *(pt - yo + xo) &&                  \
+      v CMP *(pt - yo - xo) &&                  \
+                                                \
+      v CMP *(pt + xo      + so) &&             \
+      v CMP *(pt - xo      + so) &&             \
+      v CMP *(pt + yo      + so) &&             \
+      v CMP *(pt - yo      + so) &&             \
+      v CMP *(pt + yo + xo + so) &&             \
+      v CMP *(pt + yo - xo + so) &&             \
+      v CMP *(pt - yo + xo + so) &&             \
+      v CMP *(pt - yo - xo + so) &&             \
+                                                \
+      v CMP *(pt + xo      - so) &&             \
+      v CMP *(pt - xo      - so) &&             \
+      v CMP *(pt + yo      - so) &&             \
+      v CMP *(pt - yo      - so) &&             \
+      v CMP *(pt + yo + xo - so) &&             \
+      v CMP *(pt + yo - xo - so) &&             \
+      v CMP *(pt - yo + xo - so) &&             \
+      v CMP *(pt - yo - xo - so) )
+
+    if (CHECK_NEIGHBORS(>,+) ||
+        CHECK_NEIGHBORS(<,-) ) {
+      VlSiftKeypoint *k = _vl_sift_thread_push_key (f, tid) ;
+      if (! k) return ;
+      k-> ix = x ;
+      k-> iy = y ;
+      k-> is = s ;
+    }
+    pt += 1 ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Find the local extrema of the DoG rows @a begin to @a end - 1
+ **
+ ** Rows are numbered level by level, skipping the first and last
+ ** level of the DoG and the first and last row of each level. A
+ ** compact filter converts the DoG around runs of
+ ** ::VL_SIFT_SCAN_RUN pixels to single precision, on the stack, and
+ ** scans them as the DoG of other filters.
+ **/
+
+static void
+_vl_sift_scan_rows (VlSiftFilt *f, void *data VL_UNUSED, int tid,
+                    int begin, int end)
 {
-  vl_sift_pix* dog   = f-> dog ;
-  int          s_min = f-> s_min ;
-  int          s_max = f-> s_max ;
   int          w     = f-> octave_width ;
   int          h     = f-> octave_height ;
-  double       te    = f-> edge_thresh ;
   double       tp    = f-> peak_thresh ;
 
   int const    xo    = 1 ;      /* x-stride */
   int const    yo    = w ;      /* y-stride */
   int const    so    = w * h ;  /* s-stride */
 
-  double       xper  = pow (2.0, f->o_cur) ;
+  VlSiftExtremaFunction extrema = 0 ;
+  union { float f ; vl_uint32 i ; } tpf ;
+  int r, x ;
 
-  int x, y, s, i, ii, jj ;
-  vl_sift_pix *pt, v ;
-  VlSiftKeypoint *k ;
-
-  /* clear current list */
-  f-> nkeys = 0 ;
+  /* the kernels compare in single precision: use the smallest float
+     not below 0.8 * tp, which selects the same pixels */
+  tpf.f = (float) (0.8 * tp) ;
+  if (tpf.f < 0.8 * tp) tpf.i += (tpf.f < 0) ? -1 : +1 ;
 
-  /* compute difference of gaussian (DoG) */
-  pt = f-> dog ;
-  for (s = s_min ; s <= s_max - 1 ; ++s) {
-    vl_sift_pix* src_a = vl_sift_get_octave (f, s    ) ;
-    vl_sift_pix* src_b = vl_sift_get_octave (f, s + 1) ;
-    vl_sift_pix* end_a = src_a + w * h ;
-    while (src_a != end_a) {
-      *pt++ = *src_b++ - *src_a++ ;
-    }
+#ifndef VL_DISABLE_AVX2
+  if (vl_cpu_has_avx2() && vl_get_simd_enabled()) {
+    extrema = _vl_sift_extrema_avx2 ;
   }
+#endif
+#ifndef VL_DISABLE_SSE2
+  if (! extrema && vl_cpu_has_sse2() && vl_get_simd_enabled()) {
+    extrema = _vl_sift_extrema_sse2 ;
+  }
+#endif
 
-  /* -----------------------------------------------------------------
-   *                                          Find local maxima of DoG
-   * -------------------------------------------------------------- */
-
-  /* start from dog [1,1,s_min+1] */
-  pt  = dog + xo + yo + so ;
-
-  for(s = s_min + 1 ; s <= s_max - 2 ; ++s) {
-    for(y = 1 ; y < h - 1 ; ++y) {
-      for(x = 1 ; x < w - 1 ; ++x) {
-        v = *pt ;
+  for (r = begin ; r < end ; ++r) {
+    int s = f->s_min + 1 + r / (h - 2) ;
+    int y = 1 + r % (h - 2) ;
 
-#define CHECK_NEIGHBORS(CMP,SGN)                    \
-        ( v CMP ## = SGN 0.8 * tp &&                \
-          v CMP *(pt + xo) &&                       \
-          v CMP *(pt - xo) &&                       \
-          v CMP *(pt + so) &&                       \
-          v CMP *(pt - so) &&                       \
-          v CMP *(pt + yo) &&                       \
-          v CMP *(pt - yo) &&                       \
-                                                    \
-          v CMP *(pt + yo + xo) &&                  \
-          v CMP *(pt + yo - xo) &&                  \
-          v CMP *(pt - yo + xo) &&                  \
-          v CMP *(pt - yo - xo) &&                  \
-                                                    \
-          v CMP *(pt + xo      + so) &&             \
-          v CMP *(pt - xo      + so) &&             \
-          v CMP *(pt + yo      + so) &&             \
-          v CMP *(pt - yo      + so) &&             \
-          v CMP *(pt + yo + xo + so) &&             \
-          v CMP *(pt + yo - xo + so) &&             \
-          v CMP *(pt - yo + xo + so) &&             \
-          v CMP *(pt - yo - xo + so) &&             \
-                                                    \
-          v CMP *(pt + xo      - so) &&             \
-          v CMP *(pt - xo      - so) &&             \
-          v CMP *(pt + yo      - so) &&             \
-          v CMP *(pt - yo      - so) &&             \
-          v CMP *(pt + yo + xo - so) &&             \
-          v CMP *(pt + yo - xo - so) &&             \
-          v CMP *(pt - yo + xo - so) &&             \
-          v CMP *(pt - yo - xo - so) )
-
-        if (CHECK_NEIGHBORS(>,+) ||
-            CHECK_NEIGHBORS(<,-) ) {
-
-          /* make room for more keypoints */
-          if (f->nkeys >= f->keys_res) {
-            f->keys_res += 500 ;
-            if (f->keys) {
-              f->keys = vl_realloc (f->keys,
-                                    f->keys_res *
-                                    sizeof(VlSiftKeypoint)) ;
-            } else {
-              f->keys = vl_malloc (f->keys_res *
-                                   sizeof(VlSiftKeypoint)) ;
-            }
-          }
+    if (! f->compact) {
+      _vl_sift_scan_run (f, tid, extrema,
+                         f->dog + xo + yo * y + so * (s - f->s_min),
+                         yo, so, 1, w - 1, y, s, tpf.f) ;
+      continue ;
+    }
 
-          k = f->keys + (f->nkeys ++) ;
+    for (x = 1 ; x < w - 1 ; x += VL_SIFT_SCAN_RUN) {
+      int const ryo = VL_SIFT_SCAN_RUN + 2 ;
+      vl_sift_pix rows [9 * (VL_SIFT_SCAN_RUN + 2)] ;
+      int n = VL_MIN(VL_SIFT_SCAN_RUN, w - 1 - x) ;
+      int k ;
+      for (k = 0 ; k < 9 ; ++k) {
+        int ds = k / 3 - 1 ;
+        int dy = k % 3 - 1 ;
+        _vl_sift_unpack_half (rows + ryo * k, f->dogHalf + (x - 1)
+                              + yo * (y + dy) + so * (s + ds - f->s_min),
+                              n + 2) ;
+      }
+      _vl_sift_scan_run (f, tid, extrema, rows + 4 * ryo + 1,
+                         ryo, 3 * ryo, x, x + n, y, s, tpf.f) ;
+    }
+  }
+}
 
-          k-> ix = x ;
-          k-> iy = y ;
-          k-> is = s ;
-        }
-        pt += 1 ;
+/** @internal @brief Copy the 3x3x3 DoG neighbourhood of a pixel */
+static void
+_vl_sift_dog_neighbors (VlSiftFilt const *f, int x, int y, int s,
+                        vl_sift_pix nb [27])
+{
+  vl_size w  = f->octave_width ;
+  vl_size so = w * f->octave_height ;
+  int ds, dy, dx ;
+
+  for (ds = -1 ; ds <= 1 ; ++ds) {
+    for (dy = -1 ; dy <= 1 ; ++dy) {
+      vl_size i = so * (s + ds - f->s_min) + w * (y + dy) + (x - 1) ;
+      for (dx = 0 ; dx < 3 ; ++dx) {
+        *nb++ = f->compact ?
+          _vl_sift_float_from_half (f->dogHalf [i + dx]) : f->dog [i + dx] ;
       }
-      pt += 2 ;
     }
-    pt += 2 * yo ;
   }
+}
 
-  /* -----------------------------------------------------------------
-   *                                               Refine local maxima
-   * -------------------------------------------------------------- */
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Refine the local extrema @a begin to @a end - 1
+ **
+ ** The extrema are read from the keypoint buffer of the filter and
+ ** the good ones appended, refined, to the buffer of thread @a tid.
+ **/
 
-  /* this pointer is used to write the keypoints back */
-  k = f->keys ;
+static void
+_vl_sift_refine_keys (VlSiftFilt *f, void *data VL_UNUSED, int tid,
+                      int begin, int end)
+{
+  int          s_min = f-> s_min ;
+  int          s_max = f-> s_max ;
+  int          w     = f-> octave_width ;
+  int          h     = f-> octave_height ;
+  double       te    = f-> edge_thresh ;
+  double       tp    = f-> peak_thresh ;
+
+  double       xper  = pow (2.0, f->o_cur) ;
+
+  vl_sift_pix  nb [27] ;
+  int k ;
 
-  for (i = 0 ; i < f->nkeys ; ++i) {
+  for (k = begin ; k < end ; ++k) {
 
-    int x = f-> keys [i] .ix ;
-    int y = f-> keys [i] .iy ;
-    int s = f-> keys [i]. is ;
+    int x = f-> keys [k] .ix ;
+    int y = f-> keys [k] .iy ;
+    int s = f-> keys [k]. is ;
 
     double Dx=0,Dy=0,Ds=0,Dxx=0,Dyy=0,Dss=0,Dxy=0,Dxs=0,Dys=0 ;
     double A [3*3], b [3] ;
@@ -1290,20 +2146,17 @@ vl_sift_detect (VlSiftFilt * f)
     int dx = 0 ;
     int dy = 0 ;
 
-    int iter, i, j ;
+    int iter, i, j, ii, jj ;
 
     for (iter = 0 ; iter < 5 ; ++iter) {
 
       x += dx ;
       y += dy ;
 
-      pt = dog
-        + xo * x
-        + yo * y
-        + so * (s - s_min) ;
+      _vl_sift_dog_neighbors (f, x, y, s, nb) ;
 
       /** @brief Index GSS @internal */
-#define at(dx,dy,ds) (*( pt + (dx)*xo + (dy)*yo + (ds)*so))
+#define at(dx,dy,ds) (nb [(dx) + 1 + 3 * ((dy) + 1) + 9 * ((ds) + 1)])
 
       /** @brief Index matrix A @internal */
 #define Aat(i,j)     (A[(i)+(j)*3])
@@ -1426,6 +2279,8 @@ vl_sift_detect (VlSiftFilt * f)
         sn              <= s_max ;
 
       if (good) {
+        VlSiftKeypoint *k = _vl_sift_thread_push_key (f, tid) ;
+        if (! k) return ;
         k-> o     = f->o_cur ;
         k-> ix    = x ;
         k-> iy    = y ;
@@ -1434,114 +2289,352 @@ vl_sift_detect (VlSiftFilt * f)
         k-> x     = xn * xper ;
         k-> y     = yn * xper ;
         k-> sigma = f->sigma0 * pow (2.0, sn/f->S) * xper ;
-        ++ k ;
       }
 
     } /* done checking */
   } /* next keypoint to refine */
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Detect keypoints
+ **
+ ** The function detect keypoints in the current octave filling the
+ ** internal keypoint buffer. Keypoints can be retrieved by
+ ** ::vl_sift_get_keypoints().
+ **
+ ** @param f SIFT filter.
+ ** @return error code: ::VL_ERR_ALLOC if the keypoints could not be
+ ** stored, in which case the filter has none.
+ **
+ ** The DoG, the search of its extrema and their refinement are split
+ ** among the threads of the filter (::vl_sift_set_num_threads). The
+ ** keypoints are found in the same order for any number of threads.
+ **/
+
+VL_EXPORT
+int
+vl_sift_detect (VlSiftFilt * f)
+{
+  int h = f-> octave_height ;
+  int nlevels = f-> s_max - f-> s_min ;
+  int t, numThreads, err ;
 
-  /* update keypoint count */
-  f-> nkeys = k - f->keys ;
+  /* clear current list */
+  f-> nkeys = 0 ;
+
+  /* compute difference of gaussian (DoG), which a compact filter
+     stores with the levels */
+  if (! f->compact) {
+    _vl_sift_parallel_for (f, _vl_sift_dog_rows, NULL, nlevels * h, 16, 1) ;
+  }
+
+  /* -----------------------------------------------------------------
+   *                                          Find local maxima of DoG
+   * -------------------------------------------------------------- */
+
+  for (t = 0 ; t < VL_SIFT_MAX_THREADS ; ++t) {
+    f->threadNumKeys [t] = 0 ;
+    f->threadKeysFailed [t] = VL_FALSE ;
+  }
+  numThreads = _vl_sift_parallel_for (f, _vl_sift_scan_rows, NULL,
+                                      (nlevels - 2) * VL_MAX(h - 2, 0),
+                                      8, 1) ;
+  err = _vl_sift_gather_keys (f, numThreads) ;
+  if (err) return err ;
+
+  /* -----------------------------------------------------------------
+   *                                               Refine local maxima
+   * -------------------------------------------------------------- */
+
+  for (t = 0 ; t < VL_SIFT_MAX_THREADS ; ++t) f->threadNumKeys [t] = 0 ;
+  numThreads = _vl_sift_parallel_for (f, _vl_sift_refine_keys, NULL,
+                                      f->nkeys, 32, 1) ;
+  return _vl_sift_gather_keys (f, numThreads) ;
 }
 
 
 /** ------------------------------------------------------------------
  ** @internal
- ** @brief Update gradients to current GSS octave
- **
- ** @param f SIFT filter.
+ ** @brief Compute the gradient of part of a row of the GSS
  **
- ** The function makes sure that the gradient buffer is up-to-date
- ** with the current GSS data.
+ ** @param f  SIFT filter.
+ ** @param s  level.
+ ** @param y  row.
+ ** @param x0 first column.
+ ** @param x1 last column (excluded).
  **
- ** @remark The minimum octave size is 2x2xS.
+ ** A compact filter converts the rows around the current one to
+ ** single precision and the gradient back to half precision, on the
+ ** stack, so that @a x1 - @a x0 must not exceed ::VL_SIFT_GRAD_TILE.
  **/
 
 static void
-update_gradient (VlSiftFilt *f)
+_vl_sift_gradient_row (VlSiftFilt *f, int s, int y, int x0, int x1)
 {
-  int       s_min = f->s_min ;
-  int       s_max = f->s_max ;
   int       w     = vl_sift_get_octave_width  (f) ;
   int       h     = vl_sift_get_octave_height (f) ;
   int const xo    = 1 ;
-  int const yo    = w ;
+  int const yo    = f->compact ? VL_SIFT_GRAD_TILE + 2 : w ;
   int const so    = h * w ;
-  int y, s ;
-
-  if (f->grad_o == f->o_cur) return ;
 
-  for (s  = s_min + 1 ;
-       s <= s_max - 2 ; ++ s) {
-
-    vl_sift_pix *src, *end, *grad, gx, gy ;
+  /* one-sided differences on the first and last row */
+  int    up = (y > 0)     ? -yo : 0 ;
+  int    dn = (y < h - 1) ? +yo : 0 ;
+  double ky = (up && dn)  ? 0.5 : 1.0 ;
+
+  vl_sift_pix rows [3 * (VL_SIFT_GRAD_TILE + 2)] ;
+  vl_sift_pix cache [2 * VL_SIFT_GRAD_TILE] ;
+  vl_sift_pix *src, *grad, gx, gy ;
+  int x = x0 ;
+
+  if (f->compact) {
+    /* rows y - 1 to y + 1 from column x0 - 1 to x1 */
+    int xa = VL_MAX(x0 - 1, 0) ;
+    int n  = VL_MIN(x1 + 1, w) - xa ;
+    int dy ;
+    for (dy = (up ? -1 : 0) ; dy <= (dn ? 1 : 0) ; ++dy) {
+      _vl_sift_unpack_half (rows + yo * (dy + 1), f->octaveHalf
+                            + (vl_size) so * (s - f->s_min)
+                            + (vl_size) w * (y + dy) + xa, n) ;
+    }
+    src  = rows + yo + (x0 - xa) ;
+    grad = cache ;
+  } else {
+    src  = vl_sift_get_octave (f,s) + yo * y + x0 ;
+    grad = f->grad + 2 * so * (s - f->s_min -1) + 2 * (yo * y + x0) ;
+  }
 
 #define SAVE_BACK                                                       \
-    *grad++ = vl_fast_sqrt_f (gx*gx + gy*gy) ;                          \
-    *grad++ = vl_mod_2pi_f   (vl_fast_atan2_f (gy, gx) + 2*VL_PI) ;     \
-    ++src ;                                                             \
+  *grad++ = vl_fast_sqrt_f (gx*gx + gy*gy) ;                            \
+  *grad++ = vl_mod_2pi_f   (vl_fast_atan2_f (gy, gx) + 2*VL_PI) ;       \
+  ++src ;                                                               \
+  ++x ;                                                                 \
 
-    src  = vl_sift_get_octave (f,s) ;
-    grad = f->grad + 2 * so * (s - s_min -1) ;
-
-    /* first pixel of the first row */
+  /* first pixel */
+  if (x == 0 && x < x1) {
     gx = src[+xo] - src[0] ;
-    gy = src[+yo] - src[0] ;
+    gy = ky * (src[dn] - src[up]) ;
     SAVE_BACK ;
+  }
 
-    /* middle pixels of the  first row */
-    end = (src - 1) + w - 1 ;
-    while (src < end) {
-      gx = 0.5 * (src[+xo] - src[-xo]) ;
-      gy =        src[+yo] - src[0] ;
-      SAVE_BACK ;
-    }
+  /* middle pixels */
+#ifndef VL_DISABLE_SSE2
+  if (vl_cpu_has_sse2() && vl_get_simd_enabled() && x < VL_MIN(x1, w - 1)) {
+    vl_size n = _vl_sift_gradient_sse2 (grad, src, VL_MIN(x1, w - 1) - x,
+                                        up, dn, (float) ky) ;
+    grad += 2 * n ;
+    src  += n ;
+    x    += n ;
+  }
+#endif
+  while (x < VL_MIN(x1, w - 1)) {
+    gx = 0.5 * (src[+xo] - src[-xo]) ;
+    gy = ky  * (src[dn]  - src[up]) ;
+    SAVE_BACK ;
+  }
 
-    /* last pixel of the first row */
-    gx = src[0]   - src[-xo] ;
-    gy = src[+yo] - src[0] ;
+  /* last pixel */
+  if (x == w - 1 && x < x1) {
+    gx = src[0] - src[-xo] ;
+    gy = ky * (src[dn] - src[up]) ;
     SAVE_BACK ;
+  }
+#undef SAVE_BACK
+
+  /* modulus in half precision and angle in 256 steps */
+  if (f->compact) {
+    vl_size i = (vl_size) so * (s - f->s_min - 1) + (vl_size) w * y ;
+    for (x = x0 ; x < x1 ; ++x) {
+      vl_sift_pix ang = cache [2 * (x - x0) + 1] ;
+      f->gradModHalf [i + x] = _vl_sift_half_from_float (cache [2 * (x - x0)]) ;
+      f->gradAngle   [i + x] = (vl_uint8)
+        ((int) (ang * (vl_sift_pix) (256 / (2 * VL_PI)) + 0.5F) & 0xff) ;
+    }
+  }
+}
 
-    for (y = 1 ; y < h -1 ; ++y) {
+/** @internal @brief Number of tiles of the gradient cache along x and y */
+static void
+_vl_sift_gradient_grid (VlSiftFilt const *f, int *ntx, int *nty)
+{
+  *ntx = (f->octave_width  + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE ;
+  *nty = (f->octave_height + VL_SIFT_GRAD_TILE - 1) / VL_SIFT_GRAD_TILE ;
+}
 
-      /* first pixel of the middle rows */
-      gx =        src[+xo] - src[0] ;
-      gy = 0.5 * (src[+yo] - src[-yo]) ;
-      SAVE_BACK ;
+/** @internal @brief Compute the gradient of a tile of the current octave */
+static void
+_vl_sift_gradient_tile (VlSiftFilt *f, int t)
+{
+  int ntx, nty, tx, ty, s, y, x0, x1, y1 ;
+  _vl_sift_gradient_grid (f, &ntx, &nty) ;
+  tx = t % ntx ;
+  ty = (t / ntx) % nty ;
+  s  = t / (ntx * nty) + f->s_min + 1 ;
+  x0 = tx * VL_SIFT_GRAD_TILE ;
+  x1 = VL_MIN(x0 + VL_SIFT_GRAD_TILE, f->octave_width) ;
+  y1 = VL_MIN((ty + 1) * VL_SIFT_GRAD_TILE, f->octave_height) ;
+  for (y = ty * VL_SIFT_GRAD_TILE ; y < y1 ; ++y) {
+    _vl_sift_gradient_row (f, s, y, x0, x1) ;
+  }
+}
 
-      /* middle pixels of the middle rows */
-      end = (src - 1) + w - 1 ;
-      while (src < end) {
-        gx = 0.5 * (src[+xo] - src[-xo]) ;
-        gy = 0.5 * (src[+yo] - src[-yo]) ;
-        SAVE_BACK ;
-      }
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Forget the gradient of another octave
+ **
+ ** @param f SIFT filter.
+ **
+ ** The gradient is computed lazily, by tiles of
+ ** ::VL_SIFT_GRAD_TILE x ::VL_SIFT_GRAD_TILE pixels of a level, when
+ ** a keypoint window first needs them. @c f->gradTiles marks the
+ ** tiles of the current octave which are computed (one) or about to
+ ** be computed (two). The function clears the marks if they refer to
+ ** another octave.
+ **
+ ** @remark The minimum octave size is 2x2xS.
+ **/
 
-      /* last pixel of the middle row */
-      gx =        src[0]   - src[-xo] ;
-      gy = 0.5 * (src[+yo] - src[-yo]) ;
-      SAVE_BACK ;
-    }
+static void
+_vl_sift_sync_gradient (VlSiftFilt *f)
+{
+  int ntx, nty ;
+  if (f->grad_o == f->o_cur) return ;
+  _vl_sift_gradient_grid (f, &ntx, &nty) ;
+  memset (f->gradTiles, 0, ntx * nty * (f->s_max - f->s_min - 2)) ;
+  f->grad_o = f->o_cur ;
+}
 
-    /* first pixel of the last row */
-    gx = src[+xo] - src[0] ;
-    gy = src[  0] - src[-yo] ;
-    SAVE_BACK ;
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Gradient window of a keypoint
+ **
+ ** @param f          SIFT filter.
+ ** @param k          keypoint.
+ ** @param descriptor window of the descriptor (or of the orientations).
+ ** @param box        window @c x0, @c y0, @c x1, @c y1 (output).
+ **
+ ** The function computes the rectangle of pixels (inclusive) of level
+ ** @c k->is that ::vl_sift_calc_keypoint_descriptor (or
+ ** ::vl_sift_calc_keypoint_orientations) reads from the gradient.
+ **
+ ** @return false if the keypoint is skipped.
+ **/
+
+static vl_bool
+_vl_sift_gradient_window (VlSiftFilt const *f, VlSiftKeypoint const *k,
+                          vl_bool descriptor, int box [4])
+{
+  double xper  = pow (2.0, f->o_cur) ;
+  int    w     = f->octave_width ;
+  int    h     = f->octave_height ;
+  double sigma = k->sigma / xper ;
+  int    xi    = (int) (k->x / xper + 0.5) ;
+  int    yi    = (int) (k->y / xper + 0.5) ;
+  int    W ;
+
+  if (k->o != f->o_cur ||
+      xi < 0 || xi > w - 1 || yi < 0 || yi > h - 1 ||
+      k->is < f->s_min + 1 || k->is > f->s_max - 2) {
+    return VL_FALSE ;
+  }
+
+  /* as in vl_sift_calc_keypoint_descriptor() and
+     vl_sift_calc_keypoint_orientations() */
+  if (descriptor) {
+    double const SBP = f->magnif * sigma + VL_EPSILON_D ;
+    W = floor (sqrt(2.0) * SBP * (NBP + 1) / 2.0 + 0.5) ;
+  } else {
+    double const sigmaw = 1.5 * sigma ;
+    W = VL_MAX(floor (3.0 * sigmaw), 1) ;
+  }
+
+  box [0] = VL_MAX(xi - W, 0) ;
+  box [1] = VL_MAX(yi - W, 0) ;
+  box [2] = VL_MIN(xi + W, w - 1) ;
+  box [3] = VL_MIN(yi + W, h - 1) ;
+  return VL_TRUE ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Mark or compute the gradient tiles of a keypoint window
+ **
+ ** @param f          SIFT filter.
+ ** @param k          keypoint.
+ ** @param descriptor window of the descriptor (or of the orientations).
+ ** @param schedule   only mark the missing tiles (with two).
+ **
+ ** The missing tiles are either computed or marked and added to @c
+ ** f->gradTileList, to be computed by ::_vl_sift_gradient_tiles_task.
+ **/
 
-    /* middle pixels of the last row */
-    end = (src - 1) + w - 1 ;
-    while (src < end) {
-      gx = 0.5 * (src[+xo] - src[-xo]) ;
-      gy =        src[0]   - src[-yo] ;
-      SAVE_BACK ;
+static void
+_vl_sift_need_gradient (VlSiftFilt *f, VlSiftKeypoint const *k,
+                        vl_bool descriptor, vl_bool schedule)
+{
+  int box [4], ntx, nty, tx, ty ;
+  if (! _vl_sift_gradient_window (f, k, descriptor, box)) return ;
+  _vl_sift_gradient_grid (f, &ntx, &nty) ;
+
+  for (ty = box [1] / VL_SIFT_GRAD_TILE ;
+       ty <= box [3] / VL_SIFT_GRAD_TILE ; ++ty) {
+    for (tx = box [0] / VL_SIFT_GRAD_TILE ;
+         tx <= box [2] / VL_SIFT_GRAD_TILE ; ++tx) {
+      int t = (k->is - f->s_min - 1) * ntx * nty + ty * ntx + tx ;
+      if (f->gradTiles [t] == 1) continue ;
+      if (schedule) {
+        if (f->gradTiles [t] == 0) {
+          f->gradTileList [f->numGradTiles ++] = t ;
+        }
+        f->gradTiles [t] = 2 ;
+      } else {
+        _vl_sift_gradient_tile (f, t) ;
+        f->gradTiles [t] = 1 ;
+      }
     }
+  }
+}
 
-    /* last pixel of the last row */
-    gx = src[0]   - src[-xo] ;
-    gy = src[0]   - src[-yo] ;
-    SAVE_BACK ;
+/** @internal @brief Compute the marked gradient tiles @a begin to @a end - 1 */
+static void
+_vl_sift_gradient_tiles_task (VlSiftFilt *f, void *data VL_UNUSED,
+                              int tid VL_UNUSED, int begin, int end)
+{
+  int i ;
+  for (i = begin ; i < end ; ++i) {
+    int t = f->gradTileList [i] ;
+    _vl_sift_gradient_tile (f, t) ;
+    f->gradTiles [t] = 1 ;
   }
-  f->grad_o = f->o_cur ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Compute the gradient of several keypoint windows
+ **
+ ** @param f          SIFT filter.
+ ** @param keys       keypoints.
+ ** @param nkeys      number of keypoints.
+ ** @param descriptor windows of the descriptors (or of the orientations).
+ **
+ ** The function computes the gradient tiles needed by the keypoints,
+ ** splitting them among the threads of the filter, so that the
+ ** keypoints can then be processed in parallel without modifying the
+ ** gradient.
+ **/
+
+static void
+_vl_sift_prepare_gradient (VlSiftFilt *f, VlSiftKeypoint const *keys,
+                           int nkeys, vl_bool descriptor)
+{
+  int i ;
+  _vl_sift_sync_gradient (f) ;
+  f->numGradTiles = 0 ;
+  for (i = 0 ; i < nkeys ; ++i) {
+    _vl_sift_need_gradient (f, keys + i, descriptor, VL_TRUE) ;
+  }
+  _vl_sift_parallel_for (f, _vl_sift_gradient_tiles_task, NULL,
+                         f->numGradTiles, 2, 1) ;
 }
 
 /** ------------------------------------------------------------------
@@ -1579,9 +2672,9 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
 
   int          w      = f-> octave_width ;
   int          h      = f-> octave_height ;
-  int const    xo     = 2 ;         /* x-stride */
-  int const    yo     = 2 * w ;     /* y-stride */
-  int const    so     = 2 * w * h ; /* s-stride */
+  int const    xo     = 1 ;         /* x-stride */
+  int const    yo     = w ;         /* y-stride */
+  int const    so     = w * h ;     /* s-stride */
   double       x      = k-> x     / xper ;
   double       y      = k-> y     / xper ;
   double       sigma  = k-> sigma / xper ;
@@ -1598,7 +2691,7 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
   enum {nbins = 36} ;
 
   double hist [nbins], maxh ;
-  vl_sift_pix const * pt ;
+  vl_size pt ;
   int xs, ys, iter, i ;
 
   /* skip if the keypoint octave is not current */
@@ -1615,17 +2708,15 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
     return 0 ;
   }
 
-  /* make gradient up to date */
-  update_gradient (f) ;
+  /* make the gradient of the window up to date */
+  _vl_sift_sync_gradient (f) ;
+  _vl_sift_need_gradient (f, k, VL_FALSE, VL_FALSE) ;
 
   /* clear histogram */
   memset (hist, 0, sizeof(double) * nbins) ;
 
   /* compute orientation histogram */
-  pt = f-> grad + xo*xi + yo*yi + so*(si - f->s_min - 1) ;
-
-#undef  at
-#define at(dx,dy) (*(pt + xo * (dx) + yo * (dy)))
+  pt = (vl_size) xo*xi + yo*yi + (vl_size) so*(si - f->s_min - 1) ;
 
   for(ys  =  VL_MAX (- W,       - yi) ;
       ys <=  VL_MIN (+ W, h - 1 - yi) ; ++ys) {
@@ -1643,8 +2734,8 @@ vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
       if (r2 >= W*W + 0.6) continue ;
 
       wgt  = fast_expn (r2 / (2*sigmaw*sigmaw)) ;
-      mod  = *(pt + xs*xo + ys*yo    ) ;
-      ang  = *(pt + xs*xo + ys*yo + 1) ;
+      mod  = _vl_sift_grad_mod   (f, pt + xs*xo + ys*yo) ;
+      ang  = _vl_sift_grad_angle (f, pt + xs*xo + ys*yo) ;
       fbin = nbins * ang / (2 * VL_PI) ;
 
 #if defined(VL_SIFT_BILINEAR_ORIENTATIONS)
@@ -1961,9 +3052,9 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
 
   int          w           = f-> octave_width ;
   int          h           = f-> octave_height ;
-  int const    xo          = 2 ;         /* x-stride */
-  int const    yo          = 2 * w ;     /* y-stride */
-  int const    so          = 2 * w * h ; /* s-stride */
+  int const    xo          = 1 ;         /* x-stride */
+  int const    yo          = w ;         /* y-stride */
+  int const    so          = w * h ;     /* s-stride */
   double       x           = k-> x     / xper ;
   double       y           = k-> y     / xper ;
   double       sigma       = k-> sigma / xper ;
@@ -1983,7 +3074,7 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
   int const binxo = NBO ;        /* bin x-stride */
 
   int bin, dxi, dyi ;
-  vl_sift_pix const *pt ;
+  vl_size            pt ;
   vl_sift_pix       *dpt ;
 
   /* check bounds */
@@ -1996,8 +3087,9 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
      si    >  f->s_max - 2     )
     return ;
 
-  /* synchronize gradient buffer */
-  update_gradient (f) ;
+  /* make the gradient of the window up to date */
+  _vl_sift_sync_gradient (f) ;
+  _vl_sift_need_gradient (f, k, VL_TRUE, VL_FALSE) ;
 
   /* VL_PRINTF("W = %d ; magnif = %g ; SBP = %g\n", W,magnif,SBP) ; */
 
@@ -2007,7 +3099,7 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
   /* Center the scale space and the descriptor on the current keypoint.
    * Note that dpt is pointing to the bin of center (SBP/2,SBP/2,0).
    */
-  pt  = f->grad + xi*xo + yi*yo + (si - f->s_min - 1)*so ;
+  pt  = (vl_size) xi*xo + yi*yo + (vl_size) (si - f->s_min - 1)*so ;
   dpt = descr + (NBP/2) * binyo + (NBP/2) * binxo ;
 
 #undef atd
@@ -2024,8 +3116,8 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
         dxi <= VL_MIN (+ W, w - xi - 2) ; ++ dxi) {
 
       /* retrieve */
-      vl_sift_pix mod   = *( pt + dxi*xo + dyi*yo + 0 ) ;
-      vl_sift_pix angle = *( pt + dxi*xo + dyi*yo + 1 ) ;
+      vl_sift_pix mod   = _vl_sift_grad_mod   (f, pt + dxi*xo + dyi*yo) ;
+      vl_sift_pix angle = _vl_sift_grad_angle (f, pt + dxi*xo + dyi*yo) ;
       vl_sift_pix theta = vl_mod_2pi_f (angle - angle0) ;
 
       /* fractional displacement */
@@ -2106,6 +3198,856 @@ vl_sift_calc_keypoint_descriptor (VlSiftFilt *f,
 
 }
 
+/** @internal @brief Data of the keypoint tasks */
+typedef struct _VlSiftKeysJob
+{
+  VlSiftKeypoint const *keys ;
+  double               *angles ;
+  int                  *nangles ;
+  vl_sift_pix          *descrs ;
+} _VlSiftKeysJob ;
+
+/** @internal @brief Compute the orientations of keypoints @a begin to @a end - 1 */
+static void
+_vl_sift_orientations_task (VlSiftFilt *f, void *data,
+                            int tid VL_UNUSED, int begin, int end)
+{
+  _VlSiftKeysJob *job = data ;
+  int i ;
+  for (i = begin ; i < end ; ++i) {
+    job->nangles [i] =
+      vl_sift_calc_keypoint_orientations (f, job->angles + 4 * i,
+                                          job->keys + i) ;
+  }
+}
+
+/** @internal @brief Compute the descriptors of keypoints @a begin to @a end - 1 */
+static void
+_vl_sift_descriptors_task (VlSiftFilt *f, void *data,
+                           int tid VL_UNUSED, int begin, int end)
+{
+  _VlSiftKeysJob *job = data ;
+  int i ;
+  for (i = begin ; i < end ; ++i) {
+    vl_sift_calc_keypoint_descriptor (f, job->descrs + NBO*NBP*NBP * i,
+                                      job->keys + i, job->angles [i]) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Calculate the orientations of several keypoints
+ **
+ ** @param f        SIFT filter.
+ ** @param angles   orientations (output).
+ ** @param nangles  numbers of orientations (output).
+ ** @param keys     keypoints.
+ ** @param nkeys    number of keypoints.
+ **
+ ** The function runs ::vl_sift_calc_keypoint_orientations on each
+ ** keypoint, splitting them among the threads of the filter. The
+ ** orientations of the keypoint @c keys[i] are written to @c
+ ** angles[4*i] to @c angles[4*i+nangles[i]-1], so that @a angles
+ ** must have room for @c 4*nkeys values.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoints_orientations (VlSiftFilt *f,
+                                     double *angles,
+                                     int *nangles,
+                                     VlSiftKeypoint const *keys,
+                                     int nkeys)
+{
+  _VlSiftKeysJob job ;
+  job.keys    = keys ;
+  job.angles  = angles ;
+  job.nangles = nangles ;
+  job.descrs  = NULL ;
+
+  /* the gradient is shared, compute the tiles needed before splitting */
+  _vl_sift_prepare_gradient (f, keys, nkeys, VL_FALSE) ;
+  _vl_sift_parallel_for (f, _vl_sift_orientations_task, &job, nkeys, 8, 1) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the descriptors of several keypoints
+ **
+ ** @param f        SIFT filter.
+ ** @param descrs   SIFT descriptors (output).
+ ** @param keys     keypoints.
+ ** @param angles   keypoint orientations.
+ ** @param nkeys    number of keypoints.
+ **
+ ** The function runs ::vl_sift_calc_keypoint_descriptor on the
+ ** keypoint @c keys[i] with orientation @c angles[i], writing the
+ ** descriptor to @c descrs[128*i], for all keypoints. A keypoint
+ ** with several orientations is simply repeated in @a keys. The
+ ** keypoints are split among the threads of the filter.
+ **/
+
+VL_EXPORT
+void
+vl_sift_calc_keypoints_descriptors (VlSiftFilt *f,
+                                    vl_sift_pix *descrs,
+                                    VlSiftKeypoint const *keys,
+                                    double const *angles,
+                                    int nkeys)
+{
+  _VlSiftKeysJob job ;
+  job.keys    = keys ;
+  job.angles  = (double *) angles ;
+  job.nangles = NULL ;
+  job.descrs  = descrs ;
+
+  /* the gradient is shared, compute the tiles needed before splitting */
+  _vl_sift_prepare_gradient (f, keys, nkeys, VL_TRUE) ;
+  _vl_sift_parallel_for (f, _vl_sift_descriptors_task, &job, nkeys, 8, 1) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                  Tiled processing */
+/* ---------------------------------------------------------------- */
+
+/** @internal @brief Size in bytes of the scale space buffers of a filter */
+static vl_size
+_vl_sift_buffer_size (int width, int height, int S, int o_min,
+                      vl_bool compact)
+{
+  vl_size nel =
+    (vl_size) VL_SHIFT_LEFT(width,  -o_min) *
+    (vl_size) VL_SHIFT_LEFT(height, -o_min) ;
+  /* see _vl_sift_alloc_buffers() */
+  if (compact) {
+    return nel * (sizeof(vl_sift_pix) * 3 +
+                  sizeof(vl_uint16) * ((S + 3) + (S + 2) + S) +
+                  sizeof(vl_uint8) * S) + sizeof(vl_sift_pix) * (nel / 4) ;
+  }
+  return sizeof(vl_sift_pix) * nel * (1 + (S + 3) + (S + 2) + 2 * (S + 2)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Guard band of the tiles of ::vl_sift_process_tiled
+ ** @param f      SIFT filter.
+ ** @param o_last last octave computed on the tiles.
+ ** @return width of the guard band in image pixels.
+ **
+ ** The scale space up to octave @a o_last depends on the image
+ ** pixels within the sum of the supports of the Gaussian filters
+ ** applied so far. A keypoint depends in addition on the 3x3x3
+ ** neighbourhoods visited by the refinement and on the pixels under
+ ** its orientation and descriptor windows. A tile extended by the
+ ** guard band on each side gives therefore the same keypoints as
+ ** the whole image in its interior.
+ **/
+
+static int
+_vl_sift_tile_guard (VlSiftFilt const *f, int o_last)
+{
+  double sa = f->sigma0 * pow (f->sigmak, f->s_min) ;
+  double sb = f->sigman * pow (2.0, - f->o_min) ;
+  double sigma = f->sigma0 * pow (f->sigmak, f->s_max) ;
+  double r = (f->o_min < 0) ? 1 : 0 ; /* linear interpolation */
+  double W ;
+  int o, s ;
+
+  if (sa > sb) {
+    r += VL_MAX(ceil (4.0 * sqrt (sa*sa - sb*sb)), 1) * pow (2.0, f->o_min) ;
+  }
+  for (o = f->o_min ; o <= o_last ; ++o) {
+    /* only the base of the next octave matters for earlier octaves */
+    int s_last = (o < o_last) ? VL_MIN(f->s_min + f->S, f->s_max) : f->s_max ;
+    for (s = f->s_min + 1 ; s <= s_last ; ++s) {
+      r += VL_MAX(ceil (4.0 * f->dsigma0 * pow (f->sigmak, s)), 1) * pow (2.0, o) ;
+    }
+  }
+
+  /* orientation and descriptor windows, plus the gradient and the
+     rounding of the keypoint center; at least the refinement steps */
+  W = VL_MAX(floor (3.0 * 1.5 * sigma),
+             floor (sqrt (2.0) * f->magnif * sigma * (NBP + 1) / 2.0 + 0.5)) ;
+  r += VL_MAX(W + 3, 7) * pow (2.0, o_last) ;
+
+  return (int) ceil (r) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Create a filter with the parameters of another one
+ **/
+
+static VlSiftFilt *
+_vl_sift_new_like (VlSiftFilt const *f, int width, int height,
+                   int noctaves, int o_min)
+{
+  VlSiftFilt *g = vl_sift_new (width, height, noctaves, f->S, o_min) ;
+  if (g) {
+    g-> sigman      = f-> sigman ;
+    g-> peak_thresh = f-> peak_thresh ;
+    g-> edge_thresh = f-> edge_thresh ;
+    g-> norm_thresh = f-> norm_thresh ;
+    g-> magnif      = f-> magnif ;
+    g-> windowSize  = f-> windowSize ;
+    g-> numThreads  = f-> numThreads ;
+    g-> approximate = f-> approximate ;
+    g-> compact     = f-> compact ;
+  }
+  return g ;
+}
+
+/** @internal @brief Frame buffers of ::vl_sift_process_tiled */
+typedef struct _VlSiftTiledOutput
+{
+  VlSiftFramesFunction function ;
+  void                *data ;
+  vl_bool              descriptors ;
+
+  VlSiftKeypoint *keys ;      /**< keypoints of the tile core. */
+  double         *angles ;    /**< their orientations. */
+  int            *nangles ;   /**< their number of orientations. */
+  int             keys_res ;
+
+  VlSiftKeypoint *frames ;    /**< one keypoint per orientation. */
+  double         *fangles ;   /**< orientation of the frames. */
+  vl_sift_pix    *descrs ;    /**< descriptors of the frames. */
+  int             frames_res ;
+} _VlSiftTiledOutput ;
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Detect and pass on the frames of the current octave
+ ** @param f     SIFT filter of a tile.
+ ** @param out   output.
+ ** @param x0    tile left edge.
+ ** @param y0    tile top edge.
+ ** @param cx0   core left edge.
+ ** @param cy0   core top edge.
+ ** @param cx1   core right edge (excluded).
+ ** @param cy1   core bottom edge (excluded).
+ ** @param shift octave of the first octave of the filter.
+ **
+ ** The tile and core coordinates are in pixels of the first octave
+ ** of the filter, which is octave @a shift of the image. Keypoints
+ ** are kept if their (integer) position in the octave falls in the
+ ** core, so that tiles overlapping each other do not repeat them.
+ **
+ ** @return error code.
+ **/
+
+static int
+_vl_sift_tiled_octave (VlSiftFilt *f, _VlSiftTiledOutput *out,
+                       int x0, int y0, int cx0, int cy0, int cx1, int cy1,
+                       int shift)
+{
+  int o  = f->o_cur ;
+  int ox = VL_SHIFT_LEFT(x0, -o) ;
+  int oy = VL_SHIFT_LEFT(y0, -o) ;
+  int bx0 = VL_SHIFT_LEFT(cx0, -o) - ox ;
+  int by0 = VL_SHIFT_LEFT(cy0, -o) - oy ;
+  int bx1 = VL_SHIFT_LEFT(cx1, -o) - ox ;
+  int by1 = VL_SHIFT_LEFT(cy1, -o) - oy ;
+  double scale = pow (2.0, shift) ;
+  VlSiftKeypoint const *keys ;
+  int i, j, q, nkeys, nframes, err ;
+
+  err = vl_sift_detect (f) ;
+  if (err) return err ;
+  keys = vl_sift_get_keypoints (f) ;
+
+  if (out->keys_res < f->nkeys) {
+    int n = f->nkeys ;
+    VlSiftKeypoint *k = vl_realloc (out->keys,    sizeof(VlSiftKeypoint) * n) ;
+    if (k) out->keys = k ;
+    {
+      double *a = vl_realloc (out->angles,  sizeof(double) * 4 * n) ;
+      int    *m = vl_realloc (out->nangles, sizeof(int) * n) ;
+      if (a) out->angles  = a ;
+      if (m) out->nangles = m ;
+      if (! k || ! a || ! m) return VL_ERR_ALLOC ;
+    }
+    out->keys_res = n ;
+  }
+
+  for (nkeys = 0, i = 0 ; i < f->nkeys ; ++i) {
+    if (bx0 <= keys [i].ix && keys [i].ix < bx1 &&
+        by0 <= keys [i].iy && keys [i].iy < by1) {
+      out->keys [nkeys++] = keys [i] ;
+    }
+  }
+
+  vl_sift_calc_keypoints_orientations (f, out->angles, out->nangles,
+                                       out->keys, nkeys) ;
+
+  for (nframes = 0, i = 0 ; i < nkeys ; ++i) nframes += out->nangles [i] ;
+  if (out->frames_res < nframes) {
+    VlSiftKeypoint *k = vl_realloc (out->frames,  sizeof(VlSiftKeypoint) * nframes) ;
+    double         *a = vl_realloc (out->fangles, sizeof(double) * nframes) ;
+    vl_sift_pix    *d = out->descrs ;
+    if (k) out->frames  = k ;
+    if (a) out->fangles = a ;
+    if (out->descriptors) {
+      d = vl_realloc (out->descrs, sizeof(vl_sift_pix) * 128 * nframes) ;
+      if (d) out->descrs = d ;
+    }
+    if (! k || ! a || (out->descriptors && ! d)) return VL_ERR_ALLOC ;
+    out->frames_res = nframes ;
+  }
+
+  for (j = 0, i = 0 ; i < nkeys ; ++i) {
+    for (q = 0 ; q < out->nangles [i] ; ++q, ++j) {
+      out->frames  [j] = out->keys [i] ;
+      out->fangles [j] = out->angles [4 * i + q] ;
+    }
+  }
+
+  if (out->descriptors) {
+    vl_sift_calc_keypoints_descriptors (f, out->descrs, out->frames,
+                                        out->fangles, nframes) ;
+  }
+
+  /* move the frames from the tile to the image */
+  for (j = 0 ; j < nframes ; ++j) {
+    VlSiftKeypoint *k = out->frames + j ;
+    k-> o     += shift ;
+    k-> ix    += ox ;
+    k-> iy    += oy ;
+    k-> x      = (float) ((double) k->x * scale + x0 * scale) ;
+    k-> y      = (float) ((double) k->y * scale + y0 * scale) ;
+    k-> sigma  = (float) ((double) k->sigma * scale) ;
+  }
+
+  if (nframes == 0) return VL_ERR_OK ;
+  return out->function (out->data, out->frames, out->fangles,
+                        out->descriptors ? out->descrs : 0, nframes) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Process all octaves of an image with ::_vl_sift_tiled_octave
+ **/
+
+static int
+_vl_sift_tiled_octaves (VlSiftFilt *f, _VlSiftTiledOutput *out,
+                        vl_sift_pix const *im,
+                        int x0, int y0, int cx0, int cy0, int cx1, int cy1,
+                        int shift)
+{
+  int err = vl_sift_process_first_octave (f, im) ;
+  while (! err) {
+    err = _vl_sift_tiled_octave (f, out, x0, y0, cx0, cy0, cx1, cy1, shift) ;
+    if (err) return err ;
+    if (f->o_cur == f->o_min + f->O - 1) break ;
+    err = vl_sift_process_next_octave (f) ;
+  }
+  return (err == VL_ERR_EOF) ? VL_ERR_OK : err ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the SIFT frames of an image with bounded memory
+ **
+ ** @param f           SIFT filter.
+ ** @param im          image data.
+ ** @param max_memory  maximum size of the buffers in bytes (0 for none).
+ ** @param descriptors whether to compute the descriptors.
+ ** @param function    function receiving the frames.
+ ** @param data        data passed to @a function.
+ **
+ ** The function detects the keypoints of the image @a im (of the size
+ ** of the filter @a f), computes their orientations and optionally
+ ** their descriptors, and passes them to @a function in batches. The
+ ** batches are in the coordinates of the image, with one keypoint
+ ** for each orientation and the descriptors (or @c NULL) in the
+ ** order of the keypoints. If @a function returns an error code,
+ ** the processing stops and the function returns the same code.
+ **
+ ** If the scale space of the whole image needs more than @a
+ ** max_memory bytes, the first octaves are computed on overlapping
+ ** tiles. The tiles overlap by a guard band as large as the support
+ ** of the Gaussian filters and of the descriptor, so that each tile
+ ** gives the same keypoints as the whole image in its core, and each
+ ** keypoint is reported by the tile whose core contains it. The
+ ** tiles also compose the base of the next octave, which is small
+ ** enough to be processed at once with the remaining octaves. The
+ ** keypoints are the same as those of the octave by octave
+ ** processing up to rounding of their coordinates, but they are
+ ** reported in a different order.
+ **
+ ** The filter @a f provides the parameters. Its own buffers are used
+ ** only if the image fits in @a max_memory.
+ **
+ ** @return error code. ::VL_ERR_ALLOC is returned if no tiling fits in
+ ** @a max_memory.
+ **/
+
+VL_EXPORT
+int
+vl_sift_process_tiled (VlSiftFilt *f, vl_sift_pix const *im,
+                       vl_size max_memory, vl_bool descriptors,
+                       VlSiftFramesFunction function, void *data)
+{
+  _VlSiftTiledOutput out ;
+  int width  = f->width ;
+  int height = f->height ;
+  int S      = f->S ;
+  int o_min  = f->o_min ;
+  int O      = f->O ;
+  int k, split = 0, C = 0, G = 0 ;
+  double best = 0 ;
+  int err = VL_ERR_OK ;
+  vl_sift_pix *tile = 0, *coarse = 0 ;
+  VlSiftFilt *tf = 0 ;
+
+  memset (&out, 0, sizeof(out)) ;
+  out.function    = function ;
+  out.data        = data ;
+  out.descriptors = descriptors ;
+
+  if (max_memory == 0 ||
+      _vl_sift_buffer_size (width, height, S, o_min, f->compact)
+      <= max_memory) {
+    err = _vl_sift_tiled_octaves (f, &out, im, 0, 0, 0, 0,
+                                  width, height, 0) ;
+    goto done ;
+  }
+
+  /*
+   * Octaves o_min to k-1 are computed on tiles, the others on the
+   * base of octave k. Pick k and the size of the tile core that
+   * process the fewest pixels.
+   */
+
+  for (k = o_min + 1 ; k <= o_min + O ; ++k) {
+    int step = 1 << VL_MAX(k, 0) ;
+    int g, c, nx, ny, tw = 0, th = 0 ;
+    vl_size wk = VL_SHIFT_LEFT(width,  -k) ;
+    vl_size hk = VL_SHIFT_LEFT(height, -k) ;
+    vl_size coarseSize = 0 ;
+    double cost ;
+
+    if (k < o_min + O) {
+      if (wk < 1 || hk < 1) break ;
+      coarseSize = sizeof(vl_sift_pix) * wk * hk ;
+      if (coarseSize + _vl_sift_buffer_size (wk, hk, S, 0, f->compact)
+          > max_memory) {
+        continue ;
+      }
+    }
+
+    g = _vl_sift_tile_guard (f, k - 1) ;
+    g = (g + step - 1) / step * step ;
+
+    for (c = (VL_MAX(width, height) + step - 1) / step * step ;
+         c >= step ; c -= step) {
+      tw = VL_MIN(c + 2 * g, width) ;
+      th = VL_MIN(c + 2 * g, height) ;
+      if (coarseSize + sizeof(vl_sift_pix) * tw * th +
+          _vl_sift_buffer_size (tw, th, S, o_min, f->compact)
+          <= max_memory) break ;
+    }
+    if (c < step) continue ;
+
+    nx = (width  + c - 1) / c ;
+    ny = (height + c - 1) / c ;
+    cost = (double) nx * ny * tw * th * pow (4.0, - o_min) ;
+    if (k < o_min + O) cost += (double) wk * hk ;
+
+    if (C == 0 || cost < best) {
+      split = k ;
+      C     = c ;
+      G     = g ;
+      best  = cost ;
+    }
+  }
+
+  if (C == 0) return VL_ERR_ALLOC ;
+
+  {
+    int cx0, cy0 ;
+    int wk = VL_SHIFT_LEFT(width,  -split) ;
+    int hk = VL_SHIFT_LEFT(height, -split) ;
+    vl_bool hasCoarse = (split < o_min + O) ;
+
+    tile = vl_malloc (sizeof(vl_sift_pix) *
+                      VL_MIN(C + 2 * G, width) * VL_MIN(C + 2 * G, height)) ;
+    if (hasCoarse) coarse = vl_malloc (sizeof(vl_sift_pix) * wk * hk) ;
+    if (! tile || (hasCoarse && ! coarse)) {
+      err = VL_ERR_ALLOC ;
+      goto done ;
+    }
+
+    for (cy0 = 0 ; cy0 < height ; cy0 += C) {
+      for (cx0 = 0 ; cx0 < width ; cx0 += C) {
+        int cx1 = VL_MIN(cx0 + C, width) ;
+        int cy1 = VL_MIN(cy0 + C, height) ;
+        int x0  = VL_MAX(cx0 - G, 0) ;
+        int y0  = VL_MAX(cy0 - G, 0) ;
+        int tw  = VL_MIN(cx1 + G, width)  - x0 ;
+        int th  = VL_MIN(cy1 + G, height) - y0 ;
+        int y ;
+
+        for (y = 0 ; y < th ; ++y) {
+          memcpy (tile + y * tw, im + (y0 + y) * width + x0,
+                  sizeof(vl_sift_pix) * tw) ;
+        }
+
+        /* tiles of the same size share the filter */
+        if (tf && (tf->width != tw || tf->height != th)) {
+          vl_sift_delete (tf) ;
+          tf = 0 ;
+        }
+        if (! tf) {
+          tf = _vl_sift_new_like (f, tw, th, split - o_min, o_min) ;
+          if (! tf) {
+            err = VL_ERR_ALLOC ;
+            goto done ;
+          }
+        }
+
+        err = _vl_sift_tiled_octaves (tf, &out, tile, x0, y0,
+                                      cx0, cy0, cx1, cy1, 0) ;
+        if (err) goto done ;
+
+        /* copy the core of the base of the next octave, from the
+           level in single precision as without tiles */
+        if (hasCoarse) {
+          int ox = VL_SHIFT_LEFT(x0, -(split - 1)) ;
+          int oy = VL_SHIFT_LEFT(y0, -(split - 1)) ;
+          int X, Y ;
+          for (Y = VL_SHIFT_LEFT(cy0, -split) ;
+               Y < VL_SHIFT_LEFT(cy1, -split) ; ++Y) {
+            for (X = VL_SHIFT_LEFT(cx0, -split) ;
+                 X < VL_SHIFT_LEFT(cx1, -split) ; ++X) {
+              coarse [Y * wk + X] = _vl_sift_next_base_at
+                (tf, 2 * X - ox, 2 * Y - oy) ;
+            }
+          }
+        }
+      }
+    }
+
+    vl_sift_delete (tf) ;
+    vl_free (tile) ;
+    tf = 0 ;
+    tile = 0 ;
+
+    /* the remaining octaves, starting from a base which is already
+       smoothed as the first level of an octave */
+    if (hasCoarse) {
+      tf = _vl_sift_new_like (f, wk, hk, O - (split - o_min), 0) ;
+      if (! tf) {
+        err = VL_ERR_ALLOC ;
+        goto done ;
+      }
+      tf->sigman = tf->sigma0 * pow (tf->sigmak, tf->s_min) ;
+      err = _vl_sift_tiled_octaves (tf, &out, coarse, 0, 0, 0, 0,
+                                    wk, hk, split) ;
+    }
+  }
+
+ done:
+  if (tf) vl_sift_delete (tf) ;
+  if (tile) vl_free (tile) ;
+  if (coarse) vl_free (coarse) ;
+  if (out.keys) vl_free (out.keys) ;
+  if (out.angles) vl_free (out.angles) ;
+  if (out.nangles) vl_free (out.nangles) ;
+  if (out.frames) vl_free (out.frames) ;
+  if (out.fangles) vl_free (out.fangles) ;
+  if (out.descrs) vl_free (out.descrs) ;
+  return err ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                  Batch processing */
+/* ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @brief Create a SIFT batch
+ **
+ ** @param noctaves number of octaves (negative for the maximum).
+ ** @param nlevels  number of levels per octave.
+ ** @param o_min    first octave index.
+ **
+ ** The batch computes the SIFT frames of a sequence of images of
+ ** any size with the geometry given by @a noctaves, @a nlevels and
+ ** @a o_min (see ::vl_sift_new) and the parameters set on the batch.
+ ** It keeps a filter, with its scale space buffers, for each of the
+ ** last image sizes, so that the next images of the same sizes are
+ ** processed without allocating or clearing anything. The frames of
+ ** all images are appended to the same buffers, which grow as needed
+ ** or can be reserved beforehand by ::vl_sift_batch_reserve().
+ **
+ ** @return new SIFT batch or @c NULL if there is not enough memory.
+ **/
+
+VL_EXPORT
+VlSiftBatch *
+vl_sift_batch_new (int noctaves, int nlevels, int o_min)
+{
+  VlSiftBatch *b = vl_calloc (1, sizeof(VlSiftBatch)) ;
+  if (! b) return 0 ;
+
+  b-> O     = noctaves ;
+  b-> S     = nlevels ;
+  b-> o_min = o_min ;
+
+  /* same defaults as vl_sift_new() */
+  b-> peak_thresh = 0.0 ;
+  b-> edge_thresh = 10.0 ;
+  b-> norm_thresh = 0.0 ;
+  b-> magnif      = 3.0 ;
+  b-> windowSize  = NBP / 2 ;
+  b-> numThreads  = 1 ;
+  b-> descriptors = VL_TRUE ;
+  b-> maxMemory   = 0 ;
+  b-> approximate = VL_FALSE ;
+  b-> compact     = VL_FALSE ;
+  b-> maxFilters  = 4 ;
+
+  b-> offsetsRes  = 16 ;
+  b-> offsets     = vl_malloc (sizeof(vl_size) * b->offsetsRes) ;
+  if (! b->offsets) {
+    vl_free (b) ;
+    return 0 ;
+  }
+  b-> offsets [0] = 0 ;
+  return b ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Delete a SIFT batch
+ ** @param b SIFT batch.
+ **
+ ** The function frees the filters and the frames of the batch.
+ **/
+
+VL_EXPORT
+void
+vl_sift_batch_delete (VlSiftBatch *b)
+{
+  if (b) {
+    int i ;
+    for (i = 0 ; i < b->numFilters ; ++i) vl_sift_delete (b->filters [i]) ;
+    if (b->offsets) vl_free (b->offsets) ;
+    if (b->keys) vl_free (b->keys) ;
+    if (b->angles) vl_free (b->angles) ;
+    if (b->descrs) vl_free (b->descrs) ;
+    vl_free (b) ;
+  }
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the filter of a batch for an image size
+ **
+ ** @param b      SIFT batch.
+ ** @param width  image width.
+ ** @param height image height.
+ **
+ ** The function returns the filter of the pool for images of size
+ ** @a width x @a height, creating it (and dropping the filter used
+ ** least recently if the pool is full) if there is none. The filter
+ ** gets the current parameters of the batch. It belongs to the batch
+ ** and can be used to process an image octave by octave, for
+ ** instance to source custom keypoints, until the batch creates
+ ** another filter.
+ **
+ ** @return filter or @c NULL if there is not enough memory.
+ **/
+
+VL_EXPORT
+VlSiftFilt *
+vl_sift_batch_get_filter (VlSiftBatch *b, int width, int height)
+{
+  VlSiftFilt *f = 0 ;
+  int i ;
+
+  for (i = 0 ; i < b->numFilters ; ++i) {
+    f = b->filters [i] ;
+    if (f->width == width && f->height == height) break ;
+  }
+
+  if (i == b->numFilters) {
+    f = vl_sift_new (width, height, b->O, b->S, b->o_min) ;
+    if (! f) return 0 ;
+    while (b->numFilters >= b->maxFilters) {
+      vl_sift_delete (b->filters [-- b->numFilters]) ;
+    }
+    i = b->numFilters ++ ;
+  }
+
+  /* most recently used first */
+  memmove (b->filters + 1, b->filters, sizeof(VlSiftFilt*) * i) ;
+  b->filters [0] = f ;
+
+  f-> peak_thresh = b-> peak_thresh ;
+  f-> edge_thresh = b-> edge_thresh ;
+  f-> norm_thresh = b-> norm_thresh ;
+  f-> magnif      = b-> magnif ;
+  f-> windowSize  = b-> windowSize ;
+  f-> numThreads  = b-> numThreads ;
+  f-> approximate = b-> approximate ;
+  f-> compact     = b-> compact ;
+  return f ;
+}
+
+/** @internal @brief Make room for @a numFrames frames in a batch */
+static int
+_vl_sift_batch_reserve_frames (VlSiftBatch *b, vl_size numFrames)
+{
+  vl_bool descriptors = b->descriptors || b->descrs ;
+
+  if (numFrames > b->framesRes ||
+      (descriptors && ! b->descrs && numFrames > 0)) {
+    vl_size n = VL_MAX(numFrames, b->framesRes) ;
+    VlSiftKeypoint *k = vl_realloc (b->keys,   sizeof(VlSiftKeypoint) * n) ;
+    double         *a = vl_realloc (b->angles, sizeof(double) * n) ;
+    vl_sift_pix    *d = b->descrs ;
+    if (k) b->keys   = k ;
+    if (a) b->angles = a ;
+    if (descriptors) {
+      d = vl_realloc (b->descrs, sizeof(vl_sift_pix) * 128 * n) ;
+      if (d && ! b->descrs) {
+        /* frames added before the descriptors were enabled */
+        memset (d, 0, sizeof(vl_sift_pix) * 128 * b->numFrames) ;
+      }
+      if (d) b->descrs = d ;
+    }
+    if (! k || ! a || (descriptors && ! d)) return VL_ERR_ALLOC ;
+    b->framesRes = n ;
+  }
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Reserve the buffers of a batch
+ **
+ ** @param b         SIFT batch.
+ ** @param numImages number of images.
+ ** @param numFrames number of frames.
+ **
+ ** The function makes room for a total of @a numImages images and
+ ** @a numFrames frames (with descriptors, if they are enabled), so
+ ** that the batch does not reallocate its buffers until either is
+ ** exceeded.
+ **
+ ** @return error code.
+ **/
+
+VL_EXPORT
+int
+vl_sift_batch_reserve (VlSiftBatch *b, vl_size numImages, vl_size numFrames)
+{
+  if (numImages + 1 > b->offsetsRes) {
+    vl_size *o = vl_realloc (b->offsets, sizeof(vl_size) * (numImages + 1)) ;
+    if (! o) return VL_ERR_ALLOC ;
+    b->offsets    = o ;
+    b->offsetsRes = numImages + 1 ;
+  }
+  return _vl_sift_batch_reserve_frames (b, numFrames) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Append frames to a batch
+ **
+ ** The function has the signature of ::VlSiftFramesFunction.
+ **/
+
+static int
+_vl_sift_batch_add_frames (void *data, VlSiftKeypoint const *keys,
+                           double const *angles, vl_sift_pix const *descrs,
+                           int nframes)
+{
+  VlSiftBatch *b = data ;
+  vl_size n = b->numFrames + nframes ;
+
+  if (n > b->framesRes || (b->descriptors && ! b->descrs)) {
+    int err = _vl_sift_batch_reserve_frames
+      (b, (n > b->framesRes) ? VL_MAX(n, VL_MAX(2 * b->framesRes, 1024))
+                             : b->framesRes) ;
+    if (err) return err ;
+  }
+
+  memcpy (b->keys   + b->numFrames, keys,   sizeof(VlSiftKeypoint) * nframes) ;
+  memcpy (b->angles + b->numFrames, angles, sizeof(double) * nframes) ;
+  if (b->descrs) {
+    if (descrs) {
+      memcpy (b->descrs + 128 * b->numFrames, descrs,
+              sizeof(vl_sift_pix) * 128 * nframes) ;
+    } else {
+      memset (b->descrs + 128 * b->numFrames, 0,
+              sizeof(vl_sift_pix) * 128 * nframes) ;
+    }
+  }
+  b->numFrames = n ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Compute the SIFT frames of an image of a batch
+ **
+ ** @param b      SIFT batch.
+ ** @param im     image data.
+ ** @param width  image width.
+ ** @param height image height.
+ **
+ ** The function detects the keypoints of the image @a im with the
+ ** filter of the batch for its size (see ::vl_sift_batch_get_filter),
+ ** computes their orientations and, if enabled, their descriptors,
+ ** and appends one frame for each orientation to the batch. The
+ ** frames are in the same order as those of the octave by octave
+ ** processing, unless the image is processed by tiles because it
+ ** exceeds the memory limit of the batch (see
+ ** ::vl_sift_process_tiled).
+ **
+ ** @return error code. If an error occurs, the batch is left as it
+ ** was before the call.
+ **/
+
+VL_EXPORT
+int
+vl_sift_batch_process (VlSiftBatch *b, vl_sift_pix const *im,
+                       int width, int height)
+{
+  VlSiftFilt *f ;
+  int err ;
+
+  if (b->numImages + 2 > b->offsetsRes) {
+    err = vl_sift_batch_reserve (b, 2 * b->offsetsRes, b->numFrames) ;
+    if (err) return err ;
+  }
+
+  f = vl_sift_batch_get_filter (b, width, height) ;
+  if (! f) return VL_ERR_ALLOC ;
+
+  err = vl_sift_process_tiled (f, im, b->maxMemory, b->descriptors,
+                               _vl_sift_batch_add_frames, b) ;
+  if (err) {
+    b->numFrames = b->offsets [b->numImages] ;
+    return err ;
+  }
+
+  b->offsets [++ b->numImages] = b->numFrames ;
+  return VL_ERR_OK ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Remove the frames of a batch
+ ** @param b SIFT batch.
+ **
+ ** The function removes all images and frames from the batch, but
+ ** keeps the filters and the buffers for the next images.
+ **/
+
+VL_EXPORT
+void
+vl_sift_batch_clear (VlSiftBatch *b)
+{
+  b->numImages   = 0 ;
+  b->numFrames   = 0 ;
+  b->offsets [0] = 0 ;
+}
+
 /** ------------------------------------------------------------------
  ** @brief Initialize a keypoint from its position and scale
  **
@@ -66,12 +66,17 @@ typedef struct _VlSiftFilt
   vl_sift_pix *temp ;   /**< temporary pixel buffer. */
   vl_sift_pix *octave ; /**< current GSS data. */
   vl_sift_pix *dog ;    /**< current DoG data. */
+  vl_sift_pix *work ;   /**< float levels of the compact GSS. */
+  vl_uint16 *octaveHalf ; /**< current GSS data (compact). */
+  vl_uint16 *dogHalf ;  /**< current DoG data (compact). */
   int octave_width ;    /**< current octave width. */
   int octave_height ;   /**< current octave height. */
 
   vl_sift_pix *gaussFilter ;  /**< current Gaussian filter */
   double gaussFilterSigma ;   /**< current Gaussian filter std */
   vl_size gaussFilterWidth ;  /**< current Gaussian filter width */
+  vl_bool approximate ;       /**< whether to smooth by box filters */
+  vl_bool compact ;           /**< whether to store the GSS in 16 bits */
 
   VlSiftKeypoint* keys ;/**< detected keypoints. */
   int nkeys ;           /**< number of detected keypoints. */
@@ -84,10 +89,80 @@ typedef struct _VlSiftFilt
   double windowSize ;   /**< size of Gaussian window (in spatial bins) */
 
   vl_sift_pix *grad ;   /**< GSS gradient data. */
+  vl_uint16 *gradModHalf ; /**< GSS gradient modulus (compact). */
+  vl_uint8 *gradAngle ; /**< GSS gradient angle (compact). */
   int grad_o ;          /**< GSS gradient data octave. */
+  vl_uint8 *gradTiles ; /**< computed tiles of the gradient data. */
+  int *gradTileList ;   /**< tiles of the gradient data to compute. */
+  int numGradTiles ;    /**< number of tiles to compute. */
+
+  int numThreads ;                /**< number of threads. */
+  VlSiftKeypoint **threadKeys ;   /**< per-thread keypoint buffers. */
+  int *threadNumKeys ;            /**< per-thread number of keypoints. */
+  int *threadKeysRes ;            /**< per-thread size of the buffers. */
+  vl_bool *threadKeysFailed ;     /**< per-thread allocation failure. */
 
 } VlSiftFilt ;
 
+/** @brief Maximum number of threads of a SIFT filter */
+#define VL_SIFT_MAX_THREADS 64
+
+/** @brief Function receiving the frames of ::vl_sift_process_tiled
+ **
+ ** The function receives @a nframes keypoints, one per orientation,
+ ** their orientations and their descriptors (or @c NULL). It returns
+ ** an error code, ::VL_ERR_OK to continue.
+ **/
+typedef int (*VlSiftFramesFunction) (void *data,
+                                     VlSiftKeypoint const *keys,
+                                     double const *angles,
+                                     vl_sift_pix const *descrs,
+                                     int nframes) ;
+
+/** @brief Maximum number of filters of a SIFT batch */
+#define VL_SIFT_BATCH_MAX_FILTERS 16
+
+/** ------------------------------------------------------------------
+ ** @brief SIFT batch
+ **
+ ** This structure holds a pool of SIFT filters, one for each image
+ ** size seen recently, and the frames of a sequence of images (see
+ ** ::vl_sift_batch_new).
+ **/
+
+typedef struct _VlSiftBatch
+{
+  int O ;                 /**< number of octaves (negative for the maximum). */
+  int S ;                 /**< number of levels per octave. */
+  int o_min ;             /**< minimum octave index. */
+
+  double peak_thresh ;    /**< peak threshold. */
+  double edge_thresh ;    /**< edge threshold. */
+  double norm_thresh ;    /**< norm threshold. */
+  double magnif ;         /**< magnification factor. */
+  double windowSize ;     /**< size of Gaussian window (in spatial bins). */
+  int numThreads ;        /**< number of threads of each filter. */
+  vl_bool descriptors ;   /**< whether to compute the descriptors. */
+  vl_size maxMemory ;     /**< memory limit of each image (0 for none). */
+  vl_bool approximate ;   /**< whether to smooth by box filters. */
+  vl_bool compact ;       /**< whether to store the GSS in 16 bits. */
+
+  VlSiftFilt *filters [VL_SIFT_BATCH_MAX_FILTERS] ;
+                          /**< filter pool, most recently used first. */
+  int numFilters ;        /**< number of filters in the pool. */
+  int maxFilters ;        /**< capacity of the pool. */
+
+  vl_size numImages ;     /**< number of images processed. */
+  vl_size *offsets ;      /**< first frame of each image, then the end. */
+  vl_size offsetsRes ;    /**< capacity of offsets. */
+
+  VlSiftKeypoint *keys ;  /**< frames, one keypoint per orientation. */
+  double *angles ;        /**< orientations of the frames. */
+  vl_sift_pix *descrs ;   /**< descriptors of the frames (or NULL). */
+  vl_size numFrames ;     /**< number of frames. */
+  vl_size framesRes ;     /**< capacity of the frame buffers. */
+} VlSiftBatch ;
+
 /** @name Create and destroy
  ** @{
  **/
@@ -111,7 +186,15 @@ VL_EXPORT
 int   vl_sift_process_next_octave        (VlSiftFilt *f) ;
 
 VL_EXPORT
-void  vl_sift_detect                     (VlSiftFilt *f) ;
+int   vl_sift_detect                     (VlSiftFilt *f) ;
+
+VL_EXPORT
+int   vl_sift_process_tiled              (VlSiftFilt *f,
+                                          vl_sift_pix const *im,
+                                          vl_size max_memory,
+                                          vl_bool descriptors,
+                                          VlSiftFramesFunction function,
+                                          void *data) ;
 
 VL_EXPORT
 int   vl_sift_calc_keypoint_orientations (VlSiftFilt *f,
@@ -123,6 +206,20 @@ void  vl_sift_calc_keypoint_descriptor   (VlSiftFilt *f,
                                           VlSiftKeypoint const* k,
                                           double angle) ;
 
+VL_EXPORT
+void  vl_sift_calc_keypoints_orientations (VlSiftFilt *f,
+                                           double *angles,
+                                           int *nangles,
+                                           VlSiftKeypoint const *keys,
+                                           int nkeys) ;
+
+VL_EXPORT
+void  vl_sift_calc_keypoints_descriptors  (VlSiftFilt *f,
+                                           vl_sift_pix *descrs,
+                                           VlSiftKeypoint const *keys,
+                                           double const *angles,
+                                           int nkeys) ;
+
 VL_EXPORT
 void  vl_sift_calc_raw_descriptor        (VlSiftFilt const *f,
                                           vl_sift_pix const* image,
@@ -139,6 +236,47 @@ void  vl_sift_keypoint_init              (VlSiftFilt const *f,
                                           double sigma) ;
 /** @} */
 
+/** @name Process batches of images
+ ** @{
+ **/
+VL_EXPORT
+VlSiftBatch *vl_sift_batch_new    (int noctaves, int nlevels, int o_min) ;
+VL_EXPORT
+void         vl_sift_batch_delete (VlSiftBatch *b) ;
+VL_EXPORT
+VlSiftFilt  *vl_sift_batch_get_filter (VlSiftBatch *b,
+                                       int width, int height) ;
+VL_EXPORT
+int          vl_sift_batch_reserve (VlSiftBatch *b,
+                                    vl_size numImages,
+                                    vl_size numFrames) ;
+VL_EXPORT
+int          vl_sift_batch_process (VlSiftBatch *b,
+                                    vl_sift_pix const *im,
+                                    int width, int height) ;
+VL_EXPORT
+void         vl_sift_batch_clear   (VlSiftBatch *b) ;
+
+VL_INLINE vl_size vl_sift_batch_get_num_images (VlSiftBatch const *b) ;
+VL_INLINE vl_size vl_sift_batch_get_num_frames (VlSiftBatch const *b) ;
+VL_INLINE vl_size const *vl_sift_batch_get_offsets (VlSiftBatch const *b) ;
+VL_INLINE VlSiftKeypoint const *vl_sift_batch_get_keypoints (VlSiftBatch const *b) ;
+VL_INLINE double const *vl_sift_batch_get_angles (VlSiftBatch const *b) ;
+VL_INLINE vl_sift_pix const *vl_sift_batch_get_descriptors (VlSiftBatch const *b) ;
+
+VL_INLINE void vl_sift_batch_set_peak_thresh (VlSiftBatch *b, double t) ;
+VL_INLINE void vl_sift_batch_set_edge_thresh (VlSiftBatch *b, double t) ;
+VL_INLINE void vl_sift_batch_set_norm_thresh (VlSiftBatch *b, double t) ;
+VL_INLINE void vl_sift_batch_set_magnif      (VlSiftBatch *b, double m) ;
+VL_INLINE void vl_sift_batch_set_window_size (VlSiftBatch *b, double x) ;
+VL_INLINE void vl_sift_batch_set_num_threads (VlSiftBatch *b, int n) ;
+VL_INLINE void vl_sift_batch_set_descriptors (VlSiftBatch *b, vl_bool x) ;
+VL_INLINE void vl_sift_batch_set_max_memory  (VlSiftBatch *b, vl_size n) ;
+VL_INLINE void vl_sift_batch_set_approximate (VlSiftBatch *b, vl_bool x) ;
+VL_INLINE void vl_sift_batch_set_compact     (VlSiftBatch *b, vl_bool x) ;
+VL_INLINE void vl_sift_batch_set_max_filters (VlSiftBatch *b, int n) ;
+/** @} */
+
 /** @name Retrieve data and parameters
  ** @{
  **/
@@ -154,6 +292,9 @@ VL_INLINE double vl_sift_get_edge_thresh    (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_norm_thresh    (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_magnif         (VlSiftFilt const *f) ;
 VL_INLINE double vl_sift_get_window_size    (VlSiftFilt const *f) ;
+VL_INLINE int    vl_sift_get_num_threads    (VlSiftFilt const *f) ;
+VL_INLINE vl_bool vl_sift_get_approximate   (VlSiftFilt const *f) ;
+VL_INLINE vl_bool vl_sift_get_compact       (VlSiftFilt const *f) ;
 
 VL_INLINE vl_sift_pix *vl_sift_get_octave  (VlSiftFilt const *f, int s) ;
 VL_INLINE VlSiftKeypoint const *vl_sift_get_keypoints (VlSiftFilt const *f) ;
@@ -167,6 +308,9 @@ VL_INLINE void vl_sift_set_edge_thresh (VlSiftFilt *f, double t) ;
 VL_INLINE void vl_sift_set_norm_thresh (VlSiftFilt *f, double t) ;
 VL_INLINE void vl_sift_set_magnif      (VlSiftFilt *f, double m) ;
 VL_INLINE void vl_sift_set_window_size (VlSiftFilt *f, double m) ;
+VL_INLINE void vl_sift_set_num_threads (VlSiftFilt *f, int n) ;
+VL_INLINE void vl_sift_set_approximate (VlSiftFilt *f, vl_bool x) ;
+VL_INLINE void vl_sift_set_compact     (VlSiftFilt *f, vl_bool x) ;
 /** @} */
 
 /* -------------------------------------------------------------------
@@ -242,7 +386,8 @@ vl_sift_get_octave_height (VlSiftFilt const *f)
  ** and <tt> s_max = S + 2</tt>, where @c S is the number of levels
  ** per octave.
  **
- ** @return pointer to the octave data for level @a s.
+ ** @return pointer to the octave data for level @a s, or NULL if the
+ ** filter stores the scale space in 16 bits (::vl_sift_set_compact).
  **/
 
 VL_INLINE vl_sift_pix *
@@ -250,6 +395,7 @@ vl_sift_get_octave (VlSiftFilt const *f, int s)
 {
   int w = vl_sift_get_octave_width  (f) ;
   int h = vl_sift_get_octave_height (f) ;
+  if (! f->octave) return 0 ;
   return f->octave + w * h * (s - f->s_min) ;
 }
 
@@ -349,6 +495,42 @@ vl_sift_get_window_size (VlSiftFilt const *f)
   return f -> windowSize ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Get the number of threads
+ ** @param f SIFT filter.
+ ** @return number of threads.
+ **/
+
+VL_INLINE int
+vl_sift_get_num_threads (VlSiftFilt const *f)
+{
+  return f -> numThreads ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get whether the scale space is approximated
+ ** @param f SIFT filter.
+ ** @return true if the Gaussian filters are approximated by boxes.
+ **/
+
+VL_INLINE vl_bool
+vl_sift_get_approximate (VlSiftFilt const *f)
+{
+  return f -> approximate ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get whether the scale space is stored in 16 bits
+ ** @param f SIFT filter.
+ ** @return true if the scale space is stored in half precision.
+ **/
+
+VL_INLINE vl_bool
+vl_sift_get_compact (VlSiftFilt const *f)
+{
+  return f -> compact ;
+}
+
 
 
 /** ------------------------------------------------------------------
@@ -414,5 +596,280 @@ vl_sift_set_window_size (VlSiftFilt *f, double x)
   f -> windowSize = x ;
 }
 
+/** ------------------------------------------------------------------
+ ** @brief Set the number of threads
+ ** @param f SIFT filter.
+ ** @param n number of threads.
+ **
+ ** The filter splits the scale space, the detection and the
+ ** keypoints among @a n threads (clamped to the range 1 to
+ ** ::VL_SIFT_MAX_THREADS). The results do not depend on @a n.
+ ** Without thread support the filter always uses one thread.
+ **/
+
+VL_INLINE void
+vl_sift_set_num_threads (VlSiftFilt *f, int n)
+{
+  f -> numThreads = VL_MAX(1, VL_MIN(n, VL_SIFT_MAX_THREADS)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether to approximate the scale space
+ ** @param f SIFT filter.
+ ** @param x true to approximate the Gaussian filters by boxes.
+ **
+ ** The approximate scale space costs the same for all scales but the
+ ** keypoints are less repeatable (see @ref sift-intro-extensions).
+ ** The flag applies from the next call to
+ ** ::vl_sift_process_first_octave.
+ **/
+
+VL_INLINE void
+vl_sift_set_approximate (VlSiftFilt *f, vl_bool x)
+{
+  f -> approximate = x ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether to store the scale space in 16 bits
+ ** @param f SIFT filter.
+ ** @param x true to store the scale space in half precision.
+ **
+ ** The compact scale space takes less than half the memory, at the
+ ** cost of some rounding (see @ref sift-intro-extensions), and
+ ** ::vl_sift_get_octave is not available. The flag applies from the
+ ** next call to ::vl_sift_process_first_octave. It is meant for
+ ** natural images: on flat or synthetic ones the rounding ties most
+ ** DoG extrema and removes their keypoints.
+ **/
+
+VL_INLINE void
+vl_sift_set_compact (VlSiftFilt *f, vl_bool x)
+{
+  f -> compact = x ;
+}
+
+/* -------------------------------------------------------------------
+ *                                       Inline functions of the batch
+ * ---------------------------------------------------------------- */
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of images of a batch
+ ** @param b SIFT batch.
+ ** @return number of images processed since the batch was cleared.
+ **/
+
+VL_INLINE vl_size
+vl_sift_batch_get_num_images (VlSiftBatch const *b)
+{
+  return b -> numImages ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the number of frames of a batch
+ ** @param b SIFT batch.
+ ** @return number of frames of all the images.
+ **/
+
+VL_INLINE vl_size
+vl_sift_batch_get_num_frames (VlSiftBatch const *b)
+{
+  return b -> numFrames ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the frames of each image of a batch
+ ** @param b SIFT batch.
+ ** @return offsets.
+ **
+ ** The frames of image @c i are those from index @c offsets[i] to
+ ** @c offsets[i+1] (excluded), for @c i smaller than
+ ** ::vl_sift_batch_get_num_images.
+ **/
+
+VL_INLINE vl_size const *
+vl_sift_batch_get_offsets (VlSiftBatch const *b)
+{
+  return b -> offsets ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the keypoints of a batch
+ ** @param b SIFT batch.
+ ** @return keypoints, one for each frame.
+ **/
+
+VL_INLINE VlSiftKeypoint const *
+vl_sift_batch_get_keypoints (VlSiftBatch const *b)
+{
+  return b -> keys ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the orientations of a batch
+ ** @param b SIFT batch.
+ ** @return orientations, one for each frame.
+ **/
+
+VL_INLINE double const *
+vl_sift_batch_get_angles (VlSiftBatch const *b)
+{
+  return b -> angles ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Get the descriptors of a batch
+ ** @param b SIFT batch.
+ ** @return descriptors, 128 for each frame (or @c NULL).
+ **
+ ** The descriptors are @c NULL if no image was processed with
+ ** descriptors enabled (see ::vl_sift_batch_set_descriptors). The
+ ** descriptors of images processed without them are null.
+ **/
+
+VL_INLINE vl_sift_pix const *
+vl_sift_batch_get_descriptors (VlSiftBatch const *b)
+{
+  return b -> descrs ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set peaks threshold of a batch
+ ** @param b SIFT batch.
+ ** @param t threshold (see ::vl_sift_set_peak_thresh).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_peak_thresh (VlSiftBatch *b, double t)
+{
+  b -> peak_thresh = t ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set edges threshold of a batch
+ ** @param b SIFT batch.
+ ** @param t threshold (see ::vl_sift_set_edge_thresh).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_edge_thresh (VlSiftBatch *b, double t)
+{
+  b -> edge_thresh = t ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set norm threshold of a batch
+ ** @param b SIFT batch.
+ ** @param t threshold (see ::vl_sift_set_norm_thresh).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_norm_thresh (VlSiftBatch *b, double t)
+{
+  b -> norm_thresh = t ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the magnification factor of a batch
+ ** @param b SIFT batch.
+ ** @param m magnification factor (see ::vl_sift_set_magnif).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_magnif (VlSiftBatch *b, double m)
+{
+  b -> magnif = m ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the Gaussian window size of a batch
+ ** @param b SIFT batch.
+ ** @param x window size (see ::vl_sift_set_window_size).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_window_size (VlSiftBatch *b, double x)
+{
+  b -> windowSize = x ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the number of threads of a batch
+ ** @param b SIFT batch.
+ ** @param n number of threads (see ::vl_sift_set_num_threads).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_num_threads (VlSiftBatch *b, int n)
+{
+  b -> numThreads = VL_MAX(1, VL_MIN(n, VL_SIFT_MAX_THREADS)) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether a batch computes the descriptors
+ ** @param b SIFT batch.
+ ** @param x true to compute the descriptors (default).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_descriptors (VlSiftBatch *b, vl_bool x)
+{
+  b -> descriptors = x ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the memory limit of a batch
+ ** @param b SIFT batch.
+ ** @param n limit in bytes (see ::vl_sift_process_tiled).
+ **
+ ** Zero (default) disables the limit.
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_max_memory (VlSiftBatch *b, vl_size n)
+{
+  b -> maxMemory = n ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether a batch approximates the scale space
+ ** @param b SIFT batch.
+ ** @param x true to smooth by box filters (see ::vl_sift_set_approximate).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_approximate (VlSiftBatch *b, vl_bool x)
+{
+  b -> approximate = x ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set whether a batch stores the scale space in 16 bits
+ ** @param b SIFT batch.
+ ** @param x true to store it in half precision (see ::vl_sift_set_compact).
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_compact (VlSiftBatch *b, vl_bool x)
+{
+  b -> compact = x ;
+}
+
+/** ------------------------------------------------------------------
+ ** @brief Set the number of filters of a batch
+ ** @param b SIFT batch.
+ ** @param n number of filters.
+ **
+ ** The batch keeps the filters of the last @a n image sizes
+ ** (clamped to the range 1 to ::VL_SIFT_BATCH_MAX_FILTERS, default
+ ** 4). The pool shrinks the next time a filter is created.
+ **/
+
+VL_INLINE void
+vl_sift_batch_set_max_filters (VlSiftBatch *b, int n)
+{
+  b -> maxFilters = VL_MAX(1, VL_MIN(n, VL_SIFT_BATCH_MAX_FILTERS)) ;
+}
+
 /* VL_SIFT_H */
 #endif
@@ -0,0 +1,92 @@
+/** @file sift_avx2.c
+ ** @brief SIFT - AVX2 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_AVX2) & ! defined(__AVX2__)
+#error "Compiling with AVX2 enabled, but no __AVX2__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_AVX2)
+
+#include <immintrin.h>
+#include "sift_avx2.h"
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Difference of a run of pixels of two consecutive levels
+ ** @see ::_vl_sift_dog_sse2
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_dog_avx2 (float *dog, float const *src, vl_size n, vl_size so)
+{
+  vl_size i ;
+  for (i = 0 ; i + 8 <= n ; i += 8) {
+    _mm256_storeu_ps (dog + i, _mm256_sub_ps (_mm256_loadu_ps (src + i + so),
+                                              _mm256_loadu_ps (src + i))) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Find the DoG extrema in a run of pixels
+ ** @see ::_vl_sift_extrema_sse2
+ **
+ ** The pixels are tested eight at a time.
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_extrema_avx2 (vl_uint64 *mask, float const *pt, vl_size n,
+                       int yo, int so, float tp)
+{
+  __m256 const thr  = _mm256_set1_ps (tp) ;
+  __m256 const nthr = _mm256_set1_ps (- tp) ;
+  vl_size i ;
+
+  *mask = 0 ;
+  n = VL_MIN(n, 64) ;
+  for (i = 0 ; i + 8 <= n ; i += 8) {
+    float const *q = pt + i ;
+    __m256 v  = _mm256_loadu_ps (q) ;
+    __m256 mx, mn, u, is ;
+    int ds ;
+
+    mx = mn = _mm256_loadu_ps (q - 1) ;
+#define UPDATE(o)                               \
+    u  = _mm256_loadu_ps (q + (o)) ;            \
+    mx = _mm256_max_ps (mx, u) ;                \
+    mn = _mm256_min_ps (mn, u)
+    UPDATE(+ 1) ;
+    UPDATE(- yo - 1) ; UPDATE(- yo) ; UPDATE(- yo + 1) ;
+    UPDATE(+ yo - 1) ; UPDATE(+ yo) ; UPDATE(+ yo + 1) ;
+    for (ds = - so ; ds <= so ; ds += 2 * so) {
+      UPDATE(ds - yo - 1) ; UPDATE(ds - yo) ; UPDATE(ds - yo + 1) ;
+      UPDATE(ds      - 1) ; UPDATE(ds     ) ; UPDATE(ds      + 1) ;
+      UPDATE(ds + yo - 1) ; UPDATE(ds + yo) ; UPDATE(ds + yo + 1) ;
+    }
+#undef UPDATE
+
+    is = _mm256_or_ps
+      (_mm256_and_ps (_mm256_cmp_ps (v, thr,  _CMP_GE_OQ),
+                      _mm256_cmp_ps (v, mx,   _CMP_GT_OQ)),
+       _mm256_and_ps (_mm256_cmp_ps (v, nthr, _CMP_LE_OQ),
+                      _mm256_cmp_ps (v, mn,   _CMP_LT_OQ))) ;
+    *mask |= (vl_uint64) _mm256_movemask_ps (is) << i ;
+  }
+  return i ;
+}
+
+/* ! VL_DISABLE_AVX2 */
+#endif
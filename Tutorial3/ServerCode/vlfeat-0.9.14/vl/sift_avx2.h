@@ -0,0 +1,36 @@
+/** @file sift_avx2.h
+ ** @brief SIFT - AVX2
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_SIFT_AVX2_H
+#define VL_SIFT_AVX2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_AVX2
+
+/* These functions are the eight-wide versions of the ones of
+ * sift_sse2.h and return the number of pixels processed. */
+
+VL_EXPORT
+vl_size _vl_sift_dog_avx2 (float *dog, float const *src, vl_size n,
+                           vl_size so) ;
+
+VL_EXPORT
+vl_size _vl_sift_extrema_avx2 (vl_uint64 *mask, float const *pt, vl_size n,
+                               int yo, int so, float tp) ;
+
+/* ! VL_DISABLE_AVX2 */
+#endif
+
+/* ! VL_SIFT_AVX2_H */
+#endif
@@ -0,0 +1,322 @@
+/** @file sift_sse2.c
+ ** @brief SIFT - SSE2 - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#if ! defined(VL_DISABLE_SSE2) & ! defined(__SSE2__)
+#error "Compiling with SSE2 enabled, but no __SSE2__ defined"
+#endif
+
+#if ! defined(VL_DISABLE_SSE2)
+
+#include <emmintrin.h>
+#include "mathop.h"
+#include "sift_sse2.h"
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Gradient modulus and angle of a run of pixels
+ **
+ ** @param grad output, interleaved modulus and angle of each pixel.
+ ** @param src  first pixel.
+ ** @param n    number of pixels.
+ ** @param up   offset of the pixel above (or zero).
+ ** @param dn   offset of the pixel below (or zero).
+ ** @param ky   scale of the vertical difference.
+ **
+ ** The function computes the gradient of the pixels @a src[0] to
+ ** @a src[n-1], which must all have a left and a right neighbour,
+ ** four at a time. The modulus and the angle are computed by the
+ ** same operations of ::vl_fast_sqrt_f, ::vl_fast_atan2_f and
+ ** ::vl_mod_2pi_f, so that the results are identical to theirs.
+ **
+ ** @return number of pixels processed (a multiple of four). The
+ ** caller processes the remaining ones.
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_gradient_sse2 (float *grad, float const *src, vl_size n,
+                        int up, int dn, float ky)
+{
+  union { float f ; vl_uint32 i ; } tiny ;
+  __m128  const half   = _mm_set1_ps (0.5F) ;
+  __m128  const vky    = _mm_set1_ps (ky) ;
+  __m128  const sign   = _mm_set1_ps (-0.0F) ;
+  __m128  const eps    = _mm_set1_ps (VL_EPSILON_F) ;
+  __m128  const c1     = _mm_set1_ps (0.9675F) ;
+  __m128  const c3     = _mm_set1_ps (0.1821F) ;
+  __m128  const pi4    = _mm_set1_ps ((float) (VL_PI / 4)) ;
+  __m128  const pi34   = _mm_set1_ps ((float) (3 * VL_PI / 4)) ;
+  __m128  const onep5  = _mm_set1_ps (1.5F) ;
+  __m128  const twopif = _mm_set1_ps ((float) (2 * VL_PI)) ;
+  __m128d const twopi  = _mm_set1_pd (2 * VL_PI) ;
+  __m128i const magic  = _mm_set1_epi32 (0x5f3759df) ;
+  __m128  vtiny ;
+  vl_size i ;
+
+  /* smallest float not below the 1e-8 of vl_fast_sqrt_f */
+  tiny.f = (float) 1e-8 ;
+  if (tiny.f < 1e-8) tiny.i ++ ;
+  vtiny = _mm_set1_ps (tiny.f) ;
+
+  for (i = 0 ; i + 4 <= n ; i += 4) {
+    float const *pt = src + i ;
+    __m128 gx = _mm_mul_ps (half, _mm_sub_ps (_mm_loadu_ps (pt + 1),
+                                              _mm_loadu_ps (pt - 1))) ;
+    __m128 gy = _mm_mul_ps (vky,  _mm_sub_ps (_mm_loadu_ps (pt + dn),
+                                              _mm_loadu_ps (pt + up))) ;
+    __m128 mod, ang, r, pos, sq, u, xhalf, lo, hi ;
+
+    /* vl_fast_sqrt_f (gx*gx + gy*gy) */
+    sq    = _mm_add_ps (_mm_mul_ps (gx, gx), _mm_mul_ps (gy, gy)) ;
+    xhalf = _mm_mul_ps (half, sq) ;
+    u     = _mm_castsi128_ps
+      (_mm_sub_epi32 (magic, _mm_srli_epi32 (_mm_castps_si128 (sq), 1))) ;
+    u     = _mm_mul_ps (u, _mm_sub_ps (onep5, _mm_mul_ps (_mm_mul_ps (xhalf, u), u))) ;
+    u     = _mm_mul_ps (u, _mm_sub_ps (onep5, _mm_mul_ps (_mm_mul_ps (xhalf, u), u))) ;
+    mod   = _mm_andnot_ps (_mm_cmplt_ps (sq, vtiny), _mm_mul_ps (sq, u)) ;
+
+    /* vl_fast_atan2_f (gy, gx) */
+    {
+      __m128 ay = _mm_add_ps (_mm_andnot_ps (sign, gy), eps) ;
+      __m128 rp = _mm_div_ps (_mm_sub_ps (gx, ay), _mm_add_ps (gx, ay)) ;
+      __m128 rn = _mm_div_ps (_mm_add_ps (gx, ay), _mm_sub_ps (ay, gx)) ;
+      pos = _mm_cmpge_ps (gx, _mm_setzero_ps ()) ;
+      r   = _mm_or_ps (_mm_and_ps (pos, rp), _mm_andnot_ps (pos, rn)) ;
+      ang = _mm_or_ps (_mm_and_ps (pos, pi4), _mm_andnot_ps (pos, pi34)) ;
+      ang = _mm_add_ps (ang, _mm_mul_ps (_mm_sub_ps (_mm_mul_ps (_mm_mul_ps (c3, r), r), c1), r)) ;
+      ang = _mm_xor_ps (ang, _mm_and_ps (_mm_cmplt_ps (gy, _mm_setzero_ps ()), sign)) ;
+    }
+
+    /* vl_mod_2pi_f (angle + 2*VL_PI), with the sum in double; the
+       angle is in [-pi, pi], so one subtraction is enough */
+    ang = _mm_movelh_ps
+      (_mm_cvtpd_ps (_mm_add_pd (_mm_cvtps_pd (ang), twopi)),
+       _mm_cvtpd_ps (_mm_add_pd (_mm_cvtps_pd (_mm_movehl_ps (ang, ang)), twopi))) ;
+    ang = _mm_sub_ps (ang, _mm_and_ps (_mm_cmpgt_ps (ang, twopif), twopif)) ;
+
+    lo = _mm_unpacklo_ps (mod, ang) ;
+    hi = _mm_unpackhi_ps (mod, ang) ;
+    _mm_storeu_ps (grad + 2 * i,     lo) ;
+    _mm_storeu_ps (grad + 2 * i + 4, hi) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Difference of a run of pixels of two consecutive levels
+ **
+ ** @param dog output.
+ ** @param src first pixel of the lower level.
+ ** @param n   number of pixels.
+ ** @param so  offset of the upper level.
+ **
+ ** @return number of pixels processed (a multiple of four).
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_dog_sse2 (float *dog, float const *src, vl_size n, vl_size so)
+{
+  vl_size i ;
+  for (i = 0 ; i + 4 <= n ; i += 4) {
+    _mm_storeu_ps (dog + i, _mm_sub_ps (_mm_loadu_ps (src + i + so),
+                                        _mm_loadu_ps (src + i))) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Find the DoG extrema in a run of pixels
+ **
+ ** @param mask output, bit @c i set if @a pt[i] is an extremum.
+ ** @param pt   first pixel.
+ ** @param n    number of pixels.
+ ** @param yo   y-stride.
+ ** @param so   s-stride.
+ ** @param tp   threshold.
+ **
+ ** A pixel is an extremum if it is not smaller than @a tp and larger
+ ** than its 26 neighbours in space and scale, or not larger than
+ ** - @a tp and smaller than its neighbours. The pixels are tested
+ ** four at a time against the maximum and minimum of the neighbours.
+ **
+ ** @return number of pixels processed (a multiple of four and at
+ ** most 64).
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_extrema_sse2 (vl_uint64 *mask, float const *pt, vl_size n,
+                       int yo, int so, float tp)
+{
+  __m128 const thr  = _mm_set1_ps (tp) ;
+  __m128 const nthr = _mm_set1_ps (- tp) ;
+  vl_size i ;
+
+  *mask = 0 ;
+  n = VL_MIN(n, 64) ;
+  for (i = 0 ; i + 4 <= n ; i += 4) {
+    float const *q = pt + i ;
+    __m128 v  = _mm_loadu_ps (q) ;
+    __m128 mx, mn, u, is ;
+    int ds ;
+
+    mx = mn = _mm_loadu_ps (q - 1) ;
+#define UPDATE(o)                               \
+    u  = _mm_loadu_ps (q + (o)) ;               \
+    mx = _mm_max_ps (mx, u) ;                   \
+    mn = _mm_min_ps (mn, u)
+    UPDATE(+ 1) ;
+    UPDATE(- yo - 1) ; UPDATE(- yo) ; UPDATE(- yo + 1) ;
+    UPDATE(+ yo - 1) ; UPDATE(+ yo) ; UPDATE(+ yo + 1) ;
+    for (ds = - so ; ds <= so ; ds += 2 * so) {
+      UPDATE(ds - yo - 1) ; UPDATE(ds - yo) ; UPDATE(ds - yo + 1) ;
+      UPDATE(ds      - 1) ; UPDATE(ds     ) ; UPDATE(ds      + 1) ;
+      UPDATE(ds + yo - 1) ; UPDATE(ds + yo) ; UPDATE(ds + yo + 1) ;
+    }
+#undef UPDATE
+
+    is = _mm_or_ps (_mm_and_ps (_mm_cmpge_ps (v, thr),  _mm_cmpgt_ps (v, mx)),
+                    _mm_and_ps (_mm_cmple_ps (v, nthr), _mm_cmplt_ps (v, mn))) ;
+    *mask |= (vl_uint64) _mm_movemask_ps (is) << i ;
+  }
+  return i ;
+}
+
+/** @internal @brief Round four floats to half precision (in 32 bits) */
+VL_INLINE __m128i
+_vl_sift_half_from_float_sse2 (__m128 x)
+{
+  __m128i const signMask = _mm_set1_epi32 ((int) 0x80000000u) ;
+  __m128i const maxNorm  = _mm_set1_epi32 (0x477fffff) ;
+  __m128i const minNorm  = _mm_set1_epi32 (0x38800000) ;
+  __m128i const inf      = _mm_set1_epi32 (0x7f800000) ;
+  __m128i const infHalf  = _mm_set1_epi32 (0x7c00) ;
+  __m128i const nanBit   = _mm_set1_epi32 (0x0200) ;
+  __m128i const bias     = _mm_set1_epi32 ((int) 0xc8000fffu) ;
+  __m128i const one      = _mm_set1_epi32 (1) ;
+  __m128i const magic    = _mm_set1_epi32 (0x3f000000) ;
+  __m128i u    = _mm_castps_si128 (x) ;
+  __m128i sign = _mm_and_si128 (u, signMask) ;
+  __m128i big, sub, special, subnormal, normal, h ;
+
+  /* the magnitude is below 2^31, so that signed comparisons work */
+  u   = _mm_xor_si128 (u, sign) ;
+  big = _mm_cmpgt_epi32 (u, maxNorm) ;
+  sub = _mm_cmplt_epi32 (u, minNorm) ;
+
+  special   = _mm_or_si128 (infHalf, _mm_and_si128 (_mm_cmpgt_epi32 (u, inf),
+                                                    nanBit)) ;
+  subnormal = _mm_sub_epi32
+    (_mm_castps_si128 (_mm_add_ps (_mm_castsi128_ps (u),
+                                   _mm_castsi128_ps (magic))), magic) ;
+  normal    = _mm_srli_epi32
+    (_mm_add_epi32 (_mm_add_epi32 (u, bias),
+                    _mm_and_si128 (_mm_srli_epi32 (u, 13), one)), 13) ;
+
+  h = _mm_or_si128 (_mm_and_si128 (sub, subnormal),
+                    _mm_andnot_si128 (sub, normal)) ;
+  h = _mm_or_si128 (_mm_and_si128 (big, special),
+                    _mm_andnot_si128 (big, h)) ;
+  return _mm_or_si128 (h, _mm_srli_epi32 (sign, 16)) ;
+}
+
+/** @internal @brief Convert four half precision numbers (in 32 bits) to floats */
+VL_INLINE __m128
+_vl_sift_float_from_half_sse2 (__m128i h)
+{
+  __m128i const expMask = _mm_set1_epi32 (0x0f800000) ;
+  __m128i const rebias  = _mm_set1_epi32 (0x38000000) ;
+  __m128i const magic   = _mm_set1_epi32 (0x38800000) ;
+  __m128i const minExp  = _mm_set1_epi32 (0x00800000) ;
+  __m128i const absMask = _mm_set1_epi32 (0x7fff) ;
+  __m128i const signBit = _mm_set1_epi32 (0x8000) ;
+  __m128i u = _mm_slli_epi32 (_mm_and_si128 (h, absMask), 13) ;
+  __m128i e = _mm_and_si128 (u, expMask) ;
+  __m128i special, zero, subnormal ;
+
+  u = _mm_add_epi32 (u, rebias) ;
+  special = _mm_cmpeq_epi32 (e, expMask) ;
+  zero    = _mm_cmpeq_epi32 (e, _mm_setzero_si128 ()) ;
+  u = _mm_add_epi32 (u, _mm_and_si128 (special, rebias)) ;
+
+  subnormal = _mm_castps_si128
+    (_mm_sub_ps (_mm_castsi128_ps (_mm_add_epi32 (u, minExp)),
+                 _mm_castsi128_ps (magic))) ;
+  u = _mm_or_si128 (_mm_and_si128 (zero, subnormal),
+                    _mm_andnot_si128 (zero, u)) ;
+  u = _mm_or_si128 (u, _mm_slli_epi32 (_mm_and_si128 (h, signBit), 16)) ;
+  return _mm_castsi128_ps (u) ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Round a run of floats to half precision
+ **
+ ** @param dst output.
+ ** @param src input.
+ ** @param n   number of values.
+ **
+ ** The values are rounded eight at a time as by
+ ** ::_vl_sift_half_from_float, with the same results.
+ **
+ ** @return number of values processed (a multiple of eight).
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_pack_half_sse2 (vl_uint16 *dst, float const *src, vl_size n)
+{
+  vl_size i ;
+  for (i = 0 ; i + 8 <= n ; i += 8) {
+    __m128i lo = _vl_sift_half_from_float_sse2 (_mm_loadu_ps (src + i)) ;
+    __m128i hi = _vl_sift_half_from_float_sse2 (_mm_loadu_ps (src + i + 4)) ;
+    /* sign extend, so that the signed saturation keeps the bits */
+    lo = _mm_srai_epi32 (_mm_slli_epi32 (lo, 16), 16) ;
+    hi = _mm_srai_epi32 (_mm_slli_epi32 (hi, 16), 16) ;
+    _mm_storeu_si128 ((__m128i*) (dst + i), _mm_packs_epi32 (lo, hi)) ;
+  }
+  return i ;
+}
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Convert a run of half precision numbers to floats
+ **
+ ** @param dst output.
+ ** @param src input.
+ ** @param n   number of values.
+ **
+ ** @return number of values processed (a multiple of eight).
+ **/
+
+VL_EXPORT
+vl_size
+_vl_sift_unpack_half_sse2 (float *dst, vl_uint16 const *src, vl_size n)
+{
+  __m128i const zero = _mm_setzero_si128 () ;
+  vl_size i ;
+  for (i = 0 ; i + 8 <= n ; i += 8) {
+    __m128i h = _mm_loadu_si128 ((__m128i const*) (src + i)) ;
+    _mm_storeu_ps (dst + i,
+                   _vl_sift_float_from_half_sse2 (_mm_unpacklo_epi16 (h, zero))) ;
+    _mm_storeu_ps (dst + i + 4,
+                   _vl_sift_float_from_half_sse2 (_mm_unpackhi_epi16 (h, zero))) ;
+  }
+  return i ;
+}
+
+/* ! VL_DISABLE_SSE2 */
+#endif
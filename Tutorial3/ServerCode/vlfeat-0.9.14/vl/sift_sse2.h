@@ -0,0 +1,43 @@
+/** @file sift_sse2.h
+ ** @brief SIFT - SSE2
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_SIFT_SSE2_H
+#define VL_SIFT_SSE2_H
+
+#include "generic.h"
+
+#ifndef VL_DISABLE_SSE2
+
+VL_EXPORT
+vl_size _vl_sift_gradient_sse2 (float *grad, float const *src, vl_size n,
+                                int up, int dn, float ky) ;
+
+VL_EXPORT
+vl_size _vl_sift_dog_sse2 (float *dog, float const *src, vl_size n,
+                           vl_size so) ;
+
+VL_EXPORT
+vl_size _vl_sift_extrema_sse2 (vl_uint64 *mask, float const *pt, vl_size n,
+                               int yo, int so, float tp) ;
+
+VL_EXPORT
+vl_size _vl_sift_pack_half_sse2 (vl_uint16 *dst, float const *src, vl_size n) ;
+
+VL_EXPORT
+vl_size _vl_sift_unpack_half_sse2 (float *dst, vl_uint16 const *src, vl_size n) ;
+
+/* ! VL_DISABLE_SSE2 */
+#endif
+
+/* ! VL_SIFT_SSE2_H */
+#endif
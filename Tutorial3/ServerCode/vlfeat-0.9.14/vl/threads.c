@@ -0,0 +1,105 @@
+/** @file threads.c
+ ** @brief Parallel loops (internal) - Definition
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "threads.h"
+
+#if defined(VL_THREADS_POSIX) && ! defined(VL_DISABLE_THREADS)
+#define VL_PARALLEL_THREADS
+#endif
+
+/** @internal @brief Slice of a parallel job */
+typedef struct _VlParallelSlice
+{
+  _VlParallelTask task ;
+  void *data ;
+  int tid ;
+  vl_uindex begin ;
+  vl_uindex end ;
+} _VlParallelSlice ;
+
+#if defined(VL_PARALLEL_THREADS)
+static void *
+_vl_parallel_slice_main (void *arg)
+{
+  _VlParallelSlice *slice = arg ;
+  slice->task (slice->data, slice->tid, slice->begin, slice->end) ;
+  return NULL ;
+}
+#endif
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Run a task on the items of a job in parallel
+ **
+ ** @param numThreads  maximum number of threads.
+ ** @param task        task.
+ ** @param data        task data.
+ ** @param n           number of items.
+ ** @param grain       minimum number of items of a thread.
+ ** @param align       slices start at multiples of @a align items.
+ **
+ ** The items are split in contiguous slices, one per thread, in
+ ** order: thread @c t gets the items before the ones of thread @c
+ ** t+1. The calling thread runs the first slice, and a thread that
+ ** cannot be started runs on the calling thread as well, so that
+ ** every slice is processed. Without thread support, the calling
+ ** thread runs the whole job as a single slice.
+ **
+ ** @return the number of slices, from 1 to
+ ** ::VL_PARALLEL_MAX_THREADS.
+ **/
+
+VL_EXPORT vl_size
+_vl_parallel_for (vl_size numThreads, _VlParallelTask task,
+                  void *data, vl_size n, vl_size grain, vl_size align)
+{
+  numThreads = VL_MIN(numThreads, VL_PARALLEL_MAX_THREADS) ;
+  numThreads = VL_MIN(numThreads, n / VL_MAX(grain, 1)) ;
+  align = VL_MAX(align, 1) ;
+
+#if defined(VL_PARALLEL_THREADS)
+  if (numThreads > 1) {
+    _VlParallelSlice slices [VL_PARALLEL_MAX_THREADS] ;
+    pthread_t threads [VL_PARALLEL_MAX_THREADS] ;
+    vl_bool started [VL_PARALLEL_MAX_THREADS] ;
+    vl_uindex t ;
+
+    for (t = 0 ; t < numThreads ; ++t) {
+      vl_uindex begin = (vl_uindex) ((vl_uint64) n * t / numThreads) ;
+      vl_uindex end = (vl_uindex) ((vl_uint64) n * (t + 1) / numThreads) ;
+      slices[t].task = task ;
+      slices[t].data = data ;
+      slices[t].tid = (int) t ;
+      slices[t].begin = begin - begin % align ;
+      slices[t].end = (t == numThreads - 1) ? n : end - end % align ;
+    }
+
+    for (t = 1 ; t < numThreads ; ++t) {
+      started[t] = ! pthread_create (threads + t, NULL,
+                                     _vl_parallel_slice_main, slices + t) ;
+    }
+    _vl_parallel_slice_main (slices) ;
+    for (t = 1 ; t < numThreads ; ++t) {
+      if (started[t]) {
+        pthread_join (threads[t], NULL) ;
+      } else {
+        _vl_parallel_slice_main (slices + t) ;
+      }
+    }
+    return numThreads ;
+  }
+#endif
+
+  task (data, 0, 0, n) ;
+  return 1 ;
+}
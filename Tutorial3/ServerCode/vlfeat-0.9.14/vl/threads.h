@@ -0,0 +1,39 @@
+/** @file threads.h
+ ** @brief Parallel loops (internal)
+ ** @author Andrea Vedaldi
+ **/
+
+/*
+Copyright (C) 2007-12 Andrea Vedaldi and Brian Fulkerson.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_THREADS_H
+#define VL_THREADS_H
+
+#include "generic.h"
+
+/** @internal @brief Maximum number of threads of a parallel loop */
+#define VL_PARALLEL_MAX_THREADS 64
+
+/** ------------------------------------------------------------------
+ ** @internal
+ ** @brief Task run by ::_vl_parallel_for
+ **
+ ** A task processes the items @a begin to @a end - 1 of a job on
+ ** the thread @a tid.
+ **/
+
+typedef void (*_VlParallelTask) (void *data, int tid,
+                                 vl_uindex begin, vl_uindex end) ;
+
+VL_EXPORT
+vl_size _vl_parallel_for (vl_size numThreads, _VlParallelTask task,
+                          void *data, vl_size n,
+                          vl_size grain, vl_size align) ;
+
+/* VL_THREADS_H */
+#endif